@@ -4,7 +4,65 @@
 	Rev.Date:	05/04/2009
 ---------------------------*/
 
+#include <Windows.h>
+#include <malloc.h>
 #include "Event.h"
+#include <new>
+#include <deque>
+#include <vector>
+#include <hash_map>
+#include <boost/thread/mutex.hpp>
+
+using std::deque;
+using std::vector;
+using stdext::hash_map;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+struct EventPoolClass
+	Free blocks of one size are kept on an interlocked singly linked list, so
+	events can be created on one thread and released on another without a
+	lock. The mutex is only taken to carve a new chunk.
+=============================================================================*/
+struct EventPoolClass : private boost::noncopyable {
+	SLIST_HEADER	mFreeList;
+	boost::mutex	mGrowMutex;
+	vector<void *>	mChunks;
+	volatile long	mInUse;
+	uint			mBlockSize;
+
+	explicit EventPoolClass() : mInUse(0), mBlockSize(0) { InitializeSListHead(&mFreeList); }
+};
+
+/*=============================================================================
+class EventPool
+	Size classes in steps of sBlockStep up to sMaxPooledSize, which covers
+	every event type in the project. Larger events fall back to the heap.
+	Chunks are kept for reuse until shutdown.
+=============================================================================*/
+class EventPool : private boost::noncopyable {
+	public:
+		///// DEFINITIONS /////
+		static const uint sBlockStep		= 32;
+		static const uint sMaxPooledSize	= 256;
+		static const uint sNumClasses		= sMaxPooledSize / sBlockStep;
+		static const uint sChunkSize		= 16 * 1024;
+
+		///// VARIABLES /////
+		EventPoolClass	mClasses[sNumClasses];
+
+		///// FUNCTIONS /////
+		static uint	classIndex(size_t sizeB) {
+						return (sizeB <= sMaxPooledSize ? (uint)((sizeB + sBlockStep - 1) / sBlockStep) - 1 : sNumClasses);
+					}
+
+		void *		acquire(uint c);
+		void		release(void *p, uint c);
+
+		explicit EventPool();
+		~EventPool();
+};
 
 ///// STATIC VARIABLES /////
 
@@ -13,3 +71,163 @@ int Event::sNumEventsCreated = 0;
 int Event::sNumEventsDestroyed = 0;
 #endif
 
+static EventPool sEventPool;
+
+////////// class EventPool //////////
+
+void * EventPool::acquire(uint c)
+{
+	EventPoolClass &pc = mClasses[c];
+	void *p = InterlockedPopEntrySList(&pc.mFreeList);
+	if (!p) {
+		boost::mutex::scoped_lock lock(pc.mGrowMutex);
+		p = InterlockedPopEntrySList(&pc.mFreeList); // another thread may have just grown the pool
+		if (!p) {
+			// carve a new chunk, keep the first block and free the rest
+			char *chunk = static_cast<char *>(_aligned_malloc(sChunkSize, MEMORY_ALLOCATION_ALIGNMENT));
+			if (!chunk) { throw std::bad_alloc(); }
+			pc.mChunks.push_back(chunk);
+			uint numBlocks = sChunkSize / pc.mBlockSize;
+			for (uint b = 1; b < numBlocks; ++b) {
+				InterlockedPushEntrySList(&pc.mFreeList, reinterpret_cast<PSLIST_ENTRY>(chunk + b * pc.mBlockSize));
+			}
+			p = chunk;
+		}
+	}
+	InterlockedIncrement(&pc.mInUse);
+	return p;
+}
+
+void EventPool::release(void *p, uint c)
+{
+	EventPoolClass &pc = mClasses[c];
+	InterlockedPushEntrySList(&pc.mFreeList, static_cast<PSLIST_ENTRY>(p));
+	InterlockedDecrement(&pc.mInUse);
+}
+
+EventPool::EventPool()
+{
+	for (uint c = 0; c < sNumClasses; ++c) {
+		mClasses[c].mBlockSize = (c + 1) * sBlockStep;
+	}
+}
+
+EventPool::~EventPool()
+{
+	for (uint c = 0; c < sNumClasses; ++c) {
+		if (mClasses[c].mInUse > 0) {
+			debugPrintf("EventPool: %d events of %u bytes still in use at shutdown\n",
+						mClasses[c].mInUse, mClasses[c].mBlockSize);
+		}
+		for (size_t k = 0; k < mClasses[c].mChunks.size(); ++k) {
+			_aligned_free(mClasses[c].mChunks[k]);
+		}
+	}
+}
+
+////////// class Event //////////
+
+void * Event::operator new(size_t sizeB)
+{
+	uint c = EventPool::classIndex(sizeB);
+	if (c < EventPool::sNumClasses) {
+		return sEventPool.acquire(c);
+	}
+	return ::operator new(sizeB);
+}
+
+void Event::operator delete(void *p, size_t sizeB)
+{
+	if (!p) { return; }
+	uint c = EventPool::classIndex(sizeB);
+	if (c < EventPool::sNumClasses) {
+		sEventPool.release(p, c);
+	} else {
+		::operator delete(p);
+	}
+}
+
+void Event::reportPoolUsage()
+{
+	for (uint c = 0; c < EventPool::sNumClasses; ++c) {
+		EventPoolClass &pc = sEventPool.mClasses[c];
+		boost::mutex::scoped_lock lock(pc.mGrowMutex);
+		if (!pc.mChunks.empty()) {
+			debugPrintf("EventPool: %u byte blocks, %d in use, %u reserved\n", pc.mBlockSize, pc.mInUse,
+						(uint)pc.mChunks.size() * (EventPool::sChunkSize / pc.mBlockSize));
+		}
+	}
+}
+
+void intrusive_ptr_add_ref(const Event *e)
+{
+	InterlockedIncrement(&e->mRefCount);
+}
+
+void intrusive_ptr_release(const Event *e)
+{
+	if (InterlockedDecrement(&e->mRefCount) == 0) {
+		delete e;
+	}
+}
+
+
+////////// class EventTypeRegistry //////////
+
+/*-----------------------------------------------------------------------------
+	The table is constructed on first use, since sTypeId variables of event
+	types are interned during static initialization in any order. Names are
+	kept in a deque so references returned by name() are never invalidated.
+-----------------------------------------------------------------------------*/
+struct EventTypeTable {
+	boost::mutex						mMutex;
+	hash_map<string, EventTypeId>		mIdMap;
+	deque<string>						mNames;
+
+	explicit EventTypeTable() {
+		mIdMap.insert(std::make_pair(string("*"), (EventTypeId)EventTypeRegistry::sWildcardId));
+		mNames.push_back("*");
+	}
+};
+
+static EventTypeTable &typeTable()
+{
+	static EventTypeTable table;
+	return table;
+}
+
+EventTypeId EventTypeRegistry::intern(const string &eventType)
+{
+	EventTypeTable &t = typeTable();
+	boost::mutex::scoped_lock lock(t.mMutex);
+	hash_map<string, EventTypeId>::const_iterator i = t.mIdMap.find(eventType);
+	if (i != t.mIdMap.end()) { return i->second; }
+
+	EventTypeId typeId = (EventTypeId)t.mNames.size();
+	t.mIdMap.insert(std::make_pair(eventType, typeId));
+	t.mNames.push_back(eventType);
+	return typeId;
+}
+
+EventTypeId EventTypeRegistry::find(const string &eventType)
+{
+	EventTypeTable &t = typeTable();
+	boost::mutex::scoped_lock lock(t.mMutex);
+	hash_map<string, EventTypeId>::const_iterator i = t.mIdMap.find(eventType);
+	return (i != t.mIdMap.end() ? i->second : sInvalidId);
+}
+
+const string & EventTypeRegistry::name(EventTypeId typeId)
+{
+	EventTypeTable &t = typeTable();
+	boost::mutex::scoped_lock lock(t.mMutex);
+	_ASSERTE(typeId < t.mNames.size() && "Bad event type id");
+	return t.mNames[typeId];
+}
+
+uint EventTypeRegistry::count()
+{
+	EventTypeTable &t = typeTable();
+	boost::mutex::scoped_lock lock(t.mMutex);
+	return (uint)t.mNames.size();
+}
@@ -10,6 +10,7 @@
 #include <list>
 #include <memory>
 #include <boost/noncopyable.hpp>
+#include <boost/intrusive_ptr.hpp>
 #include <boost/any.hpp>
 #include <iostream>
 #include "../Utility/Typedefs.h"
@@ -46,15 +47,63 @@ enum EventDataType : uchar {
 	EventDataType_NotEmpty		// determines that EventManager's raise and trigger by string cannot be used
 };
 
+/*=============================================================================
+	Opt-in per registered event type. When an event is raised while an event
+	of the same type and coalesce key is still waiting in the queue, the
+	waiting event absorbs the new one instead of both being queued, so the
+	queue holds at most one event per key no matter how fast they arrive.
+=============================================================================*/
+enum CoalescePolicy : uchar {
+	CoalescePolicy_None = 0,		// every event is queued and dispatched
+	CoalescePolicy_LastValueWins,	// the waiting event takes the newer event's value
+	CoalescePolicy_Sum				// the newer event's value is added to the waiting event's, for relative values
+};
+
 class Event;
 class RegisteredEvent;
-typedef shared_ptr<Event>	EventPtr;
+class EventSchema;
+typedef boost::intrusive_ptr<Event>	EventPtr;	// reference count is kept in the Event itself
 typedef shared_ptr<RegisteredEvent>	RegEventPtr;
 typedef pair<string, any>	AnyVarsValue;	// key/value pair where string is key and value utilizes boost::any
 typedef list<AnyVarsValue>	AnyVars;		// list of key/value pairs. This does not provide constant time
 											// random access to elements, so lists should generally be short
+typedef uint				EventTypeId;	// dense integer id interned from an event type string
 ///// STRUCTURES /////
 
+/*=============================================================================
+class EventTypeRegistry
+	Interns event type strings into dense integer ids, assigned in order from
+	0 so they can index the listener and handler tables directly. The
+	wildcard type is always id 0. Code-defined event types intern their
+	sEventType into a static sTypeId during static initialization, so events
+	carry their id without any lookup. The table only grows, ids stay valid
+	for the life of the program. May be called from any thread.
+=============================================================================*/
+class EventTypeRegistry {
+	public:
+		///// DEFINITIONS /////
+		static const EventTypeId	sWildcardId = 0;
+		static const EventTypeId	sInvalidId = 0xFFFFFFFF;
+
+		///// FUNCTIONS /////
+		/*---------------------------------------------------------------------
+			Returns the id of the type, assigning the next id on first use
+		---------------------------------------------------------------------*/
+		static EventTypeId		intern(const string &eventType);
+
+		/*---------------------------------------------------------------------
+			Returns the id of the type, or sInvalidId if it was never interned
+		---------------------------------------------------------------------*/
+		static EventTypeId		find(const string &eventType);
+
+		/*---------------------------------------------------------------------
+			Returns the type string of an id
+		---------------------------------------------------------------------*/
+		static const string &	name(EventTypeId typeId);
+
+		static uint				count();
+};
+
 /*=============================================================================
 class Event
 	An abstract base class for all Event types to inherit from. There are pure
@@ -62,14 +111,21 @@ class Event
 	reference to a static string variable with the event type name. mTime and
 	mState are private because derived classes should not try to manage those
 	attributes since EventManager does that job.
+	Events are reference counted intrusively through EventPtr, and allocated
+	from size-classed pools by the class operator new, so a small event costs
+	no heap allocation once its pool has warmed up. Events must always be
+	created with new and held by EventPtr.
 =============================================================================*/
 class Event : private boost::noncopyable {
 	friend class EventManager;	// allow EventManager to reach private and protected members
+	friend void intrusive_ptr_add_ref(const Event *e);
+	friend void intrusive_ptr_release(const Event *e);
 
 	private:
 		// Don't allow derived classes to modify time and state, we want the EventManager to have control
 		__int64		mTime;		// time (in counts) that the event was created
 		EventState	mState;		// stores new, triggered, raised, and handled - use to query invokation method
+		mutable volatile long	mRefCount;	// number of EventPtrs held, changed with interlocked operations
 
 	protected:
 		#if defined(_DEBUG) || defined(DEBUG_CONSOLE) // track event instantiations to ensure no memory leaks
@@ -79,13 +135,37 @@ class Event : private boost::noncopyable {
 
 	public:
 		virtual const string &	type() const = 0;
+		virtual EventTypeId		typeId() const = 0;
 		__int64					time() const	{ return mTime; }
 		EventState				state() const	{ return mState; }
 
+		/*---------------------------------------------------------------------
+			Pooled allocation for all event types, the size passed to delete
+			is that of the most derived type since the destructor is virtual
+		---------------------------------------------------------------------*/
+		static void *	operator new(size_t sizeB);
+		static void		operator delete(void *p, size_t sizeB);
+
+		/*---------------------------------------------------------------------
+			Logs blocks in use and reserved by each pool
+		---------------------------------------------------------------------*/
+		static void		reportPoolUsage();
+
+		/*---------------------------------------------------------------------
+			Event types registered with a CoalescePolicy override these. The
+			key identifies the stream of events within the type, such as the
+			control and client they are for, and must fit in 48 bits.
+			coalesce folds a newer event of the same type and key into this
+			one according to the policy.
+		---------------------------------------------------------------------*/
+		virtual uint64	coalesceKey() const { return 0; }
+		virtual void	coalesce(const Event &newer, CoalescePolicy policy) {}
+
 		// Constructor
 		explicit Event() :
 			mTime(0),				// Don't record at instantiation, EventManager records when queued or triggered.
-			mState(EventState_New)	// EventManager records when queued or triggered.
+			mState(EventState_New),	// EventManager records when queued or triggered.
+			mRefCount(0)
 		{
 			#if defined(_DEBUG) || defined(DEBUG_CONSOLE)
 			++sNumEventsCreated;
@@ -100,6 +180,9 @@ class Event : private boost::noncopyable {
 		}
 };
 
+void intrusive_ptr_add_ref(const Event *e);
+void intrusive_ptr_release(const Event *e);
+
 /*=============================================================================
 class ScriptableEvent
 	This is the abstract base class for any event with a registered event type
@@ -175,7 +258,8 @@ class ScriptEvent
 class ScriptEvent : public ScriptableEvent {
 	friend class ScriptDefinedEvent;
 	private:
-		string	mEventType;
+		string		mEventType;
+		EventTypeId	mTypeId;
 
 		/*---------------------------------------------------------------------
 			To prevent programmers from inheriting this by mistake (instead of
@@ -184,10 +268,12 @@ class ScriptEvent : public ScriptableEvent {
 		---------------------------------------------------------------------*/
 		explicit ScriptEvent(const string &eventType, const AnyVars &eventData) :
 			ScriptableEvent(eventData),
-			mEventType(eventType)
+			mEventType(eventType),
+			mTypeId(EventTypeRegistry::intern(eventType))
 		{}
 	public:
-		virtual const string & type() const { return mEventType; }
+		virtual const string &	type() const	{ return mEventType; }
+		virtual EventTypeId		typeId() const	{ return mTypeId; }
 
 		/*---------------------------------------------------------------------
 			Since this is a pass-through object, the event data will always be
@@ -218,15 +304,18 @@ class EmptyEvent
 class EmptyEvent : public Event {
 	friend class EventManager;
 	private:
-		string	mEventType;
+		string		mEventType;
+		EventTypeId	mTypeId;
 
 		// Constructors
-		explicit EmptyEvent(const string &eventType) :	// We don't want empty events being created anywhere, so to avoid the
+		explicit EmptyEvent(const string &eventType, EventTypeId typeId) :	// We don't want empty events being created anywhere, so to avoid the
 			Event(),									// unsafe practice of constructing these manually, it is made private.
-			mEventType(eventType)						// Friending EventManager lets it create these from raise and trigger
-		{}												// by string methods.
+			mEventType(eventType),						// Friending EventManager lets it create these from raise and trigger
+			mTypeId(typeId)								// by string methods.
+		{}
 	public:
-		virtual const string & type() const { return mEventType; }
+		virtual const string &	type() const	{ return mEventType; }
+		virtual EventTypeId		typeId() const	{ return mTypeId; }
 		
 		/*---------------------------------------------------------------------
 			This contructor is only made public so the program will compile
@@ -239,7 +328,7 @@ class EmptyEvent : public Event {
 			ever be called (just needs to be here to compile). If I had derived
 			from ScriptableEvent, it would carry an unneeded AnyVars attribute.
 		---------------------------------------------------------------------*/
-		explicit EmptyEvent(const AnyVars &) {
+		explicit EmptyEvent(const AnyVars &) : mTypeId(EventTypeRegistry::sInvalidId) {
 			_ASSERTE(false && "Shouldn't be calling EmptyEvent(const AnyVars &) constructor!");
 		}
 		// Destructor
@@ -256,6 +345,8 @@ class RegisteredEvent {
 	private:
 		const EventSource		mEventSource;
 		const EventDataType		mEventDataType;
+		CoalescePolicy			mCoalescePolicy;
+		const EventSchema *		mSchema;
 
 	public:
 		/*---------------------------------------------------------------------
@@ -289,11 +380,47 @@ class RegisteredEvent {
 			returns true if event type is EmptyEvent
 		---------------------------------------------------------------------*/
 		bool isEmpty() const			{ return (mEventDataType == EventDataType_Empty); }
+		/*---------------------------------------------------------------------
+			Coalescing of raised events of this type, none by default. Set it
+			before the type is registered.
+		---------------------------------------------------------------------*/
+		CoalescePolicy	coalescePolicy() const					{ return mCoalescePolicy; }
+		void			setCoalescePolicy(CoalescePolicy policy)	{ mCoalescePolicy = policy; }
+		/*---------------------------------------------------------------------
+			Field layout of the event type, null if none was declared. Lets
+			script handlers read the event's members without building the
+			AnyVars list. The schema must outlive the registration.
+		---------------------------------------------------------------------*/
+		const EventSchema *	schema() const						{ return mSchema; }
+		void				setSchema(const EventSchema *schema)	{ mSchema = schema; }
+		/*---------------------------------------------------------------------
+			Encodes the data of an event of this type in the fixed body format
+			of BinaryArchive.h, and creates an event from it again, for remote
+			clients. Only remote event types can do this, others return false
+			or a null EventPtr. Empty types write nothing and read back null,
+			they are raised by type string instead.
+		---------------------------------------------------------------------*/
+		virtual bool		writePayload(const Event &e, char *buffer, uint capacity, uint &outSize) const { return false; }
+		virtual EventPtr	readPayload(int targetClientId, const char *data, uint size) const { return EventPtr(); }
+		/*---------------------------------------------------------------------
+			Encodes the data of an event of this type in the name-value pair
+			body format of NVPArchive.h, for clients that read text. Only
+			remote event types can do this, others return false.
+		---------------------------------------------------------------------*/
+		virtual bool		writeNVPPayload(const Event &e, char *buffer, uint capacity, uint &outSize) const { return false; }
+		/*---------------------------------------------------------------------
+			Creates an event from a fixed format body sent by a client, then
+			raises or triggers it. Returns false if the body couldn't be read
+			or the type isn't remote.
+		---------------------------------------------------------------------*/
+		virtual bool		fireEventFromRemote(int targetClientId, const char *data, uint size, bool raise) const { return false; }
 
 		// Constructor / destructor
 		explicit RegisteredEvent(const EventSource src, const EventDataType dt) :
 			mEventSource(src),
-			mEventDataType(dt)
+			mEventDataType(dt),
+			mCoalescePolicy(CoalescePolicy_None),
+			mSchema(0)
 		{}
 		virtual ~RegisteredEvent() {}
 };
\ No newline at end of file
@@ -0,0 +1,97 @@
+/*----==== EVENTDISPATCHPOOL.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+---------------------------------------*/
+
+#include <Windows.h>
+#include "EventDispatchPool.h"
+#include <boost/bind.hpp>
+
+////////// class EventDispatchPool //////////
+
+boost::thread_specific_ptr<uint>	EventDispatchPool::sWorkerIndex;
+
+void EventDispatchPool::runBatches()
+{
+	for (;;) {
+		long b = InterlockedIncrement(&mNextBatch) - 1;
+		if (b >= (long)mNumBatches) { return; }
+		const EventBatch &batch = (*mBatches)[b];
+		for (size_t e = 0; e < batch.size(); ++e) {
+			mDispatchFunc(batch[e]);
+		}
+	}
+}
+
+void EventDispatchPool::workerLoop(uint index)
+{
+	sWorkerIndex.reset(new uint(index));
+	uint seenGeneration = 0;
+	for (;;) {
+		{
+			boost::mutex::scoped_lock lock(mMutex);
+			while (mGeneration == seenGeneration && !mStop) {
+				mStartCond.wait(lock);
+			}
+			if (mStop) { return; }
+			seenGeneration = mGeneration;
+			// woken too late, the dispatching thread has already collected every batch
+			if (mNextBatch >= (long)mNumBatches) { continue; }
+			++mBusyWorkers;
+		}
+
+		runBatches();
+
+		boost::mutex::scoped_lock lock(mMutex);
+		if (--mBusyWorkers == 0) {
+			mDoneCond.notify_all();
+		}
+	}
+}
+
+void EventDispatchPool::dispatch(const vector<EventBatch> &batches, uint numBatches)
+{
+	_ASSERTE(numBatches <= batches.size());
+	if (numBatches == 0) { return; }
+
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mBatches = &batches;
+		mNumBatches = numBatches;
+		mNextBatch = 0;
+		++mGeneration;
+	}
+	if (numBatches > 1 && numThreads() > 0) {
+		mStartCond.notify_all();
+	}
+
+	runBatches();
+
+	// every batch has been claimed, wait for the workers still handling theirs
+	boost::mutex::scoped_lock lock(mMutex);
+	while (mBusyWorkers > 0) {
+		mDoneCond.wait(lock);
+	}
+}
+
+EventDispatchPool::EventDispatchPool(uint numThreads, const DispatchFunc &dispatchFunc) :
+	mDispatchFunc(dispatchFunc),
+	mBatches(0), mNumBatches(0), mNextBatch(0),
+	mGeneration(0), mBusyWorkers(0), mStop(false)
+{
+	for (uint t = 0; t < numThreads; ++t) {
+		mThreads.create_thread(boost::bind(&EventDispatchPool::workerLoop, this, t));
+	}
+	debugPrintf("EventDispatchPool: %u worker threads started\n", numThreads);
+}
+
+EventDispatchPool::~EventDispatchPool()
+{
+	{
+		boost::mutex::scoped_lock lock(mMutex);
+		mStop = true;
+	}
+	mStartCond.notify_all();
+	mThreads.join_all();
+}
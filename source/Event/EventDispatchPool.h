@@ -0,0 +1,81 @@
+/*----==== EVENTDISPATCHPOOL.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Worker threads that EventManager hands batches of parallel-safe events
+		to, one batch per event type, each frame.
+-------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/tss.hpp>
+#include "Event.h"
+
+using std::vector;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class EventDispatchPool
+	dispatch() publishes a list of batches and wakes the workers, who claim
+	batches by incrementing a shared index. The calling thread claims batches
+	too, then waits for the workers to finish theirs, so when dispatch returns
+	every event has been handled. Within a batch events are handled in order
+	on one thread, so per-type ordering and consume semantics are kept. With
+	no worker threads everything runs on the calling thread. Each worker knows
+	its index through currentWorker(), for per-worker state of the caller.
+=============================================================================*/
+class EventDispatchPool : private boost::noncopyable {
+	public:
+		///// DEFINITIONS /////
+		typedef vector<EventPtr>						EventBatch;	// events of one type, in the order raised
+		typedef std::function<void (const EventPtr &)>	DispatchFunc;
+
+	private:
+		///// VARIABLES /////
+		DispatchFunc				mDispatchFunc;
+		boost::thread_group			mThreads;
+		boost::mutex				mMutex;
+		boost::condition_variable	mStartCond;		// signaled when a new set of batches is published
+		boost::condition_variable	mDoneCond;		// signaled when the last busy worker finishes
+
+		const vector<EventBatch> *	mBatches;
+		uint						mNumBatches;
+		volatile long				mNextBatch;		// next batch to claim, only reset under mMutex
+		uint						mGeneration;	// incremented for each dispatch
+		uint						mBusyWorkers;
+		bool						mStop;
+
+		static boost::thread_specific_ptr<uint>	sWorkerIndex;	// set on each worker thread, null elsewhere
+
+		///// FUNCTIONS /////
+		void	runBatches();
+		void	workerLoop(uint index);
+
+	public:
+		/*---------------------------------------------------------------------
+			Handles the first numBatches batches across the pool, returns when
+			all have been handled. Call from one thread at a time.
+		---------------------------------------------------------------------*/
+		void	dispatch(const vector<EventBatch> &batches, uint numBatches);
+
+		uint	numThreads() const { return (uint)mThreads.size(); }
+
+		/*---------------------------------------------------------------------
+			Index of the pool worker running the calling thread, from 0 to
+			numThreads()-1, or -1 on any other thread (the dispatching
+			thread included)
+		---------------------------------------------------------------------*/
+		static int	currentWorker() { uint *index = sWorkerIndex.get(); return (index ? (int)*index : -1); }
+
+		// Constructor / destructor
+		explicit EventDispatchPool(uint numThreads, const DispatchFunc &dispatchFunc);
+		~EventDispatchPool();
+};
@@ -7,9 +7,9 @@
 #pragma once
 
 #include "Event.h"
-#include "../Utility/ConcurrentQueue.h"
+#include "../Utility/MPSCQueue.h"
 
-typedef ConcurrentQueue<EventPtr>	ThreadSafeEventQueue;
+typedef MPSCQueue<EventPtr>	ThreadSafeEventQueue;
 
 /*=============================================================================
 class IEventHandler
@@ -75,10 +75,13 @@ class ThreadEventHandler
 	the handler, instead of calling a functor to handle them. The handler
 	should be created in the main thread, because registration with the manager
 	is not thread safe. The thread process can waitPop() items from the queue
-	to handle them.
+	to handle them. The queue is bounded, if the thread falls a full queue
+	behind, the main thread yields in the handler until it catches up.
 =============================================================================*/
 class ThreadEventHandler : public IEventHandler {
 	public:
+		static const uint sDefaultQueueSize = 1024;
+
 		ThreadSafeEventQueue	mEventQueue;
 
 		virtual bool	operator()(const EventPtr &ePtr) {
@@ -86,5 +89,5 @@ class ThreadEventHandler : public IEventHandler {
 			return false; // allow the event to propagate
 		}
 
-		explicit ThreadEventHandler() {}
+		explicit ThreadEventHandler(uint queueSize = sDefaultQueueSize) : mEventQueue(queueSize) {}
 };
\ No newline at end of file
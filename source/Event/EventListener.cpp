@@ -13,49 +13,49 @@ const string EventListener::sWildcardType("*"); // defines the wildcard event ty
 
 /*-----------------------------------------------------------------------------
 	Inserts a handler functor for an event type, adding it to the
-	EventHandlerMap. Returns true if insert succeeds.
+	EventHandlerList. Returns true if insert succeeds.
 -----------------------------------------------------------------------------*/
-bool EventListener::insertEventHandler(const string &eventType, const IEventHandlerPtr &handler)
+bool EventListener::insertEventHandler(EventTypeId typeId, const IEventHandlerPtr &handler)
 {
-	EventHandlerMap::const_iterator ei = mHandlerMap.find(eventType);
-	if (ei == mHandlerMap.end()) { // event type handler does not exist yet
-		EventHandlerMapResult r = mHandlerMap.insert(EventHandlerMapValue(eventType, handler));
-		debugPrintf("%s: handler created for event type \"%s\"\n", mName.c_str(), eventType.c_str());
-		_ASSERTE(r.second == true);
-	} else { // event type handler already exists
-		debugPrintf("%s: handler for event type \"%s\" already exists, not added\n", mName.c_str(), eventType.c_str());
+	if (getEventHandler(typeId)) { // event type handler already exists
+		debugPrintf("%s: handler for event type \"%s\" already exists, not added\n", mName.c_str(), EventTypeRegistry::name(typeId).c_str());
 		return false;
 	}
+	if (typeId >= mHandlerList.size()) {
+		mHandlerList.resize(typeId + 1);
+	}
+	mHandlerList[typeId] = handler;
+	debugPrintf("%s: handler created for event type \"%s\"\n", mName.c_str(), EventTypeRegistry::name(typeId).c_str());
 	return true;
 }
 
 /*-----------------------------------------------------------------------------
-	Removes a handler functor for an event type from EventHandlerMap. Returns
+	Removes a handler functor for an event type from EventHandlerList. Returns
 	true if removal succeeds.
 -----------------------------------------------------------------------------*/
-bool EventListener::removeEventHandler(const string &eventType)
+bool EventListener::removeEventHandler(EventTypeId typeId)
 {
-	// check for event type in the map
-	EventHandlerMap::iterator ei = mHandlerMap.find(eventType);
-	if (ei == mHandlerMap.end()) {
-		debugPrintf("%s: handler not found for event type \"%s\", not removed\n", mName.c_str(), eventType.c_str());
+	if (!getEventHandler(typeId)) {
+		debugPrintf("%s: handler not found for event type \"%s\", not removed\n", mName.c_str(), EventTypeRegistry::name(typeId).c_str());
 		return false;
 	}
-	mHandlerMap.erase(ei);
-	debugPrintf("%s: handler for event type \"%s\" removed\n", mName.c_str(), eventType.c_str());
+	mHandlerList[typeId].reset();
+	debugPrintf("%s: handler for event type \"%s\" removed\n", mName.c_str(), EventTypeRegistry::name(typeId).c_str());
 	return true;
 }
 
 /*-----------------------------------------------------------------------------
 	Calls insertEventHandler, and registers the listener with EventManager for
-	the event type. Passes priority along to listener registration function
+	the event type. Passes priority and affinity along to listener registration
+	function
 -----------------------------------------------------------------------------*/
-bool EventListener::registerEventHandler(const string &eventType, const IEventHandlerPtr &handler, uint priority)
+bool EventListener::registerEventHandler(EventTypeId typeId, const IEventHandlerPtr &handler, uint priority,
+										 ListenerAffinity affinity)
 {
 	// perform the insert, and if it fails, exit early
-	if (!insertEventHandler(eventType, handler)) return false;
+	if (!insertEventHandler(typeId, handler)) return false;
 	// if the insert succeeds, register the handler with EventManager
-	eventMgr.registerListener(eventType, this, priority); // register listener with manager
+	eventMgr.registerListener(typeId, this, priority, affinity); // register listener with manager
 	return true;
 }
 
@@ -63,31 +63,29 @@ bool EventListener::registerEventHandler(const string &eventType, const IEventHa
 	Calls removeEventHandler, also unregisters the listener for that event type
 	with the EventManager. Returns true if removal succeeds.
 -----------------------------------------------------------------------------*/
-bool EventListener::unregisterEventHandler(const string &eventType)
+bool EventListener::unregisterEventHandler(EventTypeId typeId)
 {
 	// remove the handler, if the removal fails exit early
-	if (!removeEventHandler(eventType)) return false;
-	// if removal from map succeeds, unregister with EventManager
-	eventMgr.removeListener(eventType, this); // remove listener from manager
+	if (!removeEventHandler(typeId)) return false;
+	// if removal from the list succeeds, unregister with EventManager
+	eventMgr.removeListener(typeId, this); // remove listener from manager
 	return true;
 }
 
 /*-----------------------------------------------------------------------------
 	Cleanup for when listener is destroyed or being reset. Unregisters all
-	remaining handlers in the map. If the derived listener hasn't explicitly
+	remaining handlers in the list. If the derived listener hasn't explicitly
 	unregistered them, this will catch it.
 -----------------------------------------------------------------------------*/
 void EventListener::clearHandlers()
 {
 	// this loop unregisters all remaining handlers
-	EventHandlerMap::const_iterator ei = mHandlerMap.begin(),
-									end = mHandlerMap.end();
-	while (ei != end) {
-		const string key(ei->first);
-		++ei;
-		unregisterEventHandler(key);
+	for (EventTypeId typeId = 0; typeId < mHandlerList.size(); ++typeId) {
+		if (mHandlerList[typeId]) {
+			unregisterEventHandler(typeId);
+		}
 	}
-	mHandlerMap.clear();
+	mHandlerList.clear();
 }
 
 /*-----------------------------------------------------------------------------
@@ -99,13 +97,13 @@ void EventListener::clearHandlers()
 bool EventListener::handle(const EventPtr &ePtr)
 {
 	// handle specific event type registrations
-	EventHandlerMap::const_iterator ei = mHandlerMap.find((*ePtr).type());
-	if (ei == mHandlerMap.end()) {
+	IEventHandler *handler = getEventHandler((*ePtr).typeId());
+	if (!handler) {
 		// if a specific event handler is not found for this type, check for any wildcard handlers
 		// so in this case, specific handlers in a listener will override the wildcard for any event type
-		ei = mHandlerMap.find(EventListener::sWildcardType);
-		if (ei != mHandlerMap.end()) {
-			(*ei->second)(ePtr); // ignore return value for wildcard event handlers
+		handler = getEventHandler(EventTypeRegistry::sWildcardId);
+		if (handler) {
+			(*handler)(ePtr); // ignore return value for wildcard event handlers
 			return false;
 		}
 		// if this is being reached, probably because you called
@@ -114,5 +112,5 @@ bool EventListener::handle(const EventPtr &ePtr)
 		return false; // allow continued propagation of the event
 	}
 	
-	return (*ei->second)(ePtr);
-}
\ No newline at end of file
+	return (*handler)(ePtr);
+}
@@ -6,23 +6,40 @@
 
 #pragma once;
 
-#include <hash_map>
+#include <vector>
 #include <string>
 #include <memory>
 #include "EventHandler.h"
 
-using stdext::hash_map;
+using std::vector;
 using std::string;
 using std::pair;
 using std::shared_ptr;
 
+///// DEFINITIONS /////
+
+/*=============================================================================
+	Declared when a handler is registered. When every listener of an event
+	type (and every wildcard listener) is parallel-safe, EventManager may
+	dispatch events of that type on a worker thread, concurrently with other
+	parallel-safe types. Events of one type are always handled in order. A
+	parallel-safe handler must not register or unregister handlers, and
+	should use raiseThreadSafe rather than trigger.
+=============================================================================*/
+enum ListenerAffinity : uchar {
+	ListenerAffinity_MainThread = 0,	// handler must run on the main thread
+	ListenerAffinity_Parallel			// handler may run on any thread, concurrently with other event types
+};
+
+///// STRUCTURES /////
+
 /*=============================================================================
 class EventListener
 	EventListener is registered with EventManager to receive notifications of
 	its registered event types. A single listener can be used to handle many
 	different event types, and each type can have only one handler function
 	registered in the listener class. Handlers are stored as functors to
-	member, static, or free functions.
+	member, static, or free functions, in a vector indexed by EventTypeId.
 	**Wildcard Handlers**
 	A listener may register a wildcard handler to receive all event types to a
 	single generic function. Specific handlers can be defined in this case to
@@ -32,40 +49,66 @@ class EventListener
 	registerEventHandler and unregisterEventHandler.
 =============================================================================*/
 class EventListener {
+	friend class EventManager;	// keeps mManagerSlots
+
 	public:
 		///// DEFINITIONS /////
 		typedef shared_ptr<IEventHandler>				IEventHandlerPtr;
-		typedef pair<string, IEventHandlerPtr>			EventHandlerMapValue;
-		typedef hash_map<string, IEventHandlerPtr>		EventHandlerMap;
-		typedef pair<EventHandlerMap::iterator, bool>	EventHandlerMapResult;
+		typedef vector<IEventHandlerPtr>				EventHandlerList;	// indexed by EventTypeId, empty where none
 
 		static const string	sWildcardType;	// stores the wildcard event type string
-		
+
+	private:
+		///// VARIABLES /////
+		vector<uint>		mManagerSlots;	// index of this listener in EventManager's listener array of each
+											// event type, by EventTypeId, sInvalidId where not registered
+
 	protected:
 		///// VARIABLES /////
 		string				mName;			// name of the listener, mostly for debugging
-		EventHandlerMap		mHandlerMap;	// map of functors, one for each event type that is listened for
+		EventHandlerList	mHandlerList;	// functors, one for each event type that is listened for
 											// the listener registers event types and functors with itself which
 		///// FUNCTIONS /////				// also registers the listener with the event manager for that event type
 
+		/*---------------------------------------------------------------------
+			Returns the handler for an event type, or 0 if there is none
+		---------------------------------------------------------------------*/
+		IEventHandler *	getEventHandler(EventTypeId typeId) const {
+							return (typeId < mHandlerList.size() ? mHandlerList[typeId].get() : 0);
+						}
+		IEventHandler *	getEventHandler(const string &eventType) const {
+							return getEventHandler(EventTypeRegistry::find(eventType));
+						}
+
 		/*---------------------------------------------------------------------
 			Inserts a handler functor for an event type, adding it to the
-			EventHandlerMap. Returns true if insert succeeds.
+			EventHandlerList. Returns true if insert succeeds.
 		---------------------------------------------------------------------*/
-		bool	insertEventHandler(const string &eventType, const IEventHandlerPtr &handler);
+		bool	insertEventHandler(EventTypeId typeId, const IEventHandlerPtr &handler);
+		bool	insertEventHandler(const string &eventType, const IEventHandlerPtr &handler) {
+					return insertEventHandler(EventTypeRegistry::intern(eventType), handler);
+				}
 
 		/*---------------------------------------------------------------------
-			Removes a handler functor for an event type from EventHandlerMap.
+			Removes a handler functor for an event type from EventHandlerList.
 			Returns true if removal succeeds.
 		---------------------------------------------------------------------*/
-		bool	removeEventHandler(const string &eventType);
+		bool	removeEventHandler(EventTypeId typeId);
+		bool	removeEventHandler(const string &eventType) {
+					return removeEventHandler(EventTypeRegistry::intern(eventType));
+				}
 
 		/*---------------------------------------------------------------------
 			Calls insertEventHandler, and registers the listener with
-			EventManager for the event type. Passes priority along to listener
-			registration function
+			EventManager for the event type. Passes priority and affinity along
+			to listener registration function
 		---------------------------------------------------------------------*/
-		bool	registerEventHandler(const string &eventType, const IEventHandlerPtr &handler, uint priority);
+		bool	registerEventHandler(EventTypeId typeId, const IEventHandlerPtr &handler, uint priority,
+									 ListenerAffinity affinity = ListenerAffinity_MainThread);
+		bool	registerEventHandler(const string &eventType, const IEventHandlerPtr &handler, uint priority,
+									 ListenerAffinity affinity = ListenerAffinity_MainThread) {
+					return registerEventHandler(EventTypeRegistry::intern(eventType), handler, priority, affinity);
+				}
 		
 		/*---------------------------------------------------------------------
 			Register a handler with listener priority 0 (FIFO)
@@ -78,7 +121,10 @@ class EventListener {
 			Calls removeEventHandler, also unregisters the listener for that
 			event type with the EventManager. Returns true if removal succeeds.
 		---------------------------------------------------------------------*/
-		bool	unregisterEventHandler(const string &eventType);
+		bool	unregisterEventHandler(EventTypeId typeId);
+		bool	unregisterEventHandler(const string &eventType) {
+					return unregisterEventHandler(EventTypeRegistry::intern(eventType));
+				}
 
 		/*---------------------------------------------------------------------
 			Cleanup for when listener is destroyed or being reset. Unregisters
@@ -4,9 +4,11 @@
 	Rev.Date:	05/22/2009
 ----------------------------------*/
 
+#include <algorithm>
 #include "EventManager.h"
+#include "EventDispatchPool.h"
 #include "../Win32/HighPerfTimer.h"
-#include "../Utility/ConcurrentQueue.h"
+#include "../Utility/MPSCQueue.h"
 
 ////////// class EventManager //////////
 
@@ -16,30 +18,30 @@
 void EventManager::notifyListeners(const EventPtr &ePtr) const
 {
 	// this section is for listeners of the wildcard type EventListener::sWildcardType
-	// if the handler returns true to consume, will not stop propagation here
-	EventTypeMap::const_iterator ei = mEventTypeMap.find(EventListener::sWildcardType);
-	if (ei != mEventTypeMap.end()) {
-		ListenerList::const_iterator li, end = ei->second.end();
-		for (li = ei->second.begin(); li != end; ++li) {
-			(*li).first->handle(ePtr);
-		}
+	// if the handler returns true to consume, will not stop propagation here. The size is
+	// read each pass but registrations made while dispatching are deferred anyway, removed
+	// listeners are left as tombstones so nothing moves under the loop.
+	const vector<ListenerListValue> &wildcards = mWildcardListeners.mEntries;
+	for (size_t l = 0; l < wildcards.size(); ++l) {
+		EventListener *lPtr = wildcards[l].mListener;
+		if (lPtr) { lPtr->handle(ePtr); }
 	}
 
 	// this section looks for listeners actually registered for the specific event
 	// and will honor the return value of true for consumed events
-	ei = mEventTypeMap.find((*ePtr).type());
-	if (ei != mEventTypeMap.end()) {
-		ListenerList::const_iterator li, end = ei->second.end();
-		for (li = ei->second.begin(); li != end; ++li) {
+	EventTypeId typeId = (*ePtr).typeId();
+	if (typeId < mListenerTable.size()) {
+		const vector<ListenerListValue> &listeners = mListenerTable[typeId].mEntries;
+		for (size_t l = 0; l < listeners.size(); ++l) {
+			EventListener *lPtr = listeners[l].mListener;
+			if (!lPtr) { continue; }
 			// if a handler returns true, it consumes the event and stops propagation
-			bool consumed = (*li).first->handle(ePtr);
+			bool consumed = lPtr->handle(ePtr);
 			if (consumed) {
 				#ifdef _DEBUG
-				ListenerList::const_iterator li_check = li;
-				++li_check;
-				if (li_check != end) {
+				if (l + 1 < listeners.size()) {
 					debugPrintf("EventMgr: Listener \"%s\" consumed event of type \"%s\", listeners skipped\n",
-						(*li).first->name().c_str(), (*ePtr).type().c_str());
+						lPtr->name().c_str(), (*ePtr).type().c_str());
 				}
 				#endif
 				break;
@@ -49,17 +51,130 @@ void EventManager::notifyListeners(const EventPtr &ePtr) const
 	(*ePtr).mState = EventState_Handled;
 }
 
+/*-----------------------------------------------------------------------------
+	Queues a parallel event in its type's batch, or notifies the listeners of a
+	main thread event right away
+-----------------------------------------------------------------------------*/
+void EventManager::dispatchOrBatch(const EventPtr &ePtr)
+{
+	EventTypeId typeId = (*ePtr).typeId();
+	if (!isParallelType(typeId) || mDispatchPool->numThreads() == 0) {
+		notifyListeners(ePtr);
+		return;
+	}
+	if (typeId >= mBatchOfType.size()) {
+		mBatchOfType.resize(typeId + 1, (EventTypeId)EventTypeRegistry::sInvalidId);
+	}
+	uint b = mBatchOfType[typeId];
+	if (b == EventTypeRegistry::sInvalidId) {
+		b = mNumBatches++;
+		if (b >= mBatches.size()) {
+			mBatches.resize(b + 1);
+		}
+		mBatchOfType[typeId] = b;
+	}
+	mBatches[b].push_back(ePtr);
+}
+
+/*-----------------------------------------------------------------------------
+	Hands this frame's batches to the pool and waits for them, then empties
+	them keeping their storage for the next frame
+-----------------------------------------------------------------------------*/
+uint EventManager::dispatchBatches()
+{
+	if (mNumBatches == 0) { return 0; }
+
+	mParallelDispatch = true;
+	mDispatchPool->dispatch(mBatches, mNumBatches);
+	mParallelDispatch = false;
+
+	// events the handlers raised on the workers, queued for next frame like any other raised during dispatch
+	for (uint w = 0; w < mWorkerRaised.size(); ++w) {
+		EventBatch &raised = mWorkerRaised[w];
+		for (size_t e = 0; e < raised.size(); ++e) {
+			raise(raised[e]);
+		}
+		raised.clear();
+	}
+
+	uint numEvents = 0;
+	for (uint b = 0; b < mNumBatches; ++b) {
+		numEvents += (uint)mBatches[b].size();
+		mBatchOfType[(*mBatches[b].front()).typeId()] = EventTypeRegistry::sInvalidId;
+		mBatches[b].clear();
+	}
+	mNumBatches = 0;
+	return numEvents;
+}
+
+/*-----------------------------------------------------------------------------
+	Folds ePtr into the pending event of its type and key if there is one and
+	returns true, otherwise records ePtr as the pending event and returns false
+-----------------------------------------------------------------------------*/
+bool EventManager::coalescePending(PendingMap &pending, const EventPtr &ePtr, CoalescePolicy policy)
+{
+	uint64 key = pendingKey(*ePtr);
+	PendingMap::iterator pi = pending.find(key);
+	if (pi != pending.end()) {
+		Event &waiting = *pi->second;
+		waiting.coalesce(*ePtr, policy);
+		waiting.mTime = (*ePtr).mTime; // now stands for the newest sample
+		InterlockedIncrement(&mNumCoalesced);
+		return true;
+	}
+	pending.insert(PendingMap::value_type(key, ePtr));
+	return false;
+}
+
+/*-----------------------------------------------------------------------------
+	Called as the consumer takes an event from the thread-safe queue, so
+	producers stop folding into it before it is handled
+-----------------------------------------------------------------------------*/
+void EventManager::releaseThreadPending(const EventPtr &ePtr)
+{
+	if (mRegEventList[(*ePtr).typeId()]->coalescePolicy() == CoalescePolicy_None) { return; }
+
+	boost::mutex::scoped_lock lock(mThreadPendingMutex);
+	PendingMap::iterator pi = mThreadPending.find(pendingKey(*ePtr));
+	if (pi != mThreadPending.end() && pi->second == ePtr) {
+		mThreadPending.erase(pi);
+	}
+}
+
+/*-----------------------------------------------------------------------------
+	A parallel handler on a pool worker must not push to the thread-safe
+	queue, the main thread is blocked in dispatchBatches until the handler
+	returns, so if the queue is full push would wait on a drain that never
+	comes. The worker's own list needs no lock, it is only read once the
+	batches are done.
+-----------------------------------------------------------------------------*/
+bool EventManager::setAsideWorkerRaise(const EventPtr &ePtr)
+{
+	int worker = EventDispatchPool::currentWorker();
+	if (worker < 0) { return false; }
+	mWorkerRaised[worker].push_back(ePtr);
+	return true;
+}
+
 /*-----------------------------------------------------------------------------
 	Add event to the queue, queue is processed each frame
 -----------------------------------------------------------------------------*/
 void EventManager::raise(const EventPtr &ePtr)
 {	// Take the pointer passed in and fill with info like time, class that raised event, etc.
-	if (!isEventTypeRegistered((*ePtr).type())) {
+	if (GetCurrentThreadId() != mMainThreadId) { // e.g. from a parallel-safe handler on a worker thread
+		raiseThreadSafe(ePtr);
+		return;
+	}
+	if (!isEventTypeRegistered((*ePtr).typeId())) {
 		debugPrintf("EventMgr: cannot raise \"%s\" event, not registered\n", (*ePtr).type().c_str());
 		return;
 	}
 	(*ePtr).mState = EventState_Raised;
 	(*ePtr).mTime = HighPerfTimer::queryCounts();
+	CoalescePolicy policy = mRegEventList[(*ePtr).typeId()]->coalescePolicy();
+	if (policy != CoalescePolicy_None && coalescePending(mPending, ePtr, policy)) {
+		return;
+	}
 	mEventQueue[mActiveQueue].push_back(ePtr);
 	debugPrintf("EventMgr: \"%s\" event raised\n", (*ePtr).type().c_str());
 }
@@ -70,11 +185,16 @@ void EventManager::raise(const EventPtr &ePtr)
 -----------------------------------------------------------------------------*/
 void EventManager::raise(const string &eventType)
 {
-	RegEventMap::const_iterator ri = mRegEventMap.find(eventType);
-	if (ri != mRegEventMap.end()) {
-		_ASSERTE(ri->second->isEmpty() && "Cannot raise non-empty event with this interface, use EventPtr interface");
-		if (ri->second->isEmpty()) {
-			EventPtr ePtr(new EmptyEvent(eventType));
+	if (GetCurrentThreadId() != mMainThreadId) {
+		raiseThreadSafe(eventType);
+		return;
+	}
+	EventTypeId typeId = EventTypeRegistry::find(eventType);
+	if (isEventTypeRegistered(typeId)) {
+		const RegEventPtr &rePtr = mRegEventList[typeId];
+		_ASSERTE(rePtr->isEmpty() && "Cannot raise non-empty event with this interface, use EventPtr interface");
+		if (rePtr->isEmpty()) {
+			EventPtr ePtr(new EmptyEvent(eventType, typeId));
 			(*ePtr).mState = EventState_Raised;
 			(*ePtr).mTime = HighPerfTimer::queryCounts();
 			mEventQueue[mActiveQueue].push_back(ePtr);
@@ -92,23 +212,34 @@ void EventManager::raise(const string &eventType)
 -----------------------------------------------------------------------------*/
 void EventManager::raiseThreadSafe(const EventPtr &ePtr)
 {
-	if (!isEventTypeRegistered((*ePtr).type())) {
+	if (!isEventTypeRegistered((*ePtr).typeId())) {
 		debugPrintf("EventMgr: cannot raise \"%s\" event, not registered\n", (*ePtr).type().c_str());
 		return;
 	}
+	if (setAsideWorkerRaise(ePtr)) { return; }
 	(*ePtr).mState = EventState_Raised;
 	(*ePtr).mTime = HighPerfTimer::queryCounts();
+	CoalescePolicy policy = mRegEventList[(*ePtr).typeId()]->coalescePolicy();
+	if (policy != CoalescePolicy_None) {
+		// the waiting event stays open to folding until the consumer takes it off the queue
+		boost::mutex::scoped_lock lock(mThreadPendingMutex);
+		if (coalescePending(mThreadPending, ePtr, policy)) {
+			return;
+		}
+	}
 	mThreadEventQueue->push(ePtr);
 	debugPrintf("EventMgr: thread safe \"%s\" event raised\n", (*ePtr).type().c_str());
 }
 
 void EventManager::raiseThreadSafe(const string &eventType)
 {
-	RegEventMap::const_iterator ri = mRegEventMap.find(eventType);
-	if (ri != mRegEventMap.end()) {
-		_ASSERTE(ri->second->isEmpty() && "Cannot raise non-empty event with this interface, use EventPtr interface");
-		if (ri->second->isEmpty()) {
-			EventPtr ePtr(new EmptyEvent(eventType));
+	EventTypeId typeId = EventTypeRegistry::find(eventType);
+	if (isEventTypeRegistered(typeId)) {
+		const RegEventPtr &rePtr = mRegEventList[typeId];
+		_ASSERTE(rePtr->isEmpty() && "Cannot raise non-empty event with this interface, use EventPtr interface");
+		if (rePtr->isEmpty()) {
+			EventPtr ePtr(new EmptyEvent(eventType, typeId));
+			if (setAsideWorkerRaise(ePtr)) { return; }
 			(*ePtr).mState = EventState_Raised;
 			(*ePtr).mTime = HighPerfTimer::queryCounts();
 			mThreadEventQueue->push(ePtr);
@@ -126,14 +257,19 @@ void EventManager::raiseThreadSafe(const string &eventType)
 -----------------------------------------------------------------------------*/
 void EventManager::trigger(const EventPtr &ePtr)
 {
-	if (!isEventTypeRegistered((*ePtr).type())) {
+	if (!isEventTypeRegistered((*ePtr).typeId())) {
 		debugPrintf("EventMgr: cannot trigger \"%s\" event, not registered\n", (*ePtr).type().c_str());
 		return;
 	}
+	_ASSERTE((GetCurrentThreadId() == mMainThreadId || isParallelType((*ePtr).typeId())) &&
+			 "Only parallel-safe event types may be triggered off the main thread");
 	debugPrintf("EventMgr: \"%s\" event triggered\n", (*ePtr).type().c_str());
 	(*ePtr).mState = EventState_Triggered;
 	(*ePtr).mTime = HighPerfTimer::queryCounts();
+	bool mainThread = (GetCurrentThreadId() == mMainThreadId && !mParallelDispatch);
+	if (mainThread) { beginDispatch(); }
 	notifyListeners(ePtr);
+	if (mainThread) { endDispatch(); }
 }
 /*-----------------------------------------------------------------------------
 	Invoke listeners immediately, does not queue the no-data event.
@@ -142,15 +278,18 @@ void EventManager::trigger(const EventPtr &ePtr)
 -----------------------------------------------------------------------------*/
 void EventManager::trigger(const string &eventType)
 {
-	RegEventMap::const_iterator ri = mRegEventMap.find(eventType);
-	if (ri != mRegEventMap.end()) {
-		_ASSERTE(ri->second->isEmpty() && "Cannot trigger non-empty event with this interface, use EventPtr interface");
-		if (ri->second->isEmpty()) {
-			EventPtr ePtr(new EmptyEvent(eventType));
+	EventTypeId typeId = EventTypeRegistry::find(eventType);
+	if (isEventTypeRegistered(typeId)) {
+		const RegEventPtr &rePtr = mRegEventList[typeId];
+		_ASSERTE(rePtr->isEmpty() && "Cannot trigger non-empty event with this interface, use EventPtr interface");
+		if (rePtr->isEmpty()) {
+			EventPtr ePtr(new EmptyEvent(eventType, typeId));
 			debugPrintf("EventMgr: \"%s\" event triggered\n", eventType.c_str());
 			(*ePtr).mState = EventState_Triggered;
 			(*ePtr).mTime = HighPerfTimer::queryCounts();
+			beginDispatch();
 			notifyListeners(ePtr);
+			endDispatch();
 		} else {
 			// add message to release logging
 		}
@@ -159,6 +298,26 @@ void EventManager::trigger(const string &eventType)
 	}
 }
 
+/*-----------------------------------------------------------------------------
+	Handles events from the front of the queue until it is empty or, checking
+	every sBudgetCheckInterval events, the deadline has passed. Reading the
+	clock once per interval rather than timing every event keeps the cost of
+	the budget flat however deep the queue is.
+-----------------------------------------------------------------------------*/
+bool EventManager::dispatchQueue(EventQueue &queue, __int64 deadline, uint &sinceCheck)
+{
+	while (!queue.empty()) {
+		dispatchOrBatch(queue.front());
+		queue.pop_front();
+		++mFrameStats.mQueuedEvents;
+		if (deadline != 0 && ++sinceCheck >= sBudgetCheckInterval) {
+			sinceCheck = 0;
+			if (HighPerfTimer::queryCounts() >= deadline) { break; }
+		}
+	}
+	return queue.empty();
+}
+
 /*-----------------------------------------------------------------------------
 	Run through the queue and notify listeners, then purge the queue
 	If maxMillis > 0, the loop will exit after time expires, and remaining
@@ -166,47 +325,46 @@ void EventManager::trigger(const string &eventType)
 -----------------------------------------------------------------------------*/
 void EventManager::notifyQueued(ulong maxMillis)
 {
+	__int64 deadline = 0;
+	if (maxMillis != 0) {
+		deadline = HighPerfTimer::queryCounts() + (HighPerfTimer::timerFreq() * maxMillis) / 1000;
+	}
+	memset(&mFrameStats, 0, sizeof(mFrameStats));
+	beginDispatch();
+
 	// This section handles all events pushed into the thread-safe queue. These are processed first
 	// to make sure we maximize concurrency, but it opens up the possibility of a thread spamming
 	// the event system, where events are added faster than they can be processed, causing the
 	// program stutter or hang. Can't do much about this case except design worker threads carefully
-	// to not send events too often.
-	EventPtr ePtr;
-	while (mThreadEventQueue->tryPop(ePtr)) {
-		notifyListeners(ePtr);
+	// to not send events too often. Only events pushed before the drain starts are handled here.
+	// Events of parallel-safe types are set aside in per-type batches, handed to the pool below.
+	mFrameStats.mThreadEvents = mThreadEventQueue->drain([this](const EventPtr &ePtr) {
+		releaseThreadPending(ePtr);
+		dispatchOrBatch(ePtr);
+	});
+
+	// Now work on the regular event queue. Events rolled over last frame are still in the inactive
+	// queue, they are older than anything in the active queue so they go first. Only once they are
+	// done is the active queue flipped, so events raised while processing it go to the other queue
+	// and can't set up an endless loop. Leftovers simply stay where they are, nothing is moved.
+	uint inactiveQueue = (mActiveQueue == 0) ? 1 : 0;
+	uint sinceCheck = 0;
+	if (dispatchQueue(mEventQueue[inactiveQueue], deadline, sinceCheck)) {
+		uint processQueue = mActiveQueue;
+		mActiveQueue = inactiveQueue;
+		mPending.clear(); // events about to be handled take no more folding, newer ones start new entries
+		dispatchQueue(mEventQueue[processQueue], deadline, sinceCheck);
 	}
 
-	// Now work on the regular event queue
-	// flip the active queue so any events raised while processing the current queue will not set up an endless loop
-	uint processQueue = mActiveQueue;
-	mActiveQueue = (mActiveQueue == 0) ? 1 : 0;
-	clearEventQueue(mActiveQueue); // make sure new active queue starts empty, but should already be empty
-
-	// run through the now inactive queue and notify listeners to handle each event
-	// may not reach end of queue if time expires
-	HighPerfTimer timer;
-	timer.start();
-	EventQueue::const_iterator	ei = mEventQueue[processQueue].begin(),
-								end = mEventQueue[processQueue].end();
-	int temp = 0;
-	while (ei != end) {
-		notifyListeners(*ei);
-		++temp;
-		++ei;
-		mEventQueue[processQueue].pop_front();
-		// if maxMillis is exceeded, time to break out of the loop
-		// timer.stop() is an expensive call, consider calling this conditional once per 10 events or something
-		if (timer.stop() > maxMillis && maxMillis != 0) break;
-	}
-
-	// if there are remaining events in the queue, push them to front of active queue so they'll be processed first next frame
-	// clears the inactive queue if not already empty
-	if (mEventQueue[processQueue].size() > 0) {
-		debugPrintf("%i queued events rolled over\n", mEventQueue[processQueue].size());
-		do {
-			mEventQueue[mActiveQueue].push_front(mEventQueue[processQueue].back());
-			mEventQueue[processQueue].pop_back();
-		} while (mEventQueue[processQueue].size() > 0);
+	// handle the parallel events set aside this frame, this thread joins in until all are done
+	mFrameStats.mBatchedEvents = dispatchBatches();
+
+	endDispatch();
+
+	mFrameStats.mRolledOver = mEventQueue[(mActiveQueue == 0) ? 1 : 0].size();
+	if (mFrameStats.mRolledOver > 0) {
+		mTotalRolledOver += mFrameStats.mRolledOver;
+		debugPrintf("%u queued events rolled over\n", mFrameStats.mRolledOver);
 	}
 }
 
@@ -217,15 +375,14 @@ void EventManager::notifyQueued(ulong maxMillis)
 -----------------------------------------------------------------------------*/
 bool EventManager::registerEventType(const string &eventType, const RegEventPtr &regPtr)
 {
-	RegEventMap::iterator ri = mRegEventMap.find(eventType);
-	if (ri == mRegEventMap.end()) { // not yet registered, good
-		RegEventMapResult r = mRegEventMap.insert(RegEventMapValue(eventType, regPtr));
-		if (r.second) {
-			debugPrintf("EventMgr: event type \"%s\" registered\n", eventType.c_str());
-		} else {
-			debugPrintf("EventMgr: event type \"%s\" failed to register!\n", eventType.c_str());
+	EventTypeId typeId = EventTypeRegistry::intern(eventType);
+	if (!isEventTypeRegistered(typeId)) { // not yet registered, good
+		if (typeId >= mRegEventList.size()) {
+			mRegEventList.resize(typeId + 1);
 		}
-		return r.second;
+		mRegEventList[typeId] = regPtr;
+		debugPrintf("EventMgr: event type \"%s\" registered with id %u\n", eventType.c_str(), typeId);
+		return true;
 	}
 	// event type already registered, kick back
 	debugPrintf("EventMgr: failed to register event type \"%s\", already exists\n", eventType.c_str());
@@ -233,110 +390,267 @@ bool EventManager::registerEventType(const string &eventType, const RegEventPtr
 }
 
 /*-----------------------------------------------------------------------------
-	Returns true if added, false if already exists, with priority (1 is highest
-	priority, 0 is no priority or FIFO order). If event type does not exist it
-	is added. An O(n) operation since it traverses the existing list for
-	duplicates.
+	Returns the listener list of an event type, growing the table if the type
+	has no list yet
 -----------------------------------------------------------------------------*/
-bool EventManager::registerListener(const string &eventType, EventListener *lPtr, uint priority)
+EventManager::ListenerList & EventManager::listenersOf(EventTypeId typeId)
 {
-	_ASSERTE(lPtr);
+	if (typeId == EventTypeRegistry::sWildcardId) {
+		return mWildcardListeners;
+	}
+	if (typeId >= mListenerTable.size()) {
+		mListenerTable.resize(typeId + 1);
+	}
+	return mListenerTable[typeId];
+}
+
+/*-----------------------------------------------------------------------------
+	Returns the slot of a listener in an event type's list, sInvalidId if it is
+	not in the list, or sDeferredSlot if its registration is deferred
+-----------------------------------------------------------------------------*/
+uint & EventManager::slotOf(EventListener *lPtr, EventTypeId typeId)
+{
+	vector<uint> &slots = lPtr->mManagerSlots;
+	if (typeId >= slots.size()) {
+		slots.resize(typeId + 1, (EventTypeId)EventTypeRegistry::sInvalidId);
+	}
+	return slots[typeId];
+}
 
-	EventTypeMap::iterator ei = mEventTypeMap.find(eventType);
-	if (ei == mEventTypeMap.end()) {	// event type does not exist yet, so add it and register the listener
-		EventTypeMapResult r = mEventTypeMap.insert(EventTypeMapValue(eventType, ListenerList()));
-		debugPrintf("EventMgr: event type \"%s\" created in listener map\n", eventType.c_str());
-		(*r.first).second.push_back(ListenerListValue(lPtr,priority));
-		debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" registered with priority %d\n", lPtr->name().c_str(), eventType.c_str(), priority);
-		_ASSERTE(r.second == true);
-
-	} else { // event type exists, check that listener doesn't already exist
-		ListenerList::iterator	li, lPriorityInsert = (*ei).second.begin(),
-								end = (*ei).second.end();
-		for (li = (*ei).second.begin(); li != end; ++li) {
-			// 1) check the whole list to see if it's a repeat
-			if ((*li).first == lPtr) {
-				debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" already exists, not registered\n", lPtr->name().c_str(), eventType.c_str());
-				return false;
+void EventManager::appendListener(EventTypeId typeId, const ListenerListValue &value)
+{
+	ListenerList &listeners = listenersOf(typeId);
+	slotOf(value.mListener, typeId) = (uint)listeners.mEntries.size();
+	listeners.mEntries.push_back(value);
+	// appending in priority order, as FIFO listeners do, needs no sort
+	size_t size = listeners.mEntries.size();
+	if (!listeners.mDirty && size > 1 && value < listeners.mEntries[size-2]) {
+		listeners.mDirty = true;
+		mDirtyTypes.push_back(typeId);
+	}
+}
+
+void EventManager::tidyListeners()
+{
+	for (size_t d = 0; d < mDirtyTypes.size(); ++d) {
+		EventTypeId typeId = mDirtyTypes[d];
+		ListenerList &listeners = listenersOf(typeId);
+		vector<ListenerListValue> &entries = listeners.mEntries;
+		if (listeners.mNumRemoved > 0) {
+			size_t live = 0;
+			for (size_t l = 0; l < entries.size(); ++l) {
+				if (entries[l].mListener) { entries[live++] = entries[l]; }
 			}
-			// 2) find where it would be inserted if based on priority
-			if (((priority >= (*li).second) && ((*li).second != 0)) || (priority == 0)) ++lPriorityInsert;
+			entries.resize(live);
+		}
+		// mOrder makes every key unique, so the sort is stable without being std::stable_sort
+		std::sort(entries.begin(), entries.end());
+		for (size_t l = 0; l < entries.size(); ++l) {
+			slotOf(entries[l].mListener, typeId) = (uint)l;
 		}
-		if (priority == 0) { // just add to back of list for FIFO order
-			(*ei).second.push_back(ListenerListValue(lPtr,0));
-			debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" registered with priority %d\n", lPtr->name().c_str(), eventType.c_str(), priority);
-		} else { // insert in priority order
-			(*ei).second.insert(lPriorityInsert, ListenerListValue(lPtr,priority));
-			debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" registered with priority %d\n", lPtr->name().c_str(), eventType.c_str(), priority);
+		listeners.mNumRemoved = 0;
+		listeners.mDirty = false;
+	}
+	mDirtyTypes.clear();
+}
+
+void EventManager::beginDispatch()
+{
+	if (mDispatchDepth++ == 0 && !mDirtyTypes.empty()) {
+		tidyListeners();
+	}
+}
+
+void EventManager::endDispatch()
+{
+	_ASSERTE(mDispatchDepth > 0);
+	if (--mDispatchDepth == 0 && !mDeferredListeners.empty()) {
+		// appending may register more types, so take the list before walking it
+		DeferredList deferred;
+		deferred.swap(mDeferredListeners);
+		for (size_t d = 0; d < deferred.size(); ++d) {
+			appendListener(deferred[d].mTypeId, deferred[d].mValue);
+			updateAffinity(deferred[d].mTypeId);
 		}
 	}
+}
 
+void EventManager::forgetSlots(const ListenerList &listeners, EventTypeId typeId)
+{
+	for (size_t l = 0; l < listeners.mEntries.size(); ++l) {
+		EventListener *lPtr = listeners.mEntries[l].mListener;
+		if (lPtr) { slotOf(lPtr, typeId) = EventTypeRegistry::sInvalidId; }
+	}
+}
+
+void EventManager::clearListeners()
+{
+	// listeners outlive the table, forget their slots so a later removal is a plain miss
+	for (EventTypeId t = 0; t < mListenerTable.size(); ++t) {
+		forgetSlots(mListenerTable[t], t);
+	}
+	forgetSlots(mWildcardListeners, EventTypeRegistry::sWildcardId);
+	for (size_t d = 0; d < mDeferredListeners.size(); ++d) {
+		slotOf(mDeferredListeners[d].mValue.mListener, mDeferredListeners[d].mTypeId) = EventTypeRegistry::sInvalidId;
+	}
+	mListenerTable.clear();
+	mWildcardListeners = ListenerList();
+	mDeferredListeners.clear();
+	mDirtyTypes.clear();
+}
+
+/*-----------------------------------------------------------------------------
+	Recomputes the cached mParallelType flag of an event type, or of all types
+	when the wildcard listeners change
+-----------------------------------------------------------------------------*/
+void EventManager::updateAffinity(EventTypeId typeId)
+{
+	if (typeId == EventTypeRegistry::sWildcardId) {
+		mWildcardParallel = isParallelList(mWildcardListeners, true);
+		for (EventTypeId t = 1; t < mListenerTable.size(); ++t) {
+			updateAffinity(t);
+		}
+		return;
+	}
+
+	if (typeId >= mParallelType.size()) {
+		mParallelType.resize(typeId + 1, 0);
+	}
+	bool parallel = (mWildcardParallel && isParallelList(mListenerTable[typeId], false));
+	mParallelType[typeId] = (parallel ? 1 : 0);
+}
+
+bool EventManager::isParallelList(const ListenerList &listeners, bool emptyResult)
+{
+	const vector<ListenerListValue> &entries = listeners.mEntries;
+	if (entries.size() == listeners.mNumRemoved) { return emptyResult; }
+	for (size_t l = 0; l < entries.size(); ++l) {
+		if (entries[l].mListener && entries[l].mAffinity != ListenerAffinity_Parallel) { return false; }
+	}
 	return true;
 }
-		
+
 /*-----------------------------------------------------------------------------
-	Removes a listener from an event type, if event type has no more listeners
-	it is removed
+	Returns true if added, false if already exists, with priority (1 is highest
+	priority, 0 is no priority or FIFO order). If event type does not exist it
+	is added. The listener's slot answers the duplicate check, and the new
+	entry is appended, to be put in priority order before the next dispatch.
+	While dispatching, the registration is deferred until dispatch returns.
 -----------------------------------------------------------------------------*/
-bool EventManager::removeListener(const string &eventType, EventListener *lPtr)
+bool EventManager::registerListener(EventTypeId typeId, EventListener *lPtr, uint priority,
+									ListenerAffinity affinity)
 {
 	_ASSERTE(lPtr);
+	_ASSERTE(!mParallelDispatch && "Listeners can't be registered from a parallel-safe handler");
 
-	// check for event type in the map
-	EventTypeMap::iterator ei = mEventTypeMap.find(eventType);
-	if (ei == mEventTypeMap.end()) {
-		debugPrintf("EventMgr: event type \"%s\" not found, listener \"%s\" not removed\n", eventType.c_str(), lPtr->name().c_str());
+	uint &slot = slotOf(lPtr, typeId);
+	if (slot != EventTypeRegistry::sInvalidId) {
+		debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" already exists, not registered\n", lPtr->name().c_str(), EventTypeRegistry::name(typeId).c_str());
 		return false;
 	}
 
-	size_t startSize = (*ei).second.size();	// store size of the list before attempting a removal
-
-	// remove the matching listener in the event type's list
-	ListenerList::iterator li, end = (*ei).second.end();
-	for (li = (*ei).second.begin(); li != end; ++li) {
-		if ((*li).first == lPtr) {	// match
-			(*ei).second.erase(li);
-			debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" removed\n", lPtr->name().c_str(), eventType.c_str());
-			break;
-		}
+	ListenerListValue value = { lPtr, priority, affinity, mListenerOrder++ };
+	if (mDispatchDepth > 0) {
+		DeferredListener deferred = { typeId, value };
+		mDeferredListeners.push_back(deferred);
+		slot = sDeferredSlot;
+		debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" registered with priority %d, deferred until dispatch returns\n", lPtr->name().c_str(), EventTypeRegistry::name(typeId).c_str(), priority);
+		return true;
 	}
-	if ((*ei).second.size() == startSize) {
-		debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" not found, not removed\n", lPtr->name().c_str(), eventType.c_str());
+	appendListener(typeId, value);
+	updateAffinity(typeId);
+	debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" registered with priority %d\n", lPtr->name().c_str(), EventTypeRegistry::name(typeId).c_str(), priority);
+
+	return true;
+}
+		
+/*-----------------------------------------------------------------------------
+	Removes a listener from an event type. The entry is cleared in place, even
+	mid-dispatch, and the gap is closed before the next dispatch.
+-----------------------------------------------------------------------------*/
+bool EventManager::removeListener(EventTypeId typeId, EventListener *lPtr)
+{
+	_ASSERTE(lPtr);
+	_ASSERTE(!mParallelDispatch && "Listeners can't be removed from a parallel-safe handler");
+
+	uint &slot = slotOf(lPtr, typeId);
+	if (slot == EventTypeRegistry::sInvalidId) {
+		debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" not found, not removed\n", lPtr->name().c_str(), EventTypeRegistry::name(typeId).c_str());
 		return false;	// listener not found for removal in the list
 	}
 
-	// if the event type has no more listeners, it can be removed from the map
-	if ((*ei).second.size() == 0) {
-		mEventTypeMap.erase(ei);
-		debugPrintf("EventMgr: event type \"%s\" removed from listener map, no more listeners\n", eventType.c_str());
+	if (slot == sDeferredSlot) {
+		// never made it into the list, just cancel the registration
+		for (size_t d = 0; d < mDeferredListeners.size(); ++d) {
+			if (mDeferredListeners[d].mTypeId == typeId && mDeferredListeners[d].mValue.mListener == lPtr) {
+				mDeferredListeners.erase(mDeferredListeners.begin() + d);
+				break;
+			}
+		}
+	} else {
+		ListenerList &listeners = listenersOf(typeId);
+		_ASSERTE(slot < listeners.mEntries.size() && listeners.mEntries[slot].mListener == lPtr);
+		listeners.mEntries[slot].mListener = 0;
+		++listeners.mNumRemoved;
+		if (!listeners.mDirty) {
+			listeners.mDirty = true;
+			mDirtyTypes.push_back(typeId);
+		}
+		updateAffinity(typeId);
 	}
-	
-	return true;	
+	slot = EventTypeRegistry::sInvalidId;
+	debugPrintf("EventMgr: listener \"%s\" for event type \"%s\" removed\n", lPtr->name().c_str(), EventTypeRegistry::name(typeId).c_str());
+	return true;
 }
 
 EventManager::EventManager() :
 	Singleton<EventManager>(*this),
+	mDispatchDepth(0),
+	mListenerOrder(0),
 	mActiveQueue(0),
-	mThreadEventQueue(new ThreadSafeEventQueue()),
-	mEventSnooper(new EventSnooper())
+	mTotalRolledOver(0),
+	mEventSnooper(0),
+	mThreadEventQueue(new ThreadSafeEventQueue(sThreadEventQueueSize)),
+	mDispatchPool(0),
+	mWildcardParallel(true),
+	mNumBatches(0),
+	mMainThreadId(GetCurrentThreadId()),
+	mParallelDispatch(false),
+	mNumCoalesced(0)
 {
+	memset(&mFrameStats, 0, sizeof(mFrameStats));
+	// leave one core to the main thread
+	uint cores = boost::thread::hardware_concurrency();
+	uint numThreads = (cores > 1 ? cores - 1 : 0);
+	if (numThreads > sMaxDispatchThreads) { numThreads = sMaxDispatchThreads; }
+	mDispatchPool = new EventDispatchPool(numThreads, [this](const EventPtr &ePtr) {
+		notifyListeners(ePtr);
+	});
+	mWorkerRaised.resize(numThreads);
+	// created last, it registers as a listener
+	mEventSnooper = new EventSnooper();
 }
 
 EventManager::~EventManager()
 {
+	delete mDispatchPool;
 	clearEventQueue(0);
 	clearEventQueue(1);
 	delete mEventSnooper;
 	delete mThreadEventQueue;
 	clearListeners();
-	debugPrintf("EventMgr: created %d events, destroyed %d\n", Event::sNumEventsCreated, Event::sNumEventsDestroyed);
+	debugPrintf("EventMgr: created %d events, destroyed %d, %d coalesced\n", Event::sNumEventsCreated, Event::sNumEventsDestroyed, mNumCoalesced);
+	Event::reportPoolUsage();
 }
 
 ////////// class EventSnooper //////////
 
 bool EventSnooper::handleAllEvents(const EventPtr &ePtr)
 {
+	// one line per event, and the pool's workers would all be waiting on the console
+	#ifdef _DEBUG
 	debugPrintf("%s: event \"%s\" handled by generic handler\n", mName.c_str(), (*ePtr).type().c_str());
+	#endif
 	return false;
 }
 
@@ -357,8 +671,9 @@ EventSnooper::EventSnooper() :
 	insertEventHandler("EVENT_SPECIFIC", p1);
 */
 	// register the wildcard event with EventManager
+	// only prints, so it doesn't hold every event type to the main thread
 	IEventHandlerPtr p(new EventHandler<EventSnooper>(this, &EventSnooper::handleAllEvents));
-	registerEventHandler(EventListener::sWildcardType, p);
+	registerEventHandler(EventListener::sWildcardType, p, 0, ListenerAffinity_Parallel);
 }
 
 EventSnooper::~EventSnooper()
@@ -27,21 +27,25 @@ Features:
 	* Events types include code-only, code/script, and script-defined
 	* Listeners can be safely registered before corresponding event type is registered (eliminates
 		order of creation issues)
+	* Event types whose listeners are all parallel-safe are dispatched on a worker pool, one batch
+		per type so events of a type are still handled in order
 --------------------------------*/
 
 #pragma once
 
 #include <string>
-#include <list>
+#include <vector>
 #include <hash_map>
+#include <boost/thread/mutex.hpp>
 #include "EventListener.h"
 #include "Event.h"
 #include "../Utility/Typedefs.h"
 #include "../Utility/Singleton.h"
+#include "../Utility/RingBuffer.h"
 
 using std::string;
-using std::list;
 using std::pair;
+using std::vector;
 using stdext::hash_map;
 
 ///// DEFINITIONS /////
@@ -50,54 +54,128 @@ using stdext::hash_map;
 //#define events		EventManager::instance()
 #define eventMgr	EventManager::instance()
 
-template<typename T> class ConcurrentQueue;
-typedef ConcurrentQueue<EventPtr>	ThreadSafeEventQueue;
+template<typename T> class MPSCQueue;
+typedef MPSCQueue<EventPtr>	ThreadSafeEventQueue;
 
 ///// STRUCTURES /////
 
 class EventSnooper;
+class EventDispatchPool;
+
+/*=============================================================================
+struct EventFrameStats
+	What notifyQueued did in the last frame
+=============================================================================*/
+struct EventFrameStats {
+	uint	mThreadEvents;		// taken from the thread-safe queue
+	uint	mQueuedEvents;		// taken from the double-buffered queue
+	uint	mBatchedEvents;		// of those, handed to the parallel dispatch pool
+	uint	mRolledOver;		// left in the queue when the time budget ran out
+};
 
 /*=============================================================================
 class EventManager
 	The central manager for the event system. Has an event queue that keeps
 	raised events to be processed each frame. Event registration and listener
-	maps are kept separately so that listeners may be registered for events
-	types event before they have been registered.
+	tables are kept separately so that listeners may be registered for events
+	types event before they have been registered. Both tables are vectors
+	indexed by EventTypeId, so dispatching an event costs no string hashing.
+	Wildcard listeners are kept in their own list.
+	**Listener lists**
+	Each list is a contiguous array kept in priority order, so notifying is a
+	linear scan. Each listener knows its slot in every list it is in, making
+	the duplicate check and removal O(1). Registration appends and removal
+	leaves a tombstone, and a changed list is re-sorted and compacted once,
+	just before it is next dispatched. While events are being dispatched,
+	registrations are deferred until the outermost dispatch returns, so the
+	array being scanned never moves. Removals take effect at once.
 =============================================================================*/
 class EventManager : public Singleton<EventManager> {
 	private:
 		///// DEFINITIONS /////
 
-		typedef pair<EventListener*, uint>			ListenerListValue;	// pairs the listener pointer with priority
-		typedef list<ListenerListValue>				ListenerList;		// stores listeners along with their priority
-		typedef pair<string, ListenerList>			EventTypeMapValue;	// value pair of the event type map
-		typedef hash_map<string, ListenerList>		EventTypeMap;		// hash_map to store lists of event listeners
-		typedef pair<EventTypeMap::iterator, bool>	EventTypeMapResult;	// result of inserting elements into the event type map
-		typedef pair<string, RegEventPtr>			RegEventMapValue;	// value pair of the event registration map
-		typedef hash_map<string, RegEventPtr>		RegEventMap;		// hash_map to store lists of event registrations
-		typedef pair<RegEventMap::iterator, bool>	RegEventMapResult;	// result of inserting elements into event registration map
-		typedef list<EventPtr>						EventQueue;
+		struct ListenerListValue {
+			EventListener *		mListener;	// 0 once removed, until the list is compacted
+			uint				mPriority;
+			ListenerAffinity	mAffinity;
+			uint				mOrder;		// registration sequence, keeps FIFO order among equal priorities
+
+			// priority 1 first, priority 0 (FIFO) after all prioritized listeners
+			bool operator<(const ListenerListValue &rhs) const {
+				uint lp = (mPriority == 0 ? 0xFFFFFFFF : mPriority);
+				uint rp = (rhs.mPriority == 0 ? 0xFFFFFFFF : rhs.mPriority);
+				return (lp < rp || (lp == rp && mOrder < rhs.mOrder));
+			}
+		};
+		struct ListenerList {
+			vector<ListenerListValue>	mEntries;
+			uint						mNumRemoved;	// tombstones in mEntries
+			bool						mDirty;			// needs sorting or compacting before dispatch
+
+			explicit ListenerList() : mNumRemoved(0), mDirty(false) {}
+		};
+		struct DeferredListener {
+			EventTypeId			mTypeId;
+			ListenerListValue	mValue;
+		};
+		typedef vector<ListenerList>				ListenerTable;		// lists of event listeners indexed by EventTypeId
+		typedef vector<DeferredListener>			DeferredList;
+		typedef vector<RegEventPtr>					RegEventList;		// event registrations indexed by EventTypeId
+		typedef RingBuffer<EventPtr>				EventQueue;		// grows to the busiest frame, then stops allocating
+		typedef vector<EventPtr>					EventBatch;
+		typedef vector<EventBatch>					EventBatchList;
+		typedef hash_map<uint64, EventPtr>			PendingMap;		// queued coalescable events by type id and coalesce key
+
+		static const uint sThreadEventQueueSize = 4096;	// events raised by other threads between frames
+		static const uint sMaxDispatchThreads = 4;		// upper limit of the parallel dispatch pool
+		static const uint sBudgetCheckInterval = 16;	// events handled between clock reads in notifyQueued
+		static const uint sDeferredSlot = 0xFFFFFFFE;	// listener slot of a registration deferred by dispatch
 
 		// add a type returned by listeners for consumed vs. not consumed (allowing further notifications of the event)
 		// so a high priority listener may choose to consume an event before others are notified
 
 		///// VARIABLES /////
 
-		RegEventMap		mRegEventMap;		// maps registration types to event types
-		EventTypeMap	mEventTypeMap;		// maps listeners to their event types
+		RegEventList	mRegEventList;		// registration of each event type, empty where not registered
+		ListenerTable	mListenerTable;		// listeners of each event type
+		ListenerList	mWildcardListeners;	// listeners of every event type
+		vector<EventTypeId>	mDirtyTypes;	// lists to tidy before the next dispatch
+		DeferredList	mDeferredListeners;	// registered while dispatching
+		uint			mDispatchDepth;		// nesting of dispatch on the main thread
+		uint			mListenerOrder;		// next registration sequence number
 		EventQueue		mEventQueue[2];		// double-buffered list of events that have been raised
 		uint			mActiveQueue;		// the active event queue is written to while the inactive queue is being processed
+											// the inactive queue keeps any events rolled over until the next frame
+		EventFrameStats	mFrameStats;
+		uint			mTotalRolledOver;
 
 		EventSnooper	*mEventSnooper;		// built-in wildcard event listener
 
 		ThreadSafeEventQueue	*mThreadEventQueue;	// thread-safe event queue, used for inter-thread events
 
+		// parallel dispatch
+		EventDispatchPool		*mDispatchPool;
+		vector<uchar>			mParallelType;		// 1 where every listener of the type is parallel-safe, by EventTypeId
+		bool					mWildcardParallel;	// every wildcard listener is parallel-safe
+		EventBatchList			mBatches;			// this frame's parallel events, one batch per type, kept for reuse
+		uint					mNumBatches;
+		vector<uint>			mBatchOfType;		// index into mBatches by EventTypeId, sInvalidId if none this frame
+		ulong					mMainThreadId;		// raise() from any other thread is redirected to raiseThreadSafe()
+		bool					mParallelDispatch;	// true while batches are being handled by the pool
+		EventBatchList			mWorkerRaised;		// raised by parallel handlers, by pool worker, queued after the batches
+
+		// coalescing
+		PendingMap				mPending;			// coalescable events in the active queue, main thread only
+		PendingMap				mThreadPending;		// coalescable events in the thread-safe queue
+		boost::mutex			mThreadPendingMutex;
+		volatile long			mNumCoalesced;		// events absorbed rather than queued
+
 		///// FUNCTIONS /////
 
 		/*---------------------------------------------------------------------
 			Cleanup for when manager is destroyed or being reset
 		---------------------------------------------------------------------*/
-		void	clearListeners() { mEventTypeMap.clear(); }
+		void	clearListeners();
 
 		/*---------------------------------------------------------------------
 			Purge event queue (usually done each frame, called by notifyQueued)
@@ -112,6 +190,101 @@ class EventManager : public Singleton<EventManager> {
 		---------------------------------------------------------------------*/
 		void	notifyListeners(const EventPtr &ePtr) const;
 
+		/*---------------------------------------------------------------------
+			Handles events from the front of the queue until it is empty or,
+			checking every sBudgetCheckInterval events, the deadline (in QPC
+			counts, 0 for none) has passed. Returns true if emptied.
+		---------------------------------------------------------------------*/
+		bool	dispatchQueue(EventQueue &queue, __int64 deadline, uint &sinceCheck);
+
+		/*---------------------------------------------------------------------
+			Returns the listener list of an event type, growing the table if
+			the type has no list yet
+		---------------------------------------------------------------------*/
+		ListenerList &	listenersOf(EventTypeId typeId);
+
+		/*---------------------------------------------------------------------
+			Sorts and compacts the lists changed since the last dispatch, and
+			rewrites the slots of their listeners
+		---------------------------------------------------------------------*/
+		void	tidyListeners();
+
+		/*---------------------------------------------------------------------
+			Called around dispatch from the main thread. When the outermost
+			dispatch ends, deferred registrations are applied.
+		---------------------------------------------------------------------*/
+		void	beginDispatch();
+		void	endDispatch();
+
+		/*---------------------------------------------------------------------
+			Adds a listener to the end of an event type's list, the list is
+			only marked for sorting if that breaks priority order
+		---------------------------------------------------------------------*/
+		void	appendListener(EventTypeId typeId, const ListenerListValue &value);
+
+		/*---------------------------------------------------------------------
+			Returns the listener's slot for an event type, growing its slot
+			table if needed
+		---------------------------------------------------------------------*/
+		static uint &	slotOf(EventListener *lPtr, EventTypeId typeId);
+		static void		forgetSlots(const ListenerList &listeners, EventTypeId typeId);
+
+		/*---------------------------------------------------------------------
+			Returns true if every live listener in the list is parallel-safe,
+			or emptyResult if there are none
+		---------------------------------------------------------------------*/
+		static bool		isParallelList(const ListenerList &listeners, bool emptyResult);
+
+		/*---------------------------------------------------------------------
+			Recomputes the cached mParallelType flag of an event type, or of
+			all types when the wildcard listeners change
+		---------------------------------------------------------------------*/
+		void	updateAffinity(EventTypeId typeId);
+
+		/*---------------------------------------------------------------------
+			Returns true if events of the type can go to the worker pool. Types
+			without listeners aren't worth handing off.
+		---------------------------------------------------------------------*/
+		bool	isParallelType(EventTypeId typeId) const {
+					return (typeId < mParallelType.size() && mParallelType[typeId] != 0);
+				}
+
+		/*---------------------------------------------------------------------
+			Queues a parallel event in its type's batch, or notifies the
+			listeners of a main thread event right away
+		---------------------------------------------------------------------*/
+		void	dispatchOrBatch(const EventPtr &ePtr);
+
+		/*---------------------------------------------------------------------
+			Hands this frame's batches to the pool, and empties them. Returns
+			the number of events they held.
+		---------------------------------------------------------------------*/
+		uint	dispatchBatches();
+
+		/*---------------------------------------------------------------------
+			Folds ePtr into the pending event of its type and key if there is
+			one and returns true, otherwise records ePtr as the pending event
+			and returns false
+		---------------------------------------------------------------------*/
+		bool	coalescePending(PendingMap &pending, const EventPtr &ePtr, CoalescePolicy policy);
+
+		/*---------------------------------------------------------------------
+			Called as the consumer takes an event from the thread-safe queue,
+			so producers stop folding into it before it is handled
+		---------------------------------------------------------------------*/
+		void	releaseThreadPending(const EventPtr &ePtr);
+
+		/*---------------------------------------------------------------------
+			Sets the event aside in the calling pool worker's list and returns
+			true, or returns false on any thread that isn't a pool worker
+		---------------------------------------------------------------------*/
+		bool	setAsideWorkerRaise(const EventPtr &ePtr);
+
+		static uint64	pendingKey(const Event &e) {
+							_ASSERTE(e.coalesceKey() < (1ULL << 48) && e.typeId() < (1U << 16));
+							return ((uint64)e.typeId() << 48) | e.coalesceKey();
+						}
+
 	public:
 		/*---------------------------------------------------------------------
 			Add event to the queue, queue is processed each frame
@@ -142,6 +315,9 @@ class EventManager : public Singleton<EventManager> {
 		---------------------------------------------------------------------*/
 		void	notifyQueued(ulong maxMillis);
 
+		const EventFrameStats &	lastFrameStats() const	{ return mFrameStats; }
+		uint					totalRolledOver() const	{ return mTotalRolledOver; }
+
 		/*---------------------------------------------------------------------
 			Registers an event type so that it may be triggered or raised. The
 			RegisteredEvent implementation will determine if the event can be
@@ -153,31 +329,37 @@ class EventManager : public Singleton<EventManager> {
 		/*---------------------------------------------------------------------
 			Returns a shared ptr to RegisteredEvent metadata for an event type
 		---------------------------------------------------------------------*/
-		RegEventPtr getRegEventPtr(const string &eventType) const {
-					RegEventMap::const_iterator ri = mRegEventMap.find(eventType);
-					if (ri != mRegEventMap.end()) return RegEventPtr(ri->second);
+		RegEventPtr getRegEventPtr(EventTypeId typeId) const {
+					if (typeId < mRegEventList.size()) return mRegEventList[typeId];
 					return RegEventPtr(); // return a null internal pointer if not found
 				}
+		RegEventPtr getRegEventPtr(const string &eventType) const {
+					return getRegEventPtr(EventTypeRegistry::find(eventType));
+				}
 
 		/*---------------------------------------------------------------------
 			Returns true if event type has already been registered in the
 			RegisteredEvent table (doesn't care about listener table)
 		---------------------------------------------------------------------*/
-		bool	isEventTypeRegistered(const string &eventType) const { return (mRegEventMap.find(eventType) != mRegEventMap.end()); }
+		bool	isEventTypeRegistered(EventTypeId typeId) const {
+					return (typeId < mRegEventList.size() && mRegEventList[typeId]);
+				}
+		bool	isEventTypeRegistered(const string &eventType) const {
+					return isEventTypeRegistered(EventTypeRegistry::find(eventType));
+				}
 		
 		/*---------------------------------------------------------------------
 			Returns true if added, false if already exists, with priority
 			(1 is highest priority, 0 is no priority or FIFO order).
-			If event type does not exist it is added. An O(n) operation since
-			it traverses the existing list for duplicates.
+			If event type does not exist it is added. Main thread only.
 		---------------------------------------------------------------------*/
-		bool	registerListener(const string &eventType, EventListener *lPtr, uint priority = 0);
+		bool	registerListener(EventTypeId typeId, EventListener *lPtr, uint priority = 0,
+								 ListenerAffinity affinity = ListenerAffinity_MainThread);
 		
 		/*---------------------------------------------------------------------
-			Removes a listener from an event type, if event type has no
-			more listeners it is removed
+			Removes a listener from an event type. Main thread only.
 		---------------------------------------------------------------------*/
-		bool	removeListener(const string &eventType, EventListener *lPtr);
+		bool	removeListener(EventTypeId typeId, EventListener *lPtr);
 
 		/*---------------------------------------------------------------------
 			Multithread safe raise methods
@@ -0,0 +1,26 @@
+/*----==== EVENTSCHEMA.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+---------------------------------*/
+
+#include "EventSchema.h"
+
+////////// class EventSchema //////////
+
+double EventSchema::getNumber(const Event &e, uint f) const
+{
+	switch (mFields[f].mType) {
+		case EventFieldType_Bool:	return (*fieldPtr<bool>(e, f) ? 1.0 : 0.0);
+		case EventFieldType_Char:	return *fieldPtr<char>(e, f);
+		case EventFieldType_UChar:	return *fieldPtr<uchar>(e, f);
+		case EventFieldType_Short:	return *fieldPtr<short>(e, f);
+		case EventFieldType_UShort:	return *fieldPtr<ushort>(e, f);
+		case EventFieldType_Int:	return *fieldPtr<int>(e, f);
+		case EventFieldType_UInt:	return *fieldPtr<uint>(e, f);
+		case EventFieldType_Float:	return *fieldPtr<float>(e, f);
+		default:
+			_ASSERTE(false && "Not a numeric field");
+	}
+	return 0.0;
+}
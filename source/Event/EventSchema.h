@@ -0,0 +1,108 @@
+/*----==== EVENTSCHEMA.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Field layout of an event type, declared once, so a bridge to script
+		can read an event's members in place.
+-------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include "Event.h"
+
+using std::string;
+using std::vector;
+
+///// DEFINITIONS /////
+
+enum EventFieldType : uchar {
+	EventFieldType_Bool = 0,
+	EventFieldType_Char,
+	EventFieldType_UChar,
+	EventFieldType_Short,
+	EventFieldType_UShort,
+	EventFieldType_Int,
+	EventFieldType_UInt,
+	EventFieldType_Float,
+	EventFieldType_String
+};
+
+///// STRUCTURES /////
+
+struct EventField {
+	const char *	mName;		// literal, key of the field in script tables
+	EventFieldType	mType;
+	ushort			mOffset;	// from the Event base of the object
+};
+
+/*=============================================================================
+class EventSchema
+	Describes the data members of an event type by name, type and offset.
+	Declared once per type and attached to its RegisteredEvent, it lets the
+	event reach script handlers without an AnyVars list (a node, a string
+	and an any per field): the bridge walks the fields and sets each member
+	into the handler's table from where it lies. Only events coming from
+	the network have schemas, scripts can't fire them.
+	Offsets are measured from the Event base, so fieldPtr works from an Event
+	reference without knowing the derived type. Schemas are built at startup
+	and read-only afterwards, safe to share between threads.
+	**Example**
+		EventSchema()
+			.field("controlId", &MyEvent::mControlId)
+			.field("value", &MyEvent::mValue);
+=============================================================================*/
+class EventSchema {
+	private:
+		///// VARIABLES /////
+		vector<EventField>	mFields;
+
+		///// FUNCTIONS /////
+		static EventFieldType	typeOf(const bool *)	{ return EventFieldType_Bool; }
+		static EventFieldType	typeOf(const char *)	{ return EventFieldType_Char; }
+		static EventFieldType	typeOf(const uchar *)	{ return EventFieldType_UChar; }
+		static EventFieldType	typeOf(const short *)	{ return EventFieldType_Short; }
+		static EventFieldType	typeOf(const ushort *)	{ return EventFieldType_UShort; }
+		static EventFieldType	typeOf(const int *)		{ return EventFieldType_Int; }
+		static EventFieldType	typeOf(const uint *)	{ return EventFieldType_UInt; }
+		static EventFieldType	typeOf(const float *)	{ return EventFieldType_Float; }
+		static EventFieldType	typeOf(const string *)	{ return EventFieldType_String; }
+
+	public:
+		/*---------------------------------------------------------------------
+			Appends a field. Events aren't standard layout so offsetof doesn't
+			apply, the member is located on a dummy address instead, which
+			is never dereferenced.
+		---------------------------------------------------------------------*/
+		template <typename TEvent, typename T>
+		EventSchema &	field(const char *name, T TEvent::*member) {
+							const size_t dummy = 0x1000;
+							TEvent *e = reinterpret_cast<TEvent *>(dummy);
+							size_t offset = reinterpret_cast<size_t>(&(e->*member)) -
+											reinterpret_cast<size_t>(static_cast<Event *>(e));
+							_ASSERTE(offset <= 0xFFFF);
+							EventField f = { name, typeOf(static_cast<const T *>(0)), (ushort)offset };
+							mFields.push_back(f);
+							return *this;
+						}
+
+		// Accessors
+		uint				numFields() const		{ return (uint)mFields.size(); }
+		const EventField &	fieldAt(uint f) const	{ return mFields[f]; }
+
+		/*---------------------------------------------------------------------
+			Pointer to a field in place, T must match the declared type
+		---------------------------------------------------------------------*/
+		template <typename T>
+		const T *		fieldPtr(const Event &e, uint f) const {
+							_ASSERTE(mFields[f].mType == typeOf(static_cast<const T *>(0)) && "Field type mismatch");
+							return reinterpret_cast<const T *>(reinterpret_cast<const char *>(&e) + mFields[f].mOffset);
+						}
+
+		/*---------------------------------------------------------------------
+			Reads any numeric or bool field as a double. Not for string fields.
+		---------------------------------------------------------------------*/
+		double			getNumber(const Event &e, uint f) const;
+};
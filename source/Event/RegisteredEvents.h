@@ -8,6 +8,8 @@
 
 #include "../Event/EventManager.h"
 #include "../Utility/Typedefs.h"
+#include "../Utility/BinaryArchive.h"
+#include "../Utility/NVPArchive.h"
 
 ///// STRUCTURES /////
 
@@ -39,6 +41,41 @@ class CodeOnlyEvent : public RegisteredEvent {
 		virtual ~CodeOnlyEvent() {}
 };
 
+/*=============================================================================
+class OutgoingRemoteEvent
+	A code-only event type that is sent to remote clients. Clients can't fire
+	it, but it can be encoded in the fixed or name-value pair body format,
+	driven by the event type's serialize() member, for the server to write
+	to a connection.
+=============================================================================*/
+template <typename TEventType>
+class OutgoingRemoteEvent : public CodeOnlyEvent {
+	public:
+		virtual bool writePayload(const Event &e, char *buffer, uint capacity, uint &outSize) const {
+			outSize = 0;
+			if (isEmpty()) { return true; }
+			BinaryOArchive archive(buffer, capacity);
+			archive << static_cast<const TEventType &>(e);
+			if (archive.overflowed()) { return false; }
+			outSize = archive.size();
+			return true;
+		}
+		virtual bool writeNVPPayload(const Event &e, char *buffer, uint capacity, uint &outSize) const {
+			outSize = 0;
+			if (isEmpty()) { return true; }
+			NVPOArchive archive(buffer, capacity);
+			archive << static_cast<const TEventType &>(e);
+			if (archive.overflowed()) { return false; }
+			outSize = archive.size();
+			return true;
+		}
+
+		explicit OutgoingRemoteEvent(const EventDataType dt) :
+			CodeOnlyEvent(dt)
+		{}
+		virtual ~OutgoingRemoteEvent() {}
+};
+
 /*=============================================================================
 class ScriptCallableCodeEvent
 	This concrete registered event type is templated by any type of event that
@@ -122,64 +159,108 @@ class ScriptDefinedEvent : public RegisteredEvent {
 class RemoteCallableEvent
 	This concrete registered event type is raised by a remote client and passed
 	to local listeners through a byte stream such as TCP or UDP networking,
-	file IO, or other communication methods.
+	file IO, or other communication methods. The event data is decoded with
+	BinaryIArchive from the fixed body format, driven by the event type's
+	serialize() member. fireEventFromRemote is the direct entry point for
+	message parsers, the AnyVars interface is kept for other sources.
 =============================================================================*/
-template <typename TEventType, class Archive>
+template <typename TEventType>
 class RemoteCallableEvent : public RegisteredEvent {
+	private:
+		/*---------------------------------------------------------------------
+			Creates the event and reads its data, null if the data was short
+		---------------------------------------------------------------------*/
+		EventPtr decode(int targetClientId, BinaryIArchive &archive) const {
+			EventPtr ePtr(new TEventType(targetClientId));
+			archive >> *(static_cast<TEventType*>(ePtr.get()));
+			if (archive.failed()) {
+				debugPrintf("RemoteCallableEvent: \"%s\" data too short, event dropped\n", TEventType::sEventType.c_str());
+				return EventPtr();
+			}
+			return ePtr;
+		}
+
+		/*---------------------------------------------------------------------
+			Decodes from eventData, which should contain two items, first the
+			targetClientId, second a pointer to a BinaryIArchive
+		---------------------------------------------------------------------*/
+		EventPtr decodeAnyVars(const AnyVars &eventData) const {
+			try {
+				AnyVars::const_iterator i = eventData.begin();
+				int targetClientId = any_cast<int>(i->second);
+				++i;
+				BinaryIArchive &archive = *(any_cast<BinaryIArchive*>(i->second));
+				return decode(targetClientId, archive);
+
+			} catch (const boost::bad_any_cast &ex) {
+				// nothing happens with a bad datatype in release build, silently ignores
+				debugPrintf("RemoteCallableEvent: bad_any_cast \"%s\"\n", ex.what());
+			}
+			return EventPtr();
+		}
+
 	public:
 		/*---------------------------------------------------------------------
-			Creates the Event, deserializing from the byte stream. Then, calls
-			EventManager::trigger or raise. eventData should contain two items,
-			first in targetClientId, second pointer to the Archive.
+			Creates the Event, deserializing from the archive. Then, calls
+			EventManager::trigger or raise.
 		---------------------------------------------------------------------*/
 		virtual bool triggerEventFromSource(const string &eventType, const AnyVars &eventData) const {
 			if (isEmpty()) { // handle empty events as a special case, avoid calling deserialize
 				eventMgr.trigger(eventType);
 				return true;
-			} else { // for all non-empty events, call deserialize after construction
-				AnyVars::const_iterator i = eventData.begin();
-				try {
-					int targetClientId = any_cast<int>(i->second);
-					EventPtr ePtr(new TEventType(targetClientId));
-					TEventType &e = *(static_cast<TEventType*>(ePtr.get()));
-					++i;
-					//ostream &os = *(any_cast<ostream*>(i->second));
-					//Archive archive(os);
-					Archive &archive = *(any_cast<Archive*>(i->second));
-					archive << e;
-					eventMgr.trigger(ePtr);
-
-				} catch (const boost::bad_any_cast &ex) {
-					// nothing happens with a bad datatype in release build, silently ignores
-					debugPrintf("RemoteCallableEvent: bad_any_cast \"%s\"\n", ex.what());
-				}
-				return true;
 			}
+			EventPtr ePtr(decodeAnyVars(eventData));
+			if (ePtr) { eventMgr.trigger(ePtr); }
+			return true;
 		}
 		virtual bool raiseEventFromSource(const string &eventType, const AnyVars &eventData) const {
 			if (isEmpty()) {
 				eventMgr.raise(eventType);
 				return true;
-			} else {
-				AnyVars::const_iterator i = eventData.begin();
-				try {
-					int targetClientId = any_cast<int>(i->second);
-					EventPtr ePtr(new TEventType(targetClientId));
-					TEventType &e = *(static_cast<TEventType*>(ePtr.get()));
-					++i;
-					//ostream &os = *(any_cast<ostream*>(i->second));
-					//Archive archive(os);
-					Archive &archive = *(any_cast<Archive*>(i->second));
-					archive << e;
-					eventMgr.raise(ePtr);
-
-				} catch (const boost::bad_any_cast &ex) {
-					// nothing happens with a bad datatype in release build, silently ignores
-					debugPrintf("RemoteCallableEvent: bad_any_cast \"%s\"\n", ex.what());
-				}
+			}
+			EventPtr ePtr(decodeAnyVars(eventData));
+			if (ePtr) { eventMgr.raise(ePtr); }
+			return true;
+		}
+
+		virtual bool fireEventFromRemote(int targetClientId, const char *data, uint size, bool raise) const {
+			if (isEmpty()) {
+				if (raise) { eventMgr.raise(TEventType::sEventType); }
+				else { eventMgr.trigger(TEventType::sEventType); }
 				return true;
 			}
+			BinaryIArchive archive(data, size);
+			EventPtr ePtr(decode(targetClientId, archive));
+			if (!ePtr) { return false; }
+			if (raise) { eventMgr.raise(ePtr); }
+			else { eventMgr.trigger(ePtr); }
+			return true;
+		}
+
+		virtual bool writePayload(const Event &e, char *buffer, uint capacity, uint &outSize) const {
+			outSize = 0;
+			if (isEmpty()) { return true; }
+			BinaryOArchive archive(buffer, capacity);
+			archive << static_cast<const TEventType &>(e);
+			if (archive.overflowed()) { return false; }
+			outSize = archive.size();
+			return true;
+		}
+		virtual bool writeNVPPayload(const Event &e, char *buffer, uint capacity, uint &outSize) const {
+			outSize = 0;
+			if (isEmpty()) { return true; }
+			NVPOArchive archive(buffer, capacity);
+			archive << static_cast<const TEventType &>(e);
+			if (archive.overflowed()) { return false; }
+			outSize = archive.size();
+			return true;
 		}
+		virtual EventPtr readPayload(int targetClientId, const char *data, uint size) const {
+			if (isEmpty()) { return EventPtr(); }
+			BinaryIArchive archive(data, size);
+			return decode(targetClientId, archive);
+		}
+
 		/*---------------------------------------------------------------------
 			Construct this object as a remote event
 		---------------------------------------------------------------------*/
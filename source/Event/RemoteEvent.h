@@ -14,6 +14,10 @@
 //#include "../Utility/Serialization.h" // using Boost.Serialization instead
 #include "Event.h"
 
+class BinaryOArchive;
+class BinaryIArchive;
+class NVPOArchive;
+
 /*=============================================================================
 class RemoteEvent
 	This is the base class for any event with a registered event type of
@@ -33,10 +37,24 @@ class RemoteEvent : public Event {//, public ISerializable {
 			//ar & type();
 			ar & BOOST_SERIALIZATION_NVP(mTargetClientId);
 		}
+		// the fixed body carries no target, the connection a message arrives on identifies the client
+		void serialize(BinaryOArchive &ar, const unsigned int version) {}
+		void serialize(BinaryIArchive &ar, const unsigned int version) {}
+		void serialize(NVPOArchive &ar, const unsigned int version) {}
 
 	protected:
 		int mTargetClientId; // unique id of the client being targeted, value of -1 used for broadcast to all clients
 
+		/*---------------------------------------------------------------------
+			Coalesce key for events of one control on one client, 48 bits
+		---------------------------------------------------------------------*/
+		uint64 controlKey(short controlId) const {
+			return controlKey(mTargetClientId, controlId);
+		}
+		static uint64 controlKey(int clientId, short controlId) {
+			return ((uint64)(ushort)controlId << 32) | (uint)clientId;
+		}
+
 	public:
 		// Derived implementations can call these base class functions if targetID is desired in byte stream
 		//virtual bool serialize(Archive &ar) const { ar << mTargetId; return true; }
@@ -8,16 +8,21 @@
 #include "../Event/EventManager.h"
 #include "../Process/ProcessManager.h"
 #include "../Resource/ResCache.h"
+#include "../Resource/ResourceProcess.h"
 #include "../Win32/HighPerfTimer.h"
 #include "../Server/TCPServerProcess.h"
 #include "../Server/TCPServerOptions.h"
 #include "../Server/HTTPRequestParser.h"
 #include "../Server/HTTPRequestHandler.h"
+#include "../Server/WebResource.h"
 #include "../Server/NexusMessageParser.h"
+#include "../Server/MessageRecorder.h"
 #include "../Server/NexusMessageHandler.h"
+#include "ControlEvents.h"
 //#include "../Scripting/ScriptManager_Lua.h"
 #include "../Resource/ZipFile.h"
 #include "../Resource/FileSystemSource.h"
+#include "../Resource/Win32MemoryMappedFile.h"
 
 ///// class Application /////
 
@@ -46,31 +51,60 @@ bool Application::init()
 	mUpdateTimer = new HighPerfTimer();
 	mUpdateTimer->start();
 	mEventMgr = new EventManager();
+	registerEventTypes();
 	mProcMgr = new ProcessManager();
 	// set up resource caches
 	uint availableSysMemMB = mConfig.webCacheMB + mConfig.projectCacheMB + mConfig.scriptCacheMB;
 	mResCacheMgr = new ResCacheManager(availableSysMemMB, 0);
-	mResCacheMgr->createCache(ResCache_Web, mConfig.webCacheMB);
-	mResCacheMgr->createCache(ResCache_Project, mConfig.projectCacheMB);
-	mResCacheMgr->createCache(ResCache_Script, mConfig.scriptCacheMB);
+	mResCacheMgr->createCache(ResCache_Web, mConfig.webCacheMB, true,
+							  IEvictionPolicy::policyFromString(mConfig.webCachePolicy));
+	mResCacheMgr->createCache(ResCache_Project, mConfig.projectCacheMB, true,
+							  IEvictionPolicy::policyFromString(mConfig.projectCachePolicy));
+	mResCacheMgr->createCache(ResCache_Script, mConfig.scriptCacheMB, true,
+							  IEvictionPolicy::policyFromString(mConfig.scriptCachePolicy));
+
+	mResCacheMgr->registerPrefetcher<WebResource>();
 
 	// init the admin http server
 	if (!initAdminServer()) {
 		return false;
 	}
 
+	// prefetch what was hot before the last shutdown, runs in parallel with the servers
+	if (mConfig.warmupBudgetMB > 0) {
+		CProcessPtr warmupProcPtr(new CacheWarmupProcess(mConfig.cacheManifest, mConfig.warmupBudgetMB));
+		mProcMgr->attach(warmupProcPtr);
+	}
+
+	// shrink the caches under memory pressure, and grow them back once it clears
+	if (mConfig.memoryHighPercent > 0) {
+		CProcessPtr governorProcPtr(new MemoryGovernorProcess(mConfig.memoryHighPercent, mConfig.memoryLowPercent,
+																   mConfig.memoryWatchSystem));
+		mProcMgr->attach(governorProcPtr);
+	}
+
 	// Load project files
 	
 	// Create projects
 
 	// Create sim server processes for projects
+	NexusMessageParser::registerControlMessages();
+	if (!mConfig.recordEventsFile.empty()) {
+		mMessageRecorder = new MessageRecorder(mConfig.recordEventsFile);
+	}
 	TCPServerOptionsPtr o = TCPServerOptions::create("ProjectServer",20000,
 								&NexusMessageParser::create,
 								&NexusMessageHandler::create,
-								512, KeepAlive);
-	CProcessPtr serverProcPtr(new TCPServerProcess(o)); // keep connection alive, 512 char buffer
+								512, KeepAlive, true);
+	CProcessPtr serverProcPtr(new TCPServerProcess(o)); // keep connection alive, 512 char buffer, route events to clients
 	mProcMgr->attach(serverProcPtr);
 
+	// play recorded client traffic back in, for load testing offline
+	if (!mConfig.replayEventsFile.empty()) {
+		CProcessPtr replayProcPtr(new MessageReplayProcess(mConfig.replayEventsFile, mConfig.replaySpeed));
+		mProcMgr->attach(replayProcPtr);
+	}
+
 	return true;
 }
 
@@ -80,8 +114,11 @@ bool Application::initAdminServer()
 	
 	if (mConfig.adminUseZip) {
 		// Set up admin server resource file
-		ResSourcePtr srcPtr(new ZipFile(L"wwwroot/admin/admin.zip"));
+		shared_ptr<ZipFile> srcPtr(new ZipFile(L"wwwroot/admin/admin.zip", mConfig.adminUseMapping));
 		if (srcPtr->open()) {
+			if (!mConfig.inflateCacheDir.empty()) {
+				srcPtr->setInflateCacheDir(wstring(mConfig.inflateCacheDir.begin(), mConfig.inflateCacheDir.end()));
+			}
 			mResCacheMgr->registerSource(adminDocRoot, srcPtr);
 		} else {
 			debugPrintf("Error: wwwroot/admin/admin.zip not found\n");
@@ -89,12 +126,20 @@ bool Application::initAdminServer()
 		}
 	} else {
 		// Set up admin server file source
-		ResSourcePtr srcPtr(new FileSystemSource("wwwroot\\"));
+		ResSourcePtr srcPtr;
+		if (mConfig.adminUseMapping) {
+			srcPtr.reset(new Win32MemoryMappedFile("wwwroot\\"));
+		} else {
+			srcPtr.reset(new FileSystemSource("wwwroot\\"));
+		}
 		if (srcPtr->open()) {
 			mResCacheMgr->registerSource(adminDocRoot, srcPtr);
 		} else {
 			return false;
 		}
+		// pick up edits to the files without flushing the caches
+		CProcessPtr watchProcPtr(new DirectoryWatchProcess(adminDocRoot, "wwwroot\\"));
+		mProcMgr->attach(watchProcPtr);
 	}
 
 	// Create http server process for administration page
@@ -110,10 +155,15 @@ bool Application::initAdminServer()
 
 void Application::deInit()
 {
+	if (mResCacheMgr) {
+		mResCacheMgr->reportMemoryUsage();
+		mResCacheMgr->writeManifest(mConfig.cacheManifest);
+	}
 	mProcMgr->clear();
 	//delete mLuaMgr;
 	delete mResCacheMgr;
 	delete mProcMgr;
+	delete mMessageRecorder;
 	delete mEventMgr;
 	delete mUpdateTimer;
 }
\ No newline at end of file
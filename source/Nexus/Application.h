@@ -10,6 +10,7 @@
 
 class HighPerfTimer;
 class EventManager;
+class MessageRecorder;
 class ProcessManager;
 class ResCacheManager;
 
@@ -18,6 +19,7 @@ class Application {
 		// Variables
 		HighPerfTimer		*mUpdateTimer;
 		EventManager		*mEventMgr;
+		MessageRecorder		*mMessageRecorder;
 		ProcessManager		*mProcMgr;
 		ResCacheManager		*mResCacheMgr;
 		AppConfig			mConfig;
@@ -32,7 +34,7 @@ class Application {
 		void deInit();
 
 		explicit Application() :
-			mUpdateTimer(0), mEventMgr(0), mProcMgr(0), mResCacheMgr(0),
+			mUpdateTimer(0), mEventMgr(0), mMessageRecorder(0), mProcMgr(0), mResCacheMgr(0),
 			mConfig(L"app.config")
 		{}
 
@@ -9,6 +9,7 @@
 #include <string>
 #include <vector>
 #include <boost/serialization/nvp.hpp>
+#include <boost/serialization/version.hpp>
 
 using std::string;
 using std::wstring;
@@ -42,9 +43,22 @@ class AppConfig {
 		ProjOptionsList	projects;
 		int				adminPort;
 		bool			adminUseZip;
+		bool			adminUseMapping;	// serve admin files from memory mapped views instead of copies
 		int				webCacheMB;
 		int				projectCacheMB;
 		int				scriptCacheMB;
+		string			webCachePolicy;		// eviction policy per cache: "lru", "clock" or "tinylfu"
+		string			projectCachePolicy;
+		string			scriptCachePolicy;
+		string			cacheManifest;		// hotness manifest written at shutdown, read for warm-up at startup
+		int				warmupBudgetMB;		// max prefetched at startup, 0 disables warm-up
+		string			inflateCacheDir;	// on-disk cache of inflated zip entries, empty disables
+		int				memoryHighPercent;	// cache budgets shrink at this memory use, 0 disables the governor
+		int				memoryLowPercent;	// and grow back below this
+		bool			memoryWatchSystem;	// without a job memory limit, measure system wide memory use
+		string			recordEventsFile;	// messages from clients are recorded to this log, empty disables
+		string			replayEventsFile;	// message log played back through the parser at startup, empty disables
+		float			replaySpeed;		// 1 is real time, 0 as fast as possible
 
 		///// FUNCTIONS /////
 		bool load();	// load settings from file
@@ -52,8 +66,13 @@ class AppConfig {
 		bool checkConfigIntegrity() const; // check for config data errors and warnings
 
 		explicit AppConfig(const wstring &_filename) :
-			filename(_filename), adminPort(8080), adminUseZip(true),
-			webCacheMB(128), projectCacheMB(128), scriptCacheMB(32)
+			filename(_filename), adminPort(8080), adminUseZip(true), adminUseMapping(true),
+			webCacheMB(128), projectCacheMB(128), scriptCacheMB(32),
+			webCachePolicy("tinylfu"), projectCachePolicy("lru"), scriptCachePolicy("tinylfu"),
+			cacheManifest("cache.manifest"), warmupBudgetMB(64),
+			inflateCacheDir("cache\\inflate"),
+			memoryHighPercent(85), memoryLowPercent(70), memoryWatchSystem(false),
+			replaySpeed(1.0f)
 		{}
 
 	private:
@@ -68,5 +87,34 @@ class AppConfig {
 			ar & BOOST_SERIALIZATION_NVP(webCacheMB);
 			ar & BOOST_SERIALIZATION_NVP(projectCacheMB);
 			ar & BOOST_SERIALIZATION_NVP(scriptCacheMB);
+			if (version >= 1) {
+				ar & BOOST_SERIALIZATION_NVP(webCachePolicy);
+				ar & BOOST_SERIALIZATION_NVP(projectCachePolicy);
+				ar & BOOST_SERIALIZATION_NVP(scriptCachePolicy);
+			}
+			if (version >= 2) {
+				ar & BOOST_SERIALIZATION_NVP(cacheManifest);
+				ar & BOOST_SERIALIZATION_NVP(warmupBudgetMB);
+			}
+			if (version >= 3) {
+				ar & BOOST_SERIALIZATION_NVP(adminUseMapping);
+			}
+			if (version >= 4) {
+				ar & BOOST_SERIALIZATION_NVP(inflateCacheDir);
+			}
+			if (version >= 5) {
+				ar & BOOST_SERIALIZATION_NVP(memoryHighPercent);
+				ar & BOOST_SERIALIZATION_NVP(memoryLowPercent);
+			}
+			if (version >= 6) {
+				ar & BOOST_SERIALIZATION_NVP(recordEventsFile);
+				ar & BOOST_SERIALIZATION_NVP(replayEventsFile);
+				ar & BOOST_SERIALIZATION_NVP(replaySpeed);
+			}
+			if (version >= 7) {
+				ar & BOOST_SERIALIZATION_NVP(memoryWatchSystem);
+			}
 		}
 };
+
+BOOST_CLASS_VERSION(AppConfig, 7)
@@ -6,47 +6,96 @@
 
 #include "ControlEvents.h"
 #include "../Event/RegisteredEvents.h"
+#include "../Event/EventSchema.h"
+#include <climits>
+#include <hash_map>
+#include <boost/thread/mutex.hpp>
 
-#include <boost/archive/text_oarchive.hpp> // TEMP
+using stdext::hash_map;
+
+///// VARIABLES /////
+
+// encoder type by RemoteEvent::controlKey, samples are coalesced on producer threads too
+static hash_map<uint64, Encoder::EncoderType>	sEncoderTypes;
+static boost::mutex								sEncoderTypesMutex;
+
+///// FUNCTIONS /////
+
+// folds a newer value into a waiting one, saturating sums to the range of short
+static short coalesceValue(short waiting, short newer, CoalescePolicy policy)
+{
+	if (policy != CoalescePolicy_Sum) { return newer; }
+	int sum = (int)waiting + (int)newer;
+	return (short)(sum > SHRT_MAX ? SHRT_MAX : (sum < SHRT_MIN ? SHRT_MIN : sum));
+}
+
+// field layouts of the incoming events, what script handlers see in their event table
+static const EventSchema sDigitalSwitchSchema = EventSchema()
+	.field("controlId", &DigitalSwitchEvent::mControlId)
+	.field("activePos", &DigitalSwitchEvent::mActivePos);
+
+static const EventSchema sAnalogControlSchema = EventSchema()
+	.field("controlId", &AnalogControlEvent::mControlId)
+	.field("rawValue", &AnalogControlEvent::mRawValue);
+
+static const EventSchema sEncoderSchema = EventSchema()
+	.field("controlId", &EncoderEvent::mControlId)
+	.field("value", &EncoderEvent::mValue);
+
+static const EventSchema sKeyMatrixSchema = EventSchema()
+	.field("controlId", &KeyMatrixEvent::mControlId)
+	.field("keyIndex", &KeyMatrixEvent::mKeyIndex)
+	.field("position", &KeyMatrixEvent::mPosition);
 
 // register event types with manager, call once on application startup
 void registerEventTypes()
 {
 	// Outgoing events (server to client)
+	// use OutgoingRemoteEvent so the server can encode them for the target client
 	eventMgr.registerEventType(DigitalSwitchCreateEvent::sEventType,
-								RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
+								RegEventPtr(new OutgoingRemoteEvent<DigitalSwitchCreateEvent>(EventDataType_NotEmpty)));
 
 	eventMgr.registerEventType(AnalogControlCreateEvent::sEventType,
-								RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
+								RegEventPtr(new OutgoingRemoteEvent<AnalogControlCreateEvent>(EventDataType_NotEmpty)));
 
 	eventMgr.registerEventType(EncoderCreateEvent::sEventType,
-								RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
+								RegEventPtr(new OutgoingRemoteEvent<EncoderCreateEvent>(EventDataType_NotEmpty)));
 
 	eventMgr.registerEventType(KeyMatrixCreateEvent::sEventType,
-								RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
+								RegEventPtr(new OutgoingRemoteEvent<KeyMatrixCreateEvent>(EventDataType_NotEmpty)));
 
 	// Incoming events (client to server)
 	// use RemoteCallableEvent as the registered type
-	eventMgr.registerEventType(DigitalSwitchEvent::sEventType,
-								RegEventPtr(new RemoteCallableEvent<DigitalSwitchEvent, boost::archive::text_oarchive>(
-													EventDataType_NotEmpty)));
-
-	eventMgr.registerEventType(AnalogControlEvent::sEventType,
-								RegEventPtr(new RemoteCallableEvent<AnalogControlEvent, boost::archive::text_oarchive>(
-													EventDataType_NotEmpty)));
-
-	eventMgr.registerEventType(EncoderEvent::sEventType,
-								RegEventPtr(new RemoteCallableEvent<EncoderEvent, boost::archive::text_oarchive>(
-													EventDataType_NotEmpty)));
-
-	eventMgr.registerEventType(KeyMatrixEvent::sEventType,
-								RegEventPtr(new RemoteCallableEvent<KeyMatrixEvent, boost::archive::text_oarchive>(
-													EventDataType_NotEmpty)));
+	RegEventPtr switchPtr(new RemoteCallableEvent<DigitalSwitchEvent>(
+								EventDataType_NotEmpty));
+	switchPtr->setSchema(&sDigitalSwitchSchema);
+	eventMgr.registerEventType(DigitalSwitchEvent::sEventType, switchPtr);
+
+	// high rate controls are coalesced per control and client, so the queue holds one event per
+	// control however fast the samples come. Pots and absolute encoders only care about the latest
+	// reading, incremental encoders send relative steps that EncoderEvent::coalesce adds up.
+	RegEventPtr analogPtr(new RemoteCallableEvent<AnalogControlEvent>(
+								EventDataType_NotEmpty));
+	analogPtr->setCoalescePolicy(CoalescePolicy_LastValueWins);
+	analogPtr->setSchema(&sAnalogControlSchema);
+	eventMgr.registerEventType(AnalogControlEvent::sEventType, analogPtr);
+
+	RegEventPtr encoderPtr(new RemoteCallableEvent<EncoderEvent>(
+								EventDataType_NotEmpty));
+	encoderPtr->setCoalescePolicy(CoalescePolicy_LastValueWins);
+	encoderPtr->setSchema(&sEncoderSchema);
+	eventMgr.registerEventType(EncoderEvent::sEventType, encoderPtr);
+
+	RegEventPtr keyMatrixPtr(new RemoteCallableEvent<KeyMatrixEvent>(
+								EventDataType_NotEmpty));
+	keyMatrixPtr->setSchema(&sKeyMatrixSchema);
+	eventMgr.registerEventType(KeyMatrixEvent::sEventType, keyMatrixPtr);
 }
 
 // class DigitalSwitchCreateEvent
 
 const string DigitalSwitchCreateEvent::sEventType("createDigitalSwitch");
+const EventTypeId DigitalSwitchCreateEvent::sTypeId(EventTypeRegistry::intern(DigitalSwitchCreateEvent::sEventType));
 
 DigitalSwitchCreateEvent::DigitalSwitchCreateEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mNumPins(2), mPins(2), mOffEvent(true), mActiveLevel(0),
@@ -55,6 +104,7 @@ DigitalSwitchCreateEvent::DigitalSwitchCreateEvent(int targetClientId) :
 
 // class DigitalSwitchEvent
 const string DigitalSwitchEvent::sEventType("ds");
+const EventTypeId DigitalSwitchEvent::sTypeId(EventTypeRegistry::intern(DigitalSwitchEvent::sEventType));
 
 DigitalSwitchEvent::DigitalSwitchEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mControlId(0), mActivePos(0)
@@ -63,37 +113,69 @@ DigitalSwitchEvent::DigitalSwitchEvent(int targetClientId) :
 // class AnalogControlCreateEvent
 
 const string AnalogControlCreateEvent::sEventType("createAnalogControl");
+const EventTypeId AnalogControlCreateEvent::sTypeId(EventTypeRegistry::intern(AnalogControlCreateEvent::sEventType));
 
 AnalogControlCreateEvent::AnalogControlCreateEvent(int targetClientId) :
-	RemoteEvent(targetClientId), mPin(0), mChangeThreshold(1), mInterval(50)
+	RemoteEvent(targetClientId), mControlId(0), mPin(0), mChangeThreshold(1), mInterval(50)
 {}
 
 // class AnalogControlEvent
 const string AnalogControlEvent::sEventType("an");
+const EventTypeId AnalogControlEvent::sTypeId(EventTypeRegistry::intern(AnalogControlEvent::sEventType));
 
 AnalogControlEvent::AnalogControlEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mControlId(0), mRawValue(0)
 {}
 
+void AnalogControlEvent::coalesce(const Event &newer, CoalescePolicy policy)
+{
+	mRawValue = coalesceValue(mRawValue, static_cast<const AnalogControlEvent &>(newer).mRawValue, policy);
+}
+
 // class EncoderCreateEvent
 
 const string EncoderCreateEvent::sEventType("createEncoder");
+const EventTypeId EncoderCreateEvent::sTypeId(EventTypeRegistry::intern(EncoderCreateEvent::sEventType));
 
 EncoderCreateEvent::EncoderCreateEvent(int targetClientId) :
-	RemoteEvent(targetClientId), mPinA(0), mPinB(0), mInterruptNumber(1), mBits(2),
+	RemoteEvent(targetClientId), mControlId(0), mPinA(0), mPinB(0), mInterruptNumber(1), mBits(2),
 	mInterval(50), mGrayCode(false), mUseInternalPullup(false)
 {}
 
 // class EncoderEvent
 const string EncoderEvent::sEventType("en");
+const EventTypeId EncoderEvent::sTypeId(EventTypeRegistry::intern(EncoderEvent::sEventType));
 
 EncoderEvent::EncoderEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mControlId(0), mValue(0)
 {}
 
+void EncoderEvent::coalesce(const Event &newer, CoalescePolicy policy)
+{
+	// only relative steps add up, an absolute reading always replaces the waiting one
+	if (encoderType(mTargetClientId, mControlId) == Encoder::EncoderType_Incremental) {
+		policy = CoalescePolicy_Sum;
+	}
+	mValue = coalesceValue(mValue, static_cast<const EncoderEvent &>(newer).mValue, policy);
+}
+
+void EncoderEvent::setEncoderType(int clientId, short controlId, Encoder::EncoderType type)
+{
+	boost::mutex::scoped_lock lock(sEncoderTypesMutex);
+	sEncoderTypes[controlKey(clientId, controlId)] = type;
+}
+
+Encoder::EncoderType EncoderEvent::encoderType(int clientId, short controlId)
+{
+	boost::mutex::scoped_lock lock(sEncoderTypesMutex);
+	hash_map<uint64, Encoder::EncoderType>::const_iterator i = sEncoderTypes.find(controlKey(clientId, controlId));
+	return (i != sEncoderTypes.end() ? i->second : Encoder::EncoderType_Absolute);
+}
+
 // class KeyMatrixCreateEvent
 
 const string KeyMatrixCreateEvent::sEventType("createKeyMatrix");
+const EventTypeId KeyMatrixCreateEvent::sTypeId(EventTypeRegistry::intern(KeyMatrixCreateEvent::sEventType));
 
 KeyMatrixCreateEvent::KeyMatrixCreateEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mNumRows(8), mNumCols(8),
@@ -102,6 +184,7 @@ KeyMatrixCreateEvent::KeyMatrixCreateEvent(int targetClientId) :
 
 // class KeyMatrixEvent
 const string KeyMatrixEvent::sEventType("km");
+const EventTypeId KeyMatrixEvent::sTypeId(EventTypeRegistry::intern(KeyMatrixEvent::sEventType));
 
 KeyMatrixEvent::KeyMatrixEvent(int targetClientId) :
 	RemoteEvent(targetClientId), mControlId(0), mKeyIndex(0), mPosition(0)
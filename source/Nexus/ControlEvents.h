@@ -30,17 +30,18 @@ class DigitalSwitchCreateEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mNumPins);
-			ar & BOOST_SERIALIZATION_NVP(mPins);
-			ar & BOOST_SERIALIZATION_NVP(mOffEvent);
-			ar & BOOST_SERIALIZATION_NVP(mActiveLevel);
-			ar & BOOST_SERIALIZATION_NVP(mUseInternalPullup);
-			ar & BOOST_SERIALIZATION_NVP(mDebounceDelay);
+			ar & boost::serialization::make_nvp("numPins", mNumPins);
+			ar & boost::serialization::make_nvp("pins", mPins);
+			ar & boost::serialization::make_nvp("offEvent", mOffEvent);
+			ar & boost::serialization::make_nvp("activeLevel", mActiveLevel);
+			ar & boost::serialization::make_nvp("useInternalPullup", mUseInternalPullup);
+			ar & boost::serialization::make_nvp("debounceDelay", mDebounceDelay);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		uchar mNumPins;
 		vector<uchar> mPins;
@@ -51,6 +52,7 @@ class DigitalSwitchCreateEvent : public RemoteEvent {
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Serialization
 		/*bool serialize(Archive &ar) const
@@ -86,19 +88,21 @@ class DigitalSwitchEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mControlId);
-			ar & BOOST_SERIALIZATION_NVP(mActivePos);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("activePos", mActivePos);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		short mControlId;	// switch id, index to control array
 		uchar mActivePos;	// active switch position, index to pin array, off position is max+1
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Constructor / destructor
 		explicit DigitalSwitchEvent(int targetClientId);
@@ -121,21 +125,25 @@ class AnalogControlCreateEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mPin);
-			ar & BOOST_SERIALIZATION_NVP(mChangeThreshold);
-			ar & BOOST_SERIALIZATION_NVP(mInterval);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("pin", mPin);
+			ar & boost::serialization::make_nvp("changeThreshold", mChangeThreshold);
+			ar & boost::serialization::make_nvp("interval", mInterval);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
+		short mControlId;	// id the client reports the control's samples under
 		uchar mPin;
 		uchar mChangeThreshold;
 		short mInterval;
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Constructor / destructor
 		explicit AnalogControlCreateEvent(int targetClientId);
@@ -156,19 +164,24 @@ class AnalogControlEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mControlId);
-			ar & BOOST_SERIALIZATION_NVP(mRawValue);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("rawValue", mRawValue);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		short mControlId;	// switch id, index to control array
 		short mRawValue;	// value read from the pin, unmapped
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
+
+		uint64			coalesceKey() const { return controlKey(mControlId); }
+		void			coalesce(const Event &newer, CoalescePolicy policy);
 
 		// Constructor / destructor
 		explicit AnalogControlEvent(int targetClientId);
@@ -191,20 +204,23 @@ class EncoderCreateEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mPinA);
-			ar & BOOST_SERIALIZATION_NVP(mPinB);
-			ar & BOOST_SERIALIZATION_NVP(mInterruptNumber);
-			ar & BOOST_SERIALIZATION_NVP(mBits);
-			ar & BOOST_SERIALIZATION_NVP(mInterval);
-			ar & BOOST_SERIALIZATION_NVP(mGrayCode);
-			ar & BOOST_SERIALIZATION_NVP(mEncoderType);
-			ar & BOOST_SERIALIZATION_NVP(mUseInternalPullup);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("pinA", mPinA);
+			ar & boost::serialization::make_nvp("pinB", mPinB);
+			ar & boost::serialization::make_nvp("interruptNumber", mInterruptNumber);
+			ar & boost::serialization::make_nvp("bits", mBits);
+			ar & boost::serialization::make_nvp("interval", mInterval);
+			ar & boost::serialization::make_nvp("grayCode", mGrayCode);
+			ar & boost::serialization::make_nvp("encoderType", mEncoderType);
+			ar & boost::serialization::make_nvp("useInternalPullup", mUseInternalPullup);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
+		short mControlId;	// id the client reports the encoder's values under
 		uchar mPinA;
 		uchar mPinB;
 		uchar mInterruptNumber;
@@ -216,6 +232,7 @@ class EncoderCreateEvent : public RemoteEvent {
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Constructor / destructor
 		explicit EncoderCreateEvent(int targetClientId);
@@ -236,19 +253,36 @@ class EncoderEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mControlId);
-			ar & BOOST_SERIALIZATION_NVP(mValue);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("value", mValue);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		short mControlId;	// switch id, index to control array
 		short mValue;		// relative change or absolute value
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
+
+		uint64			coalesceKey() const { return controlKey(mControlId); }
+		/*---------------------------------------------------------------------
+			Adds up waiting values of an incremental encoder, saturating, the
+			latest value wins for an absolute one
+		---------------------------------------------------------------------*/
+		void			coalesce(const Event &newer, CoalescePolicy policy);
+
+		/*---------------------------------------------------------------------
+			The type each client's encoders were created with, recorded as the
+			createEncoder event is sent to the client. The samples don't carry
+			it. Encoders never created are taken as absolute.
+		---------------------------------------------------------------------*/
+		static void					setEncoderType(int clientId, short controlId, Encoder::EncoderType type);
+		static Encoder::EncoderType	encoderType(int clientId, short controlId);
 
 		// Constructor / destructor
 		explicit EncoderEvent(int targetClientId);
@@ -271,16 +305,17 @@ class KeyMatrixCreateEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mNumRows);
-			ar & BOOST_SERIALIZATION_NVP(mNumCols);
-			ar & BOOST_SERIALIZATION_NVP(mRowPins);
-			ar & BOOST_SERIALIZATION_NVP(mColPins);
-			ar & BOOST_SERIALIZATION_NVP(mDebounceDelay);
+			ar & boost::serialization::make_nvp("numRows", mNumRows);
+			ar & boost::serialization::make_nvp("numCols", mNumCols);
+			ar & boost::serialization::make_nvp("rowPins", mRowPins);
+			ar & boost::serialization::make_nvp("colPins", mColPins);
+			ar & boost::serialization::make_nvp("debounceDelay", mDebounceDelay);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		uchar mNumRows;
 		uchar mNumCols;
@@ -290,6 +325,7 @@ class KeyMatrixCreateEvent : public RemoteEvent {
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Constructor / destructor
 		explicit KeyMatrixCreateEvent(int targetClientId);
@@ -310,14 +346,15 @@ class KeyMatrixEvent : public RemoteEvent {
 		void serialize(Archive & ar, const unsigned int version)
 		{
 			ar & BOOST_SERIALIZATION_BASE_OBJECT_NVP(RemoteEvent);
-			ar & BOOST_SERIALIZATION_NVP(mControlId);
-			ar & BOOST_SERIALIZATION_NVP(mKeyIndex);
-			ar & BOOST_SERIALIZATION_NVP(mPosition);
+			ar & boost::serialization::make_nvp("controlId", mControlId);
+			ar & boost::serialization::make_nvp("keyIndex", mKeyIndex);
+			ar & boost::serialization::make_nvp("position", mPosition);
 		}
 
 	public:
 		///// VARIABLES /////
 		static const string sEventType;
+		static const EventTypeId sTypeId;
 
 		short mControlId;	// switch id, index to control array
 		short mKeyIndex;	// row * numRows + col
@@ -325,6 +362,7 @@ class KeyMatrixEvent : public RemoteEvent {
 
 		///// FUNCTIONS /////
 		const string &	type() const { return sEventType; }
+		EventTypeId		typeId() const { return sTypeId; }
 
 		// Constructor / destructor
 		explicit KeyMatrixEvent(int targetClientId);
@@ -19,3 +19,8 @@ DigitalSwitch::DigitalSwitch(short id, uchar numPins, const vector<uchar> &pins,
 	mActiveLevel(activeLevel), mUseInternalPullup(useInternalPullup),
 	mDebounceDelay(debounceDelay)
 {}
+
+// class AnalogControl
+AnalogControl::AnalogControl(short id, uchar pin, uchar changeThreshold, short interval) :
+	Control(id), mPin(pin), mChangeThreshold(changeThreshold), mInterval(interval)
+{}
@@ -53,6 +53,10 @@ class AnalogControl : public Control {
 
 	public:
 		// Functions
+		uchar pin() const				{ return mPin; }
+		uchar changeThreshold() const	{ return mChangeThreshold; }
+		short interval() const			{ return mInterval; }
+
 		explicit AnalogControl(short id, uchar pin, uchar changeThreshold = 1, short interval = 50);
 		~AnalogControl() {}
 };
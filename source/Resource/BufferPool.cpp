@@ -0,0 +1,315 @@
+/*----==== BUFFERPOOL.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+--------------------------------*/
+
+#include <Windows.h>
+#include "BufferPool.h"
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <boost/thread/mutex.hpp>
+#include <boost/checked_delete.hpp>
+
+using std::vector;
+using boost::checked_array_deleter;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+struct SizeClass
+	Free list and slabs of one block size, only touched under mMutex
+=============================================================================*/
+struct SizeClass : private boost::noncopyable {
+	boost::mutex	mMutex;
+	char *			mFreeList;	// free blocks, linked through their first bytes
+	vector<char *>	mSlabs;
+	uint			mBlockSize;
+	uint			mInUse;
+
+	explicit SizeClass() : mFreeList(0), mBlockSize(0), mInUse(0) {}
+};
+
+/*=============================================================================
+class SlabPool
+	The one pool behind the static BufferPool interface
+=============================================================================*/
+class SlabPool : private boost::noncopyable {
+	public:
+		///// VARIABLES /////
+		SizeClass		mClasses[BufferPool::sNumClasses];
+		volatile long	mLargeBytes;
+		volatile long	mLargeBuffers;
+
+		///// FUNCTIONS /////
+		/*---------------------------------------------------------------------
+			Returns the index of the smallest class holding blockSize bytes,
+			or sNumClasses if the block is too large to pool
+		---------------------------------------------------------------------*/
+		uint	classIndex(uint blockSize) const {
+					for (uint c = 0; c < BufferPool::sNumClasses; ++c) {
+						if (blockSize <= mClasses[c].mBlockSize) { return c; }
+					}
+					return BufferPool::sNumClasses;
+				}
+
+		char *	acquire(uint c);
+		void	release(char *block, uint c);
+		uint64	trim(uint c);
+
+		explicit SlabPool();
+		~SlabPool();
+};
+
+/*=============================================================================
+class BlockAllocator
+	Allocator given to the shared_ptr of a pooled buffer. The one allocation
+	it is asked for is the control block, which goes in the space reserved at
+	the tail of the buffer's own block. The control block is deallocated only
+	after the deleter has run and the weak count has dropped, so that is when
+	the whole block goes back to its free list.
+=============================================================================*/
+template <typename T>
+class BlockAllocator {
+	public:
+		///// DEFINITIONS /////
+		typedef T				value_type;
+		typedef T *				pointer;
+		typedef const T *		const_pointer;
+		typedef T &				reference;
+		typedef const T &		const_reference;
+		typedef size_t			size_type;
+		typedef ptrdiff_t		difference_type;
+
+		template <typename U>
+		struct rebind { typedef BlockAllocator<U> other; };
+
+		///// VARIABLES /////
+		SlabPool *	mPool;
+		char *		mBlock;
+		uint		mClass;
+		uint		mControlOffset;	// where the control block goes within mBlock
+
+		///// FUNCTIONS /////
+		pointer		allocate(size_type n, const void * = 0) {
+						_ASSERTE(n * sizeof(T) <= BufferPool::sControlBlockSize && "control block too large for reserved space");
+						return reinterpret_cast<pointer>(mBlock + mControlOffset);
+					}
+		void		deallocate(pointer, size_type) { mPool->release(mBlock, mClass); }
+
+		void		construct(pointer p, const T &val)	{ new(static_cast<void *>(p)) T(val); }
+		void		destroy(pointer p)					{ p->~T(); }
+		size_type	max_size() const					{ return 1; }
+		pointer		address(reference r) const			{ return &r; }
+		const_pointer address(const_reference r) const	{ return &r; }
+
+		template <typename U>
+		bool operator==(const BlockAllocator<U> &a) const { return mBlock == a.mBlock; }
+		template <typename U>
+		bool operator!=(const BlockAllocator<U> &a) const { return mBlock != a.mBlock; }
+
+		// Constructors
+		explicit BlockAllocator(SlabPool *pool, char *block, uint c, uint controlOffset) :
+			mPool(pool), mBlock(block), mClass(c), mControlOffset(controlOffset)
+		{}
+		template <typename U>
+		BlockAllocator(const BlockAllocator<U> &a) :
+			mPool(a.mPool), mBlock(a.mBlock), mClass(a.mClass), mControlOffset(a.mControlOffset)
+		{}
+};
+
+/*=============================================================================
+struct PooledDeleter
+	The buffer lives in the same block as the control block, the block is
+	freed by BlockAllocator::deallocate instead
+=============================================================================*/
+struct PooledDeleter {
+	void operator()(char *) const {}
+};
+
+/*=============================================================================
+struct LargeDeleter
+	Frees a heap allocated buffer and takes it out of the pool's totals
+=============================================================================*/
+struct LargeDeleter {
+	uint	mResidentB;
+	void operator()(char *p) const;
+};
+
+///// VARIABLES /////
+
+static SlabPool sPool;
+
+///// FUNCTIONS /////
+
+static uint alignUp(uint sizeB, uint alignment)
+{
+	return (sizeB + alignment - 1) & ~(alignment - 1);
+}
+
+// size of the block holding sizeB of data followed by the control block
+static uint blockSizeFor(uint sizeB)
+{
+	return alignUp(sizeB, 16) + BufferPool::sControlBlockSize;
+}
+
+void LargeDeleter::operator()(char *p) const
+{
+	delete [] p;
+	InterlockedExchangeAdd(&sPool.mLargeBytes, -(long)mResidentB);
+	InterlockedDecrement(&sPool.mLargeBuffers);
+}
+
+////////// class SlabPool //////////
+
+char * SlabPool::acquire(uint c)
+{
+	SizeClass &sc = mClasses[c];
+	boost::mutex::scoped_lock lock(sc.mMutex);
+	if (!sc.mFreeList) {
+		// carve a new slab into blocks
+		char *slab = new char[BufferPool::sSlabSize];
+		sc.mSlabs.push_back(slab);
+		uint numBlocks = BufferPool::sSlabSize / sc.mBlockSize;
+		for (uint b = numBlocks; b > 0; --b) {
+			char *block = slab + (b-1) * sc.mBlockSize;
+			*reinterpret_cast<char **>(block) = sc.mFreeList;
+			sc.mFreeList = block;
+		}
+	}
+	char *block = sc.mFreeList;
+	sc.mFreeList = *reinterpret_cast<char **>(block);
+	++sc.mInUse;
+	return block;
+}
+
+void SlabPool::release(char *block, uint c)
+{
+	SizeClass &sc = mClasses[c];
+	boost::mutex::scoped_lock lock(sc.mMutex);
+	*reinterpret_cast<char **>(block) = sc.mFreeList;
+	sc.mFreeList = block;
+	--sc.mInUse;
+}
+
+uint64 SlabPool::trim(uint c)
+{
+	SizeClass &sc = mClasses[c];
+	boost::mutex::scoped_lock lock(sc.mMutex);
+	if (!sc.mFreeList) { return 0; }
+
+	// count the free blocks of each slab, slabs sorted by address to find a block's slab
+	std::sort(sc.mSlabs.begin(), sc.mSlabs.end());
+	uint blocksPerSlab = BufferPool::sSlabSize / sc.mBlockSize;
+	vector<uint> numFree(sc.mSlabs.size(), 0);
+	for (char *block = sc.mFreeList; block; block = *reinterpret_cast<char **>(block)) {
+		++numFree[std::upper_bound(sc.mSlabs.begin(), sc.mSlabs.end(), block) - sc.mSlabs.begin() - 1];
+	}
+
+	// unlink the blocks of slabs that are entirely free, then free those slabs
+	char **link = &sc.mFreeList;
+	while (*link) {
+		char *block = *link;
+		size_t s = std::upper_bound(sc.mSlabs.begin(), sc.mSlabs.end(), block) - sc.mSlabs.begin() - 1;
+		if (numFree[s] == blocksPerSlab) {
+			*link = *reinterpret_cast<char **>(block);
+		} else {
+			link = reinterpret_cast<char **>(block);
+		}
+	}
+	uint64 freedB = 0;
+	size_t kept = 0;
+	for (size_t s = 0; s < sc.mSlabs.size(); ++s) {
+		if (numFree[s] == blocksPerSlab) {
+			delete [] sc.mSlabs[s];
+			freedB += BufferPool::sSlabSize;
+		} else {
+			sc.mSlabs[kept++] = sc.mSlabs[s];
+		}
+	}
+	sc.mSlabs.resize(kept);
+	return freedB;
+}
+
+SlabPool::SlabPool() :
+	mLargeBytes(0), mLargeBuffers(0)
+{
+	// powers of two and the midpoints between them
+	uint size = BufferPool::sMinClassSize;
+	for (uint c = 0; c < BufferPool::sNumClasses; c += 2) {
+		mClasses[c].mBlockSize = size;
+		if (c+1 < BufferPool::sNumClasses) {
+			mClasses[c+1].mBlockSize = size + size / 2;
+		}
+		size *= 2;
+	}
+	_ASSERTE(mClasses[BufferPool::sNumClasses-1].mBlockSize == BufferPool::sMaxPooledSize && "size class table mismatch");
+}
+
+SlabPool::~SlabPool()
+{
+	for (uint c = 0; c < BufferPool::sNumClasses; ++c) {
+		if (mClasses[c].mInUse > 0) {
+			debugPrintf("BufferPool: %u buffers of %u bytes still in use at shutdown\n",
+						mClasses[c].mInUse, mClasses[c].mBlockSize);
+		}
+		for (size_t s = 0; s < mClasses[c].mSlabs.size(); ++s) {
+			delete [] mClasses[c].mSlabs[s];
+		}
+	}
+}
+
+////////// class BufferPool //////////
+
+BufferPtr BufferPool::allocate(uint sizeB)
+{
+	if (sizeB == 0) { return BufferPtr(); }
+
+	uint c = sPool.classIndex(blockSizeFor(sizeB));
+	if (c < sNumClasses) {
+		char *block = sPool.acquire(c);
+		uint controlOffset = alignUp(sizeB, 16);
+		return BufferPtr(block, PooledDeleter(), BlockAllocator<char>(&sPool, block, c, controlOffset));
+	}
+
+	LargeDeleter d = { residentSize(sizeB) };
+	BufferPtr bPtr(new char[sizeB], d);
+	InterlockedExchangeAdd(&sPool.mLargeBytes, (long)d.mResidentB);
+	InterlockedIncrement(&sPool.mLargeBuffers);
+	return bPtr;
+}
+
+uint BufferPool::residentSize(uint sizeB)
+{
+	if (sizeB == 0) { return 0; }
+	uint c = sPool.classIndex(blockSizeFor(sizeB));
+	if (c < sNumClasses) {
+		return sPool.mClasses[c].mBlockSize;
+	}
+	// large allocations are page granular, plus a separate control block
+	return alignUp(sizeB, sPageSize) + sControlBlockSize;
+}
+
+uint64 BufferPool::trim()
+{
+	uint64 freedB = 0;
+	for (uint c = 0; c < sNumClasses; ++c) {
+		freedB += sPool.trim(c);
+	}
+	return freedB;
+}
+
+void BufferPool::getStats(Stats &outStats)
+{
+	memset(&outStats, 0, sizeof(outStats));
+	for (uint c = 0; c < sNumClasses; ++c) {
+		SizeClass &sc = sPool.mClasses[c];
+		boost::mutex::scoped_lock lock(sc.mMutex);
+		outStats.mSlabBytes += (uint64)sc.mSlabs.size() * sSlabSize;
+		outStats.mPooledBytesInUse += (uint64)sc.mInUse * sc.mBlockSize;
+		outStats.mPooledBuffers += sc.mInUse;
+	}
+	outStats.mLargeBytes = (uint)sPool.mLargeBytes;
+	outStats.mLargeBuffers = (uint)sPool.mLargeBuffers;
+}
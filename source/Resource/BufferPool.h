@@ -0,0 +1,80 @@
+/*----==== BUFFERPOOL.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Size-classed slab pools for the raw data buffers of resources. Sources
+		allocate their buffers here instead of with new char[], so many small
+		files don't fragment the heap, and so the caches can charge what a
+		buffer really occupies rather than the bytes requested.
+-------------------------------*/
+
+#pragma once
+
+#include <memory>
+#include <boost/noncopyable.hpp>
+#include "../Utility/Typedefs.h"
+
+using std::shared_ptr;
+
+///// DEFINITIONS /////
+
+typedef shared_ptr<char>	BufferPtr;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class BufferPool
+	Buffers up to sMaxPooledSize are carved from sSlabSize slabs, one free list
+	per size class, with classes spaced at powers of two and the midpoints
+	between them so no more than a third of a block is wasted. The shared_ptr
+	control block is placed in the tail of the same block, so a pooled buffer
+	is a single allocation, returned to its free list once the last BufferPtr
+	(and weak_ptr) is released. Slabs are kept for reuse until trim releases
+	the ones with no block in use, or until shutdown. Larger buffers are
+	allocated from the heap, where they are page granular. All functions may
+	be called from any thread.
+=============================================================================*/
+class BufferPool : private boost::noncopyable {
+	public:
+		///// DEFINITIONS /////
+		static const uint sMinClassSize		= 128;
+		static const uint sMaxPooledSize	= 64 * 1024;	// largest block size of a class
+		static const uint sNumClasses		= 19;			// 128, 192, 256, 384 ... 48K, 64K
+		static const uint sSlabSize			= 256 * 1024;
+		static const uint sControlBlockSize	= 64;			// reserved for the shared_ptr control block
+		static const uint sPageSize			= 4096;
+
+		/*=====================================================================
+		struct Stats
+		=====================================================================*/
+		struct Stats {
+			uint64	mSlabBytes;			// reserved by all slabs, pooled memory resident in the process
+			uint64	mPooledBytesInUse;	// blocks currently handed out
+			uint	mPooledBuffers;
+			uint64	mLargeBytes;		// resident size of live heap allocated buffers
+			uint	mLargeBuffers;
+		};
+
+		///// FUNCTIONS /////
+		/*---------------------------------------------------------------------
+			Returns a buffer of at least sizeB bytes, empty if sizeB is 0 or
+			the allocation failed.
+		---------------------------------------------------------------------*/
+		static BufferPtr	allocate(uint sizeB);
+
+		/*---------------------------------------------------------------------
+			Returns the bytes a buffer of sizeB actually occupies, including
+			the rounding of its size class and its control block. This is what
+			the caches charge against their budgets.
+		---------------------------------------------------------------------*/
+		static uint			residentSize(uint sizeB);
+
+		/*---------------------------------------------------------------------
+			Frees every slab none of whose blocks are in use, so memory given
+			back by the caches leaves the process. Returns the bytes freed.
+		---------------------------------------------------------------------*/
+		static uint64		trim();
+
+		static void			getStats(Stats &outStats);
+};
@@ -0,0 +1,264 @@
+/*----==== EVICTIONPOLICY.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+------------------------------------*/
+
+#include "EvictionPolicy.h"
+#include <algorithm>
+
+////////// class ResCacheEntryList //////////
+
+void ResCacheEntryList::pushFront(ResCacheEntry *e)
+{
+	e->mPrev = 0;
+	e->mNext = mHead;
+	if (mHead) { mHead->mPrev = e; }
+	else { mTail = e; }
+	mHead = e;
+	++mSize;
+}
+
+void ResCacheEntryList::insertBefore(ResCacheEntry *pos, ResCacheEntry *e)
+{
+	if (pos == mHead) {
+		pushFront(e);
+		return;
+	}
+	e->mPrev = pos->mPrev;
+	e->mNext = pos;
+	pos->mPrev->mNext = e;
+	pos->mPrev = e;
+	++mSize;
+}
+
+void ResCacheEntryList::unlink(ResCacheEntry *e)
+{
+	if (e->mPrev) { e->mPrev->mNext = e->mNext; }
+	else { mHead = e->mNext; }
+	if (e->mNext) { e->mNext->mPrev = e->mPrev; }
+	else { mTail = e->mPrev; }
+	e->mPrev = e->mNext = 0;
+	--mSize;
+}
+
+////////// class IEvictionPolicy //////////
+
+EvictionPolicyPtr IEvictionPolicy::create(ResCachePolicy policy)
+{
+	switch (policy) {
+		case ResCachePolicy_Clock:		return EvictionPolicyPtr(new ClockPolicy());
+		case ResCachePolicy_TinyLFU:	return EvictionPolicyPtr(new TinyLFUPolicy());
+		default:						return EvictionPolicyPtr(new LRUPolicy());
+	}
+}
+
+ResCachePolicy IEvictionPolicy::policyFromString(const string &name)
+{
+	string lower(name);
+	std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+	if (lower == "clock")	{ return ResCachePolicy_Clock; }
+	if (lower == "tinylfu")	{ return ResCachePolicy_TinyLFU; }
+	if (!lower.empty() && lower != "lru") {
+		debugPrintf("IEvictionPolicy: unknown policy \"%s\", using LRU\n", name.c_str());
+	}
+	return ResCachePolicy_LRU;
+}
+
+////////// class ClockPolicy //////////
+
+void ClockPolicy::onInsert(ResCacheEntry *e)
+{
+	e->mReferenced = false;
+	if (!mHand) {
+		mRing.pushFront(e);
+		mHand = e;
+	} else {
+		mRing.insertBefore(mHand, e);
+	}
+}
+
+void ClockPolicy::onRemove(ResCacheEntry *e)
+{
+	if (e == mHand) {
+		mHand = (mRing.size() > 1 ? next(e) : 0);
+	}
+	mRing.unlink(e);
+}
+
+/*---------------------------------------------------------------------
+	Sweeps the hand forward clearing reference bits until an entry
+	without one is found, at most two full turns of the ring
+---------------------------------------------------------------------*/
+ResCacheEntry * ClockPolicy::selectVictim()
+{
+	if (!mHand) { return 0; }
+	while (mHand->mReferenced) {
+		mHand->mReferenced = false;
+		mHand = next(mHand);
+	}
+	return mHand;
+}
+
+////////// class FrequencySketch //////////
+
+uint FrequencySketch::index(uint hash, uint row)
+{
+	static const uint seeds[sDepth] = { 0x9E3779B1U, 0x85EBCA77U, 0xC2B2AE3DU, 0x27D4EB2FU };
+	uint h = (hash ^ (hash >> 16)) * seeds[row];
+	return row * sWidth + (h >> (32 - sWidthBits));
+}
+
+void FrequencySketch::age()
+{
+	for (size_t c = 0; c < mCounters.size(); ++c) {
+		mCounters[c] >>= 1;
+	}
+	mSamples /= 2;
+}
+
+void FrequencySketch::increment(uint hash)
+{
+	for (uint r = 0; r < sDepth; ++r) {
+		uchar &c = mCounters[index(hash, r)];
+		if (c < 15) { ++c; }
+	}
+	if (++mSamples >= sSampleLimit) { age(); }
+}
+
+uint FrequencySketch::frequency(uint hash) const
+{
+	uint f = 15;
+	for (uint r = 0; r < sDepth; ++r) {
+		f = std::min(f, (uint)mCounters[index(hash, r)]);
+	}
+	return f;
+}
+
+void FrequencySketch::clear()
+{
+	std::fill(mCounters.begin(), mCounters.end(), (uchar)0);
+	mSamples = 0;
+}
+
+FrequencySketch::FrequencySketch() :
+	mCounters(sDepth * sWidth, 0), mSamples(0)
+{}
+
+////////// class TinyLFUPolicy //////////
+
+ResCacheEntryList & TinyLFUPolicy::segmentList(ResCacheEntry *e)
+{
+	switch (e->mSegment) {
+		case Segment_Probation:	return mProbation;
+		case Segment_Protected:	return mProtected;
+		case Segment_Candidate:	return mCandidates;
+		default:				return mWindow;
+	}
+}
+
+uint TinyLFUPolicy::windowTarget() const
+{
+	uint total = mWindow.size() + mProbation.size() + mProtected.size() + mCandidates.size();
+	return std::max(total / 100, 1U);
+}
+
+uint TinyLFUPolicy::protectedTarget() const
+{
+	return (mProbation.size() + mProtected.size()) * 4 / 5;
+}
+
+/*---------------------------------------------------------------------
+	Moves an entry out of the window or the candidates into probation
+---------------------------------------------------------------------*/
+void TinyLFUPolicy::admit(ResCacheEntry *e)
+{
+	segmentList(e).unlink(e);
+	e->mSegment = Segment_Probation;
+	mProbation.pushFront(e);
+}
+
+void TinyLFUPolicy::onInsert(ResCacheEntry *e)
+{
+	e->mSegment = Segment_Window;
+	mWindow.pushFront(e);
+	while (mWindow.size() > windowTarget()) {
+		ResCacheEntry *overflow = mWindow.tail();
+		if (!mEvicting) {
+			admit(overflow);	// the main area still has room
+		} else {
+			mWindow.unlink(overflow);
+			overflow->mSegment = Segment_Candidate;
+			mCandidates.pushFront(overflow);
+		}
+	}
+}
+
+void TinyLFUPolicy::onHit(ResCacheEntry *e)
+{
+	mSketch.increment(e->mHash);
+	switch (e->mSegment) {
+		case Segment_Candidate:
+			admit(e);	// used again before its turn came, it has earned a place
+			break;
+		case Segment_Probation: {
+			// second hit while in the main area, promote to protected
+			mProbation.unlink(e);
+			e->mSegment = Segment_Protected;
+			mProtected.pushFront(e);
+			if (mProtected.size() > protectedTarget()) {
+				ResCacheEntry *demoted = mProtected.tail();
+				mProtected.unlink(demoted);
+				demoted->mSegment = Segment_Probation;
+				mProbation.pushFront(demoted);
+			}
+			break;
+		}
+		default:
+			segmentList(e).moveToFront(e);
+	}
+}
+
+void TinyLFUPolicy::onRemove(ResCacheEntry *e)
+{
+	segmentList(e).unlink(e);
+}
+
+/*---------------------------------------------------------------------
+	The oldest candidate is compared against the main area's victim and
+	only admitted to the main area if it has been seen more often, ties
+	go against the candidate so a one-time scan never displaces anything.
+	Candidates are admitted freely while the main area is empty. With no
+	candidates, the main area is evicted from directly, probation first,
+	and the window last.
+---------------------------------------------------------------------*/
+ResCacheEntry * TinyLFUPolicy::selectVictim()
+{
+	mEvicting = true;
+	for (;;) {
+		ResCacheEntry *mainVictim = (mProbation.tail() ? mProbation.tail() : mProtected.tail());
+		ResCacheEntry *candidate = mCandidates.tail();
+		if (!candidate) {
+			return (mainVictim ? mainVictim : mWindow.tail());
+		}
+		if (!mainVictim) {
+			admit(candidate);
+			continue;
+		}
+		if (mSketch.frequency(candidate->mHash) > mSketch.frequency(mainVictim->mHash)) {
+			admit(candidate);	// the main area's victim goes instead
+			return mainVictim;
+		}
+		return candidate;
+	}
+}
+
+void TinyLFUPolicy::clear()
+{
+	mWindow.clear();
+	mProbation.clear();
+	mProtected.clear();
+	mCandidates.clear();
+	mSketch.clear();
+	mEvicting = false;
+}
@@ -0,0 +1,242 @@
+/*----==== EVICTIONPOLICY.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Eviction policies used by the shards of ResCache. Each shard owns one
+		policy instance and only calls into it while holding the shard lock,
+		so the policies themselves do no synchronization. Policies maintain
+		their own ordering over the intrusive ResCacheEntry links and choose
+		the next victim when the cache needs room.
+
+		LRU		- the original behavior, every hit moves the entry to the front
+		Clock	- second chance, a hit only sets a reference bit (no relinking)
+		TinyLFU	- W-TinyLFU, a small LRU admission window in front of a
+				  segmented LRU main area, with a count-min sketch deciding
+				  whether the window's victim displaces the main area's
+				  victim. Resists one-time scans flushing frequently used
+				  resources.
+----------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <boost/noncopyable.hpp>
+#include "../Utility/Typedefs.h"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+///// DEFINITIONS /////
+
+/*=============================================================================
+	Selects the eviction policy of a ResCache
+=============================================================================*/
+enum ResCachePolicy : uchar {
+	ResCachePolicy_LRU = 0,
+	ResCachePolicy_Clock,
+	ResCachePolicy_TinyLFU,
+	ResCachePolicy_MAX
+};
+
+class Resource;
+class IEvictionPolicy;
+typedef shared_ptr<Resource>		ResPtr;
+typedef shared_ptr<IEvictionPolicy>	EvictionPolicyPtr;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+struct ResCacheEntry
+	Stored by value in a shard's hash map (node-based, so the address is
+	stable until erased). The links and bookkeeping fields belong to the
+	shard's eviction policy.
+=============================================================================*/
+struct ResCacheEntry {
+	ResPtr			mResPtr;
+	string			mSource;		// source the resource was loaded from, empty if injected
+	uint			mHits;			// cache hits since the entry was added, recorded in the warm-up manifest
+	ResCacheEntry *	mPrev;			// toward the list head
+	ResCacheEntry *	mNext;			// toward the list tail
+	uint			mHash;			// unmixed key hash, used by the frequency sketch
+	uchar			mSegment;		// list the entry belongs to, for policies with more than one
+	bool			mReferenced;	// reference bit for the Clock policy
+
+	explicit ResCacheEntry() :
+		mResPtr(), mSource(), mHits(0), mPrev(0), mNext(0), mHash(0), mSegment(0), mReferenced(false)
+	{}
+};
+
+/*=============================================================================
+class ResCacheEntryList
+	Intrusive doubly linked list over ResCacheEntry, head is the most recent
+=============================================================================*/
+class ResCacheEntryList {
+	private:
+		ResCacheEntry *	mHead;
+		ResCacheEntry *	mTail;
+		uint			mSize;
+
+	public:
+		void	pushFront(ResCacheEntry *e);
+		void	insertBefore(ResCacheEntry *pos, ResCacheEntry *e);
+		void	unlink(ResCacheEntry *e);
+		void	moveToFront(ResCacheEntry *e) { if (e != mHead) { unlink(e); pushFront(e); } }
+		void	clear() { mHead = mTail = 0; mSize = 0; }
+
+		// Accessors
+		ResCacheEntry *	head() const	{ return mHead; }
+		ResCacheEntry *	tail() const	{ return mTail; }
+		uint			size() const	{ return mSize; }
+		bool			empty() const	{ return (mSize == 0); }
+
+		explicit ResCacheEntryList() : mHead(0), mTail(0), mSize(0) {}
+};
+
+/*=============================================================================
+class IEvictionPolicy
+=============================================================================*/
+class IEvictionPolicy : private boost::noncopyable {
+	public:
+		virtual void	onInsert(ResCacheEntry *e) = 0;
+		virtual void	onHit(ResCacheEntry *e) = 0;
+		virtual void	onMiss(uint hash) {}
+		/*---------------------------------------------------------------------
+			Called before the entry is erased, whether it was chosen by
+			selectVictim or removed explicitly
+		---------------------------------------------------------------------*/
+		virtual void	onRemove(ResCacheEntry *e) = 0;
+		/*---------------------------------------------------------------------
+			Returns the entry that should be evicted next, or 0 if empty. The
+			entry is not removed, the caller follows up with onRemove.
+		---------------------------------------------------------------------*/
+		virtual ResCacheEntry *	selectVictim() = 0;
+		virtual void	clear() = 0;
+
+		/*---------------------------------------------------------------------
+			Creates a new policy instance of the given type
+		---------------------------------------------------------------------*/
+		static EvictionPolicyPtr	create(ResCachePolicy policy);
+
+		/*---------------------------------------------------------------------
+			Parses the policy name used in app.config ("lru", "clock" or
+			"tinylfu"), returns LRU for anything unrecognized
+		---------------------------------------------------------------------*/
+		static ResCachePolicy		policyFromString(const string &name);
+
+		virtual ~IEvictionPolicy() {}
+};
+
+/*=============================================================================
+class LRUPolicy
+=============================================================================*/
+class LRUPolicy : public IEvictionPolicy {
+	private:
+		ResCacheEntryList	mLRU;
+
+	public:
+		void	onInsert(ResCacheEntry *e)	{ mLRU.pushFront(e); }
+		void	onHit(ResCacheEntry *e)		{ mLRU.moveToFront(e); }
+		void	onRemove(ResCacheEntry *e)	{ mLRU.unlink(e); }
+		ResCacheEntry *	selectVictim()		{ return mLRU.tail(); }
+		void	clear()						{ mLRU.clear(); }
+};
+
+/*=============================================================================
+class ClockPolicy
+	The list is treated as a ring with the hand moving from head to tail.
+	New entries are inserted just behind the hand so they are visited last.
+=============================================================================*/
+class ClockPolicy : public IEvictionPolicy {
+	private:
+		ResCacheEntryList	mRing;
+		ResCacheEntry *		mHand;
+
+		ResCacheEntry *	next(ResCacheEntry *e) const { return (e->mNext ? e->mNext : mRing.head()); }
+
+	public:
+		void	onInsert(ResCacheEntry *e);
+		void	onHit(ResCacheEntry *e)		{ e->mReferenced = true; }
+		void	onRemove(ResCacheEntry *e);
+		ResCacheEntry *	selectVictim();
+		void	clear()						{ mRing.clear(); mHand = 0; }
+
+		explicit ClockPolicy() : mHand(0) {}
+};
+
+/*=============================================================================
+class FrequencySketch
+	Count-min sketch of 4 rows with saturating counters (max 15). All
+	counters are halved once the number of samples reaches 10x the row
+	width, so the popularity estimate ages out over time.
+=============================================================================*/
+class FrequencySketch {
+	public:
+		static const uint sDepth = 4;
+		static const uint sWidthBits = 11;
+		static const uint sWidth = 1 << sWidthBits;
+		static const uint sSampleLimit = sWidth * 10;
+
+	private:
+		vector<uchar>	mCounters;	// sDepth rows of sWidth counters
+		uint			mSamples;
+
+		static uint	index(uint hash, uint row);
+		void		age();
+
+	public:
+		void	increment(uint hash);
+		uint	frequency(uint hash) const;
+		void	clear();
+
+		explicit FrequencySketch();
+};
+
+/*=============================================================================
+class TinyLFUPolicy
+	Window is sized to 1% of the entries and the protected segment to 80% of
+	the main area. The policy doesn't know the cache's budget, so until the
+	first victim is asked for, the main area is taken to have room and the
+	window's overflow goes straight to probation. After that, overflow waits
+	as a candidate, and the next victim is chosen between the oldest
+	candidate and the main area's victim by estimated frequency: the
+	candidate is admitted to probation only if it has been seen more often,
+	otherwise it is the one evicted. A candidate hit before then is admitted.
+=============================================================================*/
+class TinyLFUPolicy : public IEvictionPolicy {
+	private:
+		///// DEFINITIONS /////
+		enum Segment : uchar {
+			Segment_Window = 0,
+			Segment_Probation,
+			Segment_Protected,
+			Segment_Candidate	// window overflow waiting for admission
+		};
+
+		///// VARIABLES /////
+		ResCacheEntryList	mWindow;
+		ResCacheEntryList	mProbation;
+		ResCacheEntryList	mProtected;
+		ResCacheEntryList	mCandidates;
+		FrequencySketch		mSketch;
+		bool				mEvicting;	// a victim has been asked for, the main area is full
+
+		///// FUNCTIONS /////
+		ResCacheEntryList &	segmentList(ResCacheEntry *e);
+		uint	windowTarget() const;
+		uint	protectedTarget() const;
+		void	admit(ResCacheEntry *e);
+
+	public:
+		void	onInsert(ResCacheEntry *e);
+		void	onHit(ResCacheEntry *e);
+		void	onMiss(uint hash)	{ mSketch.increment(hash); }
+		void	onRemove(ResCacheEntry *e);
+		ResCacheEntry *	selectVictim();
+		void	clear();
+
+		explicit TinyLFUPolicy() : mEvicting(false) {}
+};
@@ -4,10 +4,30 @@
 --------------------------------------*/
 
 #include "FileSystemSource.h"
-#include <fstream>
+#include <climits>
 
 using namespace std;
 
+////////// class FileStream //////////
+bool FileStream::open(const string &path)
+{
+	mFile.open(path, ios::binary);
+	if (!mFile.is_open()) { return false; }
+
+	streamoff size = mFile.rdbuf()->pubseekoff(0, ios::end, ios::in);
+	mFile.rdbuf()->pubseekpos(0, ios::in);
+	if (size <= 0 || size > INT_MAX) { return false; }
+	mSize = (int)size;
+	return true;
+}
+
+int FileStream::read(char *buffer, int maxSize)
+{
+	if (maxSize <= 0) { return 0; }
+	streamsize n = mFile.rdbuf()->sgetn(buffer, maxSize);
+	return (int)n;
+}
+
 ////////// class FileSystemSource //////////
 bool FileSystemSource::open()
 {
@@ -15,7 +35,7 @@ bool FileSystemSource::open()
 	return true;
 }
 
-int FileSystemSource::loadResourceFile(const string &resName, BufferPtr &dataPtr, int loadData) const
+string FileSystemSource::fullPath(const string &resName) const
 {
 	// get relative path of file
 	string relPath(mRootPath);
@@ -24,6 +44,12 @@ int FileSystemSource::loadResourceFile(const string &resName, BufferPtr &dataPtr
 		relPath.append("\\");
 	}
 	relPath.append(resName);
+	return relPath;
+}
+
+int FileSystemSource::loadResourceFile(const string &resName, BufferPtr &dataPtr, int loadData) const
+{
+	string relPath(fullPath(resName));
 
 	// open file for loading
 	ifstream ifs(relPath, ios::binary);
@@ -36,7 +62,7 @@ int FileSystemSource::loadResourceFile(const string &resName, BufferPtr &dataPtr
 		// without actually loading the buffer
 		if (loadData != 0) {
 			// construct new buffer
-			BufferPtr bPtr(new char[size], checked_array_deleter<char>());
+			BufferPtr bPtr(BufferPool::allocate(size));
 			dataPtr = bPtr;
 			// read the data
 			ifs.rdbuf()->sgetn(dataPtr.get(), size);
@@ -61,4 +87,15 @@ int FileSystemSource::getResourceSize(const string &resName) const
 int FileSystemSource::getResource(const string &resName, BufferPtr &dataPtr, int threadIndex)
 {
 	return loadResourceFile(resName, dataPtr, 1);
+}
+
+/*---------------------------------------------------------------------
+	Reads the file in chunks as the stream is read instead of loading
+	it whole
+---------------------------------------------------------------------*/
+ResStreamPtr FileSystemSource::openStream(const string &resName)
+{
+	shared_ptr<FileStream> streamPtr(new FileStream());
+	if (!streamPtr->open(fullPath(resName))) { return ResStreamPtr(); }
+	return streamPtr;
 }
\ No newline at end of file
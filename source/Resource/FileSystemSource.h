@@ -6,13 +6,36 @@
 #pragma once
 
 #include <string>
+#include <fstream>
 #include "ResCache.h"
 
+using std::ifstream;
+
+/*=============================================================================
+class FileStream
+	Reads a file on disk incrementally, see IResourceStream
+=============================================================================*/
+class FileStream : public IResourceStream {
+	private:
+		ifstream	mFile;
+		int			mSize;
+
+	public:
+		virtual int		read(char *buffer, int maxSize);
+		virtual int		size() const	{ return mSize; }
+
+		bool	open(const string &path);
+
+		explicit FileStream() : IResourceStream(), mSize(0) {}
+};
+
 class FileSystemSource : public IResourceSource {
 	private:
 		///// VARIABLES /////
 		string mRootPath;		// relative path to the root (also want to support full path)
 
+		string fullPath(const string &resName) const;
+
 		int loadResourceFile(const string &resName, BufferPtr &dataPtr, int loadData) const;
 
 	public:
@@ -26,6 +49,7 @@ class FileSystemSource : public IResourceSource {
 			Returns a new index, or -1 on error.
 		---------------------------------------------------------------------*/
 		virtual int getNewThreadIndex() { return 0; } // function is not neccessary in this implementation
+		virtual ResStreamPtr openStream(const string &resName);
 
 		// Constructor / destructor
 		explicit FileSystemSource(const string &rootPath) :
@@ -4,50 +4,109 @@
 	Rev.Date:	09/24/2011
 ------------------------------*/
 
+#include <Windows.h>
 #include "ResCache.h"
+#include <sstream>
+#include <fstream>
+#include <algorithm>
 #include "ResourceProcess.h"
-#include "../Event/EventManager.h"
+
+////////// class BufferedResourceStream //////////
+
+int BufferedResourceStream::read(char *buffer, int maxSize)
+{
+	int n = std::min(maxSize, mSize - mPosition);
+	if (n <= 0) { return 0; }
+	memcpy(buffer, mDataPtr.get() + mPosition, n);
+	mPosition += n;
+	return n;
+}
+
+////////// class IResourceSource //////////
+
+ResStreamPtr IResourceSource::openStream(const string &resName)
+{
+	BufferPtr dataPtr((char *)0);
+	int size = getResource(resName, dataPtr);
+	if (size <= 0) { return ResStreamPtr(); }
+	return ResStreamPtr(new BufferedResourceStream(dataPtr, size));
+}
 
 ////////// class ResCache //////////
 
 /*---------------------------------------------------------------------
-	Calls freeOneResource until new request can fit, returns false when
-	request is too large for cache
+	Picks a shard from the high bits of the mixed key hash, the low bits
+	are left for bucket selection within the shard's own hash map
 ---------------------------------------------------------------------*/
-bool ResCache::makeRoom(uint sizeB)
+uint ResCache::shardIndex(uint hash)
 {
-	debugPrintf("size requested %u is larger than max cache size %u\n", sizeB, mMaxSizeB);
-
-	if (hasRoom(sizeB)) { return true; }
+	uint h = hash * 2654435769U;
+	return h >> (32 - sShardBits);
+}
 
-	while (freeOneResource()) {
-		if (hasRoom(sizeB)) { return true; }
+/*---------------------------------------------------------------------
+	Reserves sizeB from the global budget, calling freeOneResource
+	until the request can fit. Returns false when request is too large
+	for cache, in which case nothing is reserved.
+---------------------------------------------------------------------*/
+bool ResCache::makeRoom(uint sizeB)
+{
+	uint maxB = mMaxSizeB;
+	if (sizeB > maxB) {
+		debugPrintf("size requested %u is larger than max cache size %u\n", sizeB, maxB);
+		return false;
+	}
+	for (;;) {
+		long used = mUsedB;
+		if ((unsigned __int64)(uint)used + sizeB <= maxB) {
+			if (InterlockedCompareExchange(&mUsedB, used + (long)sizeB, used) == used) {
+				return true;
+			}
+			continue; // lost the race to another thread, try again
+		}
+		if (!freeOneResource()) { return false; } // freed all resources and still no room
 	}
-	return false; // freed all resources and still no room
 }
 
 /*---------------------------------------------------------------------
-	Deletes one resource, the least recently used. Returns false if
-	cache is already empty.
+	Deletes one resource, the victim chosen by the policy of the next
+	shard in round-robin order. Returns false if cache is already empty.
 ---------------------------------------------------------------------*/
 bool ResCache::freeOneResource()
 {
-	if (mLRU.empty()) return false;
-	ResPtr gonner(mLRU.back());
-	mLRU.pop_back();
-	mResMap.erase(gonner->name());
-	return true;
+	for (uint s = 0; s < sNumShards; ++s) {
+		Shard &shard = mShards[(uint)InterlockedIncrement(&mEvictCursor) & (sNumShards-1)];
+		ResPtr gonner;
+		{
+			mutex::scoped_lock lock(shard.mMutex);
+			Entry *e = shard.mPolicy->selectVictim();
+			if (!e) { continue; }
+			shard.mPolicy->onRemove(e);
+			gonner.swap(e->mResPtr);
+			shard.mResMap.erase(gonner->name());
+		}
+		return true; // gonner released here, outside of the lock
+	}
+	return false;
 }
 
 /*---------------------------------------------------------------------
-	Pushes a resource to the front of the LRU list.
+	Called when a resource is destroyed, reducing cache total allocated.
+	May be called from any thread.
 ---------------------------------------------------------------------*/
-void ResCache::makeMostRecent(const ResMap::iterator &mi)
+void ResCache::memoryHasBeenFreed(uint sizeB, bool oversized)
 {
-	ResPtr resPtr(*mi->second);	// temporarily store the erased handle
-	mLRU.erase(mi->second);		// erase the element from its position in the list
-	mLRU.push_front(resPtr);	// make it the most recently used
-	mi->second = mLRU.begin();	// fix the iterator stored in the map
+	uint residentB = BufferPool::residentSize(sizeB);	// the same amount insert charged
+	if (oversized) {
+		InterlockedExchangeAdd(&mOversizedB, -(long)residentB);
+		return;
+	}
+	for (;;) {
+		long used = mUsedB;
+		long freed = ((residentB > (uint)used) ? used : (long)residentB);
+		if (InterlockedCompareExchange(&mUsedB, used - freed, used) == used) { break; }
+	}
+	debugPrintf("ResCache: memory freed, %u bytes\n", residentB);
 }
 
 /*---------------------------------------------------------------------
@@ -57,38 +116,82 @@ void ResCache::makeMostRecent(const ResMap::iterator &mi)
 ---------------------------------------------------------------------*/
 bool ResCache::getResource(ResPtr &resPtr, const string &key)
 {
-	ResMap::iterator mi = mResMap.find(key);
-	if (mi == mResMap.end()) { return false; }
+	uint hash = hashKey(key);
+	Shard &shard = shardFor(hash);
+	mutex::scoped_lock lock(shard.mMutex);
+
+	ResMap::iterator mi = shard.mResMap.find(key);
+	if (mi == shard.mResMap.end()) {
+		shard.mPolicy->onMiss(hash);
+		return false;
+	}
 
-	// resource loaded in the cache
-	makeMostRecent(mi);		// and make it the most recent
-	resPtr = (*mi->second); // return the ResPtr
+	// resource loaded in the cache, let the policy record the hit
+	Entry *e = &mi->second;
+	++e->mHits;
+	shard.mPolicy->onHit(e);
+	resPtr = e->mResPtr; // return the ResPtr
 	return true;
 }
 
 /*---------------------------------------------------------------------
-	adds a resource to the cache
+	Shared implementation of the addToCache overloads
 ---------------------------------------------------------------------*/
-bool ResCache::addToCache(uint sizeB, const ResHandle &h)
+bool ResCache::insert(const string &key, const string &source, uint sizeB, const ResPtr &resPtr)
 {
-	_ASSERTE(h.isLoaded() && "Trying to add an empty ResPtr to the cache");
-	_ASSERTE(!h.name().empty() && "Can't add a Resource to the cache with an empty name");
+	uint hash = hashKey(key);
+	Shard &shard = shardFor(hash);
 
 	// try to find the name in the cache, if it already exists, return false
-	if (mResMap.find(h.name()) != mResMap.end()) {
-		debugPrintf("ResCache: \"%s\" already exists, add to cache failed!\n", h.name().c_str());
-		return false;
+	{
+		mutex::scoped_lock lock(shard.mMutex);
+		if (shard.mResMap.find(key) != shard.mResMap.end()) {
+			debugPrintf("ResCache: \"%s\" already exists, add to cache failed!\n", key.c_str());
+			resPtr->mResCacheWeakPtr.reset();	// nothing reserved, nothing to give back
+			return false;
+		}
 	}
-	// make sure there is room in the cache
-	if (makeRoom(sizeB)) {
-		mLRU.push_front(h.mResPtr);	// add the resource to the front of the list
-		mResMap[h.name()] = mLRU.begin();	// and insert the iterator into the map
-		mUsedB += sizeB;			// and allocate the size in the cache
+	// make sure there is room in the cache, no shard lock is held while evicting
+	uint residentB = BufferPool::residentSize(sizeB);
+	if (!makeRoom(residentB)) {
+		if (!mAllowOversizedResources) {
+			resPtr->mResCacheWeakPtr.reset();	// never charged, nothing to give back
+			return false;
+		}
+		// we indicate that the resource has been added so loading succeeds, but it hasn't
+		// actually been added. Its memory is still counted, apart from the budget
+		resPtr->mOversized = true;
+		InterlockedExchangeAdd(&mOversizedB, (long)residentB);
 		return true;
 	}
-	// when mAllowOversizedResources is true, we indicate that the resource has been
-	// added so loading succeeds, but it hasn't actually been added
-	return mAllowOversizedResources;
+	{
+		mutex::scoped_lock lock(shard.mMutex);
+		std::pair<ResMap::iterator, bool> ins = shard.mResMap.insert(ResMap::value_type(key, Entry()));
+		if (ins.second) {
+			Entry *e = &ins.first->second;
+			e->mResPtr = resPtr;
+			e->mSource = source;
+			e->mHash = hash;
+			shard.mPolicy->onInsert(e);
+			return true;
+		}
+	}
+	// another thread added the same key while room was being made, give back the reservation
+	resPtr->mResCacheWeakPtr.reset();
+	memoryHasBeenFreed(sizeB);
+	debugPrintf("ResCache: \"%s\" already exists, add to cache failed!\n", key.c_str());
+	return false;
+}
+
+/*---------------------------------------------------------------------
+	adds a resource to the cache
+---------------------------------------------------------------------*/
+bool ResCache::addToCache(uint sizeB, const ResHandle &h)
+{
+	_ASSERTE(h.isLoaded() && "Trying to add an empty ResPtr to the cache");
+	_ASSERTE(!h.name().empty() && "Can't add a Resource to the cache with an empty name");
+
+	return insert(h.name(), h.source(), sizeB, h.mResPtr);
 }
 
 /*---------------------------------------------------------------------
@@ -96,27 +199,10 @@ bool ResCache::addToCache(uint sizeB, const ResHandle &h)
 ---------------------------------------------------------------------*/
 bool ResCache::addToCache(const ResPtr &resPtr)
 {
-	const string &resName = resPtr->name();
-	uint sizeB = resPtr->sizeB();
-
 	_ASSERTE(resPtr.get() != 0 && "Can't to add an empty ResPtr to the cache");
-	_ASSERTE(!resName.empty() && "Can't add a Resource to the cache with an empty name");
+	_ASSERTE(!resPtr->name().empty() && "Can't add a Resource to the cache with an empty name");
 
-	// try to find the name in the cache, if it already exists, return false
-	if (mResMap.find(resName) != mResMap.end()) {
-		debugPrintf("ResCache: \"%s\" already exists, add to cache failed!\n", resName.c_str());
-		return false;
-	}
-	// make sure there is room in the cache
-	if (makeRoom(sizeB)) {
-		mLRU.push_front(resPtr);	// add the resource to the front of the list
-		mResMap[resName] = mLRU.begin();	// and insert the iterator into the map
-		mUsedB += sizeB;			// and allocate the size in the cache
-		return true;
-	}
-	// when mAllowOversizedResources is true, we indicate that the resource has been
-	// added so loading succeeds, but it hasn't actually been added
-	return mAllowOversizedResources;
+	return insert(resPtr->name(), string(), resPtr->sizeB(), resPtr);
 }
 
 /*---------------------------------------------------------------------
@@ -124,20 +210,113 @@ bool ResCache::addToCache(const ResPtr &resPtr)
 ---------------------------------------------------------------------*/
 bool ResCache::removeResource(const string &key)
 {
-	ResMap::iterator mi = mResMap.find(key);
-	if (mi != mResMap.end()) {
-		mLRU.erase(mi->second);	// erase from the LRU list
-		mResMap.erase(mi);		// erase from the hash map
-		debugPrintf("ResCache: \"%s\" removed from cache: %i remaining\n", key.c_str(), mLRU.size());
-		return true;
+	Shard &shard = shardFor(hashKey(key));
+	ResPtr gonner;
+	{
+		mutex::scoped_lock lock(shard.mMutex);
+		ResMap::iterator mi = shard.mResMap.find(key);
+		if (mi == shard.mResMap.end()) { return false; }
+
+		shard.mPolicy->onRemove(&mi->second);	// erase from the policy's ordering
+		gonner.swap(mi->second.mResPtr);
+		shard.mResMap.erase(mi);			// erase from the hash map
+	}
+	debugPrintf("ResCache: \"%s\" removed from cache\n", key.c_str());
+	return true;
+}
+
+bool ResCache::removeResource(const string &key, const string &source)
+{
+	Shard &shard = shardFor(hashKey(key));
+	ResPtr gonner;
+	{
+		mutex::scoped_lock lock(shard.mMutex);
+		ResMap::iterator mi = shard.mResMap.find(key);
+		if (mi == shard.mResMap.end() || mi->second.mSource != source) { return false; }
+
+		shard.mPolicy->onRemove(&mi->second);
+		gonner.swap(mi->second.mResPtr);
+		shard.mResMap.erase(mi);
+	}
+	debugPrintf("ResCache: \"%s/%s\" invalidated\n", source.c_str(), key.c_str());
+	return true;
+}
+
+uint ResCache::removeSource(const string &source)
+{
+	vector<ResPtr> gonners;
+	for (uint s = 0; s < sNumShards; ++s) {
+		Shard &shard = mShards[s];
+		mutex::scoped_lock lock(shard.mMutex);
+		ResMap::iterator mi = shard.mResMap.begin();
+		while (mi != shard.mResMap.end()) {
+			if (mi->second.mSource == source) {
+				shard.mPolicy->onRemove(&mi->second);
+				gonners.push_back(mi->second.mResPtr);
+				mi = shard.mResMap.erase(mi);
+			} else {
+				++mi;
+			}
+		}
+	}
+	debugPrintf("ResCache: %u resources from \"%s\" invalidated\n", (uint)gonners.size(), source.c_str());
+	return (uint)gonners.size();	// gonners destroyed here, outside of the shard locks
+}
+
+/*---------------------------------------------------------------------
+	clears the entire resource list, each shard's contents are swapped
+	out under the lock and destroyed after it is released
+---------------------------------------------------------------------*/
+void ResCache::clearCache()
+{
+	for (uint s = 0; s < sNumShards; ++s) {
+		Shard &shard = mShards[s];
+		ResMap gonners;
+		{
+			mutex::scoped_lock lock(shard.mMutex);
+			gonners.swap(shard.mResMap);
+			shard.mPolicy->clear();
+		}
+	}
+}
+
+void ResCache::setMaxSize(uint sizeB)
+{
+	mMaxSizeB = sizeB;
+	while (usedBytes() > sizeB && freeOneResource()) {}
+}
+
+/*---------------------------------------------------------------------
+	appends a snapshot of every cached resource loaded from a source
+---------------------------------------------------------------------*/
+void ResCache::getStats(vector<ResCacheStat> &outStats)
+{
+	for (uint s = 0; s < sNumShards; ++s) {
+		Shard &shard = mShards[s];
+		mutex::scoped_lock lock(shard.mMutex);
+		for (ResMap::const_iterator mi = shard.mResMap.begin(); mi != shard.mResMap.end(); ++mi) {
+			const Entry &e = mi->second;
+			if (e.mSource.empty()) { continue; } // injected, can't be reloaded
+			ResCacheStat stat;
+			stat.mSource = e.mSource;
+			stat.mName = mi->first;
+			stat.mSizeB = e.mResPtr->sizeB();
+			stat.mHits = e.mHits;
+			outStats.push_back(stat);
+		}
 	}
-	return false;
 }
 
 // Constructor / destructor
-ResCache::ResCache(uint sizeMB, bool allowOversizedResources) :
-	mMaxSizeB(sizeMB*1024*1024), mUsedB(0), mAllowOversizedResources(allowOversizedResources)
-{}
+ResCache::ResCache(uint sizeMB, bool allowOversizedResources, ResCachePolicy policy) :
+	mBaseSizeB(sizeMB*1024*1024), mMaxSizeB(sizeMB*1024*1024),
+	mUsedB(0), mOversizedB(0), mEvictCursor(0),
+	mAllowOversizedResources(allowOversizedResources), mPolicy(policy)
+{
+	for (uint s = 0; s < sNumShards; ++s) {
+		mShards[s].mPolicy = IEvictionPolicy::create(policy);
+	}
+}
 
 ResCache::~ResCache()
 {
@@ -147,30 +326,141 @@ ResCache::~ResCache()
 ////////// class ResCacheManager //////////
 
 /*---------------------------------------------------------------------
-	creates the cache of a certain type passing in the budget, only one
-	cache of each type allowed
+	creates the cache of a certain type passing in the budget and the
+	eviction policy, only one cache of each type allowed
 ---------------------------------------------------------------------*/
-void ResCacheManager::createCache(ResCacheType cacheType, uint maxSizeMB, bool allowOversizedResources)
+void ResCacheManager::createCache(ResCacheType cacheType, uint maxSizeMB, bool allowOversizedResources,
+								  ResCachePolicy policy)
 {
 	if (mCacheList[cacheType].get() != 0) {
 		debugPrintf("ResCacheManager: cache %i already created\n", (int)cacheType);
 		return;
 	}
-	ResCachePtr cPtr(new ResCache(maxSizeMB, allowOversizedResources));
+	ResCachePtr cPtr(new ResCache(maxSizeMB, allowOversizedResources, policy));
 	mCacheList[cacheType] = cPtr;
 }
 
+string ResCacheManager::requestKey(const ResHandle &h)
+{
+	string key;
+	key.reserve(h.source().length() + h.name().length() + 1);
+	key.append(h.source()).append(1, '/').append(h.name());
+	return key;
+}
+
+/*---------------------------------------------------------------------
+	Finds the in-flight request for the handle's "source/name", or
+	creates and registers one, in which case isNew is set to true and
+	the caller is responsible for reading or queueing the data.
+---------------------------------------------------------------------*/
+ResLoadRequestPtr ResCacheManager::beginRequest(const ResHandle &h, const ResSourcePtr &srcPtr,
+												ResLoadPriority priority, bool claimed, bool &isNew)
+{
+	string key(requestKey(h));
+
+	mutex::scoped_lock lock(mRequestMutex);
+	RequestMap::const_iterator ri = mRequestList.find(key);
+	if (ri != mRequestList.end()) {
+		isNew = false;
+		return ri->second;
+	}
+	ResLoadRequestPtr reqPtr(new ResLoadRequest(key, h, srcPtr, priority, claimed));
+	mRequestList[key] = reqPtr;
+	isNew = true;
+	return reqPtr;
+}
+
+/*---------------------------------------------------------------------
+	Removes the request from the in-flight list, once its result is
+	available through the cache (or it failed)
+---------------------------------------------------------------------*/
+void ResCacheManager::endRequest(const ResLoadRequest &req)
+{
+	mutex::scoped_lock lock(mRequestMutex);
+	RequestMap::iterator ri = mRequestList.find(req.key());
+	if (ri != mRequestList.end() && ri->second.get() == &req) {
+		mRequestList.erase(ri);
+	}
+}
+
+/*---------------------------------------------------------------------
+	Finishes a request that another caller found in the cache after it
+	was registered
+---------------------------------------------------------------------*/
+void ResCacheManager::fulfillRequest(ResLoadRequest &req, const ResPtr &resPtr)
+{
+	{
+		mutex::scoped_lock lock(req.mMutex);
+		req.mResPtr = resPtr;
+		req.mState = ResLoadRequest::State_Done;
+		req.mCondVar.notify_all();
+	}
+	endRequest(req);
+}
+
 /*---------------------------------------------------------------------
-	Pushes an AsyncLoadDoneEvent into the staging list to be picked up
-	by tryLoad(). Also removes the entry from the request queue.
+	Cancels a pending tryLoad() request if no loader thread has picked
+	it up yet. Returns true if cancelled.
 ---------------------------------------------------------------------*/
-void ResCacheManager::addToStagingList(const string &resName, const string &source, const EventPtr &ePtr)
+bool ResCacheManager::cancelLoad(const ResHandle &h)
 {
-	std::stringstream ss;
-	ss << source << '/' << resName;
-	resMgr.mStagingList[ss.str()] = ePtr;
-	resMgr.mRequestList.erase(ss.str());	// remove entry from the request queue
-	debugPrintf("ResCacheManager: \"%s\" added to staging\n", ss.str().c_str());
+	ResLoadRequestPtr reqPtr;
+	{
+		mutex::scoped_lock lock(mRequestMutex);
+		RequestMap::const_iterator ri = mRequestList.find(requestKey(h));
+		if (ri == mRequestList.end()) { return false; }
+		reqPtr = ri->second;
+	}
+	if (!reqPtr->cancel()) { return false; }
+	endRequest(*reqPtr);
+	debugPrintf("ResCacheManager: \"%s\" load cancelled\n", reqPtr->key().c_str());
+	return true;
+}
+
+/*---------------------------------------------------------------------
+	tryLoad at prefetch priority through the registered prefetcher of
+	the cache type. Returns error if there is none.
+---------------------------------------------------------------------*/
+ResLoadResult ResCacheManager::prefetch(ResHandle &h, ResCacheType cacheType, const string &resPath)
+{
+	if (cacheType >= ResCache_MAX || !mPrefetchList[cacheType] || !mCacheList[cacheType]) {
+		return ResLoadResult_Error;
+	}
+	return mPrefetchList[cacheType](h, resPath);
+}
+
+/*---------------------------------------------------------------------
+	Writes the hotness manifest read by CacheWarmupProcess at the next
+	startup, one line per cached resource, most hit first
+---------------------------------------------------------------------*/
+bool ResCacheManager::writeManifest(const string &filename)
+{
+	typedef std::pair<ResCacheType, ResCacheStat> ManifestEntry;
+	vector<ManifestEntry> manifest;
+	vector<ResCacheStat> stats;
+	for (int c = 0; c < ResCache_MAX; ++c) {
+		if (!mCacheList[c] || !mPrefetchList[c]) { continue; }
+		stats.clear();
+		mCacheList[c]->getStats(stats);
+		for (size_t i = 0; i < stats.size(); ++i) {
+			manifest.push_back(ManifestEntry((ResCacheType)c, stats[i]));
+		}
+	}
+	std::stable_sort(manifest.begin(), manifest.end(),
+		[](const ManifestEntry &a, const ManifestEntry &b) { return a.second.mHits > b.second.mHits; });
+
+	std::ofstream ofs(filename.c_str(), std::ios::trunc);
+	if (!ofs.good()) {
+		debugPrintf("ResCacheManager: could not write manifest \"%s\"\n", filename.c_str());
+		return false;
+	}
+	for (size_t i = 0; i < manifest.size(); ++i) {
+		const ResCacheStat &stat = manifest[i].second;
+		ofs << (int)manifest[i].first << ' ' << stat.mSizeB << ' ' << stat.mHits << ' '
+			<< stat.mSource << '/' << stat.mName << '\n';
+	}
+	debugPrintf("ResCacheManager: manifest \"%s\" written, %u entries\n", filename.c_str(), manifest.size());
+	return ofs.good();
 }
 
 /*---------------------------------------------------------------------
@@ -192,6 +482,94 @@ bool ResCacheManager::getFromCache(ResHandle &h, ResCacheType cacheType)
 	return true; // found in the cache
 }
 
+void ResCacheManager::scaleBudgets(float scale)
+{
+	for (uint c = 0; c < mCacheList.size(); ++c) {
+		// resources that must stay loaded are never evicted for memory
+		if (mCacheList[c] && c != ResCache_KeepLoaded) {
+			mCacheList[c]->setMaxSize((uint)(mCacheList[c]->baseSizeBytes() * scale));
+		}
+	}
+}
+
+uint64 ResCacheManager::residentBytes() const
+{
+	uint64 totalB = 0;
+	for (uint c = 0; c < mCacheList.size(); ++c) {
+		if (mCacheList[c]) {
+			totalB += mCacheList[c]->usedBytes() + mCacheList[c]->oversizedBytes();
+		}
+	}
+	return totalB;
+}
+
+void ResCacheManager::reportMemoryUsage() const
+{
+	static const char *cacheNames[ResCache_MAX] = { "Web", "Project", "Script", "OnDemand", "KeepLoaded" };
+	for (uint c = 0; c < mCacheList.size(); ++c) {
+		if (!mCacheList[c]) { continue; }
+		debugPrintf("ResCacheManager: %s cache %u of %u bytes resident, %u oversized\n",
+					(c < ResCache_MAX ? cacheNames[c] : "?"),
+					mCacheList[c]->usedBytes(), mCacheList[c]->maxSizeBytes(),
+					mCacheList[c]->oversizedBytes());
+	}
+	BufferPool::Stats stats;
+	BufferPool::getStats(stats);
+	debugPrintf("ResCacheManager: buffer pool %u slab bytes, %u in %u buffers, %u in %u large buffers\n",
+				(uint)stats.mSlabBytes, (uint)stats.mPooledBytesInUse, stats.mPooledBuffers,
+				(uint)stats.mLargeBytes, stats.mLargeBuffers);
+}
+
+ResSourcePtr ResCacheManager::findSource(const string &resPath, string &outResName, const char *caller) const
+{
+	int i = resPath.find_first_of("/\\"); // find the first slash or backslash
+	if (i == string::npos) {
+		debugPrintf("ResCacheManager: invalid path in %s: \"%s\"\n", caller, resPath.c_str());
+		return ResSourcePtr();
+	}
+	ResSourceMap::const_iterator mi = mSourceMap.find(resPath.substr(0, i));
+	if (mi == mSourceMap.end()) {
+		debugPrintf("ResCacheManager: %s(\"%s\") source not found\n", caller, resPath.c_str());
+		return ResSourcePtr();
+	}
+	outResName = resPath.substr(i+1);
+	return mi->second;
+}
+
+ResStreamPtr ResCacheManager::openStream(const string &resPath)
+{
+	string resName;
+	ResSourcePtr srcPtr(findSource(resPath, resName, "openStream"));
+	if (!srcPtr) { return ResStreamPtr(); }
+	return srcPtr->openStream(resName);
+}
+
+int ResCacheManager::getResourceSize(const string &resPath) const
+{
+	string resName;
+	ResSourcePtr srcPtr(findSource(resPath, resName, "getResourceSize"));
+	if (!srcPtr) { return -1; }
+	return srcPtr->getResourceSize(resName);
+}
+
+uint ResCacheManager::invalidate(const string &srcName, const string &resName)
+{
+	ResSourceMap::const_iterator mi = mSourceMap.find(srcName);
+	if (mi != mSourceMap.end()) {
+		mi->second->invalidate(resName);	// before the caches, so a reload can't pick up a stale view
+	}
+	uint removed = 0;
+	for (uint c = 0; c < mCacheList.size(); ++c) {
+		if (!mCacheList[c]) { continue; }
+		if (resName.empty()) {
+			removed += mCacheList[c]->removeSource(srcName);
+		} else if (mCacheList[c]->removeResource(resName, srcName)) {
+			++removed;
+		}
+	}
+	return removed;
+}
+
 /*---------------------------------------------------------------------
 	load a new IResourceSource into the system, it should already be
 	initialized for use (open() has already been called)
@@ -217,6 +595,7 @@ ResCacheManager::ResCacheManager(uint availableSysMemMB, uint availableVidMemMB)
 	mCacheList.reserve(ResCache_MAX);
 	for (int c = 0; c < ResCache_MAX; ++c) {
 		mCacheList.push_back(ResCachePtr((ResCache*)0));
+		mPrefetchList[c] = 0;
 	}
 
 	// ** NOTE ** these three lines have been moved to Application.cpp to allow
@@ -230,32 +609,148 @@ ResCacheManager::ResCacheManager(uint availableSysMemMB, uint availableVidMemMB)
 	createCache(ResCache_OnDemand,		0); // zero size means anything can load, but will never be cached
 	createCache(ResCache_KeepLoaded,	availableSysMemMB); // large size means always keep resources cached
 
-	// create the thread process that will process async loading requests
-	CProcessPtr procPtr(new AsyncLoadProcess("AsyncLoadProcess"));
-	mThreadProcPtr = procPtr;
-	procMgr.attach(mThreadProcPtr);
+	// create the pool of thread processes that will process async loading requests, one per core
+	uint numLoaders = std::max(boost::thread::hardware_concurrency(), 1U);
+	mLoaderList.reserve(numLoaders);
+	for (uint t = 0; t < numLoaders; ++t) {
+		std::ostringstream oss;
+		oss << "AsyncLoadProcess" << t;
+		CProcessPtr procPtr(new AsyncLoadProcess(oss.str(), mLoadQueue));
+		mLoaderList.push_back(procPtr);
+		procMgr.attach(procPtr);
+	}
 }
 
 ResCacheManager::~ResCacheManager()
 {
-	// send shutdown event to wake up the thread and allow it to exit incase it's idle
-	eventMgr.trigger(AsyncLoadProcess::sAsyncLoadShutdownEvent);
+	// wake up the threads and allow them to exit incase they're idle, then wait for them to join
+	// since they reference mLoadQueue
+	mLoadQueue.shutdown();
+	for (LoaderList::const_iterator i = mLoaderList.begin(); i != mLoaderList.end(); ++i) {
+		if (!(*i)->isFinished()) { (*i)->finish(); }
+	}
+}
+
+////////// class ResLoadRequest //////////
+
+/*---------------------------------------------------------------------
+	Called by a loader thread before reading the source. Returns false
+	if the request was cancelled or another thread already claimed it.
+---------------------------------------------------------------------*/
+bool ResLoadRequest::claim()
+{
+	return (InterlockedCompareExchange(&mClaimed, 1, 0) == 0);
+}
+
+/*---------------------------------------------------------------------
+	Called by the thread that read from the source, size 0 on error.
+	Wakes any threads blocked in waitUntilLoaded.
+---------------------------------------------------------------------*/
+void ResLoadRequest::complete(const BufferPtr &dataPtr, int size)
+{
+	mutex::scoped_lock lock(mMutex);
+	mDataPtr = dataPtr;
+	mSize = size;
+	mState = State_Loaded;
+	mCondVar.notify_all();
+}
+
+/*---------------------------------------------------------------------
+	Blocks until the raw data has been read, returns false if the
+	request was cancelled instead
+---------------------------------------------------------------------*/
+bool ResLoadRequest::waitUntilLoaded()
+{
+	mutex::scoped_lock lock(mMutex);
+	++mWaiters;
+	while (mState == State_Loading) {
+		mCondVar.wait(lock);
+	}
+	--mWaiters;
+	return !mCancelled;
+}
+
+/*---------------------------------------------------------------------
+	Succeeds only if no thread has claimed the request yet and nobody
+	is blocked waiting on it
+---------------------------------------------------------------------*/
+bool ResLoadRequest::cancel()
+{
+	mutex::scoped_lock lock(mMutex);
+	if (mState != State_Loading || mWaiters > 0 || !claim()) {
+		return false;
+	}
+	mCancelled = true;
+	mState = State_Done;
+	mCondVar.notify_all();
+	return true;
 }
 
-////////// class AsyncLoadDoneListener //////////
+/*---------------------------------------------------------------------
+	Raises the priority of an unclaimed request, returns true if it
+	should be pushed again onto the higher priority queue
+---------------------------------------------------------------------*/
+bool ResLoadRequest::promote(ResLoadPriority priority)
+{
+	mutex::scoped_lock lock(mMutex);
+	if (mClaimed || priority >= mPriority) { return false; }
+	mPriority = priority;
+	return true;
+}
 
-bool ResCacheManager::AsyncLoadDoneListener::handleEvent(const EventPtr &ePtr)
+bool ResLoadRequest::isLoading()
 {
-	// the loading is done, copy the event to a staging area where it will be picked up and
-	// put into cache the next time tryLoad is run requesting the resource
-	AsyncLoadDoneEvent &e = *(static_cast<AsyncLoadDoneEvent*>(ePtr.get()));
-	resMgr.addToStagingList(e.mResName, e.mSourceName, ePtr);
-	return false; // allow event to propagate
+	mutex::scoped_lock lock(mMutex);
+	return (mState == State_Loading);
 }
 
-ResCacheManager::AsyncLoadDoneListener::AsyncLoadDoneListener() :
-	EventListener("AsyncLoadDoneListener")
+ResLoadRequest::ResLoadRequest(const string &key, const ResHandle &h, const ResSourcePtr &srcPtr,
+							   ResLoadPriority priority, bool claimed) :
+	mKey(key), mResName(h.name()), mSourceName(h.source()), mSourcePtr(srcPtr),
+	mState(State_Loading), mPriority(priority), mClaimed(claimed ? 1 : 0),
+	mCancelled(false), mWaiters(0), mDataPtr((char *)0), mSize(0), mResPtr()
+{}
+
+////////// class AsyncLoadQueue //////////
+
+void AsyncLoadQueue::push(const ResLoadRequestPtr &reqPtr, ResLoadPriority priority)
 {
-	IEventHandlerPtr p(new EventHandler<AsyncLoadDoneListener>(this, &AsyncLoadDoneListener::handleEvent));
-	registerEventHandler(AsyncLoadDoneEvent::sEventType, p, 1);
+	_ASSERTE(priority < ResLoadPriority_MAX && "Bad priority");
+	{
+		mutex::scoped_lock lock(mMutex);
+		mQueue[priority].push_back(reqPtr);
+	}
+	mCondVar.notify_one();
+}
+
+/*---------------------------------------------------------------------
+	Blocks until a request is available, highest priority first.
+	Returns false once the queue is shut down.
+---------------------------------------------------------------------*/
+bool AsyncLoadQueue::waitPop(ResLoadRequestPtr &reqPtr)
+{
+	mutex::scoped_lock lock(mMutex);
+	for (;;) {
+		if (mShutdown) { return false; }
+		for (int p = 0; p < ResLoadPriority_MAX; ++p) {
+			if (!mQueue[p].empty()) {
+				reqPtr = mQueue[p].front();
+				mQueue[p].pop_front();
+				return true;
+			}
+		}
+		mCondVar.wait(lock);
+	}
+}
+
+/*---------------------------------------------------------------------
+	Wakes all loader threads so they can exit
+---------------------------------------------------------------------*/
+void AsyncLoadQueue::shutdown()
+{
+	{
+		mutex::scoped_lock lock(mMutex);
+		mShutdown = true;
+	}
+	mCondVar.notify_all();
 }
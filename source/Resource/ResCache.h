@@ -8,21 +8,25 @@
 
 #include <string>
 #include <hash_map>
-#include <hash_set>
-#include <list>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include "ResHandle.h"
-#include "../Event/EventListener.h"
+#include "EvictionPolicy.h"
+#include "BufferPool.h"
 #include "../Utility/Typedefs.h"
 #include "../Utility/Singleton.h"
 
 using std::string;
 using stdext::hash_map;
-using stdext::hash_set;
-using std::list;
 using std::vector;
+using std::deque;
 using std::shared_ptr;
+using boost::mutex;
+using boost::condition_variable;
 
 ///// DEFINITIONS /////
 
@@ -31,12 +35,62 @@ using std::shared_ptr;
 // forward declarations
 class ResCache;
 class IResourceSource;
+class IResourceStream;
+class ResLoadRequest;
 class CProcess;
 typedef shared_ptr<ResCache>		ResCachePtr;
 typedef shared_ptr<IResourceSource>	ResSourcePtr;
-typedef shared_ptr<char>			BufferPtr; // use checked_array_deleter<char> to ensure delete[] called
+typedef shared_ptr<IResourceStream>	ResStreamPtr;
+typedef shared_ptr<ResLoadRequest>	ResLoadRequestPtr;
 typedef shared_ptr<CProcess>		CProcessPtr;
 
+/*=============================================================================
+class IResourceStream
+	Sequential reader over one resource. Consumers read fixed size chunks
+	into their own buffer, so a resource can be passed along (decompressed,
+	sent to a socket, etc.) without ever holding the whole thing in memory.
+	A stream must not outlive the source that opened it.
+=============================================================================*/
+class IResourceStream : private boost::noncopyable {
+	public:
+		/*---------------------------------------------------------------------
+			Reads up to maxSize bytes of the resource into buffer. Returns the
+			number of bytes read, 0 at the end of the resource, or -1 on
+			error.
+		---------------------------------------------------------------------*/
+		virtual int		read(char *buffer, int maxSize) = 0;
+		/*---------------------------------------------------------------------
+			Total size of the resource in bytes, as returned by
+			getResourceSize
+		---------------------------------------------------------------------*/
+		virtual int		size() const = 0;
+
+		// Constructor / destructor
+		explicit IResourceStream() {}
+		virtual ~IResourceStream() {}
+};
+
+/*=============================================================================
+class BufferedResourceStream
+	Stream over a fully loaded buffer, the default for sources that have
+	no incremental way to read
+=============================================================================*/
+class BufferedResourceStream : public IResourceStream {
+	private:
+		BufferPtr	mDataPtr;
+		int			mSize;
+		int			mPosition;
+
+	public:
+		virtual int		read(char *buffer, int maxSize);
+		virtual int		size() const	{ return mSize; }
+
+		explicit BufferedResourceStream(const BufferPtr &dataPtr, int size) :
+			IResourceStream(),
+			mDataPtr(dataPtr), mSize(size), mPosition(0)
+		{}
+};
+
 /*=============================================================================
 class IResourceSource
 	This class could be an interface to a file, memory mapped file, zip file,
@@ -62,58 +116,112 @@ class IResourceSource : private boost::noncopyable {
 			thread can be identified in calls to getResource().
 		---------------------------------------------------------------------*/
 		virtual int		getNewThreadIndex() = 0;
+		/*---------------------------------------------------------------------
+			Opens a stream over the resource, or returns an empty pointer on
+			error. The default implementation loads the whole resource with
+			getResource, sources that can read incrementally override it.
+		---------------------------------------------------------------------*/
+		virtual ResStreamPtr	openStream(const string &resName);
+		/*---------------------------------------------------------------------
+			Called by ResCacheManager::invalidate when the underlying file has
+			changed, so a source can drop anything it keeps for the resource.
+			An empty resName means the whole source. Default does nothing.
+		---------------------------------------------------------------------*/
+		virtual void	invalidate(const string &resName) {}
 
 		// Constructor / destructor
 		explicit IResourceSource() {}
 		virtual ~IResourceSource() {}
 };
 
+/*=============================================================================
+struct ResCacheStat
+	Snapshot of one cached resource, used to write the warm-up manifest
+=============================================================================*/
+struct ResCacheStat {
+	string	mSource;
+	string	mName;
+	uint	mSizeB;
+	uint	mHits;
+};
+
 /*=============================================================================
 class ResCache
+	The cache is split into sNumShards shards selected by a hash of the key.
+	Each shard owns its own mutex, hash map and eviction policy (see
+	EvictionPolicy.h), so threads touching different keys never contend.
+	The byte budget is global across all shards and is maintained with
+	interlocked operations. Resources are charged the resident size of their
+	buffer from BufferPool rather than the size requested, so the budget
+	reflects real memory use. Eviction walks the shards round-robin, locking
+	only one at a time. Evicted ResPtr's are always released outside of the
+	shard lock since the Resource destructor calls back into
+	memoryHasBeenFreed.
 =============================================================================*/
-class ResCache {
+class ResCache : private boost::noncopyable {
 	friend class Resource;	// allows access to call memoryHasBeenFreed() from ~Resource()
 	public:
 		///// DEFINITIONS /////
-		typedef list<ResPtr>	ResList;
-		typedef hash_map<string, ResList::iterator>	ResMap;
+		static const uint sShardBits = 4;
+		static const uint sNumShards = 1 << sShardBits;
+
+		typedef ResCacheEntry			Entry;
+		typedef hash_map<string, Entry>	ResMap;
 
 	private:
+		///// STRUCTURES /////
+		/*=====================================================================
+		struct Shard
+		=====================================================================*/
+		struct Shard : private boost::noncopyable {
+			mutex				mMutex;
+			ResMap				mResMap;	// hash map linking the key to the entry
+			EvictionPolicyPtr	mPolicy;	// orders the entries and picks the next victim
+		};
+
 		///// VARIABLES /////
-		ResList	mLRU;		// least recently used list, back is least recent, front is most
-		ResMap	mResMap;	// hash map linking the key to the handle
+		Shard			mShards[sNumShards];
 
-		uint	mMaxSizeB;	// total memory size in bytes
-		uint	mUsedB;		// total memory allocated in bytes
+		uint			mBaseSizeB;		// configured memory size in bytes
+		volatile uint	mMaxSizeB;		// current memory size in bytes, lowered under memory pressure
+		volatile long	mUsedB;			// total memory allocated in bytes, modified with interlocked ops only
+		volatile long	mOversizedB;	// resources admitted without room in the budget, not evictable
+		volatile long	mEvictCursor;	// round-robin shard index for eviction
 		
-		bool	mAllowOversizedResources; // when false, resources larger than mMaxSizeB will not be loaded
+		bool			mAllowOversizedResources; // when false, resources that don't fit in mMaxSizeB will not be loaded
+		ResCachePolicy	mPolicy;
 
-	protected:
 		///// FUNCTIONS /////
+		static uint	hashKey(const string &key)	{ return (uint)stdext::hash_value(key); }
+		static uint	shardIndex(uint hash);
+		Shard &		shardFor(uint hash)			{ return mShards[shardIndex(hash)]; }
+
 		/*---------------------------------------------------------------------
-			Calls freeOneResource until new request can fit, returns false when
-			request is too large for cache
+			Shared implementation of the addToCache overloads
 		---------------------------------------------------------------------*/
-		bool	makeRoom(uint sizeB);
+		bool	insert(const string &key, const string &source, uint sizeB, const ResPtr &resPtr);
 
+	protected:
 		/*---------------------------------------------------------------------
-			Deletes one resource, the least recently used. Returns false if
-			cache is already empty.
+			Reserves sizeB from the global budget, calling freeOneResource
+			until the request can fit. Returns false when request is too large
+			for cache, in which case nothing is reserved.
 		---------------------------------------------------------------------*/
-		bool	freeOneResource();
+		bool	makeRoom(uint sizeB);
 
 		/*---------------------------------------------------------------------
-			Called when a resource is destroyed, reducing cache total allocated
+			Deletes one resource, the victim chosen by the policy of the next
+			shard in round-robin order. Returns false if cache is already empty.
 		---------------------------------------------------------------------*/
-		void	memoryHasBeenFreed(uint sizeB) {
-					mUsedB -= ((sizeB > mUsedB) ? mUsedB : sizeB);
-					debugPrintf("ResCache: memory freed, %u bytes\n", sizeB);
-				}
+		bool	freeOneResource();
 
 		/*---------------------------------------------------------------------
-			Pushes a resource to the front of the LRU list.
+			Called when a resource is destroyed, reducing cache total allocated
+			(or the oversized total) by the resident size charged for sizeB.
+			Only called by resources the cache has charged for. May be called
+			from any thread.
 		---------------------------------------------------------------------*/
-		void	makeMostRecent(const ResMap::iterator &mi);
+		void	memoryHasBeenFreed(uint sizeB, bool oversized = false);
 
 	public:
 		/*---------------------------------------------------------------------
@@ -138,73 +246,235 @@ class ResCache {
 		---------------------------------------------------------------------*/
 		bool	removeResource(const string &key);
 
+		/*---------------------------------------------------------------------
+			removes the resource only if it was loaded from the named source,
+			so a change in one source never evicts another source's resource
+			that happens to share the name
+		---------------------------------------------------------------------*/
+		bool	removeResource(const string &key, const string &source);
+
+		/*---------------------------------------------------------------------
+			removes every resource loaded from the named source, returns the
+			number removed
+		---------------------------------------------------------------------*/
+		uint	removeSource(const string &source);
+
 		/*---------------------------------------------------------------------
 			clears the entire resource list
 		---------------------------------------------------------------------*/
-		void	clearCache()				{ mLRU.clear(); mResMap.clear(); }
+		void	clearCache();
+
+		/*---------------------------------------------------------------------
+			Changes the budget, evicting until the cache fits when it shrinks.
+			Call from the main thread.
+		---------------------------------------------------------------------*/
+		void	setMaxSize(uint sizeB);
+
+		/*---------------------------------------------------------------------
+			appends a snapshot of every cached resource loaded from a source
+		---------------------------------------------------------------------*/
+		void	getStats(vector<ResCacheStat> &outStats);
 
 		// Accessors
-		bool	hasRoom(uint sizeB) const	{ return (mMaxSizeB - mUsedB >= sizeB); }
+		// used stays over the max after setMaxSize shrinks it until evicted resources are released
+		bool	hasRoom(uint sizeB) const	{ uint used = usedBytes(); return (used <= mMaxSizeB && mMaxSizeB - used >= sizeB); }
 		uint	maxSizeBytes() const		{ return mMaxSizeB; }
-		uint	usedBytes() const			{ return mUsedB; }
+		uint	baseSizeBytes() const		{ return mBaseSizeB; }
+		uint	usedBytes() const			{ return (uint)mUsedB; } // resident bytes charged
+		uint	oversizedBytes() const		{ return (uint)mOversizedB; }
+		ResCachePolicy	policy() const		{ return mPolicy; }
 
 		// Constructor / destructor
-		explicit ResCache(uint sizeMB, bool allowOversizedResources = true);
+		explicit ResCache(uint sizeMB, bool allowOversizedResources = true,
+						  ResCachePolicy policy = ResCachePolicy_LRU);
 		~ResCache();
 };
 
+/*=============================================================================
+class ResLoadRequest
+	One in-flight load of a "source/name" key. Every caller that misses the
+	cache on the same key while a load is in flight shares the same request,
+	so the source is only read (and inflated) once. The raw data is filled in
+	by whichever thread does the read, synchronous load() or a loader thread,
+	and the first caller to see it loaded constructs the Resource and adds it
+	to the cache. All other callers receive the same ResPtr.
+	Async requests are claimed by exactly one loader thread before reading,
+	which is what allows them to be cancelled or re-queued at a higher
+	priority while still waiting in the queue.
+=============================================================================*/
+class ResLoadRequest : private boost::noncopyable {
+	friend class ResCacheManager;
+	public:
+		///// DEFINITIONS /////
+		enum State : uchar {
+			State_Loading = 0,	// raw data is being read from the source
+			State_Loaded,		// raw data available, Resource not yet constructed
+			State_Done			// mResPtr holds the result, empty on error
+		};
+
+	private:
+		///// VARIABLES /////
+		string				mKey;			// "source/name"
+		string				mResName;
+		string				mSourceName;
+		ResSourcePtr		mSourcePtr;
+		mutex				mMutex;
+		condition_variable	mCondVar;		// signalled on each state change
+		State				mState;
+		ResLoadPriority		mPriority;		// highest priority the request has been queued at
+		volatile long		mClaimed;		// set once by the thread that reads the source
+		bool				mCancelled;
+		uint				mWaiters;		// threads blocked in waitUntilLoaded, a request with waiters can't be cancelled
+		BufferPtr			mDataPtr;		// raw data, released once the Resource is constructed
+		int					mSize;			// size of raw data, 0 on error
+		ResPtr				mResPtr;		// the finished resource shared with every waiter
+
+	public:
+		/*---------------------------------------------------------------------
+			Called by a loader thread before reading the source. Returns false
+			if the request was cancelled or another thread already claimed it.
+		---------------------------------------------------------------------*/
+		bool	claim();
+
+		/*---------------------------------------------------------------------
+			Called by the thread that read from the source, size 0 on error.
+			Wakes any threads blocked in waitUntilLoaded.
+		---------------------------------------------------------------------*/
+		void	complete(const BufferPtr &dataPtr, int size);
+
+		/*---------------------------------------------------------------------
+			Blocks until the raw data has been read, returns false if the
+			request was cancelled instead
+		---------------------------------------------------------------------*/
+		bool	waitUntilLoaded();
+
+		/*---------------------------------------------------------------------
+			Succeeds only if no thread has claimed the request yet and nobody
+			is blocked waiting on it
+		---------------------------------------------------------------------*/
+		bool	cancel();
+
+		/*---------------------------------------------------------------------
+			Raises the priority of an unclaimed request, returns true if it
+			should be pushed again onto the higher priority queue
+		---------------------------------------------------------------------*/
+		bool	promote(ResLoadPriority priority);
+
+		bool	isLoading();
+
+		// Accessors
+		const string &			key() const			{ return mKey; }
+		const string &			resName() const		{ return mResName; }
+		const string &			sourceName() const	{ return mSourceName; }
+		const ResSourcePtr &	sourcePtr() const	{ return mSourcePtr; }
+
+		explicit ResLoadRequest(const string &key, const ResHandle &h, const ResSourcePtr &srcPtr,
+								ResLoadPriority priority, bool claimed);
+};
+
+/*=============================================================================
+class AsyncLoadQueue
+	Job queue shared by the pool of loader threads, one FIFO per priority
+	class. Requests can appear twice when promoted, the loser of the claim
+	simply drops it.
+=============================================================================*/
+class AsyncLoadQueue : private boost::noncopyable {
+	private:
+		deque<ResLoadRequestPtr>	mQueue[ResLoadPriority_MAX];
+		mutex						mMutex;
+		condition_variable			mCondVar;
+		bool						mShutdown;
+
+	public:
+		void	push(const ResLoadRequestPtr &reqPtr, ResLoadPriority priority);
+
+		/*---------------------------------------------------------------------
+			Blocks until a request is available, highest priority first.
+			Returns false once the queue is shut down.
+		---------------------------------------------------------------------*/
+		bool	waitPop(ResLoadRequestPtr &reqPtr);
+
+		/*---------------------------------------------------------------------
+			Wakes all loader threads so they can exit
+		---------------------------------------------------------------------*/
+		void	shutdown();
+
+		explicit AsyncLoadQueue() : mShutdown(false) {}
+};
+
 /*=============================================================================
 class ResCacheManager
 =============================================================================*/
 class ResCacheManager : public Singleton<ResCacheManager> {
-	friend class AsyncLoadDoneListener;		// provide access to staging list
 	public:
 		///// DEFINITIONS /////
-		typedef hash_map<string, ResSourcePtr>	ResSourceMap;
-		typedef shared_ptr<ResCache>			ResCachePtr;
-		typedef vector<ResCachePtr>				ResCacheList;
-		typedef hash_map<string, EventPtr>		EventQueue;
-		typedef hash_set<string>				RequestQueue;
+		typedef hash_map<string, ResSourcePtr>		ResSourceMap;
+		typedef shared_ptr<ResCache>				ResCachePtr;
+		typedef vector<ResCachePtr>					ResCacheList;
+		typedef hash_map<string, ResLoadRequestPtr>	RequestMap;
+		typedef vector<CProcessPtr>					LoaderList;
+		typedef ResLoadResult (*PrefetchFunc)(ResHandle &h, const string &resPath);
 
 	private:
-		///// STRUCTURES /////
-		/*=====================================================================
-		class AsyncLoadDoneListener
-		=====================================================================*/
-		class AsyncLoadDoneListener : public EventListener {
-			friend class ResCacheManager;
-			private:
-				bool handleEvent(const EventPtr &ePtr);
-			public:
-				explicit AsyncLoadDoneListener();
-		};
-
 		///// VARIABLES /////
 		ResSourceMap	mSourceMap;		// the table of registered source files
 		ResCacheList	mCacheList;		// the list of resource caches, one for each ResCacheType
 
-		// For async threaded loading
-		AsyncLoadDoneListener	mListener;		// listens for AsyncLoadDone event and pushed event into staging queue
-		EventQueue				mStagingList;	// data that has been loaded by another thread but not yet cached
-		RequestQueue			mRequestList;	// list of pending resources already requested via tryLoad, makes sure
-												// a request isn't submitted multiple times for the same resource
-		CProcessPtr				mThreadProcPtr;	// pointer to the thread process, so it can be detached in destructor
+		// For single-flight and async threaded loading
+		mutex			mRequestMutex;	// guards mRequestList only, never held while a ResLoadRequest is locked
+		RequestMap		mRequestList;	// loads in flight from load() or tryLoad(), makes sure a resource
+										// is only read from its source once no matter how many callers miss
+		AsyncLoadQueue	mLoadQueue;		// requests from tryLoad() waiting for a loader thread
+		LoaderList		mLoaderList;	// the loader thread processes, one per core
+		PrefetchFunc	mPrefetchList[ResCache_MAX];	// tryLoad of the resource type cached in each cache type
 
 		///// FUNCTIONS /////
-		bool	inStagingList(const string &resName, const string &source);
+		/*---------------------------------------------------------------------
+			Finds the in-flight request for the handle's "source/name", or
+			creates and registers one, in which case isNew is set to true and
+			the caller is responsible for reading or queueing the data.
+		---------------------------------------------------------------------*/
+		ResLoadRequestPtr	beginRequest(const ResHandle &h, const ResSourcePtr &srcPtr,
+										 ResLoadPriority priority, bool claimed, bool &isNew);
+
+		/*---------------------------------------------------------------------
+			Removes the request from the in-flight list, once its result is
+			available through the cache (or it failed)
+		---------------------------------------------------------------------*/
+		void	endRequest(const ResLoadRequest &req);
+
+		/*---------------------------------------------------------------------
+			Finishes a request that another caller found in the cache after
+			it was registered
+		---------------------------------------------------------------------*/
+		void	fulfillRequest(ResLoadRequest &req, const ResPtr &resPtr);
+
+		/*---------------------------------------------------------------------
+			Constructs the resource from a loaded request and adds it to the
+			cache if no other caller has done so yet, then passes the shared
+			result into the handle.
+		---------------------------------------------------------------------*/
+		template <typename TResource>
+		ResLoadResult	finishRequest(ResLoadRequest &req, ResHandle &h, bool async);
+
+		static string	requestKey(const ResHandle &h);
 
 		/*---------------------------------------------------------------------
-			pushes an AsyncLoadDoneEvent into the staging list to be picked up
-			by tryLoad()
+			Splits a "source/name" path and returns the registered source,
+			or an empty pointer if there is none
 		---------------------------------------------------------------------*/
-		void	addToStagingList(const string &resName, const string &source, const EventPtr &ePtr);
+		ResSourcePtr	findSource(const string &resPath, string &outResName, const char *caller) const;
+
+		template <typename TResource>
+		static ResLoadResult	prefetchResource(ResHandle &h, const string &resPath);
 
 	public:
 		/*---------------------------------------------------------------------
-			creates the cache of a certain type passing in the budget, only one
-			cache of each type allowed
+			creates the cache of a certain type passing in the budget and the
+			eviction policy, only one cache of each type allowed
 		---------------------------------------------------------------------*/
-		void	createCache(ResCacheType cacheType, uint maxSizeMB, bool allowOversizedResources = true);
+		void	createCache(ResCacheType cacheType, uint maxSizeMB, bool allowOversizedResources = true,
+							ResCachePolicy policy = ResCachePolicy_LRU);
 
 		/*---------------------------------------------------------------------
 			returns a shared_ptr to the ResCache of a given type
@@ -216,7 +486,8 @@ class ResCacheManager : public Singleton<ResCacheManager> {
 
 		/*---------------------------------------------------------------------
 			Fetch a resource from cache or a ResSource (disk), ResPtr passed in
-			will hold resource if true is returned.
+			will hold resource if true is returned. Concurrent misses on the
+			same resource share a single read from the source.
 			** NOTE **
 			The template param TResource should be a type derived from class
 			Resource and MUST implement a constructor with the signature:
@@ -233,9 +504,56 @@ class ResCacheManager : public Singleton<ResCacheManager> {
 			function periodically until it returns success, and then take
 			action with the resource. If error is returned the client should
 			not expect the resource to load and should stop asking for it.
+			Requests are served by a pool of loader threads, interactive
+			priority ahead of prefetch.
+		---------------------------------------------------------------------*/
+		template <typename TResource>
+		ResLoadResult	tryLoad(ResHandle &h, ResLoadPriority priority = ResLoadPriority_Interactive);
+
+		/*---------------------------------------------------------------------
+			Cancels a pending tryLoad() request if no loader thread has picked
+			it up yet. Returns true if cancelled.
+		---------------------------------------------------------------------*/
+		bool	cancelLoad(const ResHandle &h);
+
+		/*---------------------------------------------------------------------
+			Registers TResource as the type to construct when the warm-up
+			manifest lists a resource of TResource::sCacheType. Types without
+			a registered prefetcher are skipped by warm-up.
 		---------------------------------------------------------------------*/
 		template <typename TResource>
-		ResLoadResult	tryLoad(ResHandle &h);
+		void	registerPrefetcher();
+
+		/*---------------------------------------------------------------------
+			tryLoad at prefetch priority through the registered prefetcher of
+			the cache type. Returns error if there is none.
+		---------------------------------------------------------------------*/
+		ResLoadResult	prefetch(ResHandle &h, ResCacheType cacheType, const string &resPath);
+
+		/*---------------------------------------------------------------------
+			Writes the hotness manifest read by CacheWarmupProcess at the next
+			startup, one line per cached resource, most hit first:
+				cacheType sizeB hits source/name
+		---------------------------------------------------------------------*/
+		bool	writeManifest(const string &filename);
+
+		/*---------------------------------------------------------------------
+			Sets each cache's budget to scale times its configured size,
+			evicting from caches that shrink. The KeepLoaded cache keeps
+			its configured size.
+		---------------------------------------------------------------------*/
+		void	scaleBudgets(float scale);
+
+		/*---------------------------------------------------------------------
+			Total resident bytes held by all caches, oversized included
+		---------------------------------------------------------------------*/
+		uint64	residentBytes() const;
+
+		/*---------------------------------------------------------------------
+			Prints the resident bytes charged to each cache type, and the
+			state of the buffer pool behind them
+		---------------------------------------------------------------------*/
+		void	reportMemoryUsage() const;
 
 		/*---------------------------------------------------------------------
 			This will just attempt to pull a resource from a specific cache. If
@@ -245,6 +563,32 @@ class ResCacheManager : public Singleton<ResCacheManager> {
 		---------------------------------------------------------------------*/
 		bool	getFromCache(ResHandle &h, ResCacheType cacheType);
 
+		/*---------------------------------------------------------------------
+			Opens a stream directly from the source, bypassing the caches.
+			Meant for resources too large to be worth caching whole. The
+			resPath is in the same "source/name" form passed to load.
+		---------------------------------------------------------------------*/
+		ResStreamPtr	openStream(const string &resPath);
+
+		/*---------------------------------------------------------------------
+			Size in bytes of a resource as its source reports it, without
+			loading it, or -1 if there is no such source. Lets a caller pick
+			between load and openStream.
+		---------------------------------------------------------------------*/
+		int		getResourceSize(const string &resPath) const;
+
+		/*---------------------------------------------------------------------
+			Removes the named resource of a source from every cache, called
+			when the underlying file has changed. Data derived from the file
+			is cached under the same name in its own cache type, so it is
+			dropped along with the raw resource. An empty resName removes
+			everything loaded from the source, for when the individual changes
+			are not known. The source itself is told too, see
+			IResourceSource::invalidate. Returns the number of cached entries
+			removed.
+		---------------------------------------------------------------------*/
+		uint	invalidate(const string &srcName, const string &resName);
+
 		/*---------------------------------------------------------------------
 			load a new IResourceSource into the system, it should be
 			initialized for use externally (open() still needs to be called)
@@ -258,12 +602,61 @@ class ResCacheManager : public Singleton<ResCacheManager> {
 
 ///// TEMPLATE FUNCTIONS /////
 
-#include "ResourceProcess.h"
-#include "../Event/EventManager.h"
+template <typename TResource>
+ResLoadResult ResCacheManager::prefetchResource(ResHandle &h, const string &resPath)
+{
+	return h.tryLoad<TResource>(resPath, ResLoadPriority_Prefetch);
+}
+
+/*---------------------------------------------------------------------
+	Registers TResource as the type to construct when the warm-up
+	manifest lists a resource of TResource::sCacheType.
+---------------------------------------------------------------------*/
+template <typename TResource>
+void ResCacheManager::registerPrefetcher()
+{
+	_ASSERTE(TResource::sCacheType < ResCache_MAX && "Bad cacheType");
+	mPrefetchList[TResource::sCacheType] = &ResCacheManager::prefetchResource<TResource>;
+}
+
+/*---------------------------------------------------------------------
+	Constructs the resource from a loaded request and adds it to the
+	cache if no other caller has done so yet, then passes the shared
+	result into the handle.
+---------------------------------------------------------------------*/
+template <typename TResource>
+ResLoadResult ResCacheManager::finishRequest(ResLoadRequest &req, ResHandle &h, bool async)
+{
+	mutex::scoped_lock lock(req.mMutex);
+	if (req.mState == ResLoadRequest::State_Loaded) {
+		if (req.mSize) {
+			// construct a new Resource object, store it in a ResPtr
+			// and pass into the ResHandle
+			ResCachePtr &cache = mCacheList[TResource::sCacheType];
+			h.mResPtr.reset(new TResource(h.name(), req.mSize, cache));
+			// store the resource in a cache (specified by the resource)
+			if (cache->addToCache(req.mSize, h)) {
+				// call the resource's onLoad method
+				TResource *pRes = static_cast<TResource*>(h.mResPtr.get());
+				pRes->onLoad(req.mDataPtr, async);
+				req.mResPtr = h.mResPtr;
+			} // if not added, cache has no room
+		}
+		req.mDataPtr.reset();
+		req.mState = ResLoadRequest::State_Done;
+		req.mCondVar.notify_all();
+		endRequest(req);
+	}
+	h.mResPtr = req.mResPtr;
+	return (req.mResPtr ? ResLoadResult_Success : ResLoadResult_Error);
+}
 
 /*---------------------------------------------------------------------
 	Fetch a resource from cache or a ResSource (disk), ResPtr passed in
-	will hold resource if true is returned.
+	will hold resource if true is returned. If another caller is already
+	loading the same resource, this waits for that load instead of
+	reading the source again. A request still waiting in the async queue
+	is claimed and read by this thread.
 	** NOTE **
 	The template param TResource should be a type derived from class
 	Resource and MUST implement a constructor with the signature:
@@ -276,31 +669,38 @@ bool ResCacheManager::load(ResHandle &h)
 
 	// try to find the resource in cache
 	ResCachePtr &cache = mCacheList[TResource::sCacheType];
-	if (!cache->getResource(h.mResPtr, h.name())) {
-		// not in cache, so load it from source and put into cache
-		ResSourceMap::const_iterator mi = mSourceMap.find(h.source());
-		if (mi != mSourceMap.end()) {
+	if (cache->getResource(h.mResPtr, h.name())) { return true; } // found in the cache
+
+	// not in cache, so load it from source and put into cache
+	ResSourceMap::const_iterator mi = mSourceMap.find(h.source());
+	if (mi == mSourceMap.end()) { return false; }
+
+	for (;;) {
+		bool isNew = false;
+		ResLoadRequestPtr reqPtr(beginRequest(h, mi->second, ResLoadPriority_Interactive, true, isNew));
+		if (isNew) {
+			// a previous request may have finished between the cache miss and registering this one
+			if (cache->getResource(h.mResPtr, h.name())) {
+				fulfillRequest(*reqPtr, h.mResPtr);
+				return true;
+			}
 			// loads the resource data from source, returning size or 0 on error
 			BufferPtr dataPtr((char *)0);
 			int size = mi->second->getResource(h.name(), dataPtr);
-			if (size) {
-				// construct a new Resource object, store it in a ResPtr
-				// and pass into the ResHandle
-				ResPtr resPtr(new TResource(h.name(), size, cache));
-				h.mResPtr = resPtr;
-				// store the resource in a cache (specified by the resource)
-				bool added = cache->addToCache(size, h);
-				if (added) {
-					// call the resource's onLoad method
-					TResource *pRes = static_cast<TResource*>(resPtr.get());
-					pRes->onLoad(dataPtr, false);
-					return true;
-				} // if not added, cache has no room
-			}
+			reqPtr->complete(dataPtr, size);
+		} else if (reqPtr->claim()) {
+			// queued by tryLoad but no loader thread has taken it yet, read it here instead of
+			// waiting behind the queue, the loader that pops it later drops it on the failed claim
+			BufferPtr dataPtr((char *)0);
+			int size = mi->second->getResource(h.name(), dataPtr);
+			reqPtr->complete(dataPtr, size);
+		} else if (!reqPtr->waitUntilLoaded()) {
+			// another thread is already reading the source, wait for it (nothing left to promote
+			// once claimed), if the async request was cancelled start over
+			continue;
 		}
-		return false;
+		return (finishRequest<TResource>(*reqPtr, h, false) == ResLoadResult_Success);
 	}
-	return true; // found in the cache
 }
 
 /*---------------------------------------------------------------------
@@ -313,57 +713,36 @@ bool ResCacheManager::load(ResHandle &h)
 	not expect the resource to load and should stop asking for it.
 ---------------------------------------------------------------------*/
 template <typename TResource>
-ResLoadResult ResCacheManager::tryLoad(ResHandle &h)
+ResLoadResult ResCacheManager::tryLoad(ResHandle &h, ResLoadPriority priority)
 {
 	_ASSERTE(TResource::sCacheType < ResCache_MAX && "Bad cacheType");
 
 	// try to find the resource in cache
 	ResCachePtr &cache = mCacheList[TResource::sCacheType];
-	if (!cache->getResource(h.mResPtr, h.name())) {
-		// not in cache, check staging list to see if raw data has been loaded
-		std::stringstream ss;
-		ss << h.source() << '/' << h.name();
-		EventQueue::iterator si = mStagingList.find(ss.str());
-		if (si != mStagingList.end()) {
-			// raw data loaded, but still need to construct the resource object and store in the cache
-			AsyncLoadDoneEvent &e = *(static_cast<AsyncLoadDoneEvent*>(si->second.get()));
-			if (!e.mSuccess) { return ResLoadResult_Error; }	// error while loading
-
-			// construct a new Resource object, store it in a ResPtr
-			// and pass into the ResHandle
-			ResPtr resPtr(new TResource(h.name(), e.mSize, cache));
-			h.mResPtr = resPtr;
-			// store the resource in a cache (specified by the resource)
-			bool added = cache->addToCache(e.mSize, h);
-			if (added) {
-				// call the resource's onLoad method
-				TResource *pRes = static_cast<TResource*>(resPtr.get());
-				pRes->onLoad(e.mDataPtr, true);
-			}
-			// remove event from staging list
-			mStagingList.erase(si);
-			// return success if added to cache
-			return (added ? ResLoadResult_Success : ResLoadResult_Error);
-
-		} else {
-			// data not in staging area, check loading queue to see if it has already been requested
-			RequestQueue::const_iterator ri = mRequestList.find(ss.str());
-			if (ri == mRequestList.end()) {
-				// not yet requested, queue it up to load asynchronously in a thread process
-				ResSourceMap::const_iterator mi = mSourceMap.find(h.source());
-				if (mi != mSourceMap.end()) {
-					// add to request list, index by source/name
-					mRequestList.insert(ss.str());
-					// queues an event for thread to pick up
-					EventPtr ePtr(new AsyncLoadEvent(h.name(), h.source(), mi->second));
-					events.raise(ePtr);
-				} else {
-					return ResLoadResult_Error; // not in the queue, error requesting
-				}
-			}
+	if (cache->getResource(h.mResPtr, h.name())) { return ResLoadResult_Success; } // found in the cache
+
+	ResSourceMap::const_iterator mi = mSourceMap.find(h.source());
+	if (mi == mSourceMap.end()) { return ResLoadResult_Error; } // no source, error requesting
+
+	// check the in-flight requests to see if it has already been requested
+	bool isNew = false;
+	ResLoadRequestPtr reqPtr(beginRequest(h, mi->second, priority, false, isNew));
+	if (isNew) {
+		if (cache->getResource(h.mResPtr, h.name())) {
+			fulfillRequest(*reqPtr, h.mResPtr);
+			return ResLoadResult_Success;
 		}
-
-		return ResLoadResult_Waiting; // not in the queue, but requested for loading in the background
+		// not yet requested, queue it up for the loader threads
+		mLoadQueue.push(reqPtr, priority);
+		return ResLoadResult_Waiting;
+	}
+	if (reqPtr->isLoading()) {
+		// an interactive request for something queued as prefetch jumps ahead
+		if (reqPtr->promote(priority)) {
+			mLoadQueue.push(reqPtr, priority);
+		}
+		return ResLoadResult_Waiting; // requested for loading in the background
 	}
-	return ResLoadResult_Success; // found in the cache
+	// raw data loaded, but may still need to construct the resource object and store in the cache
+	return finishRequest<TResource>(*reqPtr, h, true);
 }
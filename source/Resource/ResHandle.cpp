@@ -20,6 +20,15 @@ bool ResHandle::getFromCache(const string &resName, ResCacheType cacheType)
 	return resMgr.getFromCache(*this, cacheType);
 }
 
+/*---------------------------------------------------------------------
+	Cancels a pending tryLoad request for this handle's resource, if a
+	loader thread has not picked it up yet. Returns true if cancelled.
+---------------------------------------------------------------------*/
+bool ResHandle::cancelLoad()
+{
+	return resMgr.cancelLoad(*this);
+}
+
 ////////// class Resource //////////
 
 /*---------------------------------------------------------------------
@@ -41,8 +50,11 @@ bool Resource::injectIntoCache(const ResPtr &resPtr, ResCacheType cacheType)
 		debugPrintf("Resource: Error: cannot inject a Resource with no name!\n");
 		return false;
 	}
+	// the cache must be known to give back the memory when the resource is destroyed
+	const ResCachePtr &cache = resMgr.getResCache(cacheType);
+	resPtr->mResCacheWeakPtr = cache;
 	// returns true if added, false if no room or name already exists
-	return resMgr.getResCache(cacheType)->addToCache(resPtr);
+	return cache->addToCache(resPtr);
 }
 
 /*---------------------------------------------------------------------
@@ -67,6 +79,6 @@ Resource::~Resource()
 	// holding onto it have also released it or are destroyed.
 	// ** NOTE ** uses weak_ptr pattern to ResCache incase cache does not exist at time of call
 	if (ResCachePtr r = mResCacheWeakPtr.lock()) {
-		r->memoryHasBeenFreed(sizeB());
+		r->memoryHasBeenFreed(sizeB(), mOversized);
 	}
 }
\ No newline at end of file
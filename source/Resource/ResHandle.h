@@ -103,6 +103,16 @@ enum ResLoadResult : uchar {
 	ResLoadResult_Error
 };
 
+/*=============================================================================
+	Priority class of an asynchronous load request. Loader threads always
+	drain interactive requests before prefetch requests.
+=============================================================================*/
+enum ResLoadPriority : uchar {
+	ResLoadPriority_Interactive = 0,	// something is waiting on the result
+	ResLoadPriority_Prefetch,			// speculative, e.g. cache warm-up
+	ResLoadPriority_MAX
+};
+
 ///// STRUCTURES /////
 
 class Resource;
@@ -141,7 +151,14 @@ class ResHandle : private boost::noncopyable {
 			loading.
 		---------------------------------------------------------------------*/
 		template <typename TResource>
-		inline ResLoadResult tryLoad(const string &resPath);
+		inline ResLoadResult tryLoad(const string &resPath,
+									 ResLoadPriority priority = ResLoadPriority_Interactive);
+
+		/*---------------------------------------------------------------------
+			Cancels a pending tryLoad request for this handle's resource, if a
+			loader thread has not picked it up yet. Returns true if cancelled.
+		---------------------------------------------------------------------*/
+		bool	cancelLoad();
 
 		/*---------------------------------------------------------------------
 			This will just attempt to pull a resource from a specific cache. If
@@ -169,10 +186,12 @@ class Resource
 	ResCache and any ResHandle's currently in scope
 =============================================================================*/
 class Resource : private boost::noncopyable {
+	friend class ResCache;	// allows the cache to drop mResCacheWeakPtr when it does not take the resource
 	protected:
 		///// VARIABLES /////
 		string		mName;			// this is the resource name, could be a filename or application-assigned
 		uint		mSizeB;			// size in bytes
+		bool		mOversized;		// charged to the cache's oversized bucket rather than its budget
 
 		ResCacheWeakPtr		mResCacheWeakPtr;	// points to the managing cache so memoryHasBeenFreed can be called
 
@@ -230,7 +249,7 @@ class Resource : private boost::noncopyable {
 			derived class - required for the res loading system
 		---------------------------------------------------------------------*/
 		explicit Resource(const string &name, uint sizeB, const ResCachePtr &resCachePtr) :
-			mName(name), mSizeB(sizeB), mResCacheWeakPtr(resCachePtr)
+			mName(name), mSizeB(sizeB), mOversized(false), mResCacheWeakPtr(resCachePtr)
 		{}
 		/*---------------------------------------------------------------------
 			this default constructor is provided for use from derived class
@@ -238,7 +257,7 @@ class Resource : private boost::noncopyable {
 			cache, or won't be cached at all.
 		---------------------------------------------------------------------*/
 		explicit Resource() :
-			mName(), mSizeB(0), mResCacheWeakPtr()
+			mName(), mSizeB(0), mOversized(false), mResCacheWeakPtr()
 		{}
 
 		virtual ~Resource();
@@ -279,7 +298,7 @@ inline bool ResHandle::load(const string &resPath)
 	loading.
 ---------------------------------------------------------------------*/
 template <typename TResource>
-inline ResLoadResult ResHandle::tryLoad(const string &resPath)
+inline ResLoadResult ResHandle::tryLoad(const string &resPath, ResLoadPriority priority)
 {
 	int i = resPath.find_first_of("/\\"); // find the first slash or backslash
 	if (i == string::npos) { // if no slash found, cannot find the source so return false
@@ -288,5 +307,5 @@ inline ResLoadResult ResHandle::tryLoad(const string &resPath)
 	}
 	mSource = resPath.substr(0, i);
 	mName = resPath.substr(i+1);
-	return ResCacheManager::instance().tryLoad<TResource>(*this);
+	return ResCacheManager::instance().tryLoad<TResource>(*this, priority);
 }
\ No newline at end of file
@@ -4,110 +4,376 @@
 	Rev.Date:	06/10/2009
 -------------------------------------*/
 
+#include <Windows.h>
+#include <Psapi.h>
 #include "ResourceProcess.h"
-#include "../Event/EventManager.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include "ResCache.h"
+#include "../Event/EventHandler.h"
 #include "../Event/RegisteredEvents.h"
-#include "ZipFile.h"
 
-////////// class AsyncLoadEvent //////////
+////////// class AsyncLoadProcess //////////
 
-const string AsyncLoadEvent::sEventType("SYS_RES_ASYNCLOAD");
+void AsyncLoadProcess::threadProc()
+{
+	ResLoadRequestPtr reqPtr;
+	// condition variable causes the process to sit idle until a request is in the queue,
+	// shutting down the queue wakes the thread and causes an exit
+	while (!threadKilled() && mLoadQueue.waitPop(reqPtr)) {
+		ResLoadRequest &req = *reqPtr;
+		// skip requests that were cancelled, or already taken from the other priority queue
+		if (!req.claim()) {
+			reqPtr.reset();
+			continue;
+		}
 
-/*void AsyncLoadEvent::buildScriptData()
+		int threadIndex = -1;
+		// find the threadIndex in our source map, or call getNewThreadIndex if it doesn't exist yet
+		ThreadIndexMap::const_iterator i = mSourceThreadIndexMap.find(req.sourceName());
+		if (i == mSourceThreadIndexMap.end()) {	// not found in the hash_map
+			threadIndex = req.sourcePtr()->getNewThreadIndex();	// request a threadIndex from the ResourceSource
+			mSourceThreadIndexMap[req.sourceName()] = threadIndex;	// store in the hash_map for future reference
+		} else {
+			threadIndex = i->second;	// found in map, get the stored threadIndex
+		}
+
+		BufferPtr dataPtr((char *)0);
+		int size = 0;
+		// threadIndex -1 means there was an error opening the file
+		if (threadIndex != -1) {
+			// load from source
+			size = req.sourcePtr()->getResource(req.resName(), dataPtr, threadIndex);
+			debugPrintf("%s: async load \"%s\": success=%i\n", name().c_str(), req.resName().c_str(), (size != 0));
+		}
+		// hand the data to the request, the next tryLoad() for it will construct and cache the resource
+		req.complete(dataPtr, size);
+		reqPtr.reset();
+	}
+}
+
+AsyncLoadProcess::AsyncLoadProcess(const string &name, AsyncLoadQueue &loadQueue) :
+	ThreadProcess(name),
+	mLoadQueue(loadQueue)
+{}
+
+AsyncLoadProcess::~AsyncLoadProcess()
 {
-	mScriptData.clear();
-	mScriptData.push_back(AnyVarsValue("mZipFileName", mZipFileName));
-	mScriptData.push_back(AnyVarsValue("mFileName", mFileName));
-	mScriptDataBuilt = true;
+	killThread();	// request thread to shut down
+	// ResCacheManager shuts down the queue to wake up the thread incase it's idle
+	if (!isFinished()) {
+		finish();	// ensures the main thread will wait for thread to join
+	}
 }
 
-AsyncLoadEvent::AsyncLoadEvent(const AnyVars &eventData) :
-	ScriptableEvent(eventData)
+////////// class CacheWarmupProcess //////////
+
+/*---------------------------------------------------------------------
+	Reads the manifest, most hit first, and requests each entry until the
+	total budget or the budget of its cache would be exceeded
+---------------------------------------------------------------------*/
+void CacheWarmupProcess::onInitialize()
 {
-	for (AnyVars::const_iterator i = eventData.begin(); i != eventData.end(); ++i) {
-		try {
-			if (_stricmp(i->first.c_str(), "mZipFileName") == 0) {
-				mZipFileName = any_cast<wstring>(i->second);
-			} else if (_stricmp(i->first.c_str(), "mFileName") == 0) {
-				mFileName = any_cast<string>(i->second);
-			}
-		} catch (const boost::bad_any_cast &ex) {
-			// nothing happens with a bad datatype in release build, silently ignores
-			debugPrintf("AsyncLoadEvent: bad_any_cast \"%s\"\n", ex.what());
+	std::ifstream ifs(mManifestFilename.c_str());
+	if (!ifs.good()) {
+		debugPrintf("CacheWarmupProcess: no manifest \"%s\"\n", mManifestFilename.c_str());
+		return;
+	}
+	uint totalB = 0;
+	uint cacheB[ResCache_MAX] = { 0 };
+	string line;
+	while (std::getline(ifs, line)) {
+		std::istringstream iss(line);
+		int cacheType = 0;
+		uint sizeB = 0, hits = 0;
+		string resPath;
+		if (!(iss >> cacheType >> sizeB >> hits) || cacheType < 0 || cacheType >= ResCache_MAX) {
+			continue;
+		}
+		std::getline(iss >> std::ws, resPath);
+		const ResCachePtr &cache = resMgr.getResCache((ResCacheType)cacheType);
+		if (resPath.empty() || !cache ||
+			cacheB[cacheType] + sizeB > cache->maxSizeBytes())
+		{
+			continue;
+		}
+		if (totalB + sizeB > mBudgetB) { break; }
+
+		Prefetch p;
+		p.mHandlePtr.reset(new ResHandle());
+		p.mResPath = resPath;
+		p.mCacheType = (ResCacheType)cacheType;
+		if (resMgr.prefetch(*p.mHandlePtr, p.mCacheType, resPath) == ResLoadResult_Waiting) {
+			mPending.push_back(p);
+		}
+		totalB += sizeB;
+		cacheB[cacheType] += sizeB;
+	}
+	debugPrintf("CacheWarmupProcess: %u resources requested, %u bytes\n", mPending.size(), totalB);
+}
+
+/*---------------------------------------------------------------------
+	Polls the outstanding requests, tryLoad constructs and caches each
+	resource once its data has been loaded
+---------------------------------------------------------------------*/
+void CacheWarmupProcess::onUpdate(float deltaMillis)
+{
+	PrefetchList::iterator i = mPending.begin();
+	while (i != mPending.end()) {
+		ResLoadResult result = resMgr.prefetch(*i->mHandlePtr, i->mCacheType, i->mResPath);
+		if (result == ResLoadResult_Waiting) {
+			++i;
+			continue;
+		}
+		if (result == ResLoadResult_Success) {
+			++mLoadedCount;
+			mLoadedB += i->mHandlePtr->getResPtr()->sizeB();
 		}
+		i = mPending.erase(i);
+	}
+	if (mPending.empty()) {
+		finish();
 	}
-}*/
+}
 
-////////// class AsyncLoadDoneEvent //////////
+void CacheWarmupProcess::onFinish()
+{
+	debugPrintf("CacheWarmupProcess: warm-up done, %u resources loaded, %u bytes\n", mLoadedCount, mLoadedB);
+}
 
-const string AsyncLoadDoneEvent::sEventType("SYS_RES_ASYNCLOAD_DONE");
+CacheWarmupProcess::CacheWarmupProcess(const string &manifestFilename, uint budgetMB) :
+	CProcess("CacheWarmupProcess"),
+	mManifestFilename(manifestFilename),
+	mBudgetB(budgetMB*1024*1024),
+	mLoadedCount(0), mLoadedB(0)
+{}
 
-////////// class AsyncLoadProcess //////////
+////////// class MemoryGovernorProcess //////////
 
-const string AsyncLoadProcess::sAsyncLoadShutdownEvent("SYS_RES_ASYNCLOAD_SHUTDOWN");
+const float MemoryGovernorProcess::sShrinkFactor = 0.75f;
+const float MemoryGovernorProcess::sGrowStep = 0.125f;
+const float MemoryGovernorProcess::sMinScale = 0.125f;
 
-void AsyncLoadProcess::threadProc()
+bool MemoryGovernorProcess::readMemoryState(uint64 &limitB, uint64 &usedB) const
 {
+	PROCESS_MEMORY_COUNTERS_EX counters;
+	JOBOBJECT_EXTENDED_LIMIT_INFORMATION jobInfo;
+	memset(&jobInfo, 0, sizeof(jobInfo));
+	// a NULL handle queries the job the process belongs to, fails if there is none
+	if (QueryInformationJobObject(NULL, JobObjectExtendedLimitInformation,
+								  &jobInfo, sizeof(jobInfo), NULL) != 0 &&
+		(jobInfo.BasicLimitInformation.LimitFlags & (JOB_OBJECT_LIMIT_PROCESS_MEMORY | JOB_OBJECT_LIMIT_JOB_MEMORY)) &&
+		GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&counters, sizeof(counters)) != 0)
+	{
+		// the tighter of the two limits, the server is expected to be the job's main process
+		limitB = 0;
+		if (jobInfo.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_PROCESS_MEMORY) {
+			limitB = jobInfo.ProcessMemoryLimit;
+		}
+		if ((jobInfo.BasicLimitInformation.LimitFlags & JOB_OBJECT_LIMIT_JOB_MEMORY) &&
+			(limitB == 0 || jobInfo.JobMemoryLimit < limitB))
+		{
+			limitB = jobInfo.JobMemoryLimit;
+		}
+		usedB = counters.PrivateUsage;
+		return (limitB > 0);
+	}
+
+	if (!mWatchSystem) { return false; }
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if (GlobalMemoryStatusEx(&status) == 0 || status.ullTotalPhys == 0) {
+		return false;
+	}
+	limitB = status.ullTotalPhys;
+	usedB = status.ullTotalPhys - status.ullAvailPhys;
+	return true;
+}
+
+void MemoryGovernorProcess::onUpdate(float deltaMillis)
+{
+	mElapsedMillis += deltaMillis;
+	if (mElapsedMillis < sCheckIntervalMillis) { return; }
+	mElapsedMillis = 0;
+
+	uint64 limitB = 0, usedB = 0;
+	if (!readMemoryState(limitB, usedB)) { return; }
+	uint percent = (uint)(usedB * 100 / limitB);
+
+	float scale = mScale;
+	if (percent >= mHighPercent) {
+		// evictions only lower the process's usage once their slabs are freed
+		uint64 freedB = BufferPool::trim();
+		if (freedB > 0) {
+			debugPrintf("MemoryGovernorProcess: memory at %u%%, %llu bytes of free slabs released\n", percent, freedB);
+			return;	// measure again before shrinking
+		}
+		scale = std::max(sMinScale, mScale * sShrinkFactor);
+	} else if (percent < mLowPercent) {
+		scale = std::min(1.0f, mScale + sGrowStep);
+	}
+	if (scale != mScale) {
+		debugPrintf("MemoryGovernorProcess: memory at %u%%, cache budgets scaled to %.3f\n", percent, scale);
+		mScale = scale;
+		resMgr.scaleBudgets(mScale);
+		BufferPool::trim();
+	}
+}
+
+MemoryGovernorProcess::MemoryGovernorProcess(uint highPercent, uint lowPercent, bool watchSystem) :
+	CProcess("MemoryGovernorProcess"),
+	mHighPercent(highPercent), mLowPercent(lowPercent),
+	mScale(1.0f), mElapsedMillis(0), mWatchSystem(watchSystem)
+{}
+
+////////// class DirectoryWatchProcess //////////
+
+const string ResourceChangedEvent::sEventType("resourceChanged");
+const EventTypeId ResourceChangedEvent::sTypeId(EventTypeRegistry::intern(ResourceChangedEvent::sEventType));
+
+void DirectoryWatchProcess::onInitialize()
+{
+	mDirHandle = CreateFileA(mRootPath.c_str(),
+							 FILE_LIST_DIRECTORY,
+							 FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, // don't lock editors out
+							 NULL,
+							 OPEN_EXISTING,
+							 FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,	// backup semantics to open a directory
+							 NULL);
+	if (mDirHandle == INVALID_HANDLE_VALUE) {
+		mDirHandle = 0;
+		debugPrintf("DirectoryWatchProcess: could not open \"%s\" (error %d)\n", mRootPath.c_str(), GetLastError());
+		finish();
+		return;
+	}
+	mStopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	ThreadProcess::onInitialize();
+}
+
+void DirectoryWatchProcess::onFinish()
+{
+	killThread();
+	if (mStopEvent) { SetEvent(mStopEvent); }
+	ThreadProcess::onFinish();	// join
+
+	if (mDirHandle) {
+		CloseHandle(mDirHandle);
+		mDirHandle = 0;
+	}
+	if (mStopEvent) {
+		CloseHandle(mStopEvent);
+		mStopEvent = 0;
+	}
+}
+
+void DirectoryWatchProcess::threadProc()
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	HANDLE waitHandles[2] = { ov.hEvent, mStopEvent };
+
+	// notify records are DWORD aligned
+	vector<DWORD> buffer(sNotifyBufferSize / sizeof(DWORD));
+	string name, lastName;
+
 	while (!threadKilled()) {
-		ThreadEventHandler &h = *((ThreadEventHandler *)mEventListener.mAsyncLoadHandler.get());
-		EventPtr ePtr;
-		h.mEventQueue.waitPop(ePtr);
-		// condition variable causes the process to sit idle until an event is in the queue,
-		// so a shutdown event could wake the thread and then exit. If load events
-		// are still queued, threadKilled() returning true could also cause an exit
-		if (ePtr->type() == sAsyncLoadShutdownEvent) break;
+		if (ReadDirectoryChangesW(mDirHandle, &buffer[0], sNotifyBufferSize, TRUE,
+								  FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE |
+								  FILE_NOTIFY_CHANGE_SIZE,
+								  NULL, &ov, NULL) == 0)
+		{
+			debugPrintf("DirectoryWatchProcess: ReadDirectoryChangesW failed (error %d)\n", GetLastError());
+			break;
+		}
 
-		// if it's not a shutdown event, we know it's a decompression event
-		AsyncLoadEvent &e = *(static_cast<AsyncLoadEvent*>(ePtr.get()));
+		DWORD bytes = 0;
+		if (WaitForMultipleObjects(2, waitHandles, FALSE, INFINITE) != WAIT_OBJECT_0) {
+			// stop requested, the read must complete before the buffer goes away
+			CancelIo(mDirHandle);
+			GetOverlappedResult(mDirHandle, &ov, &bytes, TRUE);
+			break;
+		}
+		if (GetOverlappedResult(mDirHandle, &ov, &bytes, FALSE) == 0) {
+			debugPrintf("DirectoryWatchProcess: GetOverlappedResult failed (error %d)\n", GetLastError());
+			break;
+		}
+		ResetEvent(ov.hEvent);
 
-		int threadIndex = -1;
-		// find the threadIndex in our source map, or call getNewThreadIndex if it doesn't exist yet
-		ThreadIndexMap::const_iterator i = mSourceThreadIndexMap.find(e.mSourceName);
-		if (i == mSourceThreadIndexMap.end()) {	// not found in the hash_map
-			threadIndex = e.mSourcePtr->getNewThreadIndex();	// request a threadIndex from the ResourceSource
-			mSourceThreadIndexMap[e.mSourceName] = threadIndex;	// store in the hash_map for future reference
-		} else {
-			threadIndex = i->second;	// found in map, get the stored threadIndex
+		if (bytes == 0) {
+			// more changes than fit in the buffer, the individual names were lost
+			eventMgr.raiseThreadSafe(EventPtr(new ResourceChangedEvent(mSourceName, string())));
+			continue;
 		}
-		debugPrintf("GOT THREADINDEX = %i\n\n", threadIndex); // TEMP
 
-		bool success = false;
-		BufferPtr dataPtr((char *)0);
-		int size = 0;
-		// threadIndex -1 means there was an error opening the file
-		if (threadIndex != -1) {
-			// load from source
-			size = e.mSourcePtr->getResource(e.mResName, dataPtr, threadIndex);
-			if (size) {
-				success = true;
-				debugPrintf("%s: async load \"%s\": success=%i\n", name().c_str(), e.mResName.c_str(), success);
+		// one event per file, editors tend to report a save as several consecutive changes
+		lastName.clear();
+		const char *pos = reinterpret_cast<const char *>(&buffer[0]);
+		for (;;) {
+			const FILE_NOTIFY_INFORMATION &info = *reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(pos);
+			int nameLen = (int)(info.FileNameLength / sizeof(WCHAR));
+			int len = WideCharToMultiByte(CP_ACP, 0, info.FileName, nameLen, NULL, 0, NULL, NULL);
+			if (len > 0) {
+				name.resize(len);
+				WideCharToMultiByte(CP_ACP, 0, info.FileName, nameLen, &name[0], len, NULL, NULL);
+				if (name != lastName) {
+					eventMgr.raiseThreadSafe(EventPtr(new ResourceChangedEvent(mSourceName, name)));
+					lastName = name;
+				}
 			}
+			if (info.NextEntryOffset == 0) { break; }
+			pos += info.NextEntryOffset;
 		}
-		// send async load result event
-		EventPtr doneEventPtr(new AsyncLoadDoneEvent(e.mResName, e.mSourceName, dataPtr, size, success));
-		eventMgr.raiseThreadSafe(doneEventPtr);
 	}
+
+	CloseHandle(ov.hEvent);
+	killThread();	// let the main thread know the watch has ended
 }
 
-AsyncLoadProcess::AsyncLoadProcess(const string &name) :
-	ThreadProcess(name)
+DirectoryWatchProcess::DirectoryWatchProcess(const string &sourceName, const string &rootPath) :
+	ThreadProcess("DirectoryWatchProcess_" + sourceName),
+	mSourceName(sourceName),
+	mRootPath(rootPath),
+	mDirHandle(0),
+	mStopEvent(0),
+	mListener("DirectoryWatchListener_" + sourceName, *this)
+{}
+
+DirectoryWatchProcess::~DirectoryWatchProcess()
 {
-	// register the decompress event
-	eventMgr.registerEventType(AsyncLoadEvent::sEventType,
-							 //RegEventPtr(new ScriptCallableCodeEvent<AsyncLoadEvent>(EventDataType_NotEmpty)));
-							 RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
-	// register the decompress done event
-	eventMgr.registerEventType(AsyncLoadDoneEvent::sEventType,
-							 RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
-	// register the exit thread event
-	eventMgr.registerEventType(sAsyncLoadShutdownEvent,
-							 RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+	if (!isFinished()) {
+		finish();	// wake the thread and wait for it to join
+	}
 }
 
-AsyncLoadProcess::~AsyncLoadProcess()
+///// class DirectoryWatchListener /////
+
+/*---------------------------------------------------------------------
+	Drops the changed resource of this listener's source from the
+	caches. Never consumes the event, other sources may be watched by
+	other listeners.
+---------------------------------------------------------------------*/
+bool DirectoryWatchProcess::DirectoryWatchListener::handleResourceChangedEvent(const EventPtr &ePtr)
 {
-	killThread();	// request thread to shut down
-	// send shutdown event to wake up the thread and allow it to exit incase it's idle
-	eventMgr.trigger(sAsyncLoadShutdownEvent);
-	finish();	// ensures the main thread will wait for thread to join
+	const ResourceChangedEvent &e = *(static_cast<ResourceChangedEvent*>(ePtr.get()));
+	if (e.mSource == mWatchProc.mSourceName) {
+		resMgr.invalidate(e.mSource, e.mName);
+	}
+	return false;
+}
+
+DirectoryWatchProcess::DirectoryWatchListener::DirectoryWatchListener(const string &name, DirectoryWatchProcess &watchProc) :
+	EventListener(name),
+	mWatchProc(watchProc)
+{
+	// shared by every watcher, the first one to be created registers it
+	if (!eventMgr.isEventTypeRegistered(ResourceChangedEvent::sEventType)) {
+		eventMgr.registerEventType(ResourceChangedEvent::sEventType,
+									RegEventPtr(new CodeOnlyEvent(EventDataType_NotEmpty)));
+	}
+	// the caches are thread safe, so invalidation can run alongside other event types
+	registerEventHandler(ResourceChangedEvent::sEventType,
+		IEventHandlerPtr(new EventHandler<DirectoryWatchListener>(this, &DirectoryWatchListener::handleResourceChangedEvent)),
+		0, ListenerAffinity_Parallel);
 }
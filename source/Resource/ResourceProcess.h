@@ -7,118 +7,203 @@
 #pragma once
 
 #include <string>
+#include <vector>
+#include <memory>
+#include <hash_map>
+#include "ResHandle.h"
 #include "../Process/ThreadProcess.h"
 #include "../Event/EventListener.h"
 
 using std::string;
+using std::vector;
+using std::shared_ptr;
+using stdext::hash_map;
 using boost::checked_array_deleter;
 
-class IResourceSource;
+class AsyncLoadQueue;
 
 ///// STRUCTURES /////
 
-/*=====================================================================
-class AsyncLoadEvent
-=====================================================================*/
-class AsyncLoadEvent : public Event {
-	public:
-		typedef shared_ptr<IResourceSource>		ResSourcePtr;
+/*=============================================================================
+class AsyncLoadProcess
+	One of the pool of loader threads created by ResCacheManager. Each pops
+	requests from the shared AsyncLoadQueue, reads them from their source
+	with its own threadIndex for that source, and hands the data back to the
+	request. The main thread picks the result up on the next tryLoad().
+=============================================================================*/
+class AsyncLoadProcess : public ThreadProcess {
+	private:
+		///// DEFINITIONS /////
+		typedef	hash_map<string, int>	ThreadIndexMap;
 
 		///// VARIABLES /////
-		static const string sEventType;
+		AsyncLoadQueue &	mLoadQueue;
+		ThreadIndexMap		mSourceThreadIndexMap;	// for each ResSource, the threadIndex assigned to this thread
+
+		///// FUNCTIONS /////
+		void onUpdate(float deltaMillis) {}
 
-		string			mResName;		// the file to load from the source object
-		string			mSourceName;	// the name of the ResourceSource
-		ResSourcePtr	mSourcePtr;		// shared_ptr to the ResourceSource
+		void threadProc();
+
+	public:
+		explicit AsyncLoadProcess(const string &name, AsyncLoadQueue &loadQueue);
+		~AsyncLoadProcess();
+};
+
+/*=============================================================================
+class CacheWarmupProcess
+	Reads the manifest written by ResCacheManager::writeManifest at the last
+	shutdown and prefetches the most hit resources, up to the budget, through
+	the loader pool at prefetch priority. Runs alongside the servers, any
+	interactive request for the same resource joins or jumps ahead of the
+	prefetch. Finishes once every prefetch has completed or failed.
+=============================================================================*/
+class CacheWarmupProcess : public CProcess {
+	private:
+		///// DEFINITIONS /////
+		struct Prefetch {
+			shared_ptr<ResHandle>	mHandlePtr;
+			string					mResPath;
+			ResCacheType			mCacheType;
+		};
+		typedef vector<Prefetch>	PrefetchList;
+
+		///// VARIABLES /////
+		string			mManifestFilename;
+		uint			mBudgetB;
+		PrefetchList	mPending;		// requests still waiting on a loader thread
+		uint			mLoadedCount;
+		uint			mLoadedB;
 
 		///// FUNCTIONS /////
-		const string &	type() const { return sEventType; }
-		//void	serialize(ostream &out) const {}
-		//void	deserialize(istream &in) {}
-		//void	buildScriptData();
-
-		// Constructor / destructor
-		explicit AsyncLoadEvent(const string &resName, const string &sourceName,
-								const ResSourcePtr &sourcePtr) :
-			Event(),
-			//ScriptableEvent(),
-			mResName(resName),
-			mSourceName(sourceName),
-			mSourcePtr(sourcePtr)
-		{}
-		//explicit AsyncLoadEvent(const AnyVars &eventData);
-		virtual ~AsyncLoadEvent() {}
+		void	onInitialize();
+		void	onUpdate(float deltaMillis);
+		void	onFinish();
+		void	onTogglePause() {}
+
+	public:
+		explicit CacheWarmupProcess(const string &manifestFilename, uint budgetMB);
+		~CacheWarmupProcess() {}
 };
+/*=============================================================================
+class MemoryGovernorProcess
+	Watches memory use once a second and scales every cache's budget with
+	ResCacheManager::scaleBudgets. When running in a job object with a
+	memory limit (as in a container) the process's committed memory is
+	measured against that limit. System wide physical memory use is only
+	measured when watchSystem is set, since other processes move it. At or
+	above the high percentage, slabs the caches no longer use are returned
+	with BufferPool::trim first, and only if none were the budgets shrink by
+	a quarter, down to sMinScale. Below the low percentage they grow back in
+	steps of sGrowStep until the configured sizes are restored.
+=============================================================================*/
+class MemoryGovernorProcess : public CProcess {
+	public:
+		///// DEFINITIONS /////
+		static const uint	sCheckIntervalMillis = 1000;
+		static const float	sShrinkFactor;
+		static const float	sGrowStep;
+		static const float	sMinScale;
+
+	private:
+		///// VARIABLES /////
+		uint	mHighPercent;
+		uint	mLowPercent;
+		float	mScale;			// current fraction of the configured budgets
+		float	mElapsedMillis;	// since the last check
+		bool	mWatchSystem;	// measure system memory when there is no job limit
+
+		///// FUNCTIONS /////
+		/*---------------------------------------------------------------------
+			Gets the memory limit that applies to the server and the usage
+			measured against it, returns false if neither can be read or
+			there is no job limit and system memory isn't watched
+		---------------------------------------------------------------------*/
+		bool	readMemoryState(uint64 &limitB, uint64 &usedB) const;
+
+		void	onInitialize() {}
+		void	onUpdate(float deltaMillis);
+		void	onFinish() {}
+		void	onTogglePause() {}
 
-/*=====================================================================
-class AsyncLoadDoneEvent
-=====================================================================*/
-class AsyncLoadDoneEvent : public Event {
 	public:
-		typedef shared_ptr<char>	BufferPtr; // use checked_array_deleter<char> to ensure delete[] called
+		float	scale() const { return mScale; }
 
+		explicit MemoryGovernorProcess(uint highPercent, uint lowPercent, bool watchSystem);
+		~MemoryGovernorProcess() {}
+};
+
+/*=============================================================================
+class ResourceChangedEvent
+	Raised from a DirectoryWatchProcess thread when a file under the root of
+	a watched source is written, created, renamed or deleted. An empty mName
+	means changes were missed and the whole source should be considered stale.
+=============================================================================*/
+class ResourceChangedEvent : public Event {
+	public:
 		///// VARIABLES /////
 		static const string sEventType;
-		bool		mSuccess;		// true if decompression successful
-		int			mSize;			// size of the buffer array
-		string		mResName;		// the resource path
-		string		mSourceName;	// the name of the ResourceSource
-		BufferPtr	mDataPtr;		// the buffer containing data
+		static const EventTypeId sTypeId;
+
+		string	mSource;	// name the source was registered with
+		string	mName;		// resource name relative to the source root
 
 		///// FUNCTIONS /////
-		const string &	type() const { return sEventType; }
-		//void	serialize(ostream &out) const {}
-		//void	deserialize(istream &in) {}
-
-		// Constructor / destructor
-		explicit AsyncLoadDoneEvent(const string &resName, const string &sourceName,
-									const BufferPtr &bPtr, int size, bool success = true) :
-			Event(),
-			mResName(resName), mSourceName(sourceName), mDataPtr(bPtr),
-			mSize(size), mSuccess(success)
+		const string & type() const { return sEventType; }
+		EventTypeId typeId() const { return sTypeId; }
+
+		explicit ResourceChangedEvent(const string &source, const string &name) :
+			Event(), mSource(source), mName(name)
 		{}
-		virtual ~AsyncLoadDoneEvent() {}
 };
 
 /*=============================================================================
-class AsyncLoadProcess
+class DirectoryWatchProcess
+	Watches the root directory of a file system source with
+	ReadDirectoryChangesW and raises a ResourceChangedEvent for each changed
+	file. The events are handled on the main thread, where only the affected
+	resources are removed from the caches so edits show up on the next
+	request while everything else stays cached.
 =============================================================================*/
-class AsyncLoadProcess : public ThreadProcess {
-	private:
-		///// DEFINITIONS /////
-		typedef	hash_map<string, int>	ThreadIndexMap;
+class DirectoryWatchProcess : public ThreadProcess {
+	friend class DirectoryWatchListener;
 
+	private:
 		///// STRUCTURES /////
 		/*=====================================================================
-		class AsyncLoadListener
+		class DirectoryWatchListener
 		=====================================================================*/
-		class AsyncLoadListener : public EventListener {
-			friend class AsyncLoadProcess;
+		class DirectoryWatchListener : public EventListener {
+			friend class DirectoryWatchProcess;
 			private:
-				IEventHandlerPtr	mAsyncLoadHandler;	// we need to hang on to a shared_ptr to the
-														// handler for access to its stored queue
+				///// VARIABLES /////
+				DirectoryWatchProcess &mWatchProc;
+
+				///// FUNCTIONS /////
+				bool handleResourceChangedEvent(const EventPtr &ePtr);
+
 			public:
-				explicit AsyncLoadListener() :
-					EventListener("AsyncLoadListener"),
-					mAsyncLoadHandler(new ThreadEventHandler())
-				{
-					registerEventHandler(AsyncLoadEvent::sEventType, mAsyncLoadHandler, 1);
-					registerEventHandler(sAsyncLoadShutdownEvent, mAsyncLoadHandler, 1);
-				}
+				explicit DirectoryWatchListener(const string &name, DirectoryWatchProcess &watchProc);
 		};
 
+		///// DEFINITIONS /////
+		static const uint sNotifyBufferSize = 16 * 1024;
+
 		///// VARIABLES /////
-		AsyncLoadListener	mEventListener;
-		ThreadIndexMap		mSourceThreadIndexMap;	// for each ResSource, the threadIndex assigned to this thread
+		string					mSourceName;
+		string					mRootPath;
+		void *					mDirHandle;		// void* = HANDLE, opened for overlapped change notification
+		void *					mStopEvent;		// signalled by onFinish to wake the thread
+		DirectoryWatchListener	mListener;
 
 		///// FUNCTIONS /////
-		void onUpdate(float deltaMillis) {}
+		void	onUpdate(float deltaMillis) {}
+		void	onInitialize();
+		void	onFinish();
 
-		void threadProc();
+		void	threadProc();
 
 	public:
-		static const string sAsyncLoadShutdownEvent;
-
-		explicit AsyncLoadProcess(const string &name);
-		~AsyncLoadProcess();
-};
\ No newline at end of file
+		explicit DirectoryWatchProcess(const string &sourceName, const string &rootPath);
+		~DirectoryWatchProcess();
+};
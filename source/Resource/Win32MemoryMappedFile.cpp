@@ -1,119 +1,216 @@
-/*----==== WIN32MEMORYMAPPEDFILE.H ====----
+/*----==== WIN32MEMORYMAPPEDFILE.CPP ====----
 	Author:	Jeffrey Kiah
 	Date:	7/18/2007
------------------------------------------*/
+-------------------------------------------*/
 
 #include "Windows.h"
 #include "Win32MemoryMappedFile.h"
+#include <climits>
 
+///// DEFINITIONS /////
 
-////////// class Win32MemoryMappedFile //////////
+// WIN32_MEMORY_RANGE_ENTRY and PrefetchVirtualMemory are Windows 8 and up, not in the VS2010 SDK
+struct MemoryRangeEntry {
+	void *	VirtualAddress;
+	SIZE_T	NumberOfBytes;
+};
+typedef BOOL (WINAPI *PrefetchVirtualMemoryFunc)(HANDLE, ULONG_PTR, MemoryRangeEntry *, ULONG);
+
+///// VARIABLES /////
+
+// resolved during static initialization, before any loader thread runs, null on older systems
+static const PrefetchVirtualMemoryFunc sPrefetchVirtualMemory =
+	(PrefetchVirtualMemoryFunc)GetProcAddress(GetModuleHandleA("kernel32.dll"), "PrefetchVirtualMemory");
+
+////////// class MappedView //////////
 
 ///// FUNCTIONS /////
 
-// if open returns false, close should be called to clean up
-bool Win32MemoryMappedFile::open()
+MappedViewPtr MappedView::create(const wstring &fileName, bool prefetch)
 {
-	// ensure length of filename is within limits
-	if (mFileName.length() > MAX_PATH) {
-		debugPrintf("Win32MemoryMappedFile::open: mFileName length greather than MAX_PATH\n");
-		return false;
+	MappedViewPtr viewPtr(new MappedView());
+
+	// Open the file read-only. The scan and random access flags are left off, they only steer the
+	// cache manager's read-ahead for ReadFile and do nothing for page faults in a view.
+	// Write sharing is refused so the bytes under the view can't change, a file may still be
+	// renamed, deleted or replaced by rename, which leaves the view on the old contents.
+	viewPtr->mFileHandle = CreateFileW(	fileName.c_str(),
+										GENERIC_READ,		// give read-only access
+										FILE_SHARE_READ | FILE_SHARE_DELETE,
+										NULL,
+										OPEN_EXISTING,		// function fails if file does not exist
+										FILE_ATTRIBUTE_NORMAL,
+										NULL);
+	if (viewPtr->mFileHandle == INVALID_HANDLE_VALUE) {
+		viewPtr->mFileHandle = 0;
+		debugPrintf("MappedView::create: Could not open file (error %d)\n", GetLastError());
+		return MappedViewPtr();
 	}
 
-	// Open memory mapped file
-	mFileHandle = CreateFile(	mFileName.c_str(),
-								GENERIC_READ,		// give read-only access
-								FILE_SHARE_READ,	// enable subsequent open access for read
-								NULL,
-								OPEN_EXISTING,		// function fails if file does not exist
-								FILE_FLAG_OVERLAPPED | FILE_FLAG_RANDOM_ACCESS,	// also check performance with SEQUENTIAL
-								NULL);
-	if (mFileHandle == INVALID_HANDLE_VALUE) { 
-		debugPrintf("Win32MemoryMappedFile::open: Could not open file (error %d)\n", GetLastError());
-        return false; 
-    }
-	mIsOpen = 1;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(viewPtr->mFileHandle, &size) == 0 || size.QuadPart == 0) {
+		// an empty file can't be mapped, and there is nothing to serve anyway
+		return MappedViewPtr();
+	}
+	if ((uint64)size.QuadPart > (SIZE_T)-1) {
+		debugPrintf("MappedView::create: file too large to map in this address space\n");
+		return MappedViewPtr();
+	}
+	viewPtr->mSize = size.QuadPart;
 
 	// create a mapping object from the file
-	mFileMapping = CreateFileMapping(	mFileHandle,
-										NULL,
-										PAGE_READONLY,
-										0, 0,
-										NULL);
-	if (mFileMapping == NULL) {
-		debugPrintf("Win32MemoryMappedFile::open: CreateFileMapping failed (error %d)\n", GetLastError());
-        return false;
+	viewPtr->mFileMapping = CreateFileMapping(viewPtr->mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (viewPtr->mFileMapping == NULL) {
+		debugPrintf("MappedView::create: CreateFileMapping failed (error %d)\n", GetLastError());
+		return MappedViewPtr();
 	}
-	mIsMapped = 1;
 
 	// map the file to a memory pointer
-	mFileBase = MapViewOfFile(	mFileMapping,
-								FILE_MAP_READ,
-								0, 0,
-								0);
-	if (mFileBase == NULL) {
-		debugPrintf("Win32MemoryMappedFile::open: MapViewOfFile failed (error %d)\n", GetLastError());
-		return false;
+	viewPtr->mFileBase = static_cast<char *>(MapViewOfFile(viewPtr->mFileMapping, FILE_MAP_READ, 0, 0, 0));
+	if (viewPtr->mFileBase == NULL) {
+		debugPrintf("MappedView::create: MapViewOfFile failed (error %d)\n", GetLastError());
+		return MappedViewPtr();
 	}
-	mIsViewed = 1;
 
-	return true;
+	if (prefetch && sPrefetchVirtualMemory) {
+		MemoryRangeEntry range = { viewPtr->mFileBase, (SIZE_T)viewPtr->mSize };
+		sPrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);	// only a hint, failure is harmless
+	}
+
+	return viewPtr;
 }
 
-// if open returns false, close should be called to clean up
-void Win32MemoryMappedFile::close()
+BufferPtr MappedView::makeBuffer(const MappedViewPtr &viewPtr, uint64 offset)
 {
-	if (mIsViewed == 1) {
+	_ASSERTE(viewPtr && offset < viewPtr->mSize && "MappedView offset out of range");
+	// aliasing constructor, the buffer shares the view's reference count
+	return BufferPtr(viewPtr, viewPtr->mFileBase + offset);
+}
+
+void MappedView::close()
+{
+	if (mFileBase) {
 		if (UnmapViewOfFile(mFileBase) == 0) {
-			debugPrintf("Win32MemoryMappedFile::close: UnmapViewOfFile failed (error %d)\n", GetLastError());
+			debugPrintf("MappedView::close: UnmapViewOfFile failed (error %d)\n", GetLastError());
 		}
-		mIsViewed = false;
+		mFileBase = 0;
 	}
-	if (mIsMapped == 1) {
+	if (mFileMapping) {
 		if (CloseHandle(mFileMapping) == 0) {
-			debugPrintf("Win32MemoryMappedFile::close: CloseHandle(mFileMapping) failed (error %d)\n", GetLastError());
+			debugPrintf("MappedView::close: CloseHandle(mFileMapping) failed (error %d)\n", GetLastError());
 		}
-		mIsMapped = false;
+		mFileMapping = 0;
 	}
-	if (mIsOpen == 1) {
+	if (mFileHandle) {
 		if (CloseHandle(mFileHandle) == 0) {
-			debugPrintf("Win32MemoryMappedFile::close: CloseHandle(mFileHandle) failed (error %d)\n", GetLastError());
+			debugPrintf("MappedView::close: CloseHandle(mFileHandle) failed (error %d)\n", GetLastError());
 		}
-		mIsOpen = false;
+		mFileHandle = 0;
 	}
 }
 
-// Interface implementations
-char * Win32MemoryMappedFile::get() const
-{
-	// find resource in index
-
-	// offset mFileBase by location
-	int offset = 0;
+////////// class Win32MemoryMappedFile //////////
 
-	// write to dest buffer
-	char *dest = static_cast<char*>(mFileBase) + offset;
-	// memcpy(dest, mFileBase, size);
-	// use ReadFileEx for asynch read in asynch class, but will probably need a flag
+///// FUNCTIONS /////
 
-	return 0;
+bool Win32MemoryMappedFile::open()
+{
+	DWORD attr = GetFileAttributesA(mRootPath.c_str());
+	if (attr == INVALID_FILE_ATTRIBUTES || !(attr & FILE_ATTRIBUTE_DIRECTORY)) {
+		debugPrintf("Win32MemoryMappedFile::open: \"%s\" is not a directory\n", mRootPath.c_str());
+		return false;
+	}
+	return true;
 }
 
-uint Win32MemoryMappedFile::getSize() const
+string Win32MemoryMappedFile::fullPath(const string &resName) const
 {
-	return 0;
+	string path(mRootPath);
+	char lastChar = path.back();
+	if (lastChar != '\\' && lastChar != '/') {
+		path.append("\\");
+	}
+	path.append(resName);
+	return path;
 }
 
-// Constructor / Destructor
-Win32MemoryMappedFile::Win32MemoryMappedFile(const wstring &fileName) :
-	IResourceSource(),
-	mFileName(fileName), mFileHandle(0), mFileMapping(0), mFileBase(0),
-	mIsOpen(0), mIsMapped(0), mIsViewed(0)
-{}
-
-Win32MemoryMappedFile::~Win32MemoryMappedFile()
+int Win32MemoryMappedFile::getResourceSize(const string &resName) const
 {
-	close();
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (GetFileAttributesExA(fullPath(resName).c_str(), GetFileExInfoStandard, &data) == 0 ||
+		data.nFileSizeHigh != 0 || data.nFileSizeLow > INT_MAX)
+	{
+		return -1;
+	}
+	return (int)data.nFileSizeLow;
 }
 
+/*---------------------------------------------------------------------
+	Returns the size in bytes of the resource, or 0 on error. Large
+	files are mapped and dataPtr aliases the view, smaller files are
+	read into a new buffer.
+---------------------------------------------------------------------*/
+int Win32MemoryMappedFile::getResource(const string &resName, BufferPtr &dataPtr, int threadIndex)
+{
+	dataPtr.reset();
+	string path(fullPath(resName));
+
+	int size = getResourceSize(resName);
+	if (size <= 0) { return 0; } // treat 0 size as an error, since resources must have size
+
+	if ((uint)size >= sMinMappedSize) {
+		wchar_t wPath[MAX_PATH];
+		if (MultiByteToWideChar(CP_ACP, 0, path.c_str(), -1, wPath, MAX_PATH) == 0) {
+			return 0;
+		}
+		MappedViewPtr viewPtr;
+		{
+			mutex::scoped_lock lock(mViewsMutex);
+			ViewMap::const_iterator vi = mViews.find(resName);
+			if (vi != mViews.end()) { viewPtr = vi->second.lock(); }
+		}
+		if (!viewPtr || viewPtr->size() != (uint64)size) {
+			viewPtr = MappedView::create(wPath, true);
+			if (!viewPtr || viewPtr->size() > INT_MAX) { return 0; }
+			mutex::scoped_lock lock(mViewsMutex);
+			// forget views no resource holds anymore, or every name ever mapped stays in the map
+			for (ViewMap::iterator vi = mViews.begin(); vi != mViews.end(); ) {
+				if (vi->second.expired()) {
+					vi = mViews.erase(vi);
+				} else {
+					++vi;
+				}
+			}
+			mViews[resName] = viewPtr;
+		}
+		dataPtr = MappedView::makeBuffer(viewPtr, 0);
+		return (int)viewPtr->size();
+	}
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+							  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return 0; }
+
+	BufferPtr bPtr(BufferPool::allocate(size));
+	DWORD bytesRead = 0;
+	BOOL ok = ReadFile(file, bPtr.get(), size, &bytesRead, NULL);
+	CloseHandle(file);
+	if (!ok || bytesRead != (DWORD)size) { return 0; }
 
+	dataPtr = bPtr;
+	return size;
+}
+
+/*---------------------------------------------------------------------
+	Forgets the views of changed files, resources that still hold one
+	keep it mapped until they are released, but no new load gets it
+---------------------------------------------------------------------*/
+void Win32MemoryMappedFile::invalidate(const string &resName)
+{
+	mutex::scoped_lock lock(mViewsMutex);
+	if (resName.empty()) {
+		mViews.clear();
+	} else {
+		mViews.erase(resName);
+	}
+}
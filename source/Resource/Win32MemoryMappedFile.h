@@ -8,38 +8,108 @@
 #include <string>
 #include "ResCache.h"
 
+using std::string;
 using std::wstring;
+using std::weak_ptr;
+
+///// DEFINITIONS /////
+
+class MappedView;
+typedef shared_ptr<MappedView>	MappedViewPtr;
 
 ///// STRUCTURES /////
 
 /*=============================================================================
-class Win32MemoryMappedFile
+class MappedView
+	A read-only view of an entire file. The view is shared, and buffers handed
+	out by makeBuffer alias into the mapping while holding a reference to it,
+	so the file stays mapped until the last resource using it is released.
+	No data is copied, reads are served from the system file cache.
 =============================================================================*/
-class Win32MemoryMappedFile : public IResourceSource {
+class MappedView : private boost::noncopyable {
 	private:
-		// Variables
+		///// VARIABLES /////
 		void *		mFileHandle;	// set with CreateFile, void* = HANDLE
 		void *		mFileMapping;	// set with CreateFileMapping
-		void *		mFileBase;		// set with MapViewOfFileEx
-		wstring		mFileName;		// relative path to the file on disk
-		uchar		mIsOpen, mIsMapped, mIsViewed;		// indicates the file is open, mapped, and viewed
+		char *		mFileBase;		// set with MapViewOfFile
+		uint64		mSize;			// size of the file and view
+
+		explicit MappedView() :
+			mFileHandle(0), mFileMapping(0), mFileBase(0), mSize(0)
+		{}
 
-		void			close();
+		void	close();
 
 	public:
-		// Interface implementations
-		virtual char *	get() const;
-		virtual uint	getSize() const;
-		virtual int		getResourceSize(const Resource &r) { return 0; }
-		virtual int		getResource(const Resource &r, char *buffer) { return 0; }
+		/*---------------------------------------------------------------------
+			Maps the whole file, returns an empty pointer on error or if the
+			file is empty. The file is shared for read and delete but not
+			write, so its contents can't change under a live view. Saving in
+			place fails while the view is held, replacing the file by rename
+			works and leaves the view on the old contents, so whoever hands
+			views out must drop them when the file is invalidated. Pass
+			prefetch for files that will be read front to back, the view is
+			then requested with PrefetchVirtualMemory where the OS has it
+			(Windows 8 and up), otherwise pages are faulted in on first touch.
+		---------------------------------------------------------------------*/
+		static MappedViewPtr	create(const wstring &fileName, bool prefetch);
 
-		// Member Functions
-		bool			isOpen() const	{ return (mIsOpen == 1); }
+		/*---------------------------------------------------------------------
+			Returns a buffer pointing at offset within the view, sharing
+			ownership of the view. The caller must check offset + length
+			against size().
+		---------------------------------------------------------------------*/
+		static BufferPtr		makeBuffer(const MappedViewPtr &viewPtr, uint64 offset);
 
-		bool			open();
+		// Accessors
+		const char *	data() const	{ return mFileBase; }
+		uint64			size() const	{ return mSize; }
 
-		// Constructor / Destructor
-		explicit Win32MemoryMappedFile(const wstring &fileName);
-		virtual ~Win32MemoryMappedFile();
+		~MappedView() { close(); }
 };
 
+/*=============================================================================
+class Win32MemoryMappedFile
+	Resource source for a directory on disk like FileSystemSource, but each
+	file of sMinMappedSize or more is served by mapping it rather than reading
+	it into a new buffer. Smaller files are read normally since a view always
+	reserves at least one 64KB allocation granule of address space, and they
+	are copied so they never keep the file from being written. Views are
+	kept by name while any resource still holds one, so reloading a file that
+	is still mapped reuses its view, and invalidate drops them so the next
+	load maps the changed file. Names of released views are pruned whenever a
+	new view is added.
+=============================================================================*/
+class Win32MemoryMappedFile : public IResourceSource {
+	public:
+		///// DEFINITIONS /////
+		static const uint sMinMappedSize = 64 * 1024;
+
+	private:
+		///// DEFINITIONS /////
+		typedef hash_map<string, weak_ptr<MappedView>>	ViewMap;
+
+		///// VARIABLES /////
+		string		mRootPath;		// relative path to the root (also want to support full path)
+		ViewMap		mViews;			// views handed out by resource name, expired once released
+		mutex		mViewsMutex;	// loader threads and the invalidating thread share mViews
+
+		///// FUNCTIONS /////
+		string		fullPath(const string &resName) const;
+
+	public:
+		///// FUNCTIONS /////
+		// Interface functions
+		virtual bool	open();
+		virtual int		getResourceSize(const string &resName) const;
+		virtual int		getResource(const string &resName, BufferPtr &dataPtr, int threadIndex = 0);
+		virtual int		getNewThreadIndex() { return 0; } // any thread may read
+		virtual void	invalidate(const string &resName);
+
+		// Constructor / Destructor
+		explicit Win32MemoryMappedFile(const string &rootPath) :
+			IResourceSource(),
+			mRootPath(rootPath)
+		{}
+		virtual ~Win32MemoryMappedFile() {}
+};
@@ -7,14 +7,18 @@
 				Got code from Game Coding Complete 3rd Edition and modified it for this engine.
 -----------------------------*/
 
+#include "Windows.h"
 #include "ZipFile.h"
 #include <zlib.h>
 #include <string>
 #include <algorithm>
-#include <boost/checked_delete.hpp>
+#include <climits>
+#include <cctype>
+#include <cwctype>
+#include <sstream>
+#include <iomanip>
 
 using namespace std;
-using boost::checked_array_deleter;
 
 ///// DEFINITIONS /////
 
@@ -57,6 +61,32 @@ struct ZipFile::TZipDirHeader {
 	word	cmntLen;
 };
 
+struct ZipFile::TZip64DirLocator {
+	enum {
+		SIGNATURE = 0x07064b50
+	};
+	dword	sig;
+	dword	nDisk;			// disk with the Zip64 end record
+	uint64	dirHdrOffset;	// offset of the Zip64 end record
+	dword	totalDisks;
+};
+
+struct ZipFile::TZip64DirHeader {
+	enum {
+		SIGNATURE = 0x06064b50
+	};
+	dword	sig;
+	uint64	recordSize;		// size of the remaining record
+	word	verMade;
+	word	verNeeded;
+	dword	nDisk;
+	dword	nStartDisk;
+	uint64	nDirEntries;
+	uint64	totalDirEntries;
+	uint64	dirSize;
+	uint64	dirOffset;
+};
+
 class ZipFile::TZipDirFileHeader {
 public:
 	enum {
@@ -87,6 +117,11 @@ public:
 
 #pragma pack()
 
+static const dword	ZIP64_MARKER32	= 0xFFFFFFFF;	// 32-bit field moved to the Zip64 extra/record
+static const word	ZIP64_MARKER16	= 0xFFFF;
+static const word	ZIP64_EXTRA_ID	= 0x0001;		// header id of the Zip64 extended information field
+static const uint	MAX_COMMENT_LEN	= 0xFFFF;
+
 ///// FUNCTIONS /////
 
 /*---------------------------------------------------------------------
@@ -94,89 +129,321 @@ public:
 ---------------------------------------------------------------------*/
 bool ZipFile::open()
 {
-	errno_t err = _wfopen_s(&mFile[0], mZipFilename.c_str(), L"rb");
-	if (err != 0) { return false; }
-	mInitFlags[INIT_OPEN] = true; // set the open init flag, so fclose will be called in destructor
+	mFileHandle = CreateFileW(	mZipFilename.c_str(),
+								GENERIC_READ,		// give read-only access
+								FILE_SHARE_READ,	// enable subsequent open access for read
+								NULL,
+								OPEN_EXISTING,		// function fails if file does not exist
+								FILE_FLAG_RANDOM_ACCESS | FILE_FLAG_OVERLAPPED,	// see readAt
+								NULL);
+	if (mFileHandle == INVALID_HANDLE_VALUE) {
+		mFileHandle = 0;
+		return false;
+	}
+	mInitFlags[INIT_OPEN] = true; // set the open init flag, so the handle will be closed in destructor
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(mFileHandle, &fileSize) == 0) { return false; }
+
+	uint64 dirOffset = 0, dirSize = 0, numEntries = 0;
+	if (!findDirectory(fileSize.QuadPart, dirOffset, dirSize, numEntries) ||
+		!readDirectory(dirOffset, dirSize, numEntries))
+	{
+		debugPrintf("ZipFile: could not read the central directory\n");
+		mEntryList.clear();
+		mIndex.clear();
+		mNameData.clear();
+		return false;
+	}
 
-	// Assuming no extra comment at the end, read the whole end record.
-	TZipDirHeader dh;
+	if (mMapArchive) {
+		mViewPtr = MappedView::create(mZipFilename, false);
+		if (!mViewPtr) {
+			debugPrintf("ZipFile: could not map archive, falling back to file reads\n");
+		}
+	}
+
+	return true;
+}
 
-	fseek(mFile[0], -(int)sizeof(dh), SEEK_END);
-	long dhOffset = ftell(mFile[0]);
-	memset(&dh, 0, sizeof(dh));
-	fread(&dh, sizeof(dh), 1, mFile[0]);
+/*---------------------------------------------------------------------
+	Finds the end of central directory record by searching backward
+	from the end of the file over the longest possible comment, then
+	follows the Zip64 locator if one precedes it.
+---------------------------------------------------------------------*/
+bool ZipFile::findDirectory(uint64 fileSize, uint64 &dirOffset, uint64 &dirSize, uint64 &numEntries) const
+{
+	if (fileSize < sizeof(TZipDirHeader)) { return false; }
 
-	// Check
-	if (dh.sig != TZipDirHeader::SIGNATURE) { return false; }
+	// Read the tail of the file, enough to hold the end record and a max length comment
+	uint tailSize = (uint)std::min<uint64>(fileSize, sizeof(TZipDirHeader) + MAX_COMMENT_LEN);
+	uint64 tailOffset = fileSize - tailSize;
+	vector<char> tail(tailSize);
+	if (!readAt(tailOffset, &tail[0], tailSize)) { return false; }
 
-	// Go to the beginning of the directory.
-	fseek(mFile[0], dhOffset - dh.dirSize, SEEK_SET);
+	// Search backward for the signature, accepting the first record whose comment fits in the file
+	TZipDirHeader dh;
+	uint64 dhOffset = 0;
+	bool found = false;
+	for (int p = tailSize - sizeof(TZipDirHeader); p >= 0 && !found; --p) {
+		if (*reinterpret_cast<const dword *>(&tail[p]) == TZipDirHeader::SIGNATURE) {
+			memcpy(&dh, &tail[p], sizeof(dh));
+			if (p + sizeof(dh) + dh.cmntLen <= tailSize) {
+				dhOffset = tailOffset + p;
+				found = true;
+			}
+		}
+	}
+	if (!found) { return false; }
+
+	dirOffset = dh.dirOffset;
+	dirSize = dh.dirSize;
+	numEntries = dh.totalDirEntries;
+
+	// A Zip64 locator immediately precedes the end record of a Zip64 archive
+	TZip64DirLocator loc;
+	if (dhOffset >= sizeof(loc) && readAt(dhOffset - sizeof(loc), &loc, sizeof(loc)) &&
+		loc.sig == TZip64DirLocator::SIGNATURE)
+	{
+		TZip64DirHeader dh64;
+		if (!readAt(loc.dirHdrOffset, &dh64, sizeof(dh64)) || dh64.sig != TZip64DirHeader::SIGNATURE) {
+			return false;
+		}
+		dirOffset = dh64.dirOffset;
+		dirSize = dh64.dirSize;
+		numEntries = dh64.totalDirEntries;
+	} else if (dh.totalDirEntries == ZIP64_MARKER16 && dh.dirOffset == ZIP64_MARKER32) {
+		return false; // Zip64 markers without a locator
+	}
 
-	// Allocate the data buffer, and read the whole thing.
-	mDirData = new char[dh.dirSize + dh.nDirEntries*sizeof(*mDirHdr)];
-	if (!mDirData) { return false; }
-	
-	memset(mDirData, 0, dh.dirSize + dh.nDirEntries*sizeof(*mDirHdr));
-	fread(mDirData, dh.dirSize, 1, mFile[0]);
+	return (dirOffset + dirSize <= dhOffset);
+}
 
-	// Now process each entry.
-	char *pfh = mDirData;
-	mDirHdr = (const TZipDirFileHeader **)(mDirData + dh.dirSize);
+/*---------------------------------------------------------------------
+	Reads the central directory, resolving Zip64 sizes and offsets,
+	and builds mEntryList, mNameData and the sorted mIndex. The raw
+	directory is only held for the duration of the call.
+---------------------------------------------------------------------*/
+bool ZipFile::readDirectory(uint64 dirOffset, uint64 dirSize, uint64 numEntries)
+{
+	// each entry takes at least a fixed header, which bounds the count
+	if (dirSize > INT_MAX || numEntries > dirSize / sizeof(TZipDirFileHeader)) { return false; }
 
-	bool success = true;
+	vector<char> dirData((size_t)dirSize + 1);
+	if (dirSize > 0 && !readAt(dirOffset, &dirData[0], (uint)dirSize)) { return false; }
 
-	for (int i = 0; i < dh.nDirEntries && success; ++i) {
-		TZipDirFileHeader &fh = *(TZipDirFileHeader*)pfh;
+	mEntryList.resize((size_t)numEntries);
+	mIndex.resize((size_t)numEntries);
+	mNameData.clear();
+	mNameData.reserve((size_t)dirSize - (size_t)numEntries * sizeof(TZipDirFileHeader));
 
-		// Store the address of nth file for quicker access.
-		mDirHdr[i] = &fh;
+	const char *pfh = &dirData[0];
+	const char *pEnd = pfh + dirSize;
+
+	for (uint i = 0; i < numEntries; ++i) {
+		if (pfh + sizeof(TZipDirFileHeader) > pEnd) { return false; }
+		const TZipDirFileHeader &fh = *reinterpret_cast<const TZipDirFileHeader *>(pfh);
 
 		// Check the directory entry integrity.
-		if (fh.sig != TZipDirFileHeader::SIGNATURE) {
-			success = false;
-		} else {
-			pfh += sizeof(fh);
+		if (fh.sig != TZipDirFileHeader::SIGNATURE ||
+			fh.getComment() + fh.cmntLen > pEnd)
+		{
+			return false;
+		}
 
-			// Convert UNIX slashes to DOS backlashes.
-			for (int j = 0; j < fh.fnameLen; ++j) {
-				if (pfh[j] == '/') pfh[j] = '\\';
+		ZipEntry &e = mEntryList[i];
+		e.hdrOffset = fh.hdrOffset;
+		e.cSize = fh.cSize;
+		e.ucSize = fh.ucSize;
+		e.compression = fh.compression;
+		e.crc32 = fh.crc32;
+		e.localHdrLen = 0;
+
+		// Zip64 extended information holds, in order, each field that is marked in the header
+		const char *pExtra = fh.getExtra();
+		const char *pExtraEnd = pExtra + fh.xtraLen;
+		while (pExtra + 4 <= pExtraEnd) {
+			word id = *reinterpret_cast<const word *>(pExtra);
+			word size = *reinterpret_cast<const word *>(pExtra + 2);
+			const char *pField = pExtra + 4;
+			if (pField + size > pExtraEnd) { break; }
+			if (id == ZIP64_EXTRA_ID) {
+				const uint64 *p64 = reinterpret_cast<const uint64 *>(pField);
+				const uint64 *p64End = reinterpret_cast<const uint64 *>(pField + size);
+				if (fh.ucSize == ZIP64_MARKER32 && p64 < p64End)	{ e.ucSize = *p64++; }
+				if (fh.cSize == ZIP64_MARKER32 && p64 < p64End)		{ e.cSize = *p64++; }
+				if (fh.hdrOffset == ZIP64_MARKER32 && p64 < p64End)	{ e.hdrOffset = *p64++; }
+				break;
 			}
+			pExtra = pField + size;
+		}
+
+		// Store the name as is, it is normalized when hashing and comparing
+		e.nameOffset = mNameData.size();
+		e.nameLen = fh.fnameLen;
+		mNameData.insert(mNameData.end(), fh.getName(), fh.getName() + fh.fnameLen);
+
+		mIndex[i].hash = hashName(fh.getName(), fh.fnameLen);
+		mIndex[i].entry = i;
 
-			char fileName[_MAX_PATH];
-			memcpy(fileName, pfh, fh.fnameLen);
-			fileName[fh.fnameLen]=0;
-			_strlwr_s(fileName, _MAX_PATH);
-			string spath = fileName;
-			mZipContentsMap[spath] = i;
+		// Skip name, extra and comment fields.
+		pfh = fh.getComment() + fh.cmntLen;
+	}
+
+	std::sort(mIndex.begin(), mIndex.end());
+	mEntries = (int)numEntries;
+	return true;
+}
+
+/*---------------------------------------------------------------------
+	FNV-1a over the name, lowercased and with '/' treated as '\'
+---------------------------------------------------------------------*/
+uint ZipFile::hashName(const char *name, size_t len)
+{
+	uint hash = 2166136261U;
+	for (size_t c = 0; c < len; ++c) {
+		char ch = (name[c] == '/' ? '\\' : (char)tolower((uchar)name[c]));
+		hash = (hash ^ (uchar)ch) * 16777619U;
+	}
+	return hash;
+}
+
+bool ZipFile::namesEqual(const char *a, const char *b, size_t len)
+{
+	for (size_t c = 0; c < len; ++c) {
+		char ca = (a[c] == '/' ? '\\' : (char)tolower((uchar)a[c]));
+		char cb = (b[c] == '/' ? '\\' : (char)tolower((uchar)b[c]));
+		if (ca != cb) { return false; }
+	}
+	return true;
+}
+
+/*---------------------------------------------------------------------
+	Positional read, does not touch a shared file pointer so any
+	number of threads may read at once. The handle is opened for
+	overlapped I/O, on a synchronous handle the I/O manager serializes
+	every request on the file object even when each gives its own
+	offset. Each call waits on its own event, since waiting on the file
+	handle would wake for any thread's completion.
+---------------------------------------------------------------------*/
+bool ZipFile::readAt(uint64 offset, void *pBuf, uint size) const
+{
+	OVERLAPPED ov;
+	memset(&ov, 0, sizeof(ov));
+	ov.Offset = (DWORD)offset;
+	ov.OffsetHigh = (DWORD)(offset >> 32);
+	ov.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (ov.hEvent == NULL) {
+		debugPrintf("ZipFile::readAt: CreateEvent failed (error %d)\n", GetLastError());
+		return false;
+	}
+
+	DWORD bytesRead = 0;
+	BOOL ok = ReadFile(mFileHandle, pBuf, size, NULL, &ov);
+	if (!ok && GetLastError() == ERROR_IO_PENDING) { ok = TRUE; }
+	ok = (ok && GetOverlappedResult(mFileHandle, &ov, &bytesRead, TRUE));
+	CloseHandle(ov.hEvent);
+	return (ok && bytesRead == size);
+}
 
-			// Skip name, extra and comment fields.
-			pfh += fh.fnameLen + fh.xtraLen + fh.cmntLen;
+/*---------------------------------------------------------------------
+	Sets offset to the start of entry i's data. The local header is
+	only read the first time, its length is stored in the entry.
+	Threads racing on the first read store the same value, the length
+	is read and published with interlocked operations so no thread
+	sees a torn or stale-cached value.
+---------------------------------------------------------------------*/
+bool ZipFile::dataOffset(int i, uint64 &offset) const
+{
+	ZipEntry &e = mEntryList[i];
+	long hdrLen = InterlockedCompareExchange(&e.localHdrLen, 0, 0);
+
+	if (hdrLen == 0) {
+		TZipLocalHeader h;
+		if (mViewPtr) {
+			if (e.hdrOffset + sizeof(h) > mViewPtr->size()) { return false; }
+			memcpy(&h, mViewPtr->data() + e.hdrOffset, sizeof(h));
+		} else if (!readAt(e.hdrOffset, &h, sizeof(h))) {
+			return false;
 		}
+		if (h.sig != TZipLocalHeader::SIGNATURE) { return false; }
+
+		hdrLen = sizeof(h) + h.fnameLen + h.xtraLen;
+		InterlockedExchange(&e.localHdrLen, hdrLen);
 	}
 
-	if (!success) {
-		if (mDirData) {
-			delete [] mDirData;
-			mDirData = 0;
+	offset = e.hdrOffset + hdrLen;
+	if (mViewPtr && offset + e.cSize > mViewPtr->size()) { return false; }
+	return true;
+}
+
+/*---------------------------------------------------------------------
+	Points pcData at entry i's compressed data. In a mapped archive
+	that is the mapping itself, otherwise the data is read into buffer,
+	which is taken from the pool and must be given back with
+	releaseBuffer.
+---------------------------------------------------------------------*/
+bool ZipFile::readCompressed(int i, vector<char> &buffer, const char *&pcData)
+{
+	uint64 offset = 0;
+	if (!dataOffset(i, offset)) { return false; }
+
+	if (mViewPtr) {
+		pcData = mViewPtr->data() + offset;
+		return true;
+	}
+
+	if (mEntryList[i].cSize > INT_MAX) { return false; }
+	uint cSize = (uint)mEntryList[i].cSize;
+	acquireBuffer(buffer, cSize);
+
+	pcData = (buffer.empty() ? 0 : &buffer[0]);
+	return (cSize == 0 || readAt(offset, &buffer[0], cSize));
+}
+
+/*---------------------------------------------------------------------
+	Takes a buffer from the pool if one is available, and grows it to
+	at least size bytes
+---------------------------------------------------------------------*/
+void ZipFile::acquireBuffer(vector<char> &buffer, uint size)
+{
+	{
+		boost::mutex::scoped_lock lock(mPoolMutex);
+		if (!mBufferPool.empty()) {
+			buffer.swap(mBufferPool.back());
+			mBufferPool.pop_back();
 		}
-	} else {
-		mEntries = dh.nDirEntries;
 	}
+	if (buffer.size() < size) { buffer.resize(size); }
+}
 
-	return success;
+void ZipFile::releaseBuffer(vector<char> &buffer)
+{
+	if (buffer.capacity() == 0 || buffer.capacity() > sMaxPooledBufferSize) { return; }
+
+	boost::mutex::scoped_lock lock(mPoolMutex);
+	if (mBufferPool.size() < sMaxPooledBuffers) {
+		mBufferPool.push_back(vector<char>());
+		mBufferPool.back().swap(buffer);
+	}
 }
 
 optional<int> ZipFile::find(const char *path) const
 {
-	char lwrPath[_MAX_PATH];
-	strcpy_s(lwrPath, _MAX_PATH, path);
-	_strlwr_s(lwrPath, _MAX_PATH);
-	ZipContentsMap::const_iterator i = mZipContentsMap.find(lwrPath);
-	if (i == mZipContentsMap.end()) {
-		debugPrintf("ZipFile: find(\"%s\") file not found!\n", path);
-		return optional<int>();
-	}
-	return (*i).second;
+	size_t len = strlen(path);
+	ZipIndexEntry key;
+	key.hash = hashName(path, len);
+
+	typedef vector<ZipIndexEntry>::const_iterator IndexIter;
+	pair<IndexIter, IndexIter> range = equal_range(mIndex.begin(), mIndex.end(), key);
+	for (IndexIter i = range.first; i != range.second; ++i) {
+		const ZipEntry &e = mEntryList[i->entry];
+		if (e.nameLen == len && namesEqual(mNameData.data() + e.nameOffset, path, len)) {
+			return (int)i->entry;
+		}
+	}
+	debugPrintf("ZipFile: find(\"%s\") file not found!\n", path);
+	return optional<int>();
 }
 
 /*---------------------------------------------------------------------
@@ -184,17 +451,18 @@ optional<int> ZipFile::find(const char *path) const
 ---------------------------------------------------------------------*/
 void ZipFile::close()
 {
-	mZipContentsMap.empty();
-	if (mDirData) {
-		delete [] mDirData;
-		mDirData = 0;
-	}
+	mEntryList.clear();
+	mIndex.clear();
+	mNameData.clear();
 	mEntries = 0;
+	mBufferPool.clear();
+	mViewPtr.reset(); // buffers still aliasing the view keep it mapped
 	if (mInitFlags[INIT_OPEN]) {
-		// close all of the open file pointers
-		for (uint f = 0; f < mFile.size(); ++f) {
-			fclose(mFile[f]);
+		if (CloseHandle(mFileHandle) == 0) {
+			debugPrintf("ZipFile::close: CloseHandle failed (error %d)\n", GetLastError());
 		}
+		mFileHandle = 0;
+		mInitFlags[INIT_OPEN] = false;
 	}
 }
 
@@ -217,6 +485,7 @@ int	ZipFile::getResourceSize(const string &resName) const
 	error, so return value may be tested as a boolean.
 	shared_ptr<char> &dataPtr sets the passed-in shared pointer to
 	contain a new buffer of the returned size which contains the data.
+	The threadIndex is not used, reads are positional.
 ---------------------------------------------------------------------*/
 int ZipFile::getResource(const string &resName, BufferPtr &dataPtr, int threadIndex)
 {
@@ -224,10 +493,28 @@ int ZipFile::getResource(const string &resName, BufferPtr &dataPtr, int threadIn
 	if (resNum) {
 		int size = getFileLen(*resNum);
 		if (size > 0) { // treat 0 size as an error, since resources must have size
-			BufferPtr bPtr(new char[size], checked_array_deleter<char>());
+			// stored entries in a mapped archive are served without a copy
+			uint64 offset = 0;
+			if (mViewPtr && mEntryList[*resNum].compression == Z_NO_COMPRESSION &&
+				dataOffset(*resNum, offset))
+			{
+				dataPtr = MappedView::makeBuffer(mViewPtr, offset);
+				return size;
+			}
+
+			// entries inflated before may be waiting in the disk cache
+			bool useDiskCache = (!mInflateCacheDir.empty() &&
+								 mEntryList[*resNum].compression == Z_DEFLATED &&
+								 (uint)size >= sMinInflateCacheSize);
+			if (useDiskCache && readInflateCache(*resNum, dataPtr)) {
+				return size;
+			}
+
+			BufferPtr bPtr(BufferPool::allocate(size));
 			dataPtr = bPtr;
 			void *buffer = static_cast<void *>(dataPtr.get());
-			if (readFile(*resNum, buffer, threadIndex)) {
+			if (readFile(*resNum, buffer)) {
+				if (useDiskCache) { writeInflateCache(*resNum, dataPtr.get()); }
 				return size;	// success, return the size
 			} else {				// failed
 				dataPtr.reset();	// make sure the returned shared_ptr is empty
@@ -247,22 +534,23 @@ void ZipFile::getFilename(int i, char *pszDest) const
 		if (i < 0 || i >= mEntries) {
 			*pszDest = '\0';
 		} else {
-			memcpy(pszDest, mDirHdr[i]->getName(), mDirHdr[i]->fnameLen);
-			pszDest[mDirHdr[i]->fnameLen] = '\0';
+			memcpy(pszDest, mNameData.data() + mEntryList[i].nameOffset, mEntryList[i].nameLen);
+			pszDest[mEntryList[i].nameLen] = '\0';
 		}
 	}
 }
 
 /*---------------------------------------------------------------------
-	Return the length of a file so a buffer can be allocated
+	Return the length of a file so a buffer can be allocated, or -1
+	if the entry is out of range or too large to load whole
 ---------------------------------------------------------------------*/
 int ZipFile::getFileLen(int i) const
 {
-	if (i < 0 || i >= mEntries) {
+	if (i < 0 || i >= mEntries || mEntryList[i].ucSize > INT_MAX) {
 		debugPrintf("ZipFile: getFileLen() failed!\n");
 		return -1;
 	} else {
-		return mDirHdr[i]->ucSize;
+		return (int)mEntryList[i].ucSize;
 	}
 }
 
@@ -270,51 +558,44 @@ int ZipFile::getFileLen(int i) const
 	Uncompress a complete file. Takes as parameters the file index and
 	the pre-allocated buffer.
 ---------------------------------------------------------------------*/
-bool ZipFile::readFile(int i, void *pBuf, int threadIndex)
+bool ZipFile::readFile(int i, void *pBuf)
 {
-	_ASSERTE(threadIndex >= 0 && threadIndex < (int)mFile.size() && "Thread index out of range");
-
-	if (pBuf == NULL || i < 0 || i >= mEntries) return false;
+	if (pBuf == NULL || getFileLen(i) < 0) return false;
 
 	// Quick'n dirty read, the whole file at once.
 	// Ungood if the ZIP has huge files inside
 
-	// Go to the actual file and read the local header.
-	fseek(mFile[threadIndex], mDirHdr[i]->hdrOffset, SEEK_SET);
-	TZipLocalHeader h;
+	const ZipEntry &e = mEntryList[i];
 
-	memset(&h, 0, sizeof(h));
-	fread(&h, sizeof(h), 1, mFile[threadIndex]);
-	if (h.sig != TZipLocalHeader::SIGNATURE) return false;
-
-	// Skip extra fields
-	fseek(mFile[threadIndex], h.fnameLen + h.xtraLen, SEEK_CUR);
-
-	if (h.compression == Z_NO_COMPRESSION) {
+	if (e.compression == Z_NO_COMPRESSION) {
 		// Simply read in raw stored data.
-		fread(pBuf, h.cSize, 1, mFile[threadIndex]);
-		return true;
-	} else if (h.compression != Z_DEFLATED) {
+		uint64 offset = 0;
+		if (!dataOffset(i, offset) || e.cSize != e.ucSize) return false;
+		if (mViewPtr) {
+			memcpy(pBuf, mViewPtr->data() + offset, (size_t)e.cSize);
+			return true;
+		}
+		return readAt(offset, pBuf, (uint)e.cSize);
+	} else if (e.compression != Z_DEFLATED) {
 		return false;
 	}
 
-	// Alloc compressed data buffer and read the whole stream
-	char *pcData = new char[h.cSize];
-	if (!pcData) return false;
-
-	memset(pcData, 0, h.cSize);
-	fread(pcData, h.cSize, 1, mFile[threadIndex]);
-
-	bool ret = true;
+	vector<char> buffer;
+	const char *pcData = 0;
+	if (!readCompressed(i, buffer, pcData)) {
+		releaseBuffer(buffer);
+		return false;
+	}
 
 	// Setup the inflate stream.
 	z_stream stream;
 	stream.next_in = (Bytef*)pcData;
-	stream.avail_in = (uInt)h.cSize;
+	stream.avail_in = (uInt)e.cSize;
 	stream.next_out = (Bytef*)pBuf;
-	stream.avail_out = h.ucSize;
+	stream.avail_out = (uInt)e.ucSize;
 	stream.zalloc = (alloc_func)0;
 	stream.zfree = (free_func)0;
+	stream.opaque = (voidpf)0;
 
 	// Perform inflation. wbits < 0 indicates no zlib header inside the data.
 	int err = inflateInit2(&stream, -MAX_WBITS);
@@ -322,110 +603,265 @@ bool ZipFile::readFile(int i, void *pBuf, int threadIndex)
 		err = inflate(&stream, Z_FINISH);
 		inflateEnd(&stream);
 		if (err == Z_STREAM_END) err = Z_OK;
-		inflateEnd(&stream);
 	}
-	if (err != Z_OK) ret = false;
 
-	delete [] pcData;
-	return ret;
+	releaseBuffer(buffer);
+	return (err == Z_OK);
 }
 
 /*---------------------------------------------------------------------
-	Uncompress a complete file with callbacks. Takes as parameters the
-	file index and the pre-allocated buffer.
+	Creates each directory along the path, existing ones are skipped
 ---------------------------------------------------------------------*/
-bool ZipFile::readLargeFile(int i, void *pBuf, void (*callback)(int, bool &), int threadIndex)
+static bool createDirectoryPath(const wstring &dir)
 {
-	_ASSERTE(threadIndex >= 0 && threadIndex < (int)mFile.size() && "Thread index out of range");
-
-	if (pBuf == NULL || i < 0 || i >= mEntries) return false;
+	for (size_t p = dir.find_first_of(L"\\/"); p != wstring::npos; p = dir.find_first_of(L"\\/", p+1)) {
+		if (p > 0) { CreateDirectoryW(dir.substr(0, p).c_str(), NULL); }
+	}
+	CreateDirectoryW(dir.c_str(), NULL);
+	DWORD attr = GetFileAttributesW(dir.c_str());
+	return (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY));
+}
 
-	// Quick'n dirty read, the whole file at once.
-	// Ungood if the ZIP has huge files inside
+bool ZipFile::setInflateCacheDir(const wstring &dir)
+{
+	mInflateCacheDir.clear();
+	if (dir.empty()) { return true; }
+	if (!createDirectoryPath(dir)) {
+		debugPrintf("ZipFile: could not create inflate cache directory\n");
+		return false;
+	}
+	mInflateCacheDir = dir;
+	wchar_t lastChar = mInflateCacheDir[mInflateCacheDir.size()-1];
+	if (lastChar != L'\\' && lastChar != L'/') {
+		mInflateCacheDir.append(L"\\");
+	}
+	return true;
+}
 
-	// Go to the actual file and read the local header.
-	fseek(mFile[threadIndex], mDirHdr[i]->hdrOffset, SEEK_SET);
-	TZipLocalHeader h;
+/*---------------------------------------------------------------------
+	The cache file name is a 64-bit FNV-1a hash of the archive path and
+	normalized entry name, followed by the entry CRC32
+---------------------------------------------------------------------*/
+wstring ZipFile::inflateCachePath(int i) const
+{
+	const ZipEntry &e = mEntryList[i];
+	uint64 hash = 14695981039346656037ULL;
+	for (size_t c = 0; c < mZipFilename.size(); ++c) {
+		hash = (hash ^ (uint64)towlower(mZipFilename[c])) * 1099511628211ULL;
+	}
+	hash = (hash ^ (uint64)'|') * 1099511628211ULL;
+	const char *name = mNameData.data() + e.nameOffset;
+	for (uint c = 0; c < e.nameLen; ++c) {
+		char ch = (name[c] == '/' ? '\\' : (char)tolower((uchar)name[c]));
+		hash = (hash ^ (uchar)ch) * 1099511628211ULL;
+	}
 
-	memset(&h, 0, sizeof(h));
-	fread(&h, sizeof(h), 1, mFile[threadIndex]);
-	if (h.sig != TZipLocalHeader::SIGNATURE) return false;
+	wostringstream fileName;
+	fileName << mInflateCacheDir << hex << setfill(L'0')
+			 << setw(16) << hash << L'_' << setw(8) << e.crc32 << L".bin";
+	return fileName.str();
+}
 
-	// Skip extra fields
-	fseek(mFile[threadIndex], h.fnameLen + h.xtraLen, SEEK_CUR);
+/*---------------------------------------------------------------------
+	Loads the inflated entry from the disk cache, returns false if it
+	is not there or doesn't match the entry size
+---------------------------------------------------------------------*/
+bool ZipFile::readInflateCache(int i, BufferPtr &dataPtr) const
+{
+	wstring path(inflateCachePath(i));
+	uint size = (uint)mEntryList[i].ucSize;
 
-	if (h.compression == Z_NO_COMPRESSION) {
-		// Simply read in raw stored data.
-		fread(pBuf, h.cSize, 1, mFile[threadIndex]);
+	if (size >= Win32MemoryMappedFile::sMinMappedSize) {
+		MappedViewPtr viewPtr(MappedView::create(path, true));
+		if (!viewPtr || viewPtr->size() != size) { return false; }
+		dataPtr = MappedView::makeBuffer(viewPtr, 0);
 		return true;
-	} else if (h.compression != Z_DEFLATED) {
-		return false;
 	}
 
-	// Alloc compressed data buffer and read the whole stream
-	char *pcData = new char[h.cSize];
-	if (!pcData) return false;
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+							  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return false; }
+
+	LARGE_INTEGER fileSize;
+	BufferPtr bPtr(BufferPool::allocate(size));
+	DWORD bytesRead = 0;
+	bool ok = (GetFileSizeEx(file, &fileSize) != 0 && fileSize.QuadPart == size &&
+			   ReadFile(file, bPtr.get(), size, &bytesRead, NULL) != 0 && bytesRead == size);
+	CloseHandle(file);
+	if (ok) { dataPtr = bPtr; }
+	return ok;
+}
 
-	memset(pcData, 0, h.cSize);
-	fread(pcData, h.cSize, 1, mFile[threadIndex]);
+/*---------------------------------------------------------------------
+	Writes the inflated entry to the disk cache, after checking its
+	CRC so a bad inflate is never persisted. The file is written under
+	a temporary name and renamed, so readers never see a partial file.
+---------------------------------------------------------------------*/
+void ZipFile::writeInflateCache(int i, const char *pData) const
+{
+	const ZipEntry &e = mEntryList[i];
+	uint size = (uint)e.ucSize;
+	if (crc32(0L, (const Bytef*)pData, size) != e.crc32) {
+		debugPrintf("ZipFile: CRC mismatch on inflate, not cached\n");
+		return;
+	}
 
-	bool ret = true;
+	wstring path(inflateCachePath(i));
+	wostringstream tmpPath;
+	tmpPath << path << L'.' << GetCurrentThreadId() << L".tmp";
 
-	// Setup the inflate stream.
-	z_stream stream;
-	int err;
+	HANDLE file = CreateFileW(tmpPath.str().c_str(), GENERIC_WRITE, 0, NULL,
+							  CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) { return; }
 
-	stream.next_in = (Bytef*)pcData;
-	stream.avail_in = (uInt)h.cSize;
-	stream.next_out = (Bytef*)pBuf;
-	stream.avail_out = (128 * 1024); //  read 128k at a time h.ucSize;
-	stream.zalloc = (alloc_func)0;
-	stream.zfree = (free_func)0;
+	DWORD bytesWritten = 0;
+	bool ok = (WriteFile(file, pData, size, &bytesWritten, NULL) != 0 && bytesWritten == size);
+	CloseHandle(file);
 
-	// Perform inflation. wbits < 0 indicates no zlib header inside the data.
-	err = inflateInit2(&stream, -MAX_WBITS);
-	if (err == Z_OK) {
-		uInt count = 0;
-		bool cancel = false;
-		while (stream.total_in < (uInt)h.cSize && !cancel) {
-			err = inflate(&stream, Z_SYNC_FLUSH);
-			if (err == Z_STREAM_END) {
-				err = Z_OK;
-				break;
-			} else if (err != Z_OK) {
-				assert(0 && "Something happened.");
-				break;
-			}
+	if (!ok || MoveFileExW(tmpPath.str().c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) == 0) {
+		DeleteFileW(tmpPath.str().c_str());
+	}
+}
 
-			stream.avail_out = (128 * 1024); 
-			stream.next_out += stream.total_out;
-			callback(count * 100 / h.cSize, cancel);
+////////// class ZipFile::InflateStream //////////
+
+/*=============================================================================
+class ZipFile::InflateStream
+	Reads one entry incrementally. Stored entries are copied straight from
+	the file or mapping, deflated entries are inflated from chunks of
+	compressed data read on demand.
+=============================================================================*/
+class ZipFile::InflateStream : public IResourceStream {
+	private:
+		ZipFile &		mZip;
+		uint64			mOffset;		// next compressed byte to read
+		uint64			mRemainingIn;	// compressed bytes not yet read
+		uint64			mRemainingOut;	// uncompressed bytes not yet returned
+		int				mSize;
+		bool			mDeflated;
+		bool			mInitialized;	// inflateInit2 succeeded, inflateEnd is owed
+		z_stream		mStream;
+		vector<char>	mInBuffer;		// compressed chunk, sStreamChunkSize
+
+		bool	refill();
+
+	public:
+		virtual int		read(char *buffer, int maxSize);
+		virtual int		size() const	{ return mSize; }
+
+		bool	init();
+
+		explicit InflateStream(ZipFile &zip, const ZipEntry &e, uint64 offset) :
+			IResourceStream(),
+			mZip(zip), mOffset(offset), mRemainingIn(e.cSize), mRemainingOut(e.ucSize),
+			mSize((int)e.ucSize), mDeflated(e.compression == Z_DEFLATED), mInitialized(false)
+		{
+			memset(&mStream, 0, sizeof(mStream));
 		}
-		inflateEnd(&stream);
+		~InflateStream();
+};
+
+bool ZipFile::InflateStream::init()
+{
+	if (!mDeflated) { return true; }
+
+	if (mZip.mViewPtr) {
+		// the whole compressed entry is already in memory
+		mStream.next_in = (Bytef*)(mZip.mViewPtr->data() + mOffset);
+		mStream.avail_in = (uInt)mRemainingIn;
+		mRemainingIn = 0;
+	} else {
+		// not from the pool, whose buffers may have grown to a whole entry
+		mInBuffer.resize(sStreamChunkSize);
+	}
+
+	// wbits < 0 indicates no zlib header inside the data.
+	mInitialized = (inflateInit2(&mStream, -MAX_WBITS) == Z_OK);
+	return mInitialized;
+}
+
+bool ZipFile::InflateStream::refill()
+{
+	uint chunk = (uint)std::min<uint64>(mRemainingIn, mInBuffer.size());
+	if (!mZip.readAt(mOffset, &mInBuffer[0], chunk)) { return false; }
+	mStream.next_in = (Bytef*)&mInBuffer[0];
+	mStream.avail_in = chunk;
+	mOffset += chunk;
+	mRemainingIn -= chunk;
+	return true;
+}
+
+int ZipFile::InflateStream::read(char *buffer, int maxSize)
+{
+	uint n = (uint)std::min<uint64>(mRemainingOut, (uint64)std::max(maxSize, 0));
+	if (n == 0) { return 0; }
+
+	if (!mDeflated) {
+		if (mZip.mViewPtr) {
+			memcpy(buffer, mZip.mViewPtr->data() + mOffset, n);
+		} else if (!mZip.readAt(mOffset, buffer, n)) {
+			return -1;
+		}
+		mOffset += n;
+		mRemainingOut -= n;
+		return n;
 	}
-	if (err != Z_OK) ret = false;
 
-	delete [] pcData;
-	return ret;
+	// inflate may still hold output after consuming the last input byte, so it is always
+	// called before deciding the input has run out
+	mStream.next_out = (Bytef*)buffer;
+	mStream.avail_out = n;
+	while (mStream.avail_out > 0) {
+		if (mStream.avail_in == 0 && mRemainingIn > 0 && !refill()) { return -1; } // unreadable
+		int err = inflate(&mStream, Z_NO_FLUSH);
+		if (err == Z_STREAM_END) { break; }
+		if (err == Z_BUF_ERROR) {
+			// no progress was possible, more input is the only thing that helps
+			if (mStream.avail_in == 0 && mRemainingIn > 0) { continue; }
+			break; // truncated, return what was produced so far
+		}
+		if (err != Z_OK) { return -1; }
+	}
+
+	uint produced = n - mStream.avail_out;
+	mRemainingOut -= produced;
+	if (produced == 0) { return -1; } // stream ended short of the entry size
+	return produced;
+}
+
+ZipFile::InflateStream::~InflateStream()
+{
+	if (mInitialized) { inflateEnd(&mStream); }
 }
 
 /*---------------------------------------------------------------------
-	Creates a new file pointer and returns the index, or -1 on error.
+	Opens an incremental stream over the entry, the stream holds a
+	reference to this ZipFile and must not outlive it
 ---------------------------------------------------------------------*/
-int ZipFile::getNewThreadIndex()
+ResStreamPtr ZipFile::openStream(const string &resName)
 {
-	mFile.push_back(0);
-	int index = mFile.size() - 1;
-	errno_t err = _wfopen_s(&mFile[index], mZipFilename.c_str(), L"rb");
-	if (err != 0) { return -1; }
-	return index;
+	optional<int> resNum = find(resName.c_str());
+	if (!resNum || getFileLen(*resNum) <= 0) { return ResStreamPtr(); }
+
+	const ZipEntry &e = mEntryList[*resNum];
+	uint64 offset = 0;
+	if ((e.compression != Z_NO_COMPRESSION && e.compression != Z_DEFLATED) ||
+		(e.compression == Z_NO_COMPRESSION && e.cSize != e.ucSize) ||
+		!dataOffset(*resNum, offset))
+	{
+		return ResStreamPtr();
+	}
+
+	shared_ptr<InflateStream> streamPtr(new InflateStream(*this, e, offset));
+	if (!streamPtr->init()) { return ResStreamPtr(); }
+	return streamPtr;
 }
 
 string ZipFile::dumpIndex() const
 {
 	string output("Index:\n");
-	for_each(mZipContentsMap.begin(), mZipContentsMap.end(), [&](const pair<string,int> &p){
-		output.append(p.first.c_str());
+	for_each(mEntryList.begin(), mEntryList.end(), [&](const ZipEntry &e){
+		output.append(mNameData.data() + e.nameOffset, e.nameLen);
 		output.append("\n");
 	});
 	return output;
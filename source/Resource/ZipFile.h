@@ -9,20 +9,18 @@
 
 #pragma once
 
-#include <cstdio>
 #include <string>
 #include <vector>
-#include <hash_map>
 #include <boost/optional.hpp>
+#include <boost/thread/mutex.hpp>
 #include "ResCache.h"
+#include "Win32MemoryMappedFile.h"
 
 using std::string;
 using std::wstring;
 using std::vector;
-using stdext::hash_map;
 using boost::optional;
-
-typedef hash_map<string, int>	ZipContentsMap;		// maps path to a zip content id
+using boost::mutex;
 
 /*=============================================================================
 class ZipFile
@@ -34,28 +32,99 @@ class ZipFile
 	friendly and doesn't require the client to have knowledge of the inner
 	workings (such as converting filenames into offsets, etc.).
 	Thread Safety:
-		ZipFile has been made thread-safe by the use of unique file pointers,
-	1 per thread. Each thread that would like to read from the file should
-	first request and store a new index via getNewThreadIndex(). That index is
-	then used exclusively by that thread when calling getResource(). Index 0 is
-	the default and always exists, more often than not reserved for use by the
-	"main" thread.
+		ZipFile is thread-safe without per-thread state. The archive is
+	opened once for overlapped I/O, and every read is positional (ReadFile
+	with an explicit offset, waited on through an event of its own) so no
+	file pointer is shared and reads from several threads are in flight at
+	the same time instead of queueing on the file object. The size of each
+	entry's local header is resolved on its first read and remembered, so
+	later reads of the entry go straight to its data. Compressed data is read
+	into buffers recycled through a small pool instead of being allocated
+	per read. getNewThreadIndex() always returns 0.
+	Directory Index:
+		open() locates the end of central directory record by searching
+	backward, so archives with a trailing comment work, and follows the
+	Zip64 locator when present. Each entry is reduced to a fixed size
+	ZipEntry, and lookups go through a flat array of (hash, entry) pairs
+	sorted by hash. Names are left as stored in the directory, case and
+	slash direction are normalized when hashing and comparing instead.
+	Memory Mapping:
+		When constructed with mapArchive, the whole archive is mapped at
+	open(). Stored (uncompressed) entries are then returned as buffers
+	aliasing the mapping with no copy, and deflated entries are inflated
+	straight out of the mapping.
+	Streaming:
+		openStream() returns an InflateStream, which reads sStreamChunkSize
+	bytes of compressed data at a time and inflates only as much as the
+	caller asks for, through one z_stream kept for the life of the stream.
+	Peak memory is one input chunk plus the caller's buffer, regardless of
+	the entry size.
+	Inflate Cache:
+		If setInflateCacheDir() is called, deflated entries of at least
+	sMinInflateCacheSize are written to that directory once inflated, and
+	later loads read them back (mapped if large enough) instead of running
+	zlib again. Files are named by a hash of the archive path and entry
+	name plus the entry's CRC32, so a changed entry never matches a stale
+	file. Files are written to a temporary name and renamed into place.
 =============================================================================*/
 class ZipFile : public IResourceSource {
 	private:
 		///// DECLARATIONS /////
 		struct	TZipLocalHeader;
 		struct	TZipDirHeader;
+		struct	TZip64DirLocator;
+		struct	TZip64DirHeader;
 		class	TZipDirFileHeader;
+		class	InflateStream;
+		friend class InflateStream;
+
+		///// STRUCTURES /////
+		/*=====================================================================
+		struct ZipEntry
+			Fields of a central directory entry with Zip64 sizes resolved
+		=====================================================================*/
+		struct ZipEntry {
+			uint64			hdrOffset;		// offset of the local header
+			uint64			cSize;			// compressed size
+			uint64			ucSize;			// uncompressed size
+			uint			nameOffset;		// offset of the name in mNameData
+			ushort			nameLen;
+			ushort			compression;	// Z_NO_COMPRESSION or Z_DEFLATED
+			uint			crc32;			// CRC of the uncompressed data
+			volatile long	localHdrLen;	// size of local header + name + extra, 0 until first read, see dataOffset
+		};
+
+		/*=====================================================================
+		struct ZipIndexEntry
+		=====================================================================*/
+		struct ZipIndexEntry {
+			uint	hash;	// hash of the normalized name
+			uint	entry;	// index into mEntryList
+			bool operator<(const ZipIndexEntry &rhs) const { return hash < rhs.hash; }
+		};
+
+		///// DEFINITIONS /////
+		static const uint sMaxPooledBuffers = 8;				// compressed buffers kept for reuse
+		static const uint sMaxPooledBufferSize = 1024 * 1024;	// larger buffers are freed after use
+		static const uint sStreamChunkSize = 64 * 1024;			// compressed bytes read at a time by a stream
+		static const uint sMinInflateCacheSize = 16 * 1024;		// smaller entries are cheaper to inflate than to cache
 
 		///// VARIABLES /////
-		vector<FILE*>	mFile;	// zip file pointers, one per thread that needs to read from the file
-		char *	mDirData;		// raw data buffer
+		void *	mFileHandle;	// set with CreateFile, void* = HANDLE, shared by all threads
 		int		mEntries;		// number of entries
 
-		const TZipDirFileHeader	**mDirHdr;	// pointers to the dir entries in mDirData
+		vector<char>				mNameData;	// entry names as stored, back to back
+
+		mutable vector<ZipEntry>	mEntryList;	// one per directory entry
+		vector<ZipIndexEntry>		mIndex;		// sorted by hash for lookup by name
+
+		mutex					mPoolMutex;		// protects mBufferPool
+		vector< vector<char> >	mBufferPool;	// recycled compressed data buffers
 		
 		wstring	mZipFilename;	// filename of the archive
+		bool	mMapArchive;	// map the archive at open()
+		MappedViewPtr	mViewPtr;	// view of the whole archive, if mapped
+		wstring	mInflateCacheDir;	// directory of inflated entries, empty to disable
 
 		// initialization flags
 		enum EffectInitFlags {
@@ -65,43 +134,55 @@ class ZipFile : public IResourceSource {
 		bitset<INIT_MAX>	mInitFlags;
 
 		///// FUNCTIONS /////
+		bool	findDirectory(uint64 fileSize, uint64 &dirOffset, uint64 &dirSize, uint64 &numEntries) const;
+		bool	readDirectory(uint64 dirOffset, uint64 dirSize, uint64 numEntries);
+		static uint	hashName(const char *name, size_t len);
+		static bool	namesEqual(const char *a, const char *b, size_t len);
+
 		void	getFilename(int i, char *pszDest) const;
 		int		getFileLen(int i) const;
-		bool	readFile(int i, void *pBuf, int threadIndex);
-		bool	readLargeFile(int i, void *pBuf, void (*callback)(int, bool &), int threadIndex);
+		bool	readAt(uint64 offset, void *pBuf, uint size) const;
+		bool	dataOffset(int i, uint64 &offset) const;
+		void	acquireBuffer(vector<char> &buffer, uint size);
+		bool	readCompressed(int i, vector<char> &buffer, const char *&pcData);
+		void	releaseBuffer(vector<char> &buffer);
+		bool	readFile(int i, void *pBuf);
+		wstring	inflateCachePath(int i) const;
+		bool	readInflateCache(int i, BufferPtr &dataPtr) const;
+		void	writeInflateCache(int i, const char *pData) const;
 		
 		optional<int> find(const char *path) const;
 		void	close();
 
 	public:
-		///// VARIABLES /////
-		ZipContentsMap	mZipContentsMap;
-
 		///// FUNCTIONS /////
 		// Interface functions
 		virtual bool	open();
 		virtual int		getResourceSize(const string &resName) const;
 		virtual int		getResource(const string &resName, BufferPtr &dataPtr, int threadIndex = 0);
 
-		/*---------------------------------------------------------------------
-			Creates a new file pointer and returns the index, or -1 on error.
-		---------------------------------------------------------------------*/
-		virtual int		getNewThreadIndex();
+		virtual int		getNewThreadIndex() { return 0; } // reads are positional, any thread may read
+		virtual ResStreamPtr	openStream(const string &resName);
 
 		// Accessors
 		int		getNumFiles() const		{ return mEntries; }
 		const wstring &getZipFilename() const	{ return mZipFilename; }
+		bool	isMapped() const		{ return (mViewPtr.get() != 0); }
+
+		/*---------------------------------------------------------------------
+			Enables the on-disk cache of inflated entries, creating the
+			directory if needed. Returns false if it could not be created.
+		---------------------------------------------------------------------*/
+		bool	setInflateCacheDir(const wstring &dir);
 
 		string dumpIndex() const;
 
 		// Constructor / destructor
-		explicit ZipFile(const wstring &zipFilename) :
-			mZipFilename(zipFilename),
-			mEntries(0), mDirData(0), mInitFlags(0)
-		{
-			mFile.reserve(2);	// reserve capacity for 2 threads
-			mFile.push_back(0); // create one pointer for the main (default) thread
-		}
+		explicit ZipFile(const wstring &zipFilename, bool mapArchive = false) :
+			mFileHandle(0), mEntries(0),
+			mZipFilename(zipFilename), mMapArchive(mapArchive),
+			mInitFlags(0)
+		{}
 		~ZipFile() {
 			close();
 		}
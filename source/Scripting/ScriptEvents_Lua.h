@@ -25,6 +25,7 @@ class LuaFunctionEvent : public Event {
 		///// VARIABLES /////
 		static const string		sEventType; // made public so listeners can register via this variable
 											// and not the actual string value itself
+		static const EventTypeId	sTypeId;
 		///// FUNCTIONS /////
 		// Accessors
 		const string &		stateId() const		{ return mStateId; }
@@ -33,6 +34,7 @@ class LuaFunctionEvent : public Event {
 		const LuaObject &	returnObj() const	{ return mReturnObj; }
 
 		virtual const string & type() const { return sEventType; }
+		virtual EventTypeId typeId() const { return sTypeId; }
 
 		// Mutators
 		void	setReturnObj(const LuaObject &returnObj) { mReturnObj = returnObj; }
@@ -9,6 +9,7 @@
 #include "../Utility/Typedefs.h"
 #include "../Event/EventManager.h"
 #include "../Event/RegisteredEvents.h"
+#include "../Event/EventSchema.h"
 #include "../Utility/FastMath.h"
 
 using namespace LuaPlus;
@@ -18,128 +19,37 @@ using boost::any_cast;
 
 ///// STATIC VARIABLES /////
 const string LuaFunctionEvent::sEventType("SYS_SCRIPT_CALL_FUNCTION");
-
-////////// class ScriptManager_Lua //////////
+const EventTypeId LuaFunctionEvent::sTypeId(EventTypeRegistry::intern(LuaFunctionEvent::sEventType));
 
 ///// FUNCTIONS /////
 
 /*---------------------------------------------------------------------
-	Debug print function (callable from script)
----------------------------------------------------------------------*/
-void ScriptManager_Lua::debugPrint(LuaObject debugObject)
-{
-	const char *debugStr = debugObject.ToString();
-	debugPrintf((debugStr == NULL) ? "Lua: Invalid debug string!\n" : debugStr);
-}
-
-#ifdef _DEBUG
-/*---------------------------------------------------------------------
-	Debug function for determining an object's type
+	Sets each schema field of the event into the table, read straight
+	from the event's members
 ---------------------------------------------------------------------*/
-void ScriptManager_Lua::getLuaObjectType(LuaObject &obj)
+static void pushSchemaFields(LuaObject &tbl, const EventSchema &schema, const Event &e)
 {
-	_ASSERTE(!obj.IsNil() && "Nil");
-	_ASSERTE(!obj.IsBoolean() && "Boolean");
-	_ASSERTE(!obj.IsCFunction() && "C-Function");
-	_ASSERTE(!obj.IsFunction() && "Function");
-	_ASSERTE(!obj.IsInteger() && "Integer");
-	_ASSERTE(!obj.IsLightUserData() && "Light User Data");
-	_ASSERTE(!obj.IsNone() && "None");
-	_ASSERTE(!obj.IsNumber() && "Number");
-	_ASSERTE(!obj.IsString() && "String");
-	_ASSERTE(!obj.IsTable() && "Table");
-	_ASSERTE(!obj.IsUserData() && "User Data");
-//	_ASSERTE(!obj.IsWString() && "Wide String");
-	_ASSERTE(0 && "Unknown");
-}
-#endif
-
-/*---------------------------------------------------------------------
-	Callable from script, calls inherited registerEventHandler with
-	a LuaEventHandler to create a script event handler.
----------------------------------------------------------------------*/
-bool ScriptManager_Lua::registerScriptHandler(const char *eventType, LuaObject luaFunc, uint priority)
-{
-	_ASSERTE(luaFunc.IsFunction() && "Lua handler is not a function"); // debug error checking
-
-	EventHandlerMap::const_iterator i = mHandlerMap.find(eventType);
-	if (i == mHandlerMap.end()) {
-		// if handler does not already exist, create new handler and register
-		IEventHandlerPtr p(new LuaEventHandler(luaFunc, priority));
-		debugPrintf("Lua: script function registered for \"%s\" event with priority %u\n", eventType, priority);
-		// The priority passed in determines the calling order relative to other script handlers.
-		// Notice that the listener is ALWAYS registered in FIFO order, so any code-side handlers
-		// that specify a priority will always come first. This will protect high priority events
-		// from being hijacked and consumed by script before code handlers see them. Does not
-		// protect FIFO (priority=0) code handlers in the same way.
-		return registerEventHandler(eventType, p, 0);
-	}
-	// else with the existing handler, add new function to list in priority order
-	LuaEventHandler &e = *(static_cast<LuaEventHandler*>(i->second.get()));
-	bool retVal = e.addLuaFunction(luaFunc, priority);
-	if (retVal) {
-		debugPrintf("Lua: script function registered for \"%s\" event with priority %u\n", eventType, priority);
-	} else {
-		debugPrintf("Lua: could not register function for \"%s\" event, already exists\n", eventType);
-	}
-	return retVal;
-}
-
-/*---------------------------------------------------------------------
-	Callable from script, calls inherited unregisterEventHandler.
----------------------------------------------------------------------*/
-bool ScriptManager_Lua::unregisterScriptHandler(const char *eventType, LuaObject luaFunc)
-{
-	_ASSERTE(luaFunc.IsFunction() && "Lua object is not a function");
-
-	// find the handler for this event type
-	EventHandlerMap::const_iterator i = mHandlerMap.find(eventType);
-	if (i != mHandlerMap.end()) {
-		LuaEventHandler &e = *(static_cast<LuaEventHandler*>(i->second.get()));
-		bool retVal = e.removeLuaFunction(luaFunc);	// tries to remove the function from the handler's list
-		if (retVal) {								// if it succeeds, check if the list is now empty
-			debugPrintf("Lua: script function removed for \"%s\" event\n", eventType);
-			if (e.isFuncListEmpty()) {				// and if so, unregister the listener
-				unregisterEventHandler(eventType);
-			}
-			return true;
-		} else {
-			debugPrintf("Lua: could not find function to unregister for \"%s\" event\n", eventType);
-			return false;
-		}
-	}
-	debugPrintf("Lua: could not find \"%s\" event to unregister\n", eventType);
-	return false;
-}
-
-/*---------------------------------------------------------------------
-	Handler for the LuaFunctionEvent event for code to call functions
-	defined by script. Event data is updated with any return value.
----------------------------------------------------------------------*/
-bool ScriptManager_Lua::handleLuaFunctionEvent(const EventPtr &ePtr)
-{
-	LuaFunctionEvent &e = *(static_cast<LuaFunctionEvent*>(ePtr.get()));
-	// find the lua state by id
-	auto i = mStateMap.find(e.stateId());
-	if (i != mStateMap.end()) {
-		// if the object is a Lua function, call it
-		LuaObject luaObj = i->second->mState->GetGlobal(e.funcName().c_str());
-		if (luaObj.IsFunction()) {
-			LuaFunction<LuaObject> luaFunc(luaObj);
-			e.setReturnObj(luaFunc(e.paramTable())); // calls the function passing paramTable and sets return value in event
-		} else {
-			debugPrintf("%s: event \"%s\": object \"%s\" not a function\n", mName.c_str(), e.type().c_str(), e.funcName().c_str());
-			return false; // could not handle event, so let it propagate
+	for (uint f = 0; f < schema.numFields(); ++f) {
+		const EventField &field = schema.fieldAt(f);
+		switch (field.mType) {
+			case EventFieldType_Bool:
+				tbl.SetBoolean(field.mName, *schema.fieldPtr<bool>(e, f));
+				break;
+			case EventFieldType_Float:
+				tbl.SetNumber(field.mName, *schema.fieldPtr<float>(e, f));
+				break;
+			case EventFieldType_UInt:	// past INT_MAX it doesn't fit a lua integer
+				tbl.SetNumber(field.mName, schema.getNumber(e, f));
+				break;
+			case EventFieldType_String:
+				tbl.SetString(field.mName, schema.fieldPtr<string>(e, f)->c_str());
+				break;
+			default:
+				tbl.SetInteger(field.mName, (int)schema.getNumber(e, f));
 		}
-		return true; // there should be no reason for another system to see or handle this event type, so mark it consumed
 	}
-	debugPrintf("%s: event \"%s\": state \"%s\" not found\n", mName.c_str(), e.type().c_str(), e.stateId().c_str());
-	return false;
 }
 
-/*---------------------------------------------------------------------
-	Callable from script, registers a script-defined event type
----------------------------------------------------------------------*/
 bool ScriptManager_Lua::registerEventType(const char *eventType)
 {
 	return eventMgr.registerEventType(eventType, RegEventPtr(new ScriptDefinedEvent()));
@@ -269,6 +179,9 @@ bool LuaEventHandler::removeLuaFunction(const LuaObject &luaFunc)
 	and returns true if event consumed by one of the handlers in the
 	list. Lua event data is built if it hasn't already been before the
 	first handler is called.
+	Event types with an EventSchema skip the AnyVars list altogether,
+	their members are set straight into a new table for each function, so
+	a handler that changes its table can't change what the next one sees.
 	**NOTE**
 	Could have the AnyVars list hold the resulting LuaObject instead of
 	parsing the boost::any values each time. Then, just check for the
@@ -276,8 +189,9 @@ bool LuaEventHandler::removeLuaFunction(const LuaObject &luaFunc)
 ---------------------------------------------------------------------*/
 bool LuaEventHandler::operator()(const EventPtr &ePtr)
 {
-	RegEventPtr rePtr = eventMgr.getRegEventPtr(ePtr->type());
-	if (!rePtr->scriptAllowed()) { // this handler was added before the event type was registered, but it's not valid
+	RegEventPtr rePtr = eventMgr.getRegEventPtr(ePtr->typeId());
+	const EventSchema *schema = rePtr->schema();
+	if (!rePtr->scriptAllowed() && !schema) { // this handler was added before the event type was registered, but it's not valid
 		debugPrintf("LuaEventHandler: handler for \"%s\" code-only event not allowed\n", ePtr->type().c_str());
 		return false; // allow the event to propagate
 	}
@@ -289,7 +203,12 @@ bool LuaEventHandler::operator()(const EventPtr &ePtr)
 		LuaFunction<bool> luaFunc(fi->first); // prepare the function for calling
 		
 		// empty events do not need event data processing
-		if (!rePtr->isEmpty()) {
+		if (schema && !rePtr->isEmpty()) {
+			LuaObject schemaTbl;
+			schemaTbl.AssignNewTable(fi->first.GetState());
+			pushSchemaFields(schemaTbl, *schema, *ePtr);
+			retVal = luaFunc(schemaTbl);
+		} else if (!rePtr->isEmpty()) {
 			ScriptableEvent &e = *(static_cast<ScriptableEvent*>(ePtr.get()));
 
 			// if script event data hasn't been built do it now - this is possible
@@ -0,0 +1,102 @@
+/*----==== ANALOGSAMPLEFILTER.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+----------------------------------------*/
+
+#include <Windows.h>
+#include "AnalogSampleFilter.h"
+#include "../Nexus/Controls.h"
+#include "../Win32/HighPerfTimer.h"
+
+////////// class AnalogSampleFilter //////////
+
+volatile long	AnalogSampleFilter::sTotalDropped = 0;
+
+/*-----------------------------------------------------------------------------
+	State of an id in range, the table grows to it with default limits
+-----------------------------------------------------------------------------*/
+AnalogSampleFilter::ControlState & AnalogSampleFilter::stateOf(short controlId)
+{
+	_ASSERTE(controlId >= 0 && (uint)controlId < (uint)sMaxControls);
+	if ((uint)controlId >= mControls.size()) {
+		ControlState blank = { 0, 0, 0, (short)sDefaultInterval, (uchar)sDefaultChangeThreshold, false, false, false };
+		mControls.resize(controlId + 1, blank);
+	}
+	return mControls[controlId];
+}
+
+bool AnalogSampleFilter::withinInterval(const ControlState &s, __int64 nowCounts) const
+{
+	return (s.mInterval > 0 &&
+			(nowCounts - s.mLastCounts) * 1000 < (__int64)s.mInterval * HighPerfTimer::timerFreq());
+}
+
+void AnalogSampleFilter::pass(ControlState &s, short rawValue, __int64 nowCounts)
+{
+	s.mLastValue = rawValue;
+	s.mLastCounts = nowCounts;
+	s.mSeen = true;
+	++mNumPassed;
+}
+
+/*-----------------------------------------------------------------------------
+	A held sample is dropped once a newer sample makes it stale
+-----------------------------------------------------------------------------*/
+void AnalogSampleFilter::dropHeld(ControlState &s)
+{
+	if (!s.mHeld) { return; }
+	s.mHeld = false;
+	++mNumDroppedInterval;
+	InterlockedIncrement(&sTotalDropped);
+}
+
+void AnalogSampleFilter::setLimits(short controlId, uchar changeThreshold, short interval)
+{
+	if (controlId < 0 || (uint)controlId >= (uint)sMaxControls) {
+		debugPrintf("AnalogSampleFilter: control id %i out of range, limits not set\n", (int)controlId);
+		return;
+	}
+	ControlState &s = stateOf(controlId);
+	s.mChangeThreshold = changeThreshold;
+	s.mInterval = interval;
+}
+
+void AnalogSampleFilter::setLimits(const AnalogControl &control)
+{
+	setLimits((short)control.id(), control.changeThreshold(), control.interval());
+}
+
+bool AnalogSampleFilter::accept(short controlId, short rawValue, __int64 nowCounts)
+{
+	if (controlId < 0 || (uint)controlId >= (uint)sMaxControls) {
+		++mNumPassed;
+		return true;
+	}
+	ControlState &s = stateOf(controlId);
+
+	if (s.mSeen) {
+		int change = (int)rawValue - (int)s.mLastValue;
+		if ((change < 0 ? -change : change) < (int)s.mChangeThreshold) {
+			// back within the threshold of what listeners have, a held sample is stale
+			dropHeld(s);
+			++mNumDroppedChange;
+			InterlockedIncrement(&sTotalDropped);
+			return false;
+		}
+		if (withinInterval(s, nowCounts)) {
+			dropHeld(s);
+			s.mHeldValue = rawValue;
+			s.mHeld = true;
+			if (!s.mListed) {
+				mHeldIds.push_back(controlId);
+				s.mListed = true;
+			}
+			return false;
+		}
+	}
+
+	dropHeld(s);
+	pass(s, rawValue, nowCounts);
+	return true;
+}
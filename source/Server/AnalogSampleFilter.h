@@ -0,0 +1,135 @@
+/*----==== ANALOGSAMPLEFILTER.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Server side deadband and rate limit for analog control samples, so a
+		noisy or misconfigured client can't flood the event loop.
+--------------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include "../Utility/Typedefs.h"
+
+using std::vector;
+
+class AnalogControl;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class AnalogSampleFilter
+	Applies the same limits AnalogControl configures on the device, to the
+	samples as they arrive. A sample passes when its value has moved at least
+	the control's change threshold from the last sample passed, and at least
+	the control's interval in ms has elapsed since then. The first sample of
+	a control always passes. A threshold of 0 passes repeated values, an
+	interval of 0 doesn't limit the rate.
+	Each client's parser owns a filter, limits and state are kept per control
+	id of that client. The limits are set as the client is sent the control's
+	AnalogControlCreateEvent, controls without limits set use the
+	AnalogControl defaults. Ids outside [0, sMaxControls) aren't tracked and
+	pass. Used from the thread running the server's io_service only.
+	Samples are dropped before an event is allocated. A sample past the
+	threshold that comes within the interval is held back instead, replacing
+	any older one held, and sent by flushHeld once the interval ends, so the
+	final value of a movement always reaches listeners.
+=============================================================================*/
+class AnalogSampleFilter {
+	public:
+		///// DEFINITIONS /////
+		static const uint	sMaxControls = 256;
+		static const uchar	sDefaultChangeThreshold = 1;	// as AnalogControl's defaults
+		static const short	sDefaultInterval = 50;
+
+	private:
+		///// DEFINITIONS /////
+		struct ControlState {
+			__int64	mLastCounts;		// timer counts of the last sample passed
+			short	mLastValue;
+			short	mHeldValue;			// newest sample held back by the interval
+			short	mInterval;			// ms
+			uchar	mChangeThreshold;
+			bool	mSeen;
+			bool	mHeld;
+			bool	mListed;			// in mHeldIds
+		};
+
+		///// VARIABLES /////
+		static volatile long	sTotalDropped;	// by every connection
+
+		vector<ControlState>	mControls;		// by control id, grows to the highest id seen or set
+		vector<short>			mHeldIds;		// controls that may have a held sample
+		uint					mNumPassed;
+		uint					mNumDroppedChange;	// under the change threshold
+		uint					mNumDroppedInterval;// held within the interval, then replaced by a newer sample
+
+		///// FUNCTIONS /////
+		ControlState &	stateOf(short controlId);
+		bool			withinInterval(const ControlState &s, __int64 nowCounts) const;
+		void			pass(ControlState &s, short rawValue, __int64 nowCounts);
+		void			dropHeld(ControlState &s);
+
+	public:
+		///// FUNCTIONS /////
+
+		/*---------------------------------------------------------------------
+			Sets the limits of one of this client's control ids
+		---------------------------------------------------------------------*/
+		void			setLimits(short controlId, uchar changeThreshold, short interval);
+		void			setLimits(const AnalogControl &control);
+
+		static uint		totalDropped()	{ return (uint)sTotalDropped; }
+
+		/*---------------------------------------------------------------------
+			Returns true if the sample should become an event, false to drop
+			or hold it. nowCounts is the high performance timer's count.
+		---------------------------------------------------------------------*/
+		bool			accept(short controlId, short rawValue, __int64 nowCounts);
+
+		/*---------------------------------------------------------------------
+			Passes each held sample whose interval has ended, calling
+			send(short controlId, short rawValue) for it. Call it regularly,
+			a client that stops sending has no later sample to bring its
+			held one out. Returns the number of samples sent.
+		---------------------------------------------------------------------*/
+		template <typename TSend>
+		uint			flushHeld(__int64 nowCounts, TSend &send);
+
+		// Accessors
+		uint			numPassed() const			{ return mNumPassed; }
+		uint			numDroppedChange() const	{ return mNumDroppedChange; }
+		uint			numDroppedInterval() const	{ return mNumDroppedInterval; }
+		uint			numDropped() const			{ return mNumDroppedChange + mNumDroppedInterval; }
+		bool			hasHeld() const				{ return !mHeldIds.empty(); }	// exact right after flushHeld
+
+		// Constructor
+		explicit AnalogSampleFilter() :
+			mNumPassed(0), mNumDroppedChange(0), mNumDroppedInterval(0)
+		{}
+};
+
+template <typename TSend>
+uint AnalogSampleFilter::flushHeld(__int64 nowCounts, TSend &send)
+{
+	uint numSent = 0;
+	size_t keep = 0;
+	for (size_t h = 0; h < mHeldIds.size(); ++h) {
+		short controlId = mHeldIds[h];
+		ControlState &s = mControls[controlId];
+		if (s.mHeld && withinInterval(s, nowCounts)) {
+			mHeldIds[keep++] = controlId;
+			continue;
+		}
+		s.mListed = false;
+		if (s.mHeld) {
+			s.mHeld = false;
+			pass(s, s.mHeldValue, nowCounts);
+			send(controlId, s.mHeldValue);
+			++numSent;
+		}
+	}
+	mHeldIds.resize(keep);
+	return numSent;
+}
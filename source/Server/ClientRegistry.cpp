@@ -0,0 +1,53 @@
+/*----==== CLIENTREGISTRY.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+------------------------------------*/
+
+#include "ClientRegistry.h"
+#include "TCPConnection.h"
+
+////////// class ClientRegistry //////////
+
+int ClientRegistry::add(const TCPConnectionPtr &cn, ArchiveFormat format)
+{
+	int clientId;
+	if (!mFreeIds.empty()) {
+		clientId = mFreeIds.front();
+		mFreeIds.pop_front();
+	} else {
+		clientId = (int)mClients.size();
+		mClients.push_back(ClientEntry());
+	}
+	ClientEntry &c = mClients[clientId];
+	c.mConnection = cn;
+	c.mFormat = format;
+	++mNumClients;
+	return clientId;
+}
+
+bool ClientRegistry::remove(const TCPConnectionPtr &cn)
+{
+	int clientId = cn->id();
+	if ((uint)clientId >= mClients.size() || mClients[clientId].mConnection != cn) {
+		return false;
+	}
+	mClients[clientId].mConnection.reset();
+	mFreeIds.push_back(clientId);
+	--mNumClients;
+	return true;
+}
+
+void ClientRegistry::clear()
+{
+	mClients.clear();
+	mFreeIds.clear();
+	mNumClients = 0;
+}
+
+bool ClientRegistry::setFormat(int clientId, ArchiveFormat format)
+{
+	if (!find(clientId)) { return false; }
+	mClients[clientId].mFormat = format;
+	return true;
+}
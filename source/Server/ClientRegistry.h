@@ -0,0 +1,85 @@
+/*----==== CLIENTREGISTRY.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Live connections of a server by client id, for routing RemoteEvents
+		to their target client.
+----------------------------------*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <boost/noncopyable.hpp>
+#include "TCPTypes.h"
+#include "../Utility/Typedefs.h"
+
+using std::vector;
+using std::deque;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class ClientRegistry
+	Dense table of a server's accepted connections indexed by client id, so
+	finding the connection of a RemoteEvent's mTargetClientId is one bounds
+	check and an index. Ids are handed out when a connection is added and
+	freed when it's removed, then reused oldest first, so the table stays as
+	large as the most clients connected at once. An event still queued for
+	a client that has left can reach the next client given its id, reusing
+	the oldest id makes that as unlikely as it can be. Broadcasts walk the
+	table and skip free slots. Used from the thread running the server's
+	io_service only.
+=============================================================================*/
+class ClientRegistry : private boost::noncopyable {
+	public:
+		///// DEFINITIONS /////
+		struct ClientEntry {
+			TCPConnectionPtr	mConnection;	// null when the slot is free
+			ArchiveFormat		mFormat;		// how events are written to the client
+		};
+
+	private:
+		///// VARIABLES /////
+		vector<ClientEntry>	mClients;	// by client id
+		deque<int>			mFreeIds;	// oldest freed at the front
+		uint				mNumClients;
+
+	public:
+		///// FUNCTIONS /////
+
+		/*---------------------------------------------------------------------
+			Adds a connection and returns its client id
+		---------------------------------------------------------------------*/
+		int		add(const TCPConnectionPtr &cn, ArchiveFormat format);
+
+		/*---------------------------------------------------------------------
+			Frees the connection's id. Returns false if the connection wasn't
+			registered under it, when it has already been removed.
+		---------------------------------------------------------------------*/
+		bool	remove(const TCPConnectionPtr &cn);
+
+		void	clear();
+
+		/*---------------------------------------------------------------------
+			Entry of a connected client, null for a free or out of range id,
+			-1 included
+		---------------------------------------------------------------------*/
+		const ClientEntry *	find(int clientId) const {
+								if ((uint)clientId >= mClients.size() || !mClients[clientId].mConnection) { return 0; }
+								return &mClients[clientId];
+							}
+
+		bool	setFormat(int clientId, ArchiveFormat format);
+
+		// Accessors
+		uint				numClients() const		{ return mNumClients; }
+		uint				capacity() const		{ return (uint)mClients.size(); }
+		const ClientEntry &	at(uint slot) const		{ return mClients[slot]; }
+
+		// Constructor
+		explicit ClientRegistry() :
+			mNumClients(0)
+		{}
+};
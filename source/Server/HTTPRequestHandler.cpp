@@ -67,16 +67,22 @@ void HTTPRequestHandler::handleRequest(HTTPRequest &req)
 	string requestPath(mDocRoot + scriptName);
 	std::replace(requestPath.begin(), requestPath.end(), '/', '\\');
 
+	// make extension lowercase, extensions are now case insensitive
+	std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
+
+	// Large static files are read from the source a chunk at a time as the connection
+	// writes them, instead of being loaded whole and pushing everything else out of the cache
+	mStreamPtr.reset();
+	if (extension != "luap" && resMgr.getResourceSize(requestPath) >= (int)sMinStreamSize) {
+		mStreamPtr = resMgr.openStream(requestPath);
+	}
+
 	// Open the requested resource
 	ResHandle h;
-	if (!h.load<WebResource>(requestPath)) {
+	if (!mStreamPtr && !h.load<WebResource>(requestPath)) {
 		mReply = HTTPReply::stockReply(HTTPReply::not_found);
 		return;
 	}
-	WebResource &res = *(reinterpret_cast<WebResource*>(h.getResPtr().get()));
-
-	// make extension lowercase, extensions are now case insensitive
-	std::transform(extension.begin(), extension.end(), extension.begin(), tolower);
 
 	// Write CGI environment variables
 	getCGIVars(req, scriptName, requestPath);
@@ -84,21 +90,28 @@ void HTTPRequestHandler::handleRequest(HTTPRequest &req)
 	// Fill out the reply to be sent to the client
 	// Check file extension for registered markup pre-processors
 	// currently Lua is the only available language
-	if (extension == "luap") {
-		mReply.status = HTTPReply::ok;
-		// process markup here and add to mReply.content
-		LuaRequestHandler lh(string(res.dataPtr().get(), res.sizeB()),
-							 req, mReply);
-		lh.parse();
+	mReply.status = HTTPReply::ok;
+	size_t contentLength = 0;
+	if (mStreamPtr) {
+		// the content is left empty, the connection reads it with readReplyStream
+		contentLength = mStreamPtr->size();
 	} else {
-		// anything else is not a dynamic page and sent as-is
-		mReply.status = HTTPReply::ok;
-		mReply.content.append(res.dataPtr().get(), res.sizeB());
+		WebResource &res = *(reinterpret_cast<WebResource*>(h.getResPtr().get()));
+		if (extension == "luap") {
+			// process markup here and add to mReply.content
+			LuaRequestHandler lh(string(res.dataPtr().get(), res.sizeB()),
+								 req, mReply);
+			lh.parse();
+		} else {
+			// anything else is not a dynamic page and sent as-is
+			mReply.content.append(res.dataPtr().get(), res.sizeB());
+		}
+		contentLength = mReply.content.size();
 	}
 
 	// Add common response headers
 	mReply.addHeader("Connection", "close");
-	mReply.addHeader("Content-Length", boost::lexical_cast<string>(mReply.content.size()));
+	mReply.addHeader("Content-Length", boost::lexical_cast<string>(contentLength));
 	mReply.addHeader("Content-Type", MimeTypes::extension_to_type(extension));
 
 	// Add cookies to response headers
@@ -108,6 +121,16 @@ void HTTPRequestHandler::handleRequest(HTTPRequest &req)
 		});
 }
 
+int HTTPRequestHandler::readReplyStream(char *buffer, int maxSize)
+{
+	if (!mStreamPtr) { return 0; }
+	int size = mStreamPtr->read(buffer, maxSize);
+	if (size <= 0) {
+		mStreamPtr.reset(); // done with the source
+	}
+	return size;
+}
+
 void HTTPRequestHandler::getCGIVars(HTTPRequest &req, const string &scriptName,
 									const string &requestPath)
 {
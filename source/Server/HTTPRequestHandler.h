@@ -4,15 +4,20 @@
 #include "TCPTypes.h"
 #include "Message.h"
 #include "HTTPReply.h"
+#include "../Resource/ResCache.h"
 
 class HTTPRequest;
 
 class HTTPRequestHandler : public MessageHandler, private boost::noncopyable
 {
 	private:
+		// Definitions
+		static const uint sMinStreamSize = 1024 * 1024; // static files this large are streamed instead of cached
+
 		// Variables
 		string		mDocRoot; // Resource Source name containing the web documents
 		HTTPReply	mReply;
+		ResStreamPtr	mStreamPtr; // body of the reply when streamed from the source
 
 		// Functions
 		// Handle a request and produce a reply
@@ -41,18 +46,24 @@ class HTTPRequestHandler : public MessageHandler, private boost::noncopyable
 			return mReply.toBuffers();
 		}
 
+		virtual bool hasReplyStream() const { return (mStreamPtr.get() != 0); }
+
+		virtual int readReplyStream(char *buffer, int maxSize);
+
 		virtual void setBadRequest()
 		{
 			// if the status is already set to something else, it was done in the parser
 			// so we should not override it here and return a 500 code
 			if (!mReply.statusSet()) {
 				mReply = HTTPReply::stockReply(HTTPReply::bad_request);
+				mStreamPtr.reset();
 			}
 		}
 
 		void setStockReply(HTTPReply::StatusType status)
 		{
 			mReply = HTTPReply::stockReply(status);
+			mStreamPtr.reset();
 		}
 		
 		static HandlerPtr create(const string &docRoot)
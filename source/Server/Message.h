@@ -4,6 +4,7 @@
 #include <string>
 #include <boost/logic/tribool.hpp>
 #include <boost/asio/buffer.hpp>
+#include "TCPTypes.h"
 
 using std::vector;
 using std::string;
@@ -18,6 +19,10 @@ class MessageParser {
 		virtual void reset() = 0;
 		virtual tribool collectMessage(std::istream &is, unsigned int size, TCPConnection *cn) = 0;
 		virtual const std::stringstream &getMessage() const = 0;
+		// called once per server tick, for parsers that hold input back between messages
+		virtual void flush() {}
+		// the format the sender of the last message wants events written in, false if it didn't say
+		virtual bool requestedFormat(ArchiveFormat &outFormat) const { return false; }
 };
 
 class MessageHandler {
@@ -27,4 +32,8 @@ class MessageHandler {
 		virtual string getReply() const = 0;
 		virtual const BufferList &getReplyBuffers() = 0;
 		virtual void setBadRequest() = 0;
+		// a reply whose body is too large to build whole is read in parts once its buffers are written
+		virtual bool hasReplyStream() const { return false; }
+		// reads the next part of the body into buffer, returns its size, 0 at the end or -1 on error
+		virtual int readReplyStream(char *buffer, int maxSize) { return 0; }
 };
\ No newline at end of file
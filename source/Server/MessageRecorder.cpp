@@ -0,0 +1,174 @@
+/*----==== MESSAGERECORDER.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+-------------------------------------*/
+
+#include <Windows.h>
+#include "MessageRecorder.h"
+#include "NexusMessageParser.h"
+#include "../Utility/Typedefs.h"
+#include "../Win32/HighPerfTimer.h"
+
+///// FUNCTIONS /////
+
+// values are written in memory order, which is little-endian on every target
+template <typename T>
+static void writeValue(std::ostream &out, const T &value)
+{
+	out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(std::istream &in, T &value)
+{
+	in.read(reinterpret_cast<char *>(&value), sizeof(T));
+	return (in.gcount() == sizeof(T));
+}
+
+////////// class MessageRecorder //////////
+
+void MessageRecorder::record(int clientId, const char *header, uint headerSize, const char *body, uint bodySize)
+{
+	if (!mFile.is_open()) { return; }
+	writeValue(mFile, HighPerfTimer::queryCounts());
+	writeValue(mFile, clientId);
+	writeValue(mFile, headerSize + bodySize);
+	mFile.write(header, headerSize);
+	if (bodySize > 0) { mFile.write(body, bodySize); }
+	++mNumRecorded;
+}
+
+MessageRecorder::MessageRecorder(const string &filename) :
+	mFile(filename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc),
+	mNumRecorded(0)
+{
+	if (!mFile.is_open()) {
+		debugPrintf("MessageRecorder: could not open \"%s\", not recording\n", filename.c_str());
+		return;
+	}
+	writeValue(mFile, (uint)sLogMagic);
+	writeValue(mFile, (uint)sLogVersion);
+	writeValue(mFile, HighPerfTimer::timerFreq());
+
+	NexusMessageParser::setRecorder(this);
+	debugPrintf("MessageRecorder: recording client messages to \"%s\"\n", filename.c_str());
+}
+
+MessageRecorder::~MessageRecorder()
+{
+	if (mFile.is_open()) {
+		NexusMessageParser::setRecorder(0);
+		mFile.close();
+		debugPrintf("MessageRecorder: %u messages recorded\n", mNumRecorded);
+	}
+}
+
+////////// class MessageReplayProcess //////////
+
+/*-----------------------------------------------------------------------------
+	Reads the next record ahead, returns false at the end of the log
+-----------------------------------------------------------------------------*/
+bool MessageReplayProcess::readNext()
+{
+	uint len = 0;
+	if (!readValue(mFile, mNextTime) || !readValue(mFile, mNextClientId) || !readValue(mFile, len)) {
+		return false;
+	}
+	if (len > NexusMessageParser::sHeaderSize + NexusMessageParser::sMaxBodySize || mNextClientId < 0) {
+		debugPrintf("MessageReplayProcess: bad record in \"%s\", stopping\n", mFilename.c_str());
+		return false;
+	}
+	mNextMsg.resize(len);
+	return (len == 0 || mFile.read(&mNextMsg[0], len));
+}
+
+/*-----------------------------------------------------------------------------
+	Scales the recorded gap from the first message to this machine's timer
+	and the speed
+-----------------------------------------------------------------------------*/
+bool MessageReplayProcess::isDue(__int64 time) const
+{
+	if (mSpeed <= 0.0f) { return true; }
+	double secs = (double)(time - mFirstTime) / (double)mLogFreq / mSpeed;
+	return (HighPerfTimer::queryCounts() >= mStartCounts + (__int64)(secs * (double)HighPerfTimer::timerFreq()));
+}
+
+void MessageReplayProcess::replay(int clientId, const string &msg)
+{
+	if ((uint)clientId >= mParsers.size()) {
+		mParsers.resize(clientId + 1);
+	}
+	if (!mParsers[clientId]) {
+		mParsers[clientId] = NexusMessageParser::create();
+		static_cast<NexusMessageParser &>(*mParsers[clientId]).setClientId(clientId);
+	}
+	NexusMessageParser &parser = static_cast<NexusMessageParser &>(*mParsers[clientId]);
+
+	mStream.clear();
+	mStream.str(msg);
+	if (parser.collectMessage(mStream, (uint)msg.size(), 0) == true) {
+		parser.dispatchMessage();
+		++mNumReplayed;
+	} else {
+		++mNumSkipped;
+	}
+}
+
+void MessageReplayProcess::onInitialize()
+{
+	mFile.open(mFilename.c_str(), std::ios::in | std::ios::binary);
+	uint magic = 0, version = 0;
+	if (!mFile.is_open() || !readValue(mFile, magic) || !readValue(mFile, version) || !readValue(mFile, mLogFreq) ||
+		magic != MessageRecorder::sLogMagic || version != MessageRecorder::sLogVersion || mLogFreq <= 0)
+	{
+		debugPrintf("MessageReplayProcess: \"%s\" is not a message log\n", mFilename.c_str());
+		return;
+	}
+	mHasNext = readNext();
+	mFirstTime = mNextTime;
+	mStartCounts = HighPerfTimer::queryCounts();
+}
+
+void MessageReplayProcess::onUpdate(float deltaMillis)
+{
+	uint numPlayed = 0;
+	while (mHasNext && numPlayed < sMaxMessagesPerUpdate && isDue(mNextTime)) {
+		replay(mNextClientId, mNextMsg);
+		++numPlayed;
+		mHasNext = readNext();
+	}
+	// as the server's tick does, pass on held samples whose interval has ended
+	bool held = false;
+	for (uint c = 0; c < mParsers.size(); ++c) {
+		if (!mParsers[c]) { continue; }
+		NexusMessageParser &parser = static_cast<NexusMessageParser &>(*mParsers[c]);
+		parser.flush();
+		held = held || parser.analogFilter().hasHeld();
+	}
+	// the log is done once the last held sample is out
+	if (!mHasNext && !held) {
+		finish();
+	}
+}
+
+void MessageReplayProcess::onFinish()
+{
+	mFile.close();
+	debugPrintf("MessageReplayProcess: \"%s\" done, %u messages replayed, %u skipped\n",
+				mFilename.c_str(), mNumReplayed, mNumSkipped);
+}
+
+MessageReplayProcess::MessageReplayProcess(const string &filename, float speed) :
+	CProcess("MessageReplayProcess"),
+	mFilename(filename),
+	mSpeed(speed),
+	mLogFreq(0),
+	mFirstTime(0),
+	mStartCounts(0),
+	mHasNext(false),
+	mNextTime(0),
+	mNextClientId(0),
+	mNumReplayed(0),
+	mNumSkipped(0)
+{}
@@ -0,0 +1,113 @@
+/*----==== MESSAGERECORDER.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Records the Nexus messages clients send, as framed by the parser, and
+		plays a log back through the parser, to reproduce client load offline.
+-----------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <boost/noncopyable.hpp>
+#include "TCPTypes.h"
+#include "../Process/ProcessManager.h"
+
+using std::string;
+using std::vector;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class MessageRecorder
+	Writes every message NexusMessageParser collects from a client connection
+	to the log, header and body as received, with its time and the client
+	id. Messages are recorded before the analog filter or coalescing can
+	drop or fold anything, so a replay puts the same load on the server as
+	the clients did. The parsers run on the thread polling the server's
+	io_service, which is the only thread calling record.
+	**Log layout**
+	All values are little-endian.
+		header	uint magic "NXMS", uint version, __int64 timer frequency
+		records	__int64 time, int client id, uint length, message
+=============================================================================*/
+class MessageRecorder : private boost::noncopyable {
+	public:
+		///// DEFINITIONS /////
+		static const uint	sLogMagic = 0x534D584E;	// "NXMS" in file order
+		static const uint	sLogVersion = 1;
+
+	private:
+		///// VARIABLES /////
+		std::ofstream	mFile;
+		uint			mNumRecorded;
+
+	public:
+		///// FUNCTIONS /////
+		/*---------------------------------------------------------------------
+			Appends a message collected from the client's connection
+		---------------------------------------------------------------------*/
+		void	record(int clientId, const char *header, uint headerSize, const char *body, uint bodySize);
+
+		bool	isOpen() const		{ return mFile.is_open(); }
+		uint	numRecorded() const	{ return mNumRecorded; }
+
+		// Constructor / destructor
+		explicit MessageRecorder(const string &filename);
+		~MessageRecorder();
+};
+
+/*=============================================================================
+class MessageReplayProcess
+	Reads a log written by MessageRecorder and feeds each message to a
+	NexusMessageParser of its client, with no connection, then dispatches
+	it the way TCPConnection does. The messages go through the same
+	framing, analog filter and raise as live traffic, and held samples are
+	flushed every update as TCPServer::tick does. speed scales the recorded
+	timing, 1 plays back in real time, 4 at four times the rate, and 0
+	plays up to sMaxMessagesPerUpdate each update. Runs on the main thread
+	like the server it stands in for, finishes at the end of the log once
+	no sample is held back.
+=============================================================================*/
+class MessageReplayProcess : public CProcess {
+	public:
+		///// DEFINITIONS /////
+		static const uint	sMaxMessagesPerUpdate = 4096;
+
+	private:
+		///// VARIABLES /////
+		string				mFilename;
+		float				mSpeed;
+		std::ifstream		mFile;
+		__int64				mLogFreq;
+		__int64				mFirstTime;		// of the first message in the log
+		__int64				mStartCounts;	// when it was played
+		bool				mHasNext;
+		__int64				mNextTime;		// the next message, read ahead until it is due
+		int					mNextClientId;
+		string				mNextMsg;
+		std::stringstream	mStream;		// the message as the parser reads it
+		vector<ParserPtr>	mParsers;		// by client id
+		uint				mNumReplayed;
+		uint				mNumSkipped;
+
+		///// FUNCTIONS /////
+		bool	readNext();
+		bool	isDue(__int64 time) const;
+		void	replay(int clientId, const string &msg);
+
+		void	onInitialize();
+		void	onUpdate(float deltaMillis);
+		void	onFinish();
+		void	onTogglePause() {}
+
+	public:
+		uint	numReplayed() const	{ return mNumReplayed; }
+
+		explicit MessageReplayProcess(const string &filename, float speed);
+		~MessageReplayProcess() {}
+};
@@ -17,7 +17,11 @@ class NexusMessageHandler : public MessageHandler
 		virtual void handleMessage(MessageParser *parser)
 		{
 			NexusMessageParser &rp = *(reinterpret_cast<NexusMessageParser*>(parser));
-			mReply.assign(rp.getMessage().str()); // echo message back to sender
+			mReply.clear();
+			// event messages are raised, anything else is echoed back to the sender (for now)
+			if (!rp.dispatchMessage()) {
+				mReply.assign(rp.getMessage().str());
+			}
 		}
 
 		virtual bool hasReply() const { return (mReply.length() > 0); }
@@ -30,7 +34,7 @@ class NexusMessageHandler : public MessageHandler
 			return mReplyBuffers;
 		}
 
-		virtual void setBadRequest() {} // do nothing (for now)
+		virtual void setBadRequest() { mReply.clear(); } // nothing is sent back (for now)
 
 		static HandlerPtr create()
 		{
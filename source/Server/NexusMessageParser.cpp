@@ -1,7 +1,7 @@
 /*----==== NEXUSMESSAGEPARSER.CPP ====----
 	Author:	Jeff Kiah
 	Date:	10/27/2010
-	Rev:	9/16/2011
+	Rev:	9/24/2011
 ----------------------------------------*/
 
 #include <string>
@@ -9,7 +9,12 @@
 #include "NexusMessageParser.h"
 #include "TCPServer.h"
 #include "TCPConnection.h"
+#include "MessageRecorder.h"
 #include "../Utility/Typedefs.h"
+#include "../Event/EventManager.h"
+#include "../Utility/BinaryArchive.h"
+#include "../Win32/HighPerfTimer.h"
+#include "../Nexus/ControlEvents.h"
 
 #define DFLT_MSG_PREFIX				'/'
 #define DFLT_MSG_TERMINATOR			'\r'
@@ -24,36 +29,214 @@ NexusMessageParser::MsgSpecialChars NexusMessageParser::sSpecials =
 	{DFLT_MSG_PREFIX,DFLT_MSG_TERMINATOR,DFLT_MSG_TERMINATOR2,DFLT_NVP_SEPARATOR,
 	 DFLT_NVP_DELIMITER,DFLT_NVP_PREFIX,DFLT_NVP_STRING_DELIMITER};
 
+vector<EventTypeId>	NexusMessageParser::sTypeOfCode;
+vector<uint>		NexusMessageParser::sCodeOfType;
+MessageRecorder *	NexusMessageParser::sRecorder = 0;
+
+// Structures
+
+// raises the analog samples the filter held back, as the connection's client
+struct HeldSampleSender {
+	int mClientId;
+	void operator()(short controlId, short rawValue) const {
+		AnalogControlEvent *e = new AnalogControlEvent(mClientId);
+		e->mControlId = controlId;
+		e->mRawValue = rawValue;
+		eventMgr.raise(EventPtr(e));
+	}
+};
+
 // Functions
 tribool NexusMessageParser::collectMessage(std::istream &is, unsigned int size, TCPConnection *cn)
 {
-	for (unsigned int i = 0; i < size; ++i) {
-		char c;
-		is.get(c);
-
-		// Begin new message
-		if (c == sSpecials.msgPrefix && !mMsgInProgress) {
-			mMsg.str(string()); // clear the buffer
-			mMsgInProgress = true;
-			mMsgTerminating = false;
-
-		// End of message
-		} else if (c == sSpecials.msgTerminator && mMsgInProgress) {
-			mMsgTerminating = true;
-
-		} else if (c == sSpecials.msgTerminator2 && mMsgTerminating) {
-			mMsgInProgress = false;
-			mMsgTerminating = false;
-			// log the message
-			debugPrintf("%s sent: %s\n",
-						cn->getSocket().remote_endpoint().address().to_string().c_str(),
-						mMsg.str().c_str());
-			return true;
-
-		} else if (mMsgInProgress) {
-			mMsg << c;
-			mMsgTerminating = false;
+	if (cn) { mClientId = cn->id(); }	// no connection when reading a replayed or test stream
+	unsigned int i = 0;
+	while (i < size) {
+		switch (mState) {
+			case ParseState_Start: {
+				char c;
+				is.get(c);
+				++i;
+				if (c == sSpecials.msgPrefix) {
+					mHeader[0] = c;
+					mHeaderPos = 1;
+					mState = ParseState_Header;
+				}
+				break;
+			}
+			case ParseState_Header: {
+				is.get(mHeader[mHeaderPos++]);
+				++i;
+				if (mHeaderPos < sHeaderSize) { break; }
+
+				BinaryIArchive ar(mHeader + 1, sHeaderSize - 1);
+				ar >> mMessageCode >> mBodyLength >> mBodyFormat;
+				mState = ParseState_Start;
+				if (mBodyLength > sMaxBodySize ||
+					(mBodyFormat != 'f' && mBodyFormat != 'n' && mBodyFormat != 'b'))
+				{
+					debugPrintf("NexusMessageParser: \"%i\" bad header, code %u length %u format %i\n",
+								mClientId, mMessageCode, mBodyLength, (int)mBodyFormat);
+					return false;
+				}
+				if (mBodyLength == 0) { return messageCollected(cn); }
+				mBody.resize(mBodyLength);
+				mBodyPos = 0;
+				mState = ParseState_Body;
+				break;
+			}
+			case ParseState_Body: {
+				uint n = mBodyLength - mBodyPos;
+				if (n > size - i) { n = size - i; }
+				is.read(&mBody[mBodyPos], n);
+				i += n;
+				mBodyPos += n;
+				if (mBodyPos == mBodyLength) {
+					mState = ParseState_Start;
+					return messageCollected(cn);
+				}
+				break;
+			}
 		}
 	}
 	return boost::indeterminate;
-}
\ No newline at end of file
+}
+
+/*-----------------------------------------------------------------------------
+	Records the message as it came off the connection, before the analog
+	filter or coalescing can drop or fold it. Replayed messages have no
+	connection and aren't recorded again.
+-----------------------------------------------------------------------------*/
+bool NexusMessageParser::messageCollected(TCPConnection *cn)
+{
+	if (sRecorder && cn) {
+		sRecorder->record(mClientId, mHeader, sHeaderSize, body(), mBodyLength);
+	}
+	return true;
+}
+
+void NexusMessageParser::flush()
+{
+	HeldSampleSender send = { mClientId };
+	mAnalogFilter.flushHeld(HighPerfTimer::queryCounts(), send);
+}
+
+bool NexusMessageParser::requestedFormat(ArchiveFormat &outFormat) const
+{
+	if (mMessageCode != NexusMessageCode_ClientId || (mBodyFormat != 'f' && mBodyFormat != 'n')) {
+		return false;
+	}
+	outFormat = (mBodyFormat == 'f' ? ArchiveFormat_Binary : ArchiveFormat_Text);
+	return true;
+}
+
+const std::stringstream &NexusMessageParser::getMessage() const
+{
+	mMsg.str(string());
+	mMsg.write(mHeader, sHeaderSize);
+	if (mBodyLength > 0) { mMsg.write(&mBody[0], mBodyLength); }
+	return mMsg;
+}
+
+bool NexusMessageParser::dispatchMessage()
+{
+	EventTypeId typeId = eventTypeOf(mMessageCode);
+	if (typeId == EventTypeRegistry::sInvalidId) { return false; }
+	if (mBodyFormat != 'f') {
+		debugPrintf("NexusMessageParser: \"%i\" sent \"%s\" in format '%c', only fixed is read, message dropped\n",
+					mClientId, EventTypeRegistry::name(typeId).c_str(), mBodyFormat);
+		return true;
+	}
+	fireEventFromRemote(typeId, mClientId, body(), mBodyLength, true);
+	return true;
+}
+
+bool NexusMessageParser::fireEventFromRemote(EventTypeId typeId, int clientId, const char *body, uint size, bool raise)
+{
+	// filter analog samples on the two leading shorts of the body, before anything is allocated
+	if (typeId == AnalogControlEvent::sTypeId) {
+		BinaryIArchive ar(body, size);
+		short controlId = 0, rawValue = 0;
+		ar >> controlId >> rawValue;
+		if (!ar.failed() && !mAnalogFilter.accept(controlId, rawValue, HighPerfTimer::queryCounts())) {
+			return false;
+		}
+	}
+
+	RegEventPtr regPtr = eventMgr.getRegEventPtr(typeId);
+	if (!regPtr || !regPtr->remoteAllowed()) {
+		debugPrintf("NexusMessageParser: \"%s\" is not a remote event type, message dropped\n",
+					EventTypeRegistry::name(typeId).c_str());
+		return false;
+	}
+	// the typed entry point decodes straight from the body, no stream or AnyVars in between
+	return regPtr->fireEventFromRemote(clientId, body, size, raise);
+}
+
+bool NexusMessageParser::registerMessageCode(uint code, const string &eventType)
+{
+	EventTypeId typeId = EventTypeRegistry::find(eventType);
+	if (code >= sMaxMessageCodes || code < (uint)NexusMessageCode_CreateDigitalSwitch ||
+		typeId == EventTypeRegistry::sInvalidId)
+	{
+		debugPrintf("NexusMessageParser: cannot register code %u for \"%s\"\n", code, eventType.c_str());
+		return false;
+	}
+	if (code >= sTypeOfCode.size()) {
+		sTypeOfCode.resize(code + 1, (EventTypeId)EventTypeRegistry::sInvalidId);
+	}
+	if (typeId >= sCodeOfType.size()) {
+		sCodeOfType.resize(typeId + 1, (uint)sInvalidCode);
+	}
+	sTypeOfCode[code] = typeId;
+	sCodeOfType[typeId] = code;
+	return true;
+}
+
+void NexusMessageParser::registerControlMessages()
+{
+	registerMessageCode(NexusMessageCode_CreateDigitalSwitch, DigitalSwitchCreateEvent::sEventType);
+	registerMessageCode(NexusMessageCode_CreateAnalogControl, AnalogControlCreateEvent::sEventType);
+	registerMessageCode(NexusMessageCode_CreateEncoder, EncoderCreateEvent::sEventType);
+	registerMessageCode(NexusMessageCode_CreateKeyMatrix, KeyMatrixCreateEvent::sEventType);
+	registerMessageCode(NexusMessageCode_DigitalSwitch, DigitalSwitchEvent::sEventType);
+	registerMessageCode(NexusMessageCode_AnalogControl, AnalogControlEvent::sEventType);
+	registerMessageCode(NexusMessageCode_Encoder, EncoderEvent::sEventType);
+	registerMessageCode(NexusMessageCode_KeyMatrix, KeyMatrixEvent::sEventType);
+}
+
+bool NexusMessageParser::writeEvent(const Event &e, ArchiveFormat format, string &msg)
+{
+	uint code = messageCodeOf(e.typeId());
+	if (code == sInvalidCode) {
+		debugPrintf("NexusMessageParser: \"%s\" has no message code, not sent\n", e.type().c_str());
+		return false;
+	}
+	RegEventPtr regPtr = eventMgr.getRegEventPtr(e.typeId());
+	char body[sMaxPayloadSize];
+	uint size = 0;
+	char bodyFormat = (format == ArchiveFormat_Binary ? 'f' : 'n');
+	bool encoded = (regPtr && (format == ArchiveFormat_Binary ?
+		regPtr->writePayload(e, body, sMaxPayloadSize, size) :
+		regPtr->writeNVPPayload(e, body, sMaxPayloadSize, size)));
+	if (!encoded) {
+		debugPrintf("NexusMessageParser: \"%s\" event could not be encoded, not sent\n", e.type().c_str());
+		return false;
+	}
+
+	char header[sHeaderSize];
+	header[0] = sSpecials.msgPrefix;
+	BinaryOArchive ar(header + 1, sHeaderSize - 1);
+	ar << code << size << bodyFormat;
+	msg.assign(header, sHeaderSize);
+	msg.append(body, size);
+	return true;
+}
+
+NexusMessageParser::~NexusMessageParser()
+{
+	if (mAnalogFilter.numDropped() > 0) {
+		debugPrintf("NexusMessageParser: analog samples %u passed, %u dropped under threshold, %u within interval\n",
+					mAnalogFilter.numPassed(), mAnalogFilter.numDroppedChange(), mAnalogFilter.numDroppedInterval());
+	}
+}
@@ -7,30 +7,90 @@
 #pragma once
 
 #include <sstream>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include "TCPTypes.h"
 #include "Message.h"
+#include "AnalogSampleFilter.h"
+#include "../Event/Event.h"
 
-class NexusRequestHeader {
-	public:
-		short	eventID;	// event ID
-		char	version;	// event message version
-		short	length;		// length of data in bytes
+using std::vector;
 
-		explicit NexusRequestHeader(short _eventID, char _version, short _length) :
-			eventID(_eventID), version(_version), length(_length)
-		{}
+class MessageRecorder;
+
+///// DEFINITIONS /////
+
+/*---------------------------------------------------------------------
+	Message codes of the built-in event messages. Codes below 16 are
+	reserved for the protocol messages of NexusProtocol.txt section 4.
+---------------------------------------------------------------------*/
+enum NexusMessageCode : uint {
+	NexusMessageCode_ClientId = 0,
+	NexusMessageCode_CreateDigitalSwitch = 16,	// server to client
+	NexusMessageCode_CreateAnalogControl,
+	NexusMessageCode_CreateEncoder,
+	NexusMessageCode_CreateKeyMatrix,
+	NexusMessageCode_DigitalSwitch = 32,		// client to server
+	NexusMessageCode_AnalogControl,
+	NexusMessageCode_Encoder,
+	NexusMessageCode_KeyMatrix
 };
 
+///// STRUCTURES /////
+
+/*=============================================================================
+class NexusMessageParser
+	Collects messages framed as in NexusProtocol.txt section 2.2, a ten byte
+	header of the start character, the message code and body length as
+	little-endian uints, and the body format character, then the body. The
+	body length frames the message, bytes outside a message are skipped
+	until the next start character. Message codes registered for an event
+	type are raised as that event by dispatchMessage, other messages are
+	left to the handler. A client id message (code 0) also sets how events
+	are written to its sender, Binary when its body format is 'f', Text
+	when it is 'n'. Clients are written in Text until they identify.
+=============================================================================*/
 class NexusMessageParser : public MessageParser, private boost::noncopyable
 {
+	public:
+		// Definitions
+		static const uint sHeaderSize = 10;			// NexusProtocol.txt 2.2
+		static const uint sMaxBodySize = 64 * 1024;	// longer messages are refused
+		static const uint sMaxPayloadSize = 1024;	// larger events aren't sent
+		static const uint sMaxMessageCodes = 1024;	// event messages are registered below this
+		static const uint sInvalidCode = 0xFFFFFFFF;
+
 	private:
-		std::stringstream	mMsg;
-		bool				mMsgInProgress;
-		bool				mMsgTerminating;
+		// Definitions
+		enum ParseState {
+			ParseState_Start = 0,	// looking for the start character
+			ParseState_Header,
+			ParseState_Body
+		};
+
+		// Variables
+		static vector<EventTypeId>	sTypeOfCode;	// by message code, sInvalidId where not registered
+		static vector<uint>			sCodeOfType;	// by EventTypeId, sInvalidCode where not registered
+		static MessageRecorder *	sRecorder;		// given each message collected from a connection
+
+		ParseState			mState;
+		char				mHeader[sHeaderSize];
+		uint				mHeaderPos;
+		vector<char>		mBody;			// keeps its capacity between messages
+		uint				mBodyPos;
+		uint				mMessageCode;
+		uint				mBodyLength;
+		char				mBodyFormat;
+		int					mClientId;		// of the connection the message came from
+		mutable std::stringstream	mMsg;	// whole message, only built when getMessage asks
+		AnalogSampleFilter	mAnalogFilter;	// this client's analog samples
+
+		// Functions
+		bool messageCollected(TCPConnection *cn);
 
 		explicit NexusMessageParser() :
-			mMsgInProgress(false), mMsgTerminating(false)
+			mState(ParseState_Start), mHeaderPos(0), mBodyPos(0), mMessageCode(0),
+			mBodyLength(0), mBodyFormat(0), mClientId(-1)
 		{}
 
 	public:
@@ -51,12 +111,78 @@ class NexusMessageParser : public MessageParser, private boost::noncopyable
 		// Functions
 		virtual void reset() {}
 		virtual tribool collectMessage(std::istream &is, unsigned int size, TCPConnection *cn);
-		virtual const std::stringstream &getMessage() const
-		{
-			return mMsg;
-		}
-		
-		void fireEventFromRemote(const char *eventType, std::ostream &os, bool raise);
+		virtual void flush();
+		virtual bool requestedFormat(ArchiveFormat &outFormat) const;
+
+		/*---------------------------------------------------------------------
+			The last message collected, header and body, as it was received
+		---------------------------------------------------------------------*/
+		virtual const std::stringstream &getMessage() const;
+
+		uint		messageCode() const	{ return mMessageCode; }
+		char		bodyFormat() const	{ return mBodyFormat; }
+		uint		bodyLength() const	{ return mBodyLength; }
+		const char *body() const		{ return (mBodyLength > 0 ? &mBody[0] : 0); }
+
+		/*---------------------------------------------------------------------
+			Raises the event of the last message collected if its code is
+			registered and returns true, even if the event was dropped, or
+			returns false for any other code. Event messages use the fixed
+			('f') body format.
+		---------------------------------------------------------------------*/
+		bool dispatchMessage();
+
+		/*---------------------------------------------------------------------
+			Creates an event of a registered remote type from a fixed ('f')
+			format message body and raises it, or triggers it if raise is
+			false (main thread only). clientId is the sending connection's id.
+			Analog samples go through this connection's AnalogSampleFilter
+			first, and are dropped without allocating an event when they
+			don't pass. Returns false if the type isn't remote callable, the
+			body is short or the sample was dropped or held.
+		---------------------------------------------------------------------*/
+		bool fireEventFromRemote(EventTypeId typeId, int clientId, const char *body, uint size, bool raise);
+
+		/*---------------------------------------------------------------------
+			Writes an event as a message for a client into msg, which keeps
+			its capacity between calls. The message is the section 2.2
+			header with the type's registered message code, then the body,
+			fixed ('f') from writePayload for Binary clients or name-value
+			pairs ('n') from writeNVPPayload for Text clients. Returns false
+			if the type has no message code or can't be encoded.
+		---------------------------------------------------------------------*/
+		static bool writeEvent(const Event &e, ArchiveFormat format, string &msg);
+
+		/*---------------------------------------------------------------------
+			Maps a message code to a registered event type both ways, at
+			startup before clients connect. Codes must be below
+			sMaxMessageCodes and not reserved for the protocol.
+		---------------------------------------------------------------------*/
+		static bool			registerMessageCode(uint code, const string &eventType);
+		static void			registerControlMessages();	// the NexusMessageCode event messages
+		static EventTypeId	eventTypeOf(uint code) {
+								return (code < sTypeOfCode.size() ? sTypeOfCode[code] : EventTypeRegistry::sInvalidId);
+							}
+		static uint			messageCodeOf(EventTypeId typeId) {
+								return (typeId < sCodeOfType.size() ? sCodeOfType[typeId] : sInvalidCode);
+							}
+
+		/*---------------------------------------------------------------------
+			Sets the recorder given every message collected from a client
+			connection, before it is dispatched, or 0 to stop recording
+		---------------------------------------------------------------------*/
+		static void			setRecorder(MessageRecorder *recorder) { sRecorder = recorder; }
+
+		/*---------------------------------------------------------------------
+			Client the messages are from when collectMessage is given no
+			connection, as for a replayed log
+		---------------------------------------------------------------------*/
+		void				setClientId(int clientId) { mClientId = clientId; }
+
+		AnalogSampleFilter &		analogFilter()			{ return mAnalogFilter; }
+		const AnalogSampleFilter &	analogFilter() const	{ return mAnalogFilter; }
+
+		~NexusMessageParser();
 
 		static ParserPtr create()
 		{
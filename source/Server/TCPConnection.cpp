@@ -13,8 +13,6 @@ using std::iostream;
 
 ///// class TCPConnection /////
 
-unsigned int TCPConnection::nextId = 0;
-
 void TCPConnection::start()
 {
 	error_code ec;
@@ -40,7 +38,7 @@ void TCPConnection::start()
 void TCPConnection::stop()
 {
 	if (mSocket.is_open()) {
-		debugPrintf("%s: \"%u\" connection closed: %s\n",
+		debugPrintf("%s: \"%i\" connection closed: %s\n",
 			mOptions->name.c_str(), mId,
 			mSocket.remote_endpoint().address().to_string().c_str());
 		mSocket.close();
@@ -49,6 +47,22 @@ void TCPConnection::stop()
 
 void TCPConnection::writeReply()
 {
+	// one write at a time on the socket, a reply behind queued sends is copied in after them.
+	// A kept alive connection's handler builds its next reply while this one may still be in
+	// flight, so its replies are always copied.
+	// A reply with a streamed body has its headers written here, the body follows from
+	// handleWrite a chunk at a time.
+	mStreaming = mHandler->hasReplyStream();
+	if (mWriting || mOptions->connDefault == KeepAlive) {
+		const BufferList &buffers = mHandler->getReplyBuffers();
+		for (BufferList::const_iterator b = buffers.begin(); b != buffers.end(); ++b) {
+			const char *data = buffer_cast<const char *>(*b);
+			mOutQueue.insert(mOutQueue.end(), data, data + buffer_size(*b));
+		}
+		startWrite();
+		return;
+	}
+	mWriting = true;
 	async_write(mSocket, mHandler->getReplyBuffers(),
 				bind(&TCPConnection::handleWrite, shared_from_this(),
 					placeholders::error, placeholders::bytes_transferred));
@@ -61,22 +75,36 @@ void TCPConnection::handleRead(const error_code &error, size_t bytesTransferred)
 		mBuffer.commit(bytesTransferred);
 		iostream ios(&mBuffer);
 
-		//debugPrintf("\n\"%u\" collecting message\n", mId);
-		boost::tribool result =
-			mParser->collectMessage(ios, bytesTransferred, this);
-
-		if (result) { // parsed a message successfully
-			//debugPrintf("\n\"%u\" message received\n", mId, mParser->getMessage().str().c_str());
-			mHandler->handleMessage(mParser.get());
-			
-			if (mHandler->hasReply()) {
-				writeReply();
+		// one read can hold several messages, or the end of one and the start of the next,
+		// so collect until the buffer is used up
+		boost::tribool result = boost::indeterminate;
+		while (mBuffer.size() > 0) {
+			//debugPrintf("\n\"%u\" collecting message\n", mId);
+			result = mParser->collectMessage(ios, (unsigned int)mBuffer.size(), this);
+
+			if (result) { // parsed a message successfully
+				//debugPrintf("\n\"%u\" message received\n", mId, mParser->getMessage().str().c_str());
+				mHandler->handleMessage(mParser.get());
+				ArchiveFormat format;
+				if (mParser->requestedFormat(format)) {
+					TCPServerPtr server(mServer);
+					server->setArchiveFormat(mId, format);
+				}
+				
+				if (mHandler->hasReply()) {
+					writeReply();
+				}
+				mParser->reset();
+
+			} else if (!result) { // parsed a complete but invalid message
+				mHandler->setBadRequest();
+				if (mHandler->hasReply()) {
+					writeReply();
+				}
+			} else {
+				break; // everything read is part of an unfinished message
 			}
-			mParser->reset();
-
-		} else if (!result) { // parsed a complete but invalid message
-			mHandler->setBadRequest();
-			writeReply();
+			if (mOptions->connDefault != KeepAlive) { break; }
 		}
 		
 		// continue receiving data, connection does not die
@@ -84,6 +112,9 @@ void TCPConnection::handleRead(const error_code &error, size_t bytesTransferred)
 			mSocket.async_read_some(mBuffer.prepare(mOptions->connectionBufferSize),
 				boost::bind(&TCPConnection::handleRead, shared_from_this(),
 					placeholders::error, placeholders::bytes_transferred));
+		} else if (mStreaming) {
+			// the rest of the reply is still to be written, close once it is
+			mCloseAfterStream = true;
 		} else {
 			// Initiate graceful connection closure
 			error_code ec;
@@ -92,7 +123,7 @@ void TCPConnection::handleRead(const error_code &error, size_t bytesTransferred)
 			server->close(shared_from_this());
 		}
 	} else if (error != error::operation_aborted) {
-		debugPrintf("\n\"%u\" error \"%s\"\n", mId, error.message().c_str());
+		debugPrintf("\n\"%i\" error \"%s\"\n", mId, error.message().c_str());
 		TCPServerPtr server(mServer);
 
 		server->close(shared_from_this());
@@ -105,7 +136,7 @@ void TCPConnection::handleWrite(const error_code &error, size_t bytesTransferred
 		// Initiate graceful connection closure
 		error_code ec;
 		mSocket.shutdown(tcp::socket::shutdown_both, ec);
-		debugPrintf("\n\"%u\" closing socket due to error: %s\n", mId, error.message().c_str());
+		debugPrintf("\n\"%i\" closing socket due to error: %s\n", mId, error.message().c_str());
 	}
 
 	if (error != error::operation_aborted) {
@@ -114,13 +145,72 @@ void TCPConnection::handleWrite(const error_code &error, size_t bytesTransferred
 		debugPrintf("\n\"%u\" operation aborted\n", mId);
 	}*/
 
-	if (error) {
+	mWriting = false;
+	if (!error) {
+		// sends queued while this write was in flight go first, then the next part of a streamed reply
+		if (mStreaming && mOutQueue.empty()) {
+			writeReplyChunk();
+		} else {
+			startWrite();
+		}
+	} else {
 		// Close connection
 		error_code ec;
 		mSocket.shutdown(tcp::socket::shutdown_both, ec);
 		TCPServerPtr server(mServer);
 		server->close(shared_from_this());
-		debugPrintf("\n\"%u\" closing socket due to error: %s\n", mId, error.message().c_str());
+		debugPrintf("\n\"%i\" closing socket due to error: %s\n", mId, error.message().c_str());
+	}
+}
+
+bool TCPConnection::send(const char *data, unsigned int size)
+{
+	if (!mSocket.is_open() || mOutQueue.size() + size > (size_t)sMaxQueuedBytes) {
+		++mNumDroppedSends;
+		return false;
+	}
+	mOutQueue.insert(mOutQueue.end(), data, data + size);
+	startWrite();
+	return true;
+}
+
+void TCPConnection::startWrite()
+{
+	if (mWriting || mOutQueue.empty()) { return; }
+	// the sending buffer keeps its capacity, so a busy connection stops allocating
+	mOutSending.swap(mOutQueue);
+	mOutQueue.clear();
+	mWriting = true;
+	async_write(mSocket, buffer(mOutSending),
+				boost::bind(&TCPConnection::handleWrite, shared_from_this(),
+					placeholders::error, placeholders::bytes_transferred));
+}
+
+void TCPConnection::writeReplyChunk()
+{
+	// no write is in flight, so the sending buffer is free to read into
+	mOutSending.resize(sReplyChunkSize);
+	int size = mHandler->readReplyStream(&mOutSending[0], (int)sReplyChunkSize);
+	if (size > 0) {
+		mOutSending.resize(size);
+		mWriting = true;
+		async_write(mSocket, buffer(mOutSending),
+					boost::bind(&TCPConnection::handleWrite, shared_from_this(),
+						placeholders::error, placeholders::bytes_transferred));
+		return;
+	}
+	mStreaming = false;
+	mOutSending.clear();
+	if (size < 0) {
+		// the headers promised more than can be sent, closing is the only way to tell the client
+		debugPrintf("\n\"%i\" reply stream failed, closing connection\n", mId);
+		mCloseAfterStream = true;
+	}
+	if (mCloseAfterStream) {
+		error_code ec;
+		mSocket.shutdown(tcp::socket::shutdown_both, ec);
+		TCPServerPtr server(mServer);
+		server->close(shared_from_this());
 	}
 }
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <vector>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/enable_shared_from_this.hpp>
@@ -11,6 +12,7 @@ using boost::asio::io_service;
 using boost::asio::ip::tcp;
 using boost::asio::streambuf;
 using boost::system::error_code;
+using std::vector;
 
 // Structures
 
@@ -23,15 +25,24 @@ class TCPConnection : public boost::enable_shared_from_this<TCPConnection>,
 		// Functions
 		tcp::socket & getSocket() { return mSocket; }
 		HandlerPtr & getHandler() { return mHandler; }
-		unsigned int id() const { return mId; }
+		ParserPtr & getParser() { return mParser; }
+		int id() const { return mId; }	// client id in the server's registry, -1 until accepted
+		unsigned int numDroppedSends() const { return mNumDroppedSends; }
 
 		void start();
 		void writeReply();
 
+		// Queue bytes to send to the client, returns false if the socket is closed or the queue is full
+		bool send(const char *data, unsigned int size);
+
 		static TCPConnectionPtr create(io_service &ioService, const TCPServerPtr &server,
 									   const TCPServerOptionsPtr &options);
 
 	private:
+		// Definitions
+		static const unsigned int sMaxQueuedBytes = 64 * 1024;	// per connection, a client that stops reading loses sends past this
+		static const unsigned int sReplyChunkSize = 64 * 1024;	// bytes of a streamed reply body written at a time
+
 		// Variables
 		tcp::socket			mSocket;
 		streambuf			mBuffer;
@@ -39,17 +50,25 @@ class TCPConnection : public boost::enable_shared_from_this<TCPConnection>,
 		TCPServerOptionsPtr	mOptions;
 		ParserPtr			mParser;
 		HandlerPtr			mHandler;
-		unsigned int		mId;
-		static unsigned int	nextId;
+		int					mId;
+		vector<char>		mOutQueue;		// appended while a write is in flight
+		vector<char>		mOutSending;	// swapped with the queue when a write starts
+		bool				mWriting;
+		bool				mStreaming;		// the handler's reply body is still being read and written
+		bool				mCloseAfterStream;	// a connection closing after its message waits for the stream
+		unsigned int		mNumDroppedSends;
 
 		// Functions
 		void stop();
 		void handleRead(const error_code &error, size_t bytesTransferred);
 		void handleWrite(const error_code &error, size_t bytesTransferred);
+		void startWrite();
+		void writeReplyChunk();
 
 		// Constructor
 		explicit TCPConnection(io_service &ioService, const TCPServerPtr &server, const TCPServerOptionsPtr &options,
 							   const ParserPtr &parser, const HandlerPtr &handler) : 
-			mSocket(ioService), mServer(server), mOptions(options), mParser(parser), mHandler(handler), mId(nextId++)
+			mSocket(ioService), mServer(server), mOptions(options), mParser(parser), mHandler(handler), mId(-1),
+			mWriting(false), mStreaming(false), mCloseAfterStream(false), mNumDroppedSends(0)
 		{}
 };
\ No newline at end of file
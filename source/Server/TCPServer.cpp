@@ -10,6 +10,7 @@
 #include "TCPServer.h"
 #include "TCPConnection.h"
 #include "TCPServerOptions.h"
+#include "Message.h"
 
 using namespace boost::asio;
 
@@ -27,9 +28,10 @@ void TCPServer::startAccept()
 void TCPServer::handleAccept(const TCPConnectionPtr &cn, const error_code &error)
 {
     if (!error) {
-		mConnectionList.insert(cn); // add the accepted connection to the list
+		// register the accepted connection under a client id, in Text until its client id message says otherwise
+		cn->mId = mClients.add(cn, ArchiveFormat_Text);
 		cn->start(); // start handling the connection
-		debugPrintf("\n%s: \"%u\" connection accepted: %s\n",
+		debugPrintf("\n%s: \"%i\" connection accepted: %s\n",
 			mOptions->name.c_str(), cn->id(),
 			cn->getSocket().remote_endpoint().address().to_string().c_str());
 		startAccept(); // start accepting a new connection
@@ -53,6 +55,11 @@ void TCPServer::tick()
 {
 	if (!mRunning) { return; }
 	mIOService.poll();
+	// a parser holding input back may be due to pass it on even if its client has gone quiet
+	for (uint c = 0; c < mClients.capacity(); ++c) {
+		const TCPConnectionPtr &cn = mClients.at(c).mConnection;
+		if (cn) { cn->getParser()->flush(); }
+	}
 }
 
 // Stop the server
@@ -61,9 +68,11 @@ void TCPServer::stop()
 	if (!mRunning) { return; }
 	// The server is stopped by cancelling all outstanding asynchronous operations
 	mAcceptor.close();
-	std::for_each(mConnectionList.begin(), mConnectionList.end(),
-				  bind(&TCPConnection::stop, _1));
-	mConnectionList.clear();
+	for (uint c = 0; c < mClients.capacity(); ++c) {
+		const TCPConnectionPtr &cn = mClients.at(c).mConnection;
+		if (cn) { cn->stop(); }
+	}
+	mClients.clear();
 	mIOService.run();
 	mRunning = false;
 	debugPrintf("\n%s: server stopped\n", mOptions->name.c_str());
@@ -72,7 +81,7 @@ void TCPServer::stop()
 // Stop one connection
 void TCPServer::close(const TCPConnectionPtr &cn)
 {
-	mConnectionList.erase(cn);
+	mClients.remove(cn);
 	cn->stop();
 }
 
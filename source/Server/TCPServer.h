@@ -10,6 +10,7 @@
 #include <boost/asio/ip/tcp.hpp>
 #include <boost/enable_shared_from_this.hpp>
 #include "TCPTypes.h"
+#include "ClientRegistry.h"
 
 using boost::asio::io_service;
 using boost::asio::ip::tcp;
@@ -23,7 +24,7 @@ class TCPServer : public boost::enable_shared_from_this<TCPServer>,
 		bool					mRunning;
 		io_service				mIOService;
 		tcp::acceptor			mAcceptor;
-		TCPConnectionList		mConnectionList;
+		ClientRegistry			mClients;	// accepted connections by client id
 		TCPServerOptionsPtr		mOptions;
 
 		// Functions
@@ -52,8 +53,12 @@ class TCPServer : public boost::enable_shared_from_this<TCPServer>,
 		// Close one connection
 		void close(const TCPConnectionPtr &cn);
 
+		// Set how events are written to a client, returns false if it isn't connected
+		bool setArchiveFormat(int clientId, ArchiveFormat format) { return mClients.setFormat(clientId, format); }
+
 		// Accessors
 		bool isRunning() const { return mRunning; }
+		const ClientRegistry &clients() const { return mClients; }
 		const TCPServerOptions &getOptions() const { return *(mOptions.get()); }
 
 		// Create server instance
@@ -13,17 +13,19 @@ class TCPServerOptions : private boost::noncopyable
 		TCPConnectionSettings	connDefault;
 		CreateParserFuncPtr		createParser;
 		CreateHandlerFuncPtr	createHandler;
+		bool					routeRemoteEvents;	// send outgoing RemoteEvents to their target clients
 
 		// Functions
 		static TCPServerOptionsPtr create(const string &_name, unsigned short _port,
 										  const CreateParserFuncPtr &_createParser,
 										  const CreateHandlerFuncPtr &_createHandler,
 										  unsigned int _connectionBufferSize = DFLT_BUFFER_SIZE,
-										  TCPConnectionSettings _connDefault = CloseAfterMessage
+										  TCPConnectionSettings _connDefault = CloseAfterMessage,
+										  bool _routeRemoteEvents = false
 										 )
 		{
 			TCPServerOptionsPtr p(new TCPServerOptions(_name, _port, _connectionBufferSize, _connDefault,
-													   _createParser, _createHandler));
+													   _createParser, _createHandler, _routeRemoteEvents));
 			return p;
 		}
 	private:
@@ -31,8 +33,10 @@ class TCPServerOptions : private boost::noncopyable
 								  unsigned int _connectionBufferSize,
 								  TCPConnectionSettings _connDefault,
 								  const CreateParserFuncPtr &_createParser,
-								  const CreateHandlerFuncPtr &_createHandler) :
+								  const CreateHandlerFuncPtr &_createHandler,
+								  bool _routeRemoteEvents) :
 			name(_name), port(_port), createParser(_createParser), createHandler(_createHandler),
-			connectionBufferSize(_connectionBufferSize), connDefault(_connDefault)
+			connectionBufferSize(_connectionBufferSize), connDefault(_connDefault),
+			routeRemoteEvents(_routeRemoteEvents)
 		{}
 };
\ No newline at end of file
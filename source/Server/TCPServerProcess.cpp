@@ -7,6 +7,8 @@
 #include "TCPServerProcess.h"
 #include "TCPServer.h"
 #include "TCPServerOptions.h"
+#include "TCPConnection.h"
+#include "NexusMessageParser.h"
 #include "../Nexus/ControlEvents.h"
 
 ///// class TCPServerProcess /////
@@ -20,12 +22,20 @@ void TCPServerProcess::onInitialize()
 {
 	mServerPtr = TCPServer::create(mOptions);
 	mServerPtr->run();
+	if (mOptions->routeRemoteEvents) {
+		mServerListener.registerRoutes();
+	}
 
 	debugPrintf("%s: process initialized\n", name().c_str());
 }
 
 void TCPServerProcess::onFinish()
 {
+	if (mOptions->routeRemoteEvents) {
+		mServerListener.clearHandlers();
+		debugPrintf("%s: %u events routed to clients, %u for clients not connected\n",
+					name().c_str(), mServerListener.mNumRouted, mServerListener.mNumUnrouted);
+	}
 	mServerPtr->stop();
 	mServerPtr.reset();
 
@@ -50,25 +60,85 @@ TCPServerProcess::TCPServerProcess(const TCPServerOptionsPtr &options) :
 ///// class TCPServerProcessListener /////
 
 /*---------------------------------------------------------------------
-	Handles event by serializing with the socket's "Archive" object and
-	passing the bytes over the socket
+	A client is told the limits of its analog control by the create event,
+	so the server holds the client's samples to the same limits
 ---------------------------------------------------------------------*/
-/*bool TCPServerProcess::TCPServerProcessListener::handleDigitalSwitchCreateEvent(const EventPtr &ePtr)
+static void setAnalogLimits(const RemoteEvent &e, TCPConnection &cn)
 {
-	//DigitalSwitchCreateEvent<TCPTextStream> &e = *(static_cast<DigitalSwitchCreateEvent<TCPTextStream>*>(ePtr.get()));
-	//e.serialize(mSvrProc.mServerPtr->getClient() );
-	//mServerPtr
+	if (e.typeId() != AnalogControlCreateEvent::sTypeId) { return; }
+	NexusMessageParser *parser = dynamic_cast<NexusMessageParser *>(cn.getParser().get());
+	if (!parser) { return; }
+	const AnalogControlCreateEvent &create = static_cast<const AnalogControlCreateEvent &>(e);
+	parser->analogFilter().setLimits(create.mControlId, create.mChangeThreshold, create.mInterval);
+}
 
-	// here we need to decide which client the event is routed to, so we should first test that the event is a RemoteEvent or similar with a specific target ID
-	// then we use that property of the event to find the client, and the Archive type that the client is using (text or binary), then we know which way to
-	// serialize the event and send the byte stream along to the client for sending
-	return true;
-}*/
+/*---------------------------------------------------------------------
+	The encoder's samples don't say whether they are relative steps, so
+	the type the client was told is kept for coalescing them
+---------------------------------------------------------------------*/
+static void recordEncoderType(const RemoteEvent &e, int clientId)
+{
+	if (e.typeId() != EncoderCreateEvent::sTypeId) { return; }
+	const EncoderCreateEvent &create = static_cast<const EncoderCreateEvent &>(e);
+	EncoderEvent::setEncoderType(clientId, create.mControlId, create.mEncoderType);
+}
 
-TCPServerProcess::TCPServerProcessListener::TCPServerProcessListener(const string &name, TCPServerProcess &svrProc) :
-	EventListener(name), mSvrProc(svrProc)
+/*---------------------------------------------------------------------
+	Handles event by encoding it in the format of each target client and
+	queueing the bytes on its connection
+---------------------------------------------------------------------*/
+bool TCPServerProcess::TCPServerProcessListener::handleRemoteEvent(const EventPtr &ePtr)
 {
-	// register listeners with manager
-	//IEventHandlerPtr p(new EventHandler<TCPServerProcessListener>(this, &TCPServerProcessListener::handleDigitalSwitchCreateEvent));
-	//registerEventHandler(DigitalSwitchCreateEvent::sEventType, p, 1);
-}
\ No newline at end of file
+	if (!mSvrProc.mServerPtr) { return false; }
+	const RemoteEvent &e = *(static_cast<RemoteEvent*>(ePtr.get()));
+	const ClientRegistry &clients = mSvrProc.mServerPtr->clients();
+
+	if (!e.isBroadcast()) {
+		const ClientRegistry::ClientEntry *c = clients.find(e.targetClientId());
+		if (!c) {
+			++mNumUnrouted;
+			debugPrintf("%s: client \"%i\" not connected, \"%s\" event dropped\n",
+						name().c_str(), e.targetClientId(), e.type().c_str());
+			return false;
+		}
+		string &msg = mMsg[c->mFormat];
+		if (NexusMessageParser::writeEvent(e, c->mFormat, msg)) {
+			c->mConnection->send(msg.data(), (uint)msg.size());
+			setAnalogLimits(e, *c->mConnection);
+			recordEncoderType(e, c->mConnection->id());
+			++mNumRouted;
+		}
+		return false;
+	}
+
+	bool encoded[ArchiveFormat_Count] = { false };
+	for (uint slot = 0; slot < clients.capacity(); ++slot) {
+		const ClientRegistry::ClientEntry &c = clients.at(slot);
+		if (!c.mConnection) { continue; }
+		string &msg = mMsg[c.mFormat];
+		if (!encoded[c.mFormat]) {
+			if (!NexusMessageParser::writeEvent(e, c.mFormat, msg)) { return false; }
+			encoded[c.mFormat] = true;
+		}
+		c.mConnection->send(msg.data(), (uint)msg.size());
+		setAnalogLimits(e, *c.mConnection);
+		recordEncoderType(e, c.mConnection->id());
+		++mNumRouted;
+	}
+	return false;
+}
+
+void TCPServerProcess::TCPServerProcessListener::registerRoutes()
+{
+	// outgoing event types, server to client
+	IEventHandlerPtr p(new EventHandler<TCPServerProcessListener>(this, &TCPServerProcessListener::handleRemoteEvent));
+	registerEventHandler(DigitalSwitchCreateEvent::sEventType, p, 1);
+	registerEventHandler(AnalogControlCreateEvent::sEventType, p, 1);
+	registerEventHandler(EncoderCreateEvent::sEventType, p, 1);
+	registerEventHandler(KeyMatrixCreateEvent::sEventType, p, 1);
+}
+
+TCPServerProcess::TCPServerProcessListener::TCPServerProcessListener(const string &name, TCPServerProcess &svrProc) :
+	EventListener(name), mSvrProc(svrProc),
+	mNumRouted(0), mNumUnrouted(0)
+{}
\ No newline at end of file
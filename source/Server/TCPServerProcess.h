@@ -23,17 +23,28 @@ class TCPServerProcess : public CProcess
 		///// STRUCTURES /////
 		/*=====================================================================
 		class TCPServerProcessListener
+			Routes outgoing RemoteEvents to the connection of their target
+			client, found by id in the server's ClientRegistry, or to every
+			client for a broadcast. Each event is encoded once per archive
+			format in use. Registered for the outgoing types only when the
+			server's options ask for it, handlers run on the main thread
+			like the server's io_service.
 		=====================================================================*/
 		class TCPServerProcessListener : public EventListener {
 			friend class TCPServerProcess;
 			private:
 				///// VARIABLES /////
 				TCPServerProcess &mSvrProc;
+				string		mMsg[ArchiveFormat_Count];	// encoded message by format, keeps its capacity
+				uint		mNumRouted;
+				uint		mNumUnrouted;	// target client not connected
 
 				///// FUNCTIONS /////
-				//bool handleDigitalSwitchCreateEvent(const EventPtr &ePtr);
+				bool handleRemoteEvent(const EventPtr &ePtr);
 
 			public:
+				void registerRoutes();
+
 				explicit TCPServerProcessListener(const string &name, TCPServerProcess &svrProc);
 		};
 
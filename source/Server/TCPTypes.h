@@ -23,7 +23,6 @@ typedef boost::shared_ptr<TCPServer>		TCPServerPtr;
 typedef boost::weak_ptr<TCPServer>			TCPServerWeakPtr;
 typedef boost::shared_ptr<TCPConnection>	TCPConnectionPtr;
 typedef boost::weak_ptr<TCPConnection>		TCPConnectionWeakPtr;
-typedef set<TCPConnectionPtr>				TCPConnectionList;
 typedef std::shared_ptr<TCPServerOptions>	TCPServerOptionsPtr;
 typedef std::shared_ptr<TCPServerOptions>	TCPServerOptionsPtr;
 typedef std::shared_ptr<MessageParser>		ParserPtr;
@@ -31,6 +30,13 @@ typedef std::shared_ptr<MessageHandler>		HandlerPtr;
 typedef function<ParserPtr()>				CreateParserFuncPtr;
 typedef function<HandlerPtr()>				CreateHandlerFuncPtr;
 
+// how events are written to a client, Binary in the fixed ('f') body format, Text as name-value pairs ('n')
+enum ArchiveFormat {
+	ArchiveFormat_Binary = 0,
+	ArchiveFormat_Text,
+	ArchiveFormat_Count
+};
+
 enum TCPConnectionSettings {
 	KeepAlive = 0,
 	CloseAfterMessage
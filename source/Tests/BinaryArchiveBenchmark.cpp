@@ -0,0 +1,173 @@
+/*----==== BINARYARCHIVEBENCHMARK.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone benchmark of per-event encode and decode cost for the
+		remote control events. The binary path is what the server runs,
+		RegisteredEvent::writePayload into a stack buffer and readPayload
+		back to a new EventPtr. The text path is the Boost text_oarchive and
+		text_iarchive through string streams that remote events went through
+		before BinaryArchive.h. Every decoded event is compared with the
+		original, so a broken archive fails instead of timing well.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /O2 /I. /I%BOOST_ROOT% Tests\BinaryArchiveBenchmark.cpp
+				Nexus\ControlEvents.cpp Event\Event.cpp Event\EventManager.cpp
+				Event\EventListener.cpp Event\EventDispatchPool.cpp
+				Event\EventSchema.cpp Win32\HighPerfTimer.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Prints wall time per event for each path.
+---------------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <sstream>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/serialization/vector.hpp>
+#include "../Utility/BinaryArchive.h"
+#include "../Event/EventManager.h"
+#include "../Nexus/ControlEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+///// VARIABLES /////
+
+static const uint	sBinaryIterations = 1000000;
+static const uint	sTextIterations = 50000;	// text is slow enough that fewer runs give a steady figure
+static const uint	sBufferSize = 256;
+
+///// FUNCTIONS /////
+
+static __int64 counts()
+{
+	LARGE_INTEGER c;
+	QueryPerformanceCounter(&c);
+	return c.QuadPart;
+}
+
+static double nsPerEvent(__int64 elapsed, uint iterations)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return ((double)elapsed * 1.0e9 / (double)freq.QuadPart) / (double)iterations;
+}
+
+// field by field, Event has no operator==
+static bool sameData(const DigitalSwitchEvent &a, const DigitalSwitchEvent &b) {
+	return (a.mControlId == b.mControlId && a.mActivePos == b.mActivePos);
+}
+static bool sameData(const AnalogControlEvent &a, const AnalogControlEvent &b) {
+	return (a.mControlId == b.mControlId && a.mRawValue == b.mRawValue);
+}
+static bool sameData(const EncoderEvent &a, const EncoderEvent &b) {
+	return (a.mControlId == b.mControlId && a.mValue == b.mValue);
+}
+static bool sameData(const DigitalSwitchCreateEvent &a, const DigitalSwitchCreateEvent &b) {
+	return (a.mNumPins == b.mNumPins && a.mPins == b.mPins && a.mOffEvent == b.mOffEvent &&
+			a.mActiveLevel == b.mActiveLevel && a.mUseInternalPullup == b.mUseInternalPullup &&
+			a.mDebounceDelay == b.mDebounceDelay);
+}
+
+/*---------------------------------------------------------------------
+	Times the binary and text paths for one event and prints a row.
+	Returns false if either path didn't decode what was encoded.
+---------------------------------------------------------------------*/
+template <typename TEvent>
+static bool runEvent(const TEvent &e)
+{
+	RegEventPtr regPtr = eventMgr.getRegEventPtr(TEvent::sEventType);
+	char buffer[sBufferSize];
+	uint size = 0;
+	bool ok = true;
+
+	// binary encode, the buffer is reused like the connection's send buffer
+	__int64 start = counts();
+	for (uint i = 0; i < sBinaryIterations; ++i) {
+		ok &= regPtr->writePayload(e, buffer, sBufferSize, size);
+	}
+	double binaryEncode = nsPerEvent(counts() - start, sBinaryIterations);
+
+	// binary decode, including the event allocation the server would make
+	// readPayload belongs to incoming types, outgoing ones are decoded into a stack event
+	bool incoming = regPtr->remoteAllowed();
+	start = counts();
+	for (uint i = 0; i < sBinaryIterations; ++i) {
+		if (incoming) {
+			EventPtr ePtr(regPtr->readPayload(0, buffer, size));
+			ok &= (ePtr && sameData(e, static_cast<const TEvent &>(*ePtr)));
+		} else {
+			TEvent decoded(0);
+			BinaryIArchive archive(buffer, size);
+			archive >> decoded;
+			ok &= (!archive.failed() && sameData(e, decoded));
+		}
+	}
+	double binaryDecode = nsPerEvent(counts() - start, sBinaryIterations);
+
+	// text encode, a stream and archive per event as the old registration built them
+	string text;
+	start = counts();
+	for (uint i = 0; i < sTextIterations; ++i) {
+		std::ostringstream oss;
+		boost::archive::text_oarchive oa(oss, boost::archive::no_header);
+		oa << e;
+		text = oss.str();
+	}
+	double textEncode = nsPerEvent(counts() - start, sTextIterations);
+
+	start = counts();
+	for (uint i = 0; i < sTextIterations; ++i) {
+		std::istringstream iss(text);
+		boost::archive::text_iarchive ia(iss, boost::archive::no_header);
+		TEvent decoded(0);
+		ia >> decoded;
+		ok &= sameData(e, decoded);
+	}
+	double textDecode = nsPerEvent(counts() - start, sTextIterations);
+
+	printf("%-20s\t%u\t%.1f\t%.1f\t\t%u\t%.1f\t%.1f\n", TEvent::sEventType.c_str(),
+		   size, binaryEncode, binaryDecode, (uint)text.size(), textEncode, textDecode);
+	if (!ok) { printf("%s did not round trip\n", TEvent::sEventType.c_str()); }
+	return ok;
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	registerEventTypes();
+
+	DigitalSwitchEvent ds(0);
+	ds.mControlId = 12;
+	ds.mActivePos = 1;
+
+	AnalogControlEvent an(0);
+	an.mControlId = 3;
+	an.mRawValue = 517;
+
+	EncoderEvent en(0);
+	en.mControlId = 7;
+	en.mValue = -2;
+
+	DigitalSwitchCreateEvent create(0);
+	create.mNumPins = 4;
+	create.mPins.resize(create.mNumPins);	// the constructor sizes it for 2 pins
+	for (uchar p = 0; p < create.mNumPins; ++p) {
+		create.mPins[p] = p + 22;
+	}
+	create.mOffEvent = true;
+	create.mActiveLevel = 1;
+	create.mUseInternalPullup = true;
+	create.mDebounceDelay = 20;
+
+	printf("ns per event, binary %u runs, text %u runs\n", sBinaryIterations, sTextIterations);
+	printf("event\t\t\tbytes\tencode\tdecode\t\tbytes\tencode\tdecode\n");
+	int failed = 0;
+	if (!runEvent(ds)) { ++failed; }
+	if (!runEvent(an)) { ++failed; }
+	if (!runEvent(en)) { ++failed; }
+	if (!runEvent(create)) { ++failed; }
+	printf(failed == 0 ? "passed\n" : "FAILED\n");
+	return failed;
+}
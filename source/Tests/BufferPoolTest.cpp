@@ -0,0 +1,97 @@
+/*----==== BUFFERPOOLTEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of BufferPool::trim. Fills many slabs of one size
+		class, releases most of the buffers the way cache evictions do, and
+		checks that trim frees every slab without a live buffer, keeps the
+		ones with one, leaves the survivors' data intact and still hands out
+		buffers afterwards.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\BufferPoolTest.cpp
+				Resource\BufferPool.cpp /link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes.
+------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../Resource/BufferPool.h"
+
+using std::vector;
+
+///// VARIABLES /////
+
+static const uint	sBufferSize = 1000;		// all in one size class
+static const uint	sNumBuffers = 3000;		// enough for many slabs
+static const uint	sKeepEvery = 500;		// survivors, each pins its slab
+
+static int			sFailed = 0;
+
+///// DEFINITIONS /////
+
+#define CHECK(c)	do { if (!(c)) { printf("FAILED: %s (line %d)\n", #c, __LINE__); ++sFailed; } } while (0)
+
+///// FUNCTIONS /////
+
+static uint64 slabBytes()
+{
+	BufferPool::Stats stats;
+	BufferPool::getStats(stats);
+	return stats.mSlabBytes;
+}
+
+int main()
+{
+	vector<BufferPtr> buffers;
+	for (uint b = 0; b < sNumBuffers; ++b) {
+		buffers.push_back(BufferPool::allocate(sBufferSize));
+		memset(buffers.back().get(), (int)(b & 0xFF), sBufferSize);
+	}
+	uint64 fullB = slabBytes();
+	uint numSlabs = (uint)(fullB / BufferPool::sSlabSize);
+
+	// nothing is free yet, so nothing can be trimmed
+	CHECK(BufferPool::trim() == 0);
+	CHECK(slabBytes() == fullB);
+
+	vector<BufferPtr> kept;
+	for (uint b = 0; b < sNumBuffers; b += sKeepEvery) {
+		kept.push_back(buffers[b]);
+	}
+	buffers.clear();
+
+	uint64 freedB = BufferPool::trim();
+	uint64 keptB = slabBytes();
+	printf("%u slabs filled, %llu bytes freed, %llu bytes kept for %u live buffers\n",
+		   numSlabs, freedB, keptB, (uint)kept.size());
+	CHECK(freedB + keptB == fullB);
+	CHECK(keptB > 0 && keptB <= kept.size() * BufferPool::sSlabSize);
+	CHECK(BufferPool::trim() == 0);
+
+	for (uint k = 0; k < kept.size(); ++k) {
+		uchar expected = (uchar)((k * sKeepEvery) & 0xFF);
+		bool intact = true;
+		for (uint i = 0; i < sBufferSize; ++i) {
+			if ((uchar)kept[k].get()[i] != expected) { intact = false; }
+		}
+		CHECK(intact);
+	}
+
+	// the free lists left in the kept slabs still work
+	for (uint b = 0; b < sNumBuffers; ++b) {
+		buffers.push_back(BufferPool::allocate(sBufferSize));
+		CHECK(buffers.back());
+	}
+	buffers.clear();
+	kept.clear();
+	BufferPool::trim();
+	printf("%llu bytes of slabs left once every buffer is released\n", slabBytes());
+	CHECK(slabBytes() == 0);
+
+	printf(sFailed == 0 ? "passed\n" : "FAILED\n");
+	return sFailed;
+}
@@ -0,0 +1,242 @@
+/*----==== EVENTCOALESCETEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of coalescing queued control events. Samples of one
+		control from one client must fold into the waiting event, latest
+		value winning, on the main queue and on the thread-safe queue.
+		Values of incremental encoders must add up, saturating at the range
+		of short. A sample raised once its waiting event has been taken by
+		the consumer must start a new event, the handled one unchanged.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\EventCoalesceTest.cpp
+				Nexus\ControlEvents.cpp Event\Event.cpp Event\EventManager.cpp
+				Event\EventListener.cpp Event\EventDispatchPool.cpp
+				Event\EventSchema.cpp Win32\HighPerfTimer.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes.
+----------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <climits>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include "../Event/EventManager.h"
+#include "../Event/EventListener.h"
+#include "../Event/EventHandler.h"
+#include "../Nexus/ControlEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+using std::vector;
+
+///// VARIABLES /////
+
+static const int	sIncrementalClient = 1;
+static const int	sAbsoluteClient = 2;
+static const short	sTakenControl = 4;		// raises another sample while its first is handled
+
+static int			sFailed = 0;
+
+///// DEFINITIONS /////
+
+#define CHECK(c)	do { if (!(c)) { printf("FAILED: %s (line %d)\n", #c, __LINE__); ++sFailed; } } while (0)
+
+///// FUNCTIONS /////
+
+static EventPtr analog(int clientId, short controlId, short value)
+{
+	AnalogControlEvent *e = new AnalogControlEvent(clientId);
+	e->mControlId = controlId;
+	e->mRawValue = value;
+	return EventPtr(e);
+}
+
+static EventPtr encoder(int clientId, short controlId, short value)
+{
+	EncoderEvent *e = new EncoderEvent(clientId);
+	e->mControlId = controlId;
+	e->mValue = value;
+	return EventPtr(e);
+}
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class CoalesceListener
+	Keeps client, control and value of every analog and encoder event handled
+=============================================================================*/
+class CoalesceListener : public EventListener {
+	public:
+		struct Received {
+			int		mClientId;
+			short	mControlId;
+			short	mValue;
+		};
+
+		vector<Received>	mAnalogs;
+		vector<Received>	mEncoders;
+		bool				mRaiseWhileTaken;
+		short				mTakenValueAfterRaise;	// the handled value, read again after the raise
+
+		static void raiseEncoder(int clientId, short controlId, short value) {
+			eventMgr.raiseThreadSafe(encoder(clientId, controlId, value));
+		}
+
+		bool handleAnalog(const EventPtr &ePtr) {
+			const AnalogControlEvent &e = static_cast<const AnalogControlEvent &>(*ePtr);
+			Received r = { e.targetClientId(), e.mControlId, e.mRawValue };
+			mAnalogs.push_back(r);
+			if (mRaiseWhileTaken && e.mControlId == sTakenControl) {
+				mRaiseWhileTaken = false;
+				eventMgr.raise(analog(e.targetClientId(), sTakenControl, e.mRawValue + 10));
+				mTakenValueAfterRaise = e.mRawValue;
+			}
+			return false;
+		}
+		bool handleEncoder(const EventPtr &ePtr) {
+			const EncoderEvent &e = static_cast<const EncoderEvent &>(*ePtr);
+			Received r = { e.targetClientId(), e.mControlId, e.mValue };
+			mEncoders.push_back(r);
+			if (mRaiseWhileTaken && e.mControlId == sTakenControl) {
+				mRaiseWhileTaken = false;
+				// a producer thread raises the next step while this event is being handled
+				boost::thread producer(boost::bind(&CoalesceListener::raiseEncoder,
+												   sIncrementalClient, sTakenControl, (short)2));
+				producer.join();
+				mTakenValueAfterRaise = e.mValue;
+			}
+			return false;
+		}
+
+		void clear() { mAnalogs.clear(); mEncoders.clear(); }
+
+		explicit CoalesceListener() :
+			EventListener("CoalesceListener"), mRaiseWhileTaken(false), mTakenValueAfterRaise(0)
+		{
+			registerEventHandler(AnalogControlEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<CoalesceListener>(this, &CoalesceListener::handleAnalog)));
+			registerEventHandler(EncoderEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<CoalesceListener>(this, &CoalesceListener::handleEncoder)));
+		}
+};
+
+///// FUNCTIONS /////
+
+static const CoalesceListener::Received *find(const vector<CoalesceListener::Received> &received,
+											  int clientId, short controlId, uint &outCount)
+{
+	const CoalesceListener::Received *found = 0;
+	outCount = 0;
+	for (size_t i = 0; i < received.size(); ++i) {
+		if (received[i].mClientId == clientId && received[i].mControlId == controlId) {
+			found = &received[i];
+			++outCount;
+		}
+	}
+	return found;
+}
+
+// one event for the client and control, with the expected value
+static void checkOne(const vector<CoalesceListener::Received> &received, int clientId, short controlId, short value)
+{
+	uint count = 0;
+	const CoalesceListener::Received *r = find(received, clientId, controlId, count);
+	CHECK(count == 1);
+	CHECK(r && r->mValue == value);
+}
+
+static void produceAnalogs(int clientId, short controlId, short first, short last)
+{
+	for (short v = first; v <= last; ++v) {
+		eventMgr.raiseThreadSafe(analog(clientId, controlId, v));
+	}
+}
+
+static void produceEncoderSteps(int clientId, short controlId, short step, uint count)
+{
+	for (uint i = 0; i < count; ++i) {
+		eventMgr.raiseThreadSafe(encoder(clientId, controlId, step));
+	}
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	registerEventTypes();
+	EncoderEvent::setEncoderType(sIncrementalClient, 3, Encoder::EncoderType_Incremental);
+	EncoderEvent::setEncoderType(sIncrementalClient, sTakenControl, Encoder::EncoderType_Incremental);
+	EncoderEvent::setEncoderType(sAbsoluteClient, 3, Encoder::EncoderType_Absolute);
+	CoalesceListener listener;
+
+	// main queue, latest value wins per control and client
+	mgr.raise(analog(1, 5, 100));
+	mgr.raise(analog(1, 5, 110));
+	mgr.raise(analog(1, 6, 7));
+	mgr.raise(analog(2, 5, 50));	// same control on another client isn't folded
+	mgr.raise(analog(1, 5, 120));
+	mgr.notifyQueued(0);
+	printf("main queue: %u analog events\n", (uint)listener.mAnalogs.size());
+	CHECK(listener.mAnalogs.size() == 3);
+	checkOne(listener.mAnalogs, 1, 5, 120);
+	checkOne(listener.mAnalogs, 1, 6, 7);
+	checkOne(listener.mAnalogs, 2, 5, 50);
+
+	// main queue, incremental encoders add up and saturate, absolute ones don't
+	listener.clear();
+	mgr.raise(encoder(sIncrementalClient, 3, 30000));
+	mgr.raise(encoder(sIncrementalClient, 3, 5000));
+	mgr.raise(encoder(sAbsoluteClient, 3, 100));
+	mgr.raise(encoder(sAbsoluteClient, 3, 120));
+	mgr.notifyQueued(0);
+	printf("main queue: %u encoder events\n", (uint)listener.mEncoders.size());
+	CHECK(listener.mEncoders.size() == 2);
+	checkOne(listener.mEncoders, sIncrementalClient, 3, SHRT_MAX);
+	checkOne(listener.mEncoders, sAbsoluteClient, 3, 120);
+
+	// thread-safe queue, two producers of different controls
+	listener.clear();
+	{
+		boost::thread_group producers;
+		producers.create_thread(boost::bind(&produceAnalogs, 1, 5, (short)1, (short)1000));
+		producers.create_thread(boost::bind(&produceEncoderSteps, sIncrementalClient, 3, (short)-30, 2000));
+		producers.join_all();
+	}
+	mgr.notifyQueued(0);
+	printf("thread-safe queue: %u analog, %u encoder events\n",
+		   (uint)listener.mAnalogs.size(), (uint)listener.mEncoders.size());
+	checkOne(listener.mAnalogs, 1, 5, 1000);
+	checkOne(listener.mEncoders, sIncrementalClient, 3, SHRT_MIN);
+
+	// an event the consumer has taken takes no more folding, the next step is a new event
+	listener.clear();
+	listener.mRaiseWhileTaken = true;
+	mgr.raiseThreadSafe(encoder(sIncrementalClient, sTakenControl, 1));
+	mgr.notifyQueued(0);
+	CHECK(listener.mTakenValueAfterRaise == 1);
+	mgr.notifyQueued(0);
+	uint count = 0;
+	find(listener.mEncoders, sIncrementalClient, sTakenControl, count);
+	printf("taken event: handled value %d, %u events\n", listener.mTakenValueAfterRaise, count);
+	CHECK(count == 2);
+	CHECK(listener.mEncoders.size() == 2 && listener.mEncoders[0].mValue == 1 && listener.mEncoders[1].mValue == 2);
+
+	// the same on the main queue, raised by a handler while its event is dispatched
+	listener.clear();
+	listener.mRaiseWhileTaken = true;
+	mgr.raise(analog(3, sTakenControl, 10));
+	mgr.notifyQueued(0);
+	CHECK(listener.mTakenValueAfterRaise == 10);
+	mgr.notifyQueued(0);
+	printf("taken main queue event: handled value %d, %u events\n",
+		   listener.mTakenValueAfterRaise, (uint)listener.mAnalogs.size());
+	CHECK(listener.mAnalogs.size() == 2 && listener.mAnalogs[0].mValue == 10 && listener.mAnalogs[1].mValue == 20);
+
+	printf(sFailed == 0 ? "passed\n" : "FAILED\n");
+	fflush(stdout);
+	return sFailed;
+}
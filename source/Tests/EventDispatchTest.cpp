@@ -0,0 +1,121 @@
+/*----==== EVENTDISPATCHTEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of raising events from parallel-safe handlers. Each
+		of several parallel event types has a handler that raises more
+		events than the thread-safe queue holds, which used to deadlock:
+		the worker spun on the full queue while the main thread waited in
+		dispatchBatches for that worker. Every raised event must reach its
+		main thread listener on the following frame. The pool only has
+		workers on a machine with more than one core, on a single core
+		the handlers all run on the main thread and the test proves less.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\EventDispatchTest.cpp
+				Event\Event.cpp Event\EventManager.cpp Event\EventListener.cpp
+				Event\EventDispatchPool.cpp Win32\HighPerfTimer.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes, exits with 2 if still stuck after
+		sTimeoutMillis.
+----------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+#include <boost/thread/thread.hpp>
+#include "../Event/EventManager.h"
+#include "../Event/EventListener.h"
+#include "../Event/EventHandler.h"
+#include "../Event/EventDispatchPool.h"
+#include "../Event/RegisteredEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+///// VARIABLES /////
+
+static const uint	sNumWorkTypes = 8;			// one batch each, so the pool's workers get some
+static const uint	sRaisesPerWork = 5000;		// more than EventManager::sThreadEventQueueSize
+static const DWORD	sTimeoutMillis = 10000;
+static const string	sResultType("dispatchTestResult");
+
+static volatile long	sWorkedOnWorker = 0;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class DispatchTestListener
+=============================================================================*/
+class DispatchTestListener : public EventListener {
+	public:
+		uint	mNumResults;
+
+		bool handleWork(const EventPtr &ePtr) {
+			if (EventDispatchPool::currentWorker() >= 0) { InterlockedIncrement(&sWorkedOnWorker); }
+			for (uint r = 0; r < sRaisesPerWork; ++r) {
+				eventMgr.raise(sResultType);
+			}
+			return false;
+		}
+
+		bool handleResult(const EventPtr &ePtr) {
+			++mNumResults;
+			return false;
+		}
+
+		explicit DispatchTestListener() :
+			EventListener("DispatchTestListener"), mNumResults(0)
+		{
+			for (uint w = 0; w < sNumWorkTypes; ++w) {
+				std::ostringstream oss;
+				oss << "dispatchTestWork" << w;
+				registerEventHandler(oss.str(),
+					IEventHandlerPtr(new EventHandler<DispatchTestListener>(this, &DispatchTestListener::handleWork)),
+					0, ListenerAffinity_Parallel);
+			}
+			registerEventHandler(sResultType,
+				IEventHandlerPtr(new EventHandler<DispatchTestListener>(this, &DispatchTestListener::handleResult)));
+		}
+};
+
+///// FUNCTIONS /////
+
+static void watchdog()
+{
+	Sleep(sTimeoutMillis);
+	printf("FAILED, still dispatching after %lu ms\n", sTimeoutMillis);
+	fflush(stdout);
+	_exit(2);
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	for (uint w = 0; w < sNumWorkTypes; ++w) {
+		std::ostringstream oss;
+		oss << "dispatchTestWork" << w;
+		mgr.registerEventType(oss.str(), RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+	}
+	mgr.registerEventType(sResultType, RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+
+	DispatchTestListener listener;
+	boost::thread timeout(&watchdog);
+
+	for (uint w = 0; w < sNumWorkTypes; ++w) {
+		std::ostringstream oss;
+		oss << "dispatchTestWork" << w;
+		mgr.raise(oss.str());
+	}
+	mgr.notifyQueued(0);	// the work batches, raising the results
+	mgr.notifyQueued(0);	// the results
+
+	uint expected = sNumWorkTypes * sRaisesPerWork;
+	printf("%u of %u results handled, %li of %u work events ran on a pool worker\n",
+		   listener.mNumResults, expected, sWorkedOnWorker, sNumWorkTypes);
+	int failed = (listener.mNumResults == expected ? 0 : 1);
+	printf(failed == 0 ? "passed\n" : "FAILED\n");
+	fflush(stdout);
+	_exit(failed);	// don't wait for the watchdog
+}
@@ -0,0 +1,182 @@
+/*----==== EVENTLISTENERTEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of changing EventManager's listener lists while they
+		are dispatched. A listener registered by a handler must be deferred
+		until the outermost dispatch returns, one removed by a handler must
+		not be called again in that dispatch while the others still are,
+		removing a deferred registration must cancel it, and a listener
+		removed and registered again must be called once, in its new place.
+		Listeners must be called by priority, then in registration order for
+		equal priorities, after the list is re-sorted.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\EventListenerTest.cpp
+				Event\Event.cpp Event\EventManager.cpp Event\EventListener.cpp
+				Event\EventDispatchPool.cpp Win32\HighPerfTimer.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes.
+----------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <string>
+#include "../Event/EventManager.h"
+#include "../Event/EventListener.h"
+#include "../Event/EventHandler.h"
+#include "../Event/RegisteredEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+using std::string;
+
+///// VARIABLES /////
+
+static const string	sTestType("listenerTest");
+static const string	sNestedType("listenerTestNested");
+
+static string		sCalls;		// names of the listeners called, in order
+static int			sFailed = 0;
+
+///// DEFINITIONS /////
+
+#define CHECK(c)	do { if (!(c)) { printf("FAILED: %s (line %d)\n", #c, __LINE__); ++sFailed; } } while (0)
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class OrderListener
+	Appends its name to sCalls when handled, and changes another listener's
+	registration from inside its handler when told to
+=============================================================================*/
+class OrderListener : public EventListener {
+	public:
+		OrderListener *	mRegisterOnHandle;	// registered from the handler, then cleared
+		uint			mRegisterPriority;
+		OrderListener *	mRemoveOnHandle;	// removed from the handler, then cleared
+		bool			mTriggerNested;		// triggers sNestedType from the handler, then cleared
+
+		bool handleTest(const EventPtr &ePtr) {
+			sCalls += mName;
+			if (mTriggerNested) {
+				mTriggerNested = false;
+				eventMgr.trigger(sNestedType);
+			}
+			if (mRemoveOnHandle) {
+				mRemoveOnHandle->stopListening();
+				mRemoveOnHandle = 0;
+			}
+			if (mRegisterOnHandle) {
+				mRegisterOnHandle->listen(mRegisterPriority);
+				mRegisterOnHandle = 0;
+			}
+			return false;
+		}
+
+		bool listen(uint priority) {
+			return registerEventHandler(sTestType,
+				IEventHandlerPtr(new EventHandler<OrderListener>(this, &OrderListener::handleTest)), priority);
+		}
+		bool stopListening() {
+			return unregisterEventHandler(sTestType);
+		}
+		// listens to sNestedType only, so triggering it dispatches inside the sTestType dispatch
+		bool listenNested() {
+			return registerEventHandler(sNestedType,
+				IEventHandlerPtr(new EventHandler<OrderListener>(this, &OrderListener::handleTest)));
+		}
+
+		explicit OrderListener(const string &name) :
+			EventListener(name),
+			mRegisterOnHandle(0), mRegisterPriority(0), mRemoveOnHandle(0), mTriggerNested(false)
+		{}
+};
+
+///// FUNCTIONS /////
+
+// triggers sTestType and returns the listeners called, in order
+static string dispatch()
+{
+	sCalls.clear();
+	eventMgr.trigger(sTestType);
+	return sCalls;
+}
+
+static void checkCalls(const char *step, const string &calls, const char *expected)
+{
+	printf("%-40s %s\n", step, calls.c_str());
+	CHECK(calls == expected);
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	mgr.registerEventType(sTestType, RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+	mgr.registerEventType(sNestedType, RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+
+	OrderListener a("A"), b("B"), c("C"), d("D"), e("E"), n("N");
+
+	// priority 1 first, then 2, then the FIFO listeners in registration order
+	CHECK(a.listen(0));
+	CHECK(b.listen(2));
+	CHECK(c.listen(1));
+	CHECK(d.listen(0));
+	CHECK(!d.listen(0));	// already registered
+	checkCalls("priority then FIFO:", dispatch(), "CBAD");
+
+	// removed and registered again, it goes behind the FIFO listeners registered before it
+	CHECK(b.stopListening());
+	CHECK(!b.stopListening());	// already removed
+	CHECK(b.listen(0));
+	checkCalls("re-registered after removal:", dispatch(), "CADB");
+	CHECK(b.stopListening());
+	CHECK(b.listen(2));
+	checkCalls("re-registered with priority:", dispatch(), "CBAD");
+
+	// registered during dispatch, deferred until it returns
+	c.mRegisterOnHandle = &e;
+	c.mRegisterPriority = 1;
+	checkCalls("register during dispatch:", dispatch(), "CBAD");
+	checkCalls("  next dispatch:", dispatch(), "CEBAD");
+
+	// removed during dispatch, later listeners are still called but not the removed one
+	c.mRemoveOnHandle = &b;
+	checkCalls("remove during dispatch:", dispatch(), "CEAD");
+	checkCalls("  next dispatch:", dispatch(), "CEAD");
+
+	// a listener removing itself, and one already called
+	a.mRemoveOnHandle = &a;
+	d.mRemoveOnHandle = &c;
+	checkCalls("remove self and earlier:", dispatch(), "CEAD");
+	checkCalls("  next dispatch:", dispatch(), "ED");
+
+	// a deferred registration removed in the same dispatch is cancelled
+	e.mRegisterOnHandle = &b;
+	d.mRemoveOnHandle = &b;
+	checkCalls("remove deferred registration:", dispatch(), "ED");
+	checkCalls("  next dispatch:", dispatch(), "ED");
+	CHECK(!b.stopListening());	// its slot was forgotten
+	CHECK(b.listen(0));
+	checkCalls("  registered again:", dispatch(), "EDB");
+
+	// removed and registered again in the same dispatch, not called again until the next
+	e.mRemoveOnHandle = &d;
+	e.mRegisterOnHandle = &d;
+	e.mRegisterPriority = 0;
+	checkCalls("remove and re-register in dispatch:", dispatch(), "EB");
+	checkCalls("  next dispatch:", dispatch(), "EBD");
+
+	// registered from a nested dispatch, deferred until the outer one returns
+	CHECK(n.listenNested());
+	e.mTriggerNested = true;
+	n.mRegisterOnHandle = &a;
+	n.mRegisterPriority = 0;
+	checkCalls("register from nested dispatch:", dispatch(), "ENBD");
+	checkCalls("  next dispatch:", dispatch(), "EBDA");
+
+	printf(sFailed == 0 ? "passed\n" : "FAILED\n");
+	fflush(stdout);
+	return sFailed;
+}
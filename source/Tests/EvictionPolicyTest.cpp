@@ -0,0 +1,121 @@
+/*----==== EVICTIONPOLICYTEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of the eviction policies' scan resistance. Drives a
+		policy the way a ResCache shard does, with a fixed entry count in
+		place of the byte budget. A few hot keys are hit repeatedly, then a
+		long run of one-time keys is scanned through. TinyLFU must keep every
+		hot key, LRU is expected to lose them all.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\EvictionPolicyTest.cpp
+				Resource\EvictionPolicy.cpp
+		Returns 0 when every check passes.
+----------------------------------------*/
+
+#include <cstdio>
+#include <map>
+#include "../Resource/EvictionPolicy.h"
+
+using std::map;
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class PolicyHarness
+	Keys stand in for resource names and are also used as the entry hash
+=============================================================================*/
+class PolicyHarness {
+	private:
+		typedef map<uint, ResCacheEntry>	EntryMap;
+
+		EntryMap			mEntries;	// node-based like the shard map
+		EvictionPolicyPtr	mPolicy;
+		uint				mCapacity;
+
+	public:
+		void access(uint key) {
+			EntryMap::iterator i = mEntries.find(key);
+			if (i != mEntries.end()) {
+				mPolicy->onHit(&i->second);
+				return;
+			}
+			mPolicy->onMiss(key);
+			while (mEntries.size() >= mCapacity) {
+				ResCacheEntry *victim = mPolicy->selectVictim();
+				mPolicy->onRemove(victim);
+				mEntries.erase(victim->mHash);
+			}
+			ResCacheEntry &e = mEntries[key];
+			e.mHash = key;
+			mPolicy->onInsert(&e);
+		}
+
+		bool contains(uint key) const { return (mEntries.find(key) != mEntries.end()); }
+		uint size() const { return (uint)mEntries.size(); }
+
+		explicit PolicyHarness(ResCachePolicy policy, uint capacity) :
+			mPolicy(IEvictionPolicy::create(policy)), mCapacity(capacity)
+		{}
+};
+
+///// VARIABLES /////
+
+static const uint	sCapacity = 200;
+static const uint	sNumHot = 20;
+static const uint	sHotHits = 8;
+static const uint	sScanLength = 10000;
+static const uint	sScanBase = 1000000;	// scan keys never collide with the warm-up keys
+
+///// FUNCTIONS /////
+
+/*---------------------------------------------------------------------
+	Fills the cache with keys seen once, hits the hot keys, then scans.
+	Returns how many hot keys survived.
+---------------------------------------------------------------------*/
+static uint runScan(ResCachePolicy policy)
+{
+	PolicyHarness cache(policy, sCapacity);
+	for (uint k = 0; k < sCapacity; ++k) {
+		cache.access(100 + k);
+	}
+	for (uint h = 0; h < sHotHits; ++h) {
+		for (uint k = 0; k < sNumHot; ++k) {
+			cache.access(k);
+		}
+	}
+	for (uint k = 0; k < sScanLength; ++k) {
+		cache.access(sScanBase + k);
+	}
+	uint survived = 0;
+	for (uint k = 0; k < sNumHot; ++k) {
+		if (cache.contains(k)) { ++survived; }
+	}
+	return survived;
+}
+
+int main()
+{
+	int failed = 0;
+
+	uint tinyLFU = runScan(ResCachePolicy_TinyLFU);
+	printf("TinyLFU: %u of %u hot keys survived a %u key scan\n", tinyLFU, sNumHot, sScanLength);
+	if (tinyLFU != sNumHot) { ++failed; }
+
+	uint lru = runScan(ResCachePolicy_LRU);
+	printf("LRU:     %u of %u hot keys survived a %u key scan\n", lru, sNumHot, sScanLength);
+	if (lru != 0) { ++failed; }
+
+	// a cache that never fills must keep everything, nothing to admit against
+	PolicyHarness cache(ResCachePolicy_TinyLFU, sCapacity);
+	for (uint k = 0; k < sCapacity; ++k) {
+		cache.access(k);
+	}
+	printf("TinyLFU: %u of %u entries kept below capacity\n", cache.size(), sCapacity);
+	if (cache.size() != sCapacity) { ++failed; }
+
+	printf(failed == 0 ? "passed\n" : "FAILED\n");
+	return failed;
+}
@@ -0,0 +1,132 @@
+/*----==== MPSCQUEUEBENCHMARK.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone contention benchmark of MPSCQueue against the mutex and
+		condition variable ConcurrentQueue it replaced for cross-thread
+		events. N producer threads push reference counted items, the way
+		raiseThreadSafe pushes EventPtrs, while the main thread consumes
+		them, draining in batches from MPSCQueue and popping one at a time
+		from ConcurrentQueue as notifyQueued used to. The ring is sized like
+		the event manager's thread queue, so a fast enough set of producers
+		will also exercise push yielding on a full ring.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /O2 /I. /I%BOOST_ROOT% Tests\MPSCQueueBenchmark.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Prints wall time per item from the first push to the last pop.
+----------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <memory>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include "../Utility/MPSCQueue.h"
+#include "../Utility/ConcurrentQueue.h"
+
+using std::shared_ptr;
+
+///// DEFINITIONS /////
+
+typedef shared_ptr<int>	ItemPtr;	// stands in for EventPtr, copying it costs the same interlocked refcount
+
+///// VARIABLES /////
+
+static const uint	sQueueSize = 4096;		// EventManager::sThreadEventQueueSize
+static const uint	sItemsPerRun = 1000000;	// split across the producers
+
+///// FUNCTIONS /////
+
+static __int64 counts()
+{
+	LARGE_INTEGER c;
+	QueryPerformanceCounter(&c);
+	return c.QuadPart;
+}
+
+static double nsPerItem(__int64 elapsed)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return ((double)elapsed * 1.0e9 / (double)freq.QuadPart) / (double)sItemsPerRun;
+}
+
+template <typename TQueue>
+static void produce(TQueue *queue, const ItemPtr *item, uint count)
+{
+	for (uint i = 0; i < count; ++i) {
+		queue->push(*item);
+	}
+}
+
+struct CountItems {
+	uint *mCount;
+	void operator()(const ItemPtr &) const { ++(*mCount); }
+};
+
+static double runMPSC(uint numProducers)
+{
+	MPSCQueue<ItemPtr> queue(sQueueSize);
+	ItemPtr item(new int(0));
+	uint perProducer = sItemsPerRun / numProducers;
+	uint total = perProducer * numProducers;
+
+	__int64 start = counts();
+	boost::thread_group threads;
+	for (uint p = 0; p < numProducers; ++p) {
+		threads.create_thread(boost::bind(&produce<MPSCQueue<ItemPtr> >, &queue, &item, perProducer));
+	}
+	uint received = 0;
+	CountItems counter = { &received };
+	while (received < total) {
+		if (queue.drain(counter) == 0) {
+			ItemPtr popped;
+			if (queue.waitPop(popped, 1)) { ++received; }
+		}
+	}
+	__int64 elapsed = counts() - start;
+	threads.join_all();
+	return nsPerItem(elapsed);
+}
+
+static double runConcurrent(uint numProducers)
+{
+	ConcurrentQueue<ItemPtr> queue;
+	ItemPtr item(new int(0));
+	uint perProducer = sItemsPerRun / numProducers;
+	uint total = perProducer * numProducers;
+
+	__int64 start = counts();
+	boost::thread_group threads;
+	for (uint p = 0; p < numProducers; ++p) {
+		threads.create_thread(boost::bind(&produce<ConcurrentQueue<ItemPtr> >, &queue, &item, perProducer));
+	}
+	uint received = 0;
+	ItemPtr popped;
+	while (received < total) {
+		if (queue.tryPop(popped)) {
+			++received;
+		} else {
+			queue.waitPop(popped);
+			++received;
+		}
+	}
+	__int64 elapsed = counts() - start;
+	threads.join_all();
+	return nsPerItem(elapsed);
+}
+
+int main()
+{
+	printf("%u items per run, ring of %u, %u hardware threads\n",
+		   sItemsPerRun, sQueueSize, boost::thread::hardware_concurrency());
+	printf("producers\tMPSCQueue ns/item\tConcurrentQueue ns/item\n");
+	for (uint p = 1; p <= 8; p *= 2) {
+		double mpsc = runMPSC(p);
+		double concurrent = runConcurrent(p);
+		printf("%u\t\t%.1f\t\t\t%.1f\n", p, mpsc, concurrent);
+	}
+	return 0;
+}
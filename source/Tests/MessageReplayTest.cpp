@@ -0,0 +1,164 @@
+/*----==== MESSAGEREPLAYTEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone test of MessageRecorder and MessageReplayProcess. Messages
+		are written to a log the way NexusMessageParser records them and
+		played back as fast as possible. The replay must raise them as the
+		clients they came from, through the same analog filter a live
+		connection has, so samples that come within a control's interval
+		are held back again instead of arriving as the log's raw count, and
+		the newest held one still arrives once the interval ends.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\MessageReplayTest.cpp
+				Server\MessageRecorder.cpp Server\NexusMessageParser.cpp
+				Server\AnalogSampleFilter.cpp Nexus\ControlEvents.cpp
+				Event\Event.cpp Event\EventManager.cpp Event\EventListener.cpp
+				Event\EventDispatchPool.cpp Event\EventSchema.cpp
+				Win32\HighPerfTimer.cpp /link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes.
+---------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <vector>
+#include <sstream>
+#include "../Server/MessageRecorder.h"
+#include "../Server/NexusMessageParser.h"
+#include "../Event/EventManager.h"
+#include "../Event/EventListener.h"
+#include "../Event/EventHandler.h"
+#include "../Nexus/ControlEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+using std::vector;
+
+///// VARIABLES /////
+
+static const char *	sLogFile = "MessageReplayTest.log";
+static const int	sClientA = 3;
+static const int	sClientB = 7;
+
+static int			sFailed = 0;
+
+///// DEFINITIONS /////
+
+#define CHECK(c)	do { if (!(c)) { printf("FAILED: %s (line %d)\n", #c, __LINE__); ++sFailed; } } while (0)
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class ReplayListener
+	Keeps client and value of every analog and encoder event handled
+=============================================================================*/
+class ReplayListener : public EventListener {
+	public:
+		struct Received {
+			int		mClientId;
+			short	mValue;
+		};
+
+		vector<Received>	mAnalogs;
+		vector<Received>	mEncoders;
+
+		bool handleAnalog(const EventPtr &ePtr) {
+			const AnalogControlEvent &e = static_cast<const AnalogControlEvent &>(*ePtr);
+			Received r = { e.targetClientId(), e.mRawValue };
+			mAnalogs.push_back(r);
+			return false;
+		}
+		bool handleEncoder(const EventPtr &ePtr) {
+			const EncoderEvent &e = static_cast<const EncoderEvent &>(*ePtr);
+			Received r = { e.targetClientId(), e.mValue };
+			mEncoders.push_back(r);
+			return false;
+		}
+
+		explicit ReplayListener() :
+			EventListener("ReplayListener")
+		{
+			registerEventHandler(AnalogControlEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<ReplayListener>(this, &ReplayListener::handleAnalog)));
+			registerEventHandler(EncoderEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<ReplayListener>(this, &ReplayListener::handleEncoder)));
+		}
+};
+
+///// FUNCTIONS /////
+
+// records the event's message as the parser would for the client's connection
+static void record(MessageRecorder &recorder, int clientId, const Event &e)
+{
+	string msg;
+	CHECK(NexusMessageParser::writeEvent(e, ArchiveFormat_Binary, msg));
+	recorder.record(clientId, msg.data(), NexusMessageParser::sHeaderSize,
+					msg.data() + NexusMessageParser::sHeaderSize, (uint)msg.size() - NexusMessageParser::sHeaderSize);
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	registerEventTypes();
+	NexusMessageParser::registerControlMessages();
+	ReplayListener listener;
+
+	// client A sends 10 samples of one control at once, client B one encoder value
+	{
+		MessageRecorder recorder(sLogFile);
+		CHECK(recorder.isOpen());
+		AnalogControlEvent an(-1);
+		an.mControlId = 5;
+		const short values[] = { 100, 100, 101, 100, 101, 100, 101, 100, 110, 120 };
+		for (uint v = 0; v < sizeof(values) / sizeof(values[0]); ++v) {
+			an.mRawValue = values[v];
+			record(recorder, sClientA, an);
+		}
+		EncoderEvent en(-1);
+		en.mControlId = 2;
+		en.mValue = 4;
+		record(recorder, sClientB, en);
+
+		// a parser given no connection, as in a replay, doesn't record
+		string msg;
+		CHECK(NexusMessageParser::writeEvent(an, ArchiveFormat_Binary, msg));
+		std::stringstream ss(msg);
+		ParserPtr parser(NexusMessageParser::create());
+		CHECK(parser->collectMessage(ss, (uint)msg.size(), 0) == true);
+
+		printf("%u messages recorded\n", recorder.numRecorded());
+		CHECK(recorder.numRecorded() == 11);
+	}
+
+	// all of it in the first update, then updates until the held sample is out
+	MessageReplayProcess replay(sLogFile, 0.0f);
+	replay.update(0);
+	mgr.notifyQueued(0);
+	uint numFirst = (uint)listener.mAnalogs.size();
+	CHECK(!replay.isFinished());
+	uint numUpdates = 1;
+	while (!replay.isFinished() && numUpdates < 100) {
+		Sleep(10);
+		replay.update(10);
+		mgr.notifyQueued(0);
+		++numUpdates;
+	}
+	CHECK(replay.isFinished());
+
+	printf("%u messages replayed in %u updates, %u analog events (%u in the first update), %u encoder events\n",
+		   replay.numReplayed(), numUpdates, (uint)listener.mAnalogs.size(), numFirst, (uint)listener.mEncoders.size());
+	CHECK(replay.numReplayed() == 11);
+	// the first sample passes, the later ones come within the interval and only the newest is held for it
+	CHECK(numFirst == 1 && listener.mAnalogs.size() == 2);
+	CHECK(listener.mAnalogs.size() == 2 && listener.mAnalogs[0].mClientId == sClientA &&
+		  listener.mAnalogs[0].mValue == 100 && listener.mAnalogs[1].mClientId == sClientA &&
+		  listener.mAnalogs[1].mValue == 120);
+	CHECK(listener.mEncoders.size() == 1 && listener.mEncoders[0].mClientId == sClientB &&
+		  listener.mEncoders[0].mValue == 4);
+
+	DeleteFileA(sLogFile);
+	printf(sFailed == 0 ? "passed\n" : "FAILED\n");
+	return sFailed;
+}
@@ -0,0 +1,315 @@
+/*----==== NEXUSMESSAGETEST.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone round trip test of the Nexus message framing. Events are
+		written with NexusMessageParser::writeEvent and read back through
+		collectMessage, whole and one byte at a time, with junk between the
+		messages. The header must match NexusProtocol.txt section 2.2 and
+		the body length alone must frame each message. Incoming control
+		events are raised through dispatchMessage and compared by a
+		listener, outgoing ones are decoded from the body. Text clients get
+		name-value pair bodies, which are compared as strings. A client id
+		message must request the format of its body.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /I. /I%BOOST_ROOT% Tests\NexusMessageTest.cpp
+				Server\NexusMessageParser.cpp Server\AnalogSampleFilter.cpp
+				Server\MessageRecorder.cpp
+				Nexus\ControlEvents.cpp Event\Event.cpp Event\EventManager.cpp
+				Event\EventListener.cpp Event\EventDispatchPool.cpp
+				Event\EventSchema.cpp Win32\HighPerfTimer.cpp
+				/link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Returns 0 when every check passes.
+---------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <sstream>
+#include "../Server/NexusMessageParser.h"
+#include "../Utility/BinaryArchive.h"
+#include "../Event/EventManager.h"
+#include "../Event/EventListener.h"
+#include "../Event/EventHandler.h"
+#include "../Event/RegisteredEvents.h"
+#include "../Nexus/ControlEvents.h"
+#include "../Win32/HighPerfTimer.h"
+
+///// VARIABLES /////
+
+static const string	sUncodedType("nexusMessageTestUncoded");	// registered without a message code
+static int			sFailed = 0;
+
+///// DEFINITIONS /////
+
+#define CHECK(c)	do { if (!(c)) { printf("FAILED: %s (line %d)\n", #c, __LINE__); ++sFailed; } } while (0)
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class UncodedEvent
+	Registered like any code-only event but given no message code
+=============================================================================*/
+class UncodedEvent : public Event {
+	public:
+		const string &	type() const	{ return sUncodedType; }
+		EventTypeId		typeId() const	{ return EventTypeRegistry::find(sUncodedType); }
+};
+
+/*=============================================================================
+class ReceivedListener
+	Keeps the data of every control event raised from a message, events
+	themselves are noncopyable
+=============================================================================*/
+class ReceivedListener : public EventListener {
+	public:
+		struct Received {
+			short	mControlId;
+			int		mValue;
+		};
+
+		vector<Received>	mSwitches;
+		vector<Received>	mAnalogs;
+		vector<Received>	mEncoders;
+
+		bool handleSwitch(const EventPtr &ePtr) {
+			const DigitalSwitchEvent &e = static_cast<const DigitalSwitchEvent &>(*ePtr);
+			Received r = { e.mControlId, e.mActivePos };
+			mSwitches.push_back(r);
+			return false;
+		}
+		bool handleAnalog(const EventPtr &ePtr) {
+			const AnalogControlEvent &e = static_cast<const AnalogControlEvent &>(*ePtr);
+			Received r = { e.mControlId, e.mRawValue };
+			mAnalogs.push_back(r);
+			return false;
+		}
+		bool handleEncoder(const EventPtr &ePtr) {
+			const EncoderEvent &e = static_cast<const EncoderEvent &>(*ePtr);
+			Received r = { e.mControlId, e.mValue };
+			mEncoders.push_back(r);
+			return false;
+		}
+
+		void clear() { mSwitches.clear(); mAnalogs.clear(); mEncoders.clear(); }
+
+		explicit ReceivedListener() :
+			EventListener("ReceivedListener")
+		{
+			registerEventHandler(DigitalSwitchEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<ReceivedListener>(this, &ReceivedListener::handleSwitch)));
+			registerEventHandler(AnalogControlEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<ReceivedListener>(this, &ReceivedListener::handleAnalog)));
+			registerEventHandler(EncoderEvent::sEventType,
+				IEventHandlerPtr(new EventHandler<ReceivedListener>(this, &ReceivedListener::handleEncoder)));
+		}
+};
+
+///// FUNCTIONS /////
+
+/*---------------------------------------------------------------------
+	Checks the section 2.2 header of a written message
+---------------------------------------------------------------------*/
+static void checkHeader(const string &msg, uint code, char bodyFormat)
+{
+	CHECK(msg.size() >= NexusMessageParser::sHeaderSize);
+	if (msg.size() < NexusMessageParser::sHeaderSize) { return; }
+	uint msgCode = 0, bodyLength = 0;
+	char msgFormat = 0;
+	BinaryIArchive ar(msg.data() + 1, NexusMessageParser::sHeaderSize - 1);
+	ar >> msgCode >> bodyLength >> msgFormat;
+	CHECK(msg[0] == '/');
+	CHECK(msgCode == code);
+	CHECK(bodyLength == msg.size() - NexusMessageParser::sHeaderSize);
+	CHECK(msgFormat == bodyFormat);
+}
+
+/*---------------------------------------------------------------------
+	Feeds a stream to the parser in chunks, the way TCPConnection reads
+	it, dispatching each message collected. Returns the message count.
+---------------------------------------------------------------------*/
+static uint feed(NexusMessageParser &parser, const string &bytes, size_t chunk)
+{
+	std::stringstream ss;
+	uint numMessages = 0;
+	for (size_t offset = 0; offset < bytes.size(); offset += chunk) {
+		size_t n = (chunk < bytes.size() - offset ? chunk : bytes.size() - offset);
+		ss.clear();
+		ss.write(bytes.data() + offset, n);
+		size_t unread = n;
+		while (unread > 0) {
+			std::streampos before = ss.tellg();
+			tribool result = parser.collectMessage(ss, (uint)unread, 0);
+			unread -= (size_t)(ss.tellg() - before);
+			if (result) {
+				++numMessages;
+				CHECK(parser.dispatchMessage());
+			} else if (!result) {
+				printf("bad header at byte %u\n", (uint)(offset + n - unread));
+				++sFailed;
+			}
+		}
+	}
+	return numMessages;
+}
+
+static void roundTripIncoming(NexusMessageParser &parser, ReceivedListener &listener, size_t chunk)
+{
+	DigitalSwitchEvent ds(-1);
+	ds.mControlId = 12;
+	ds.mActivePos = 2;
+
+	AnalogControlEvent an(-1);
+	an.mControlId = (short)(20 + chunk);	// a control the filter hasn't seen, so the sample passes
+	an.mRawValue = -517;
+
+	EncoderEvent en(-1);
+	en.mControlId = 7;
+	en.mValue = 3;
+
+	string msg, stream;
+	CHECK(NexusMessageParser::writeEvent(ds, ArchiveFormat_Binary, msg));
+	checkHeader(msg, NexusMessageCode_DigitalSwitch, 'f');
+	stream += msg + "junk";	// bytes between messages are skipped
+	CHECK(NexusMessageParser::writeEvent(an, ArchiveFormat_Binary, msg));
+	checkHeader(msg, NexusMessageCode_AnalogControl, 'f');
+	stream += msg;
+	CHECK(NexusMessageParser::writeEvent(en, ArchiveFormat_Binary, msg));
+	checkHeader(msg, NexusMessageCode_Encoder, 'f');
+	stream += msg;
+
+	listener.clear();
+	uint numMessages = feed(parser, stream, chunk);
+	eventMgr.notifyQueued(0);
+	printf("incoming, %u byte chunks: %u messages, %u ds, %u an, %u en\n", (uint)chunk, numMessages,
+		   (uint)listener.mSwitches.size(), (uint)listener.mAnalogs.size(), (uint)listener.mEncoders.size());
+	CHECK(numMessages == 3);
+	CHECK(listener.mSwitches.size() == 1 && listener.mSwitches[0].mControlId == ds.mControlId &&
+		  listener.mSwitches[0].mValue == ds.mActivePos);
+	CHECK(listener.mAnalogs.size() == 1 && listener.mAnalogs[0].mControlId == an.mControlId &&
+		  listener.mAnalogs[0].mValue == an.mRawValue);
+	CHECK(listener.mEncoders.size() == 1 && listener.mEncoders[0].mControlId == en.mControlId &&
+		  listener.mEncoders[0].mValue == en.mValue);
+}
+
+static void roundTripOutgoing(NexusMessageParser &parser, size_t chunk)
+{
+	DigitalSwitchCreateEvent create(-1);
+	create.mNumPins = 4;
+	create.mPins.resize(create.mNumPins);	// the constructor sizes it for 2 pins
+	for (uchar p = 0; p < create.mNumPins; ++p) {
+		create.mPins[p] = p + 22;
+	}
+	create.mOffEvent = true;
+	create.mActiveLevel = 1;
+	create.mUseInternalPullup = true;
+	create.mDebounceDelay = 20;
+
+	string msg;
+	CHECK(NexusMessageParser::writeEvent(create, ArchiveFormat_Binary, msg));
+	checkHeader(msg, NexusMessageCode_CreateDigitalSwitch, 'f');
+
+	// the create code isn't remote callable, dispatchMessage only reports it was registered
+	uint numMessages = feed(parser, msg, chunk);
+	CHECK(numMessages == 1);
+	CHECK(parser.messageCode() == NexusMessageCode_CreateDigitalSwitch);
+	CHECK(parser.bodyFormat() == 'f');
+	CHECK(parser.bodyLength() == msg.size() - NexusMessageParser::sHeaderSize);
+
+	DigitalSwitchCreateEvent decoded(-1);
+	BinaryIArchive ar(parser.body(), parser.bodyLength());
+	ar >> decoded;
+	CHECK(!ar.failed() && ar.remaining() == 0);
+	CHECK(decoded.mNumPins == create.mNumPins && decoded.mPins == create.mPins &&
+		  decoded.mOffEvent == create.mOffEvent && decoded.mActiveLevel == create.mActiveLevel &&
+		  decoded.mUseInternalPullup == create.mUseInternalPullup && decoded.mDebounceDelay == create.mDebounceDelay);
+	printf("outgoing, %u byte chunks: %u messages, body %u bytes\n", (uint)chunk, numMessages, parser.bodyLength());
+}
+
+static void checkText()
+{
+	AnalogControlCreateEvent create(-1);
+	create.mControlId = 3;
+	create.mPin = 14;
+	create.mChangeThreshold = 2;
+	create.mInterval = -40;
+
+	string msg;
+	CHECK(NexusMessageParser::writeEvent(create, ArchiveFormat_Text, msg));
+	checkHeader(msg, NexusMessageCode_CreateAnalogControl, 'n');
+	string body(msg, NexusMessageParser::sHeaderSize);
+	printf("text body: %s\n", body.c_str());
+	CHECK(body == "controlId=3&pin=14&changeThreshold=2&interval=-40");
+
+	DigitalSwitchCreateEvent sw(-1);
+	sw.mNumPins = 2;
+	sw.mPins[0] = 22;
+	sw.mPins[1] = 23;
+	sw.mOffEvent = false;
+	sw.mActiveLevel = 0;
+	sw.mUseInternalPullup = true;
+	sw.mDebounceDelay = 20;
+	CHECK(NexusMessageParser::writeEvent(sw, ArchiveFormat_Text, msg));
+	checkHeader(msg, NexusMessageCode_CreateDigitalSwitch, 'n');
+	body.assign(msg, NexusMessageParser::sHeaderSize, string::npos);
+	printf("text body: %s\n", body.c_str());
+	CHECK(body == "numPins=2&pins=22,23&offEvent=0&activeLevel=0&useInternalPullup=1&debounceDelay=20");
+}
+
+/*---------------------------------------------------------------------
+	The client id message selects the format events are written in, by
+	its body format
+---------------------------------------------------------------------*/
+static void checkClientId(NexusMessageParser &parser, ReceivedListener &listener)
+{
+	const char bodyFormats[] = { 'f', 'n', 'b' };
+	for (uint f = 0; f < sizeof(bodyFormats); ++f) {
+		char header[NexusMessageParser::sHeaderSize];
+		header[0] = '/';
+		BinaryOArchive ar(header + 1, NexusMessageParser::sHeaderSize - 1);
+		ar << (uint)NexusMessageCode_ClientId << (uint)4 << bodyFormats[f];
+		std::stringstream ss;
+		ss.write(header, NexusMessageParser::sHeaderSize);
+		ss.write("name", 4);
+		CHECK(parser.collectMessage(ss, NexusMessageParser::sHeaderSize + 4, 0) == true);
+		ArchiveFormat format = ArchiveFormat_Count;
+		bool requested = parser.requestedFormat(format);
+		printf("client id in format '%c': %s\n", bodyFormats[f],
+			   (!requested ? "no format" : (format == ArchiveFormat_Binary ? "Binary" : "Text")));
+		CHECK(requested == (bodyFormats[f] != 'b'));
+		CHECK(!requested || format == (bodyFormats[f] == 'f' ? ArchiveFormat_Binary : ArchiveFormat_Text));
+	}
+	// other messages don't change the format
+	ArchiveFormat format;
+	roundTripIncoming(parser, listener, 4096);
+	CHECK(!parser.requestedFormat(format));
+}
+
+int main()
+{
+	HighPerfTimer::initHighPerfTimer();
+	EventManager mgr;
+	registerEventTypes();
+	mgr.registerEventType(sUncodedType, RegEventPtr(new CodeOnlyEvent(EventDataType_Empty)));
+	NexusMessageParser::registerControlMessages();
+	ReceivedListener listener;
+
+	ParserPtr parserPtr(NexusMessageParser::create());
+	NexusMessageParser &parser = static_cast<NexusMessageParser &>(*parserPtr);
+
+	roundTripIncoming(parser, listener, 4096);
+	roundTripIncoming(parser, listener, 1);
+	roundTripOutgoing(parser, 4096);
+	roundTripOutgoing(parser, 1);
+	checkText();
+	checkClientId(parser, listener);
+
+	// a type without a message code can't be framed
+	UncodedEvent uncoded;
+	string msg("unchanged");
+	CHECK(!NexusMessageParser::writeEvent(uncoded, ArchiveFormat_Binary, msg));
+
+	printf(sFailed == 0 ? "passed\n" : "FAILED\n");
+	return sFailed;
+}
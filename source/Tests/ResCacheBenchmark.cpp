@@ -0,0 +1,207 @@
+/*----==== RESCACHEBENCHMARK.CPP ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Standalone benchmark of ResHandle::load hits and misses from 1 to 8
+		threads. Hits are spread over keys in every shard of the Web cache.
+		Every miss is a key not loaded before, so it takes the whole path a
+		server request does: the cache lookup, the in-flight request, the
+		read from the source, constructing the resource and inserting it,
+		evicting from the Project cache once its budget is full.
+		Not part of NexusServer.vcxproj, build it as its own console program
+		from the source directory, e.g.
+			cl /EHsc /O2 /I. /I%BOOST_ROOT% Tests\ResCacheBenchmark.cpp
+				Resource\ResCache.cpp Resource\ResHandle.cpp
+				Resource\EvictionPolicy.cpp Resource\BufferPool.cpp
+				Resource\ResourceProcess.cpp Process\ProcessManager.cpp
+				Process\ThreadProcess.cpp Event\Event.cpp Event\EventManager.cpp
+				Event\EventListener.cpp Event\EventDispatchPool.cpp
+				Win32\HighPerfTimer.cpp /link /LIBPATH:%BOOST_ROOT%\stage\lib
+		Prints wall time divided by the loads of all threads, which falls
+		as threads are added while the shards keep them apart.
+---------------------------------------*/
+
+#include <Windows.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include "../Resource/ResHandle.h"
+#include "../Resource/ResCache.h"
+#include "../Resource/BufferPool.h"
+#include "../Process/ProcessManager.h"
+
+using std::string;
+using std::vector;
+
+///// VARIABLES /////
+
+static const uint	sNumKeys = 4096;
+static const uint	sHitsPerThread = 1000000;
+static const uint	sMissesPerThread = 100000;
+static const uint	sResSize = 1024;
+static const char *	sSourceName = "bench";
+
+static volatile long	sSourceReads = 0;
+
+///// STRUCTURES /////
+
+class HitRes : public Resource {
+	public:
+		static const ResCacheType	sCacheType = ResCache_Web;
+
+		bool onLoad(const BufferPtr &dataPtr, bool async) { return true; }
+
+		explicit HitRes(const string &name, uint sizeB, const ResCachePtr &resCachePtr) :
+			Resource(name, sizeB, resCachePtr)
+		{}
+};
+
+// kept in a cache of its own, so evicting misses never pushes out the hit keys
+class MissRes : public Resource {
+	public:
+		static const ResCacheType	sCacheType = ResCache_Project;
+
+		bool onLoad(const BufferPtr &dataPtr, bool async) { return true; }
+
+		explicit MissRes(const string &name, uint sizeB, const ResCachePtr &resCachePtr) :
+			Resource(name, sizeB, resCachePtr)
+		{}
+};
+
+/*=============================================================================
+class BenchSource
+	Serves sResSize bytes for any name, counting the reads
+=============================================================================*/
+class BenchSource : public IResourceSource {
+	public:
+		virtual bool	open() { return true; }
+		virtual int		getResourceSize(const string &resName) const { return sResSize; }
+		virtual int		getResource(const string &resName, BufferPtr &dataPtr, int threadIndex = 0) {
+							InterlockedIncrement(&sSourceReads);
+							dataPtr = BufferPool::allocate(sResSize);
+							return sResSize;
+						}
+		virtual int		getNewThreadIndex() { return 0; }
+};
+
+///// FUNCTIONS /////
+
+static __int64 counts()
+{
+	LARGE_INTEGER c;
+	QueryPerformanceCounter(&c);
+	return c.QuadPart;
+}
+
+static void hitLoop(const vector<string> *keys, uint seed, volatile long *loaded)
+{
+	ResHandle h;
+	long n = 0;
+	uint k = seed * 7919;
+	for (uint i = 0; i < sHitsPerThread; ++i) {
+		k = k * 1103515245 + 12345;	// spread threads over different keys
+		if (h.load<HitRes>((*keys)[(k >> 8) % keys->size()])) { ++n; }
+	}
+	InterlockedExchangeAdd(loaded, n);
+}
+
+static void missLoop(const vector<string> *keys, volatile long *loaded)
+{
+	ResHandle h;
+	long n = 0;
+	for (uint i = 0; i < keys->size(); ++i) {
+		if (h.load<MissRes>((*keys)[i])) { ++n; }
+	}
+	InterlockedExchangeAdd(loaded, n);
+}
+
+static double elapsedNs(__int64 start, uint numLoads)
+{
+	LARGE_INTEGER freq;
+	QueryPerformanceFrequency(&freq);
+	return ((double)(counts() - start) * 1.0e9 / (double)freq.QuadPart) / (double)numLoads;
+}
+
+static double runHits(const vector<string> &keys, uint numThreads, long &loaded)
+{
+	volatile long l = 0;
+	__int64 start = counts();
+	boost::thread_group threads;
+	for (uint t = 0; t < numThreads; ++t) {
+		threads.create_thread(boost::bind(&hitLoop, &keys, t + 1, &l));
+	}
+	threads.join_all();
+	double ns = elapsedNs(start, sHitsPerThread * numThreads);
+	loaded = l;
+	return ns;
+}
+
+static double runMisses(uint numThreads, long &loaded)
+{
+	// names never loaded before, made up front so building them isn't timed
+	static uint sRound = 0;
+	++sRound;
+	vector< vector<string> > keys(numThreads);
+	char name[64];
+	for (uint t = 0; t < numThreads; ++t) {
+		keys[t].reserve(sMissesPerThread);
+		for (uint i = 0; i < sMissesPerThread; ++i) {
+			sprintf(name, "%s/miss%u_%u_%u.htm", sSourceName, sRound, t, i);
+			keys[t].push_back(name);
+		}
+	}
+
+	volatile long l = 0;
+	__int64 start = counts();
+	boost::thread_group threads;
+	for (uint t = 0; t < numThreads; ++t) {
+		threads.create_thread(boost::bind(&missLoop, &keys[t], &l));
+	}
+	threads.join_all();
+	double ns = elapsedNs(start, sMissesPerThread * numThreads);
+	loaded = l;
+	return ns;
+}
+
+int main()
+{
+	ProcessManager procManager;		// the cache manager attaches its loader processes, never run here
+	ResCacheManager cacheManager(256, 0);
+	cacheManager.createCache(ResCache_Web, 64);
+	cacheManager.createCache(ResCache_Project, 16);
+	cacheManager.registerSource(sSourceName, ResSourcePtr(new BenchSource()));
+
+	vector<string> hitKeys;
+	char name[64];
+	for (uint k = 0; k < sNumKeys; ++k) {
+		sprintf(name, "%s/hit%u.htm", sSourceName, k);
+		hitKeys.push_back(name);
+		ResHandle h;
+		h.load<HitRes>(hitKeys.back());
+	}
+
+	printf("ResHandle::load, %u hit keys, %u shards, %u hits and %u misses per thread\n",
+		   sNumKeys, ResCache::sNumShards, sHitsPerThread, sMissesPerThread);
+	printf("threads\thit ns/op\tmiss ns/op\n");
+	for (uint t = 1; t <= 8; t *= 2) {
+		long hits = 0, misses = 0;
+		InterlockedExchange(&sSourceReads, 0);
+		double hitNs = runHits(hitKeys, t, hits);
+		long hitReads = InterlockedExchange(&sSourceReads, 0);
+		double missNs = runMisses(t, misses);
+		long missReads = InterlockedExchange(&sSourceReads, 0);
+		// every hit found in the cache, every miss read from the source once
+		if (hits != (long)(sHitsPerThread * t) || hitReads != 0 ||
+			misses != (long)(sMissesPerThread * t) || missReads != misses)
+		{
+			printf("unexpected result, %li hits with %li reads, %li misses with %li reads\n",
+				   hits, hitReads, misses, missReads);
+			return 1;
+		}
+		printf("%u\t%.1f\t\t%.1f\n", t, hitNs, missNs);
+	}
+	return 0;
+}
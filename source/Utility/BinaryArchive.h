@@ -0,0 +1,198 @@
+/*----==== BINARYARCHIVE.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Little-endian binary archives in the Nexus protocol's fixed ('f') body
+		format, driven by the same serialize() member templates Boost.
+		Serialization uses, without its stream and formatting overhead.
+---------------------------------*/
+
+#pragma once
+
+#include <cstring>
+#include <vector>
+#include <boost/type_traits/is_arithmetic.hpp>
+#include <boost/type_traits/is_enum.hpp>
+#include <boost/type_traits/integral_constant.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/nvp.hpp>
+#include <boost/serialization/base_object.hpp>
+#include <boost/serialization/extended_type_info_typeid.hpp>
+#include <boost/serialization/void_cast.hpp>		// defines what base_object registers
+#include "Typedefs.h"
+
+using std::vector;
+
+///// DEFINITIONS /////
+
+// arithmetic types and enums are copied as they lie in memory, anything else has serialize()
+template <typename T>
+struct BinaryArchiveRaw :
+	boost::integral_constant<bool, boost::is_arithmetic<T>::value || boost::is_enum<T>::value>
+{};
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class BinaryOArchive
+	Writes into a buffer supplied by the caller, so encoding never allocates.
+	The fixed body is just the fields in serialize() order, arithmetic types
+	and enums at their own width with no padding, bools as one byte. Vectors
+	are a ushort element count followed by the elements, with vectors of
+	bytes copied in one block. Names given through NVPs are ignored. Every Windows
+	target is little-endian, so values are copied as they are in memory. A
+	write that doesn't fit sets overflowed() and stops the archive, the
+	caller should check it before sending.
+=============================================================================*/
+class BinaryOArchive {
+	private:
+		///// VARIABLES /////
+		char *	mBuffer;
+		uint	mCapacity;
+		uint	mSize;
+		bool	mOverflowed;
+
+		///// FUNCTIONS /////
+		void	writeBytes(const void *data, uint size) {
+					if (mOverflowed || size > mCapacity - mSize) {
+						mOverflowed = true;
+						return;
+					}
+					memcpy(mBuffer + mSize, data, size);
+					mSize += size;
+				}
+
+		template <typename T>
+		void	save(const T &t, boost::true_type) { writeBytes(&t, sizeof(T)); }	// arithmetic or enum
+		template <typename T>
+		void	save(const T &t, boost::false_type) {								// class with serialize()
+					boost::serialization::access::serialize(*this, const_cast<T &>(t), 0);
+				}
+		void	saveCount(size_t count) {
+					_ASSERTE(count <= 0xFFFF && "Vector too long for the fixed body format");
+					ushort c = (ushort)count;
+					writeBytes(&c, sizeof(c));
+				}
+
+	public:
+		// Accessors
+		uint	size() const		{ return mSize; }
+		bool	overflowed() const	{ return mOverflowed; }
+
+		// Operators
+		template <typename T>
+		BinaryOArchive & operator<<(const T &t) {
+			save(t, typename BinaryArchiveRaw<T>::type());
+			return *this;
+		}
+		template <typename T>
+		BinaryOArchive & operator<<(const boost::serialization::nvp<T> &t) {
+			return *this << t.const_value();
+		}
+		template <typename T>
+		BinaryOArchive & operator<<(const vector<T> &v) {
+			saveCount(v.size());
+			for (size_t i = 0; i < v.size(); ++i) { *this << v[i]; }
+			return *this;
+		}
+		BinaryOArchive & operator<<(const vector<uchar> &v) {
+			saveCount(v.size());
+			if (!v.empty()) { writeBytes(&v[0], (uint)v.size()); }
+			return *this;
+		}
+		BinaryOArchive & operator<<(const vector<char> &v) {
+			saveCount(v.size());
+			if (!v.empty()) { writeBytes(&v[0], (uint)v.size()); }
+			return *this;
+		}
+		template <typename T>
+		BinaryOArchive & operator&(const T &t) { return *this << t; }
+
+		// Constructor
+		explicit BinaryOArchive(char *buffer, uint capacity) :
+			mBuffer(buffer), mCapacity(capacity), mSize(0), mOverflowed(false)
+		{}
+};
+
+/*=============================================================================
+class BinaryIArchive
+	Reads the format written by BinaryOArchive from a buffer it does not own.
+	Reading past the end sets failed(), zeroes what couldn't be read and
+	stops the archive, so a short message never reads stray memory. Vectors
+	are resized to the count read, which only allocates when they grow past
+	their capacity.
+=============================================================================*/
+class BinaryIArchive {
+	private:
+		///// VARIABLES /////
+		const char *	mBuffer;
+		uint			mSize;
+		uint			mPos;
+		bool			mFailed;
+
+		///// FUNCTIONS /////
+		void	readBytes(void *data, uint size) {
+					if (mFailed || size > mSize - mPos) {
+						mFailed = true;
+						memset(data, 0, size);
+						return;
+					}
+					memcpy(data, mBuffer + mPos, size);
+					mPos += size;
+				}
+
+		template <typename T>
+		void	load(T &t, boost::true_type) { readBytes(&t, sizeof(T)); }	// arithmetic or enum
+		template <typename T>
+		void	load(T &t, boost::false_type) {								// class with serialize()
+					boost::serialization::access::serialize(*this, t, 0);
+				}
+		size_t	loadCount() {
+					ushort c = 0;
+					readBytes(&c, sizeof(c));
+					return c;
+				}
+
+	public:
+		// Accessors
+		uint	position() const	{ return mPos; }
+		uint	remaining() const	{ return mSize - mPos; }
+		bool	failed() const		{ return mFailed; }
+
+		// Operators
+		template <typename T>
+		BinaryIArchive & operator>>(T &t) {
+			load(t, typename BinaryArchiveRaw<T>::type());
+			return *this;
+		}
+		template <typename T>
+		BinaryIArchive & operator>>(const boost::serialization::nvp<T> &t) {
+			return *this >> t.value();
+		}
+		template <typename T>
+		BinaryIArchive & operator>>(vector<T> &v) {
+			v.resize(loadCount());
+			for (size_t i = 0; i < v.size(); ++i) { *this >> v[i]; }
+			return *this;
+		}
+		BinaryIArchive & operator>>(vector<uchar> &v) {
+			v.resize(loadCount());
+			if (!v.empty()) { readBytes(&v[0], (uint)v.size()); }
+			return *this;
+		}
+		BinaryIArchive & operator>>(vector<char> &v) {
+			v.resize(loadCount());
+			if (!v.empty()) { readBytes(&v[0], (uint)v.size()); }
+			return *this;
+		}
+		template <typename T>
+		BinaryIArchive & operator&(T &t) { return *this >> t; }
+		template <typename T>
+		BinaryIArchive & operator&(const boost::serialization::nvp<T> &t) { return *this >> t; }
+
+		// Constructor
+		explicit BinaryIArchive(const char *buffer, uint size) :
+			mBuffer(buffer), mSize(size), mPos(0), mFailed(false)
+		{}
+};
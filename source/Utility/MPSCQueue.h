@@ -0,0 +1,192 @@
+/*----==== MPSCQUEUE.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Bounded lock-free queue for many producer threads and one consumer
+		thread, used to pass events between threads without a mutex.
+-----------------------------*/
+
+#pragma once
+
+#include <Windows.h>
+#include <boost/noncopyable.hpp>
+#include "Typedefs.h"
+
+/*=============================================================================
+class MPSCQueue
+	Ring buffer of cells, each carrying a sequence number that tells whether
+	it is free for the producer claiming that position or ready for the
+	consumer (after Dmitry Vyukov's bounded queue). Producers claim positions
+	with a compare-exchange on the enqueue index and publish with an
+	interlocked store. The consumer owns the dequeue index outright, so popping
+	takes no interlocked operation at all.
+
+	Capacity is rounded up to a power of two. tryPush fails when the ring is
+	full, push yields until there is room, so producers are held back rather
+	than events being lost. tryPop, drain and waitPop may only be called from
+	the single consumer thread. A waiting consumer is flagged, producers only
+	signal the wake event when they see the flag, so a busy consumer costs
+	producers no kernel call. Loads and stores of the volatile members rely
+	on the acquire/release semantics VC++ gives volatile on x86/x64.
+=============================================================================*/
+template <typename T>
+class MPSCQueue : private boost::noncopyable {
+	private:
+		///// DEFINITIONS /////
+		static const uint sCacheLineSize = 64;
+
+		struct Cell {
+			volatile long	mSequence;	// position this cell is ready for, see class notes
+			T				mData;
+		};
+
+		///// VARIABLES /////
+		Cell *			mCells;
+		ulong			mMask;			// capacity - 1
+		HANDLE			mWakeEvent;		// auto-reset, set when a producer finds the consumer waiting
+		char			mPad0[sCacheLineSize];
+		volatile long	mEnqueuePos;	// next position claimed by producers
+		char			mPad1[sCacheLineSize];
+		long			mDequeuePos;	// next position read by the consumer
+		volatile long	mWaiting;		// 1 while the consumer is blocked, or about to block, in waitPop
+		char			mPad2[sCacheLineSize];
+
+		///// FUNCTIONS /////
+		static long		distance(long a, long b) { return (long)((ulong)a - (ulong)b); } // wraps safely
+
+		Cell &			cellAt(long pos) const { return mCells[(ulong)pos & mMask]; }
+
+		void			wakeConsumer() {
+							// the interlocked publish in tryPush orders this read after the cell write,
+							// pairing with the interlocked write of mWaiting in waitPop
+							if (mWaiting != 0 && InterlockedExchange(&mWaiting, 0) != 0) {
+								SetEvent(mWakeEvent);
+							}
+						}
+
+	public:
+		/*---------------------------------------------------------------------
+			Pushes a copy of inData, returns false if the queue is full. Safe
+			to call from any number of threads.
+		---------------------------------------------------------------------*/
+		bool	tryPush(const T &inData)
+				{
+					long pos = mEnqueuePos;
+					for (;;) {
+						Cell &cell = cellAt(pos);
+						long diff = distance(cell.mSequence, pos);
+						if (diff == 0) {
+							// cell is free for this position, try to claim it
+							long prev = InterlockedCompareExchange(&mEnqueuePos, pos + 1, pos);
+							if (prev == pos) {
+								cell.mData = inData;
+								InterlockedExchange(&cell.mSequence, pos + 1); // publish to the consumer
+								wakeConsumer();
+								return true;
+							}
+							pos = prev; // another producer took it
+						} else if (diff < 0) {
+							return false; // cell still holds an item from the last lap, queue is full
+						} else {
+							pos = mEnqueuePos; // fell behind other producers, reload
+						}
+					}
+				}
+
+		/*---------------------------------------------------------------------
+			Pushes a copy of inData, yielding the thread while the queue is
+			full. Safe to call from any number of threads.
+		---------------------------------------------------------------------*/
+		void	push(const T &inData)
+				{
+					while (!tryPush(inData)) {
+						SwitchToThread();
+					}
+				}
+
+		/*---------------------------------------------------------------------
+			Pops the oldest item, returns false immediately if the queue is
+			empty. Consumer thread only.
+		---------------------------------------------------------------------*/
+		bool	tryPop(T &outData)
+				{
+					Cell &cell = cellAt(mDequeuePos);
+					if (distance(cell.mSequence, mDequeuePos + 1) < 0) {
+						return false; // not yet published
+					}
+					outData = cell.mData;
+					cell.mData = T(); // don't hold a reference until the cell is reused
+					cell.mSequence = mDequeuePos + (long)mMask + 1; // free the cell for the next lap
+					++mDequeuePos;
+					return true;
+				}
+
+		/*---------------------------------------------------------------------
+			Pops and passes to func each item that was pushed before the call,
+			and returns how many. Items pushed while draining, including by
+			func itself, are left for the next call so a chatty producer can't
+			hold the consumer here. Consumer thread only.
+		---------------------------------------------------------------------*/
+		template <typename Func>
+		uint	drain(Func func)
+				{
+					long endPos = mEnqueuePos;
+					uint count = 0;
+					T item;
+					while (distance(endPos, mDequeuePos) > 0 && tryPop(item)) {
+						func(item);
+						++count;
+					}
+					return count;
+				}
+
+		/*---------------------------------------------------------------------
+			Pops the oldest item, blocking the thread until one is pushed or
+			timeoutMillis passes. Returns false on timeout. Consumer thread
+			only.
+		---------------------------------------------------------------------*/
+		bool	waitPop(T &outData, DWORD timeoutMillis = INFINITE)
+				{
+					for (;;) {
+						if (tryPop(outData)) { return true; }
+						// flag before the last look, so a push landing in between is sure to signal
+						InterlockedExchange(&mWaiting, 1);
+						if (tryPop(outData)) {
+							InterlockedExchange(&mWaiting, 0); // a stray signal just causes one extra loop
+							return true;
+						}
+						if (WaitForSingleObject(mWakeEvent, timeoutMillis) != WAIT_OBJECT_0) {
+							InterlockedExchange(&mWaiting, 0);
+							return tryPop(outData);
+						}
+					}
+				}
+
+		/*---------------------------------------------------------------------
+			Accurate only from the consumer thread
+		---------------------------------------------------------------------*/
+		bool	empty() const { return (distance(cellAt(mDequeuePos).mSequence, mDequeuePos + 1) < 0); }
+
+		uint	capacity() const { return (uint)(mMask + 1); }
+
+		// Constructor / destructor
+		explicit MPSCQueue(uint capacity) :
+			mCells(0), mMask(0), mWakeEvent(0),
+			mEnqueuePos(0), mDequeuePos(0), mWaiting(0)
+		{
+			ulong size = 2;
+			while (size < capacity) { size <<= 1; }
+			mMask = size - 1;
+			mCells = new Cell[size];
+			for (ulong c = 0; c < size; ++c) {
+				mCells[c].mSequence = (long)c;
+			}
+			mWakeEvent = CreateEventW(NULL, FALSE, FALSE, NULL);
+		}
+
+		~MPSCQueue() {
+			delete [] mCells;
+			if (mWakeEvent) { CloseHandle(mWakeEvent); }
+		}
+};
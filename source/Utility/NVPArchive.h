@@ -0,0 +1,108 @@
+/*----==== NVPARCHIVE.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Output archive in the Nexus protocol's name-value pair ('n') body
+		format, driven by the same serialize() member templates as the
+		binary archives of BinaryArchive.h.
+------------------------------*/
+
+#pragma once
+
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/type_traits/is_same.hpp>
+#include "BinaryArchive.h"
+
+///// STRUCTURES /////
+
+/*=============================================================================
+class NVPOArchive
+	Writes into a buffer supplied by the caller, so encoding never allocates.
+	Each field serialized through an NVP becomes name=value, with pairs
+	separated by '&' as in NexusProtocol.txt section 2.4. Values are decimal
+	text, bools are 0 or 1 and vector elements are separated by ','. Names
+	of base objects are not written, their fields are. Names and numbers
+	never contain the special characters, so nothing needs escaping. A
+	write that doesn't fit sets overflowed() and stops the archive, the
+	caller should check it before sending.
+=============================================================================*/
+class NVPOArchive {
+	private:
+		///// VARIABLES /////
+		char *	mBuffer;
+		uint	mCapacity;
+		uint	mSize;
+		bool	mOverflowed;
+
+		///// FUNCTIONS /////
+		void	writeBytes(const char *data, uint size) {
+					if (mOverflowed || size > mCapacity - mSize) {
+						mOverflowed = true;
+						return;
+					}
+					memcpy(mBuffer + mSize, data, size);
+					mSize += size;
+				}
+		void	writeName(const char *name) {
+					if (mSize > 0) { writeBytes("&", 1); }
+					writeBytes(name, (uint)strlen(name));
+					writeBytes("=", 1);
+				}
+		void	writeNumber(int64 n) {
+					char digits[24];
+					uint pos = sizeof(digits);
+					uint64 u = (n < 0 ? (uint64)(-(n + 1)) + 1 : (uint64)n);
+					do {
+						digits[--pos] = (char)('0' + (u % 10));
+						u /= 10;
+					} while (u > 0);
+					if (n < 0) { digits[--pos] = '-'; }
+					writeBytes(digits + pos, sizeof(digits) - pos);
+				}
+
+		template <typename T>
+		void	save(const T &t, boost::true_type) {								// arithmetic or enum
+					BOOST_STATIC_ASSERT(!boost::is_floating_point<T>::value && !boost::is_same<T, uint64>::value);
+					writeNumber((int64)t);
+				}
+		template <typename T>
+		void	save(const T &t, boost::false_type) {								// class with serialize()
+					boost::serialization::access::serialize(*this, const_cast<T &>(t), 0);
+				}
+
+	public:
+		// Accessors
+		uint	size() const		{ return mSize; }
+		bool	overflowed() const	{ return mOverflowed; }
+
+		// Operators
+		template <typename T>
+		NVPOArchive & operator<<(const T &t) {
+			save(t, typename BinaryArchiveRaw<T>::type());
+			return *this;
+		}
+		template <typename T>
+		NVPOArchive & operator<<(const boost::serialization::nvp<T> &t) {
+			if (BinaryArchiveRaw<T>::value) { writeName(t.name()); }
+			return *this << t.const_value();
+		}
+		template <typename T>
+		NVPOArchive & operator<<(const boost::serialization::nvp<vector<T> > &t) {
+			writeName(t.name());
+			const vector<T> &v = t.const_value();
+			for (size_t i = 0; i < v.size(); ++i) {
+				if (i > 0) { writeBytes(",", 1); }
+				*this << v[i];
+			}
+			return *this;
+		}
+		template <typename T>
+		NVPOArchive & operator&(const T &t) { return *this << t; }
+
+		// Constructor
+		explicit NVPOArchive(char *buffer, uint capacity) :
+			mBuffer(buffer), mCapacity(capacity), mSize(0), mOverflowed(false)
+		{}
+};
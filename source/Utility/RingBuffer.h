@@ -0,0 +1,93 @@
+/*----==== RINGBUFFER.H ====----
+	Author:		Jeff Kiah
+	Orig.Date:	09/24/2011
+	Rev.Date:	09/24/2011
+	Description:
+		Growable circular double-ended queue, for per-frame queues that are
+		filled and emptied over and over without allocating.
+------------------------------*/
+
+#pragma once
+
+#include <crtdbg.h>
+#include <boost/noncopyable.hpp>
+#include "Typedefs.h"
+
+/*=============================================================================
+class RingBuffer
+	Elements live in one power of two sized array, doubled when a push finds
+	it full and never shrunk, so once a queue reaches its working size pushes
+	and pops cost no allocation. Popped slots are reset to T() so they don't
+	hold on to what they referenced. Not thread safe.
+=============================================================================*/
+template <typename T>
+class RingBuffer : private boost::noncopyable {
+	private:
+		///// VARIABLES /////
+		T *		mItems;
+		uint	mMask;		// capacity - 1
+		uint	mHead;		// index of the front element
+		uint	mSize;
+
+		///// FUNCTIONS /////
+		void	grow() {
+					uint capacity = (mMask + 1) * 2;
+					T *items = new T[capacity];
+					for (uint i = 0; i < mSize; ++i) {
+						items[i] = mItems[(mHead + i) & mMask];
+					}
+					delete [] mItems;
+					mItems = items;
+					mMask = capacity - 1;
+					mHead = 0;
+				}
+
+	public:
+		// Accessors
+		uint		size() const		{ return mSize; }
+		bool		empty() const		{ return (mSize == 0); }
+		uint		capacity() const	{ return mMask + 1; }
+		T &			front()				{ _ASSERTE(mSize > 0); return mItems[mHead]; }
+		const T &	front() const		{ _ASSERTE(mSize > 0); return mItems[mHead]; }
+		T &			back()				{ _ASSERTE(mSize > 0); return mItems[(mHead + mSize - 1) & mMask]; }
+		const T &	back() const		{ _ASSERTE(mSize > 0); return mItems[(mHead + mSize - 1) & mMask]; }
+
+		// Mutators
+		void	push_back(const T &item) {
+					if (mSize > mMask) { grow(); }
+					mItems[(mHead + mSize) & mMask] = item;
+					++mSize;
+				}
+		void	push_front(const T &item) {
+					if (mSize > mMask) { grow(); }
+					mHead = (mHead - 1) & mMask;
+					mItems[mHead] = item;
+					++mSize;
+				}
+		void	pop_front() {
+					_ASSERTE(mSize > 0);
+					mItems[mHead] = T();
+					mHead = (mHead + 1) & mMask;
+					--mSize;
+				}
+		void	pop_back() {
+					_ASSERTE(mSize > 0);
+					--mSize;
+					mItems[(mHead + mSize) & mMask] = T();
+				}
+		void	clear() {
+					while (mSize > 0) { pop_front(); }
+					mHead = 0;
+				}
+
+		// Constructor / destructor
+		explicit RingBuffer(uint initialCapacity = 16) :
+			mItems(0), mMask(0), mHead(0), mSize(0)
+		{
+			uint capacity = 2;
+			while (capacity < initialCapacity) { capacity <<= 1; }
+			mItems = new T[capacity];
+			mMask = capacity - 1;
+		}
+		~RingBuffer() { delete [] mItems; }
+};